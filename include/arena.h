@@ -0,0 +1,25 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+typedef struct ArenaChunk {
+  struct ArenaChunk *next;
+  size_t size;
+  size_t used;
+  _Alignas(16) char data[];
+} ArenaChunk;
+
+typedef struct {
+  ArenaChunk *head;
+  size_t chunk_size;
+} Arena;
+
+void arena_init(Arena *arena, size_t chunk_size);
+void *arena_alloc(Arena *arena, size_t size);
+char *arena_strndup(Arena *arena, const char *string, size_t length);
+void arena_reset(Arena *arena);
+void arena_free(Arena *arena);
+size_t arena_bytes_used(const Arena *arena);
+
+#endif // !ARENA_H
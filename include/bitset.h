@@ -0,0 +1,37 @@
+#ifndef BITSET_H
+#define BITSET_H
+
+#include <stdint.h>
+
+/*
+ * Dense bit sets stored as arrays of 64-bit words. Word counts are rounded up
+ * to a multiple of four so the vector loops never need a scalar tail.
+ */
+
+#define BITSET_NONE UINT32_MAX
+
+static inline uint32_t bitset_words(uint32_t bits) {
+  return (bits + 255) / 256 * 4;
+}
+
+static inline void bitset_set(uint64_t *set, uint32_t bit) {
+  set[bit / 64] |= (uint64_t)1 << (bit % 64);
+}
+
+static inline void bitset_reset(uint64_t *set, uint32_t bit) {
+  set[bit / 64] &= ~((uint64_t)1 << (bit % 64));
+}
+
+static inline int bitset_test(const uint64_t *set, uint32_t bit) {
+  return (set[bit / 64] >> (bit % 64)) & 1;
+}
+
+void bitset_clear(uint64_t *set, uint32_t words);
+void bitset_copy(uint64_t *destination, const uint64_t *source, uint32_t words);
+int bitset_union(uint64_t *destination, const uint64_t *source, uint32_t words);
+void bitset_difference(uint64_t *destination, const uint64_t *source,
+                       uint32_t words);
+uint32_t bitset_count(const uint64_t *set, uint32_t words);
+uint32_t bitset_next(const uint64_t *set, uint32_t words, uint32_t from);
+
+#endif // !BITSET_H
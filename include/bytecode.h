@@ -0,0 +1,92 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include "parser.h"
+#include <stdint.h>
+#include <stdio.h>
+
+/* Register bytecode for the interpreter. Each function has up to
+ * BYTECODE_MAX_REGISTERS registers: its parameters, then its other locals in
+ * declaration order, then temporaries, which are allocated like a stack. A
+ * call passes its arguments in consecutive temporaries, which become the
+ * first registers of the callee. */
+#define BYTECODE_MAX_REGISTERS 256
+
+#define BYTECODE_COMPARISONS(X)                                                \
+  X(EQ, ==)                                                                    \
+  X(NE, !=)                                                                    \
+  X(LT, <)                                                                     \
+  X(LE, <=)                                                                    \
+  X(GT, >)                                                                     \
+  X(GE, >=)
+
+#define BYTECODE_COMPARE_OPCODES(name, op) BC_##name,
+#define BYTECODE_COMPARE_IMMEDIATE_OPCODES(name, op) BC_##name##I,
+#define BYTECODE_BRANCH_OPCODES(name, op) BC_J##name,
+#define BYTECODE_BRANCH_IMMEDIATE_OPCODES(name, op) BC_J##name##I,
+
+typedef enum {
+  BC_MOV,    // a = b
+  BC_LOADI,  // a = imm
+  BC_LOADG,  // a = global imm
+  BC_STOREG, // global imm = b
+  BC_ADD,    // a = b + c
+  BC_SUB,
+  BC_MUL,
+  BC_DIV,
+  BC_MOD,
+  BYTECODE_COMPARISONS(BYTECODE_COMPARE_OPCODES) // a = b op c
+  BC_JMP,    // Jump to imm
+  BC_JZ,     // Jump to imm if b is zero
+  BC_CALL,   // a = function imm (registers b to b + c - 1)
+  BC_RET,    // Return b
+  BC_RET0,   // Return zero
+  // Superinstructions, each replacing a common pair of the above
+  BC_ADDI,   // a = b + imm, from LOADI and ADD
+  BC_SUBI,
+  BC_MULI,
+  BYTECODE_COMPARISONS(BYTECODE_COMPARE_IMMEDIATE_OPCODES) // a = b op imm
+  BYTECODE_COMPARISONS(BYTECODE_BRANCH_OPCODES) // Jump to imm if b op c
+  // Jump to imm if a op the signed 16-bit constant in b:c
+  BYTECODE_COMPARISONS(BYTECODE_BRANCH_IMMEDIATE_OPCODES)
+  NUM_BYTECODE_OPCODES,
+} BytecodeOpcode;
+
+typedef struct {
+  uint8_t opcode;
+  uint8_t a;   // Destination register
+  uint8_t b;   // Source registers
+  uint8_t c;
+  int32_t imm; // Constant, global, callee or jump target
+} BytecodeInstr;
+
+#define BYTECODE_SHORT(instr) ((int16_t)((instr)->b | (instr)->c << 8))
+
+typedef struct {
+  const char *name;
+  unsigned int name_id;
+  int param_count;
+  int register_count;
+  BytecodeInstr *code;
+  uint32_t code_count;
+  uint32_t code_capacity;
+} BytecodeFunction;
+
+typedef struct {
+  BytecodeFunction *functions;
+  int function_count;
+  uint32_t function_capacity;
+  int32_t *globals; // Initial values
+  int global_count;
+  uint32_t global_capacity;
+  int main_index; // -1 without a main function
+  uint64_t superinstructions; // Pairs fused while compiling
+} BytecodeModule;
+
+extern const char *bytecode_opcode_names[NUM_BYTECODE_OPCODES];
+
+int compile_bytecode(ASTNode_t *ast, BytecodeModule *module);
+void bytecode_module_free(BytecodeModule *module);
+void dump_bytecode(FILE *out, const BytecodeModule *module);
+
+#endif // !BYTECODE_H
@@ -0,0 +1,36 @@
+#ifndef CODEGEN_H
+#define CODEGEN_H
+
+#include "ir.h"
+#include "peephole.h"
+#include "x86_encoder.h"
+#include <stdio.h>
+
+typedef struct {
+  const char *name;
+  unsigned int name_id;
+  uint32_t offset; // In the module's code
+  uint32_t size;
+} CodeSymbol;
+
+typedef struct {
+  PeepholeStats *peephole; // Counts the rewrites; NULL skips the optimizer
+  int omit_frame_pointer;  // Addresses the frame from rsp instead of rbp
+} CodegenOptions;
+
+typedef struct {
+  Assembler assembler;
+  CodeSymbol *functions;
+  int function_count;
+  uint32_t function_capacity;
+} MachineCode;
+
+void machine_code_init(MachineCode *code);
+void generate_function_code(MachineCode *code, const IRFunction *function,
+                            const CodegenOptions *options);
+void generate_code(const IRModule *module, MachineCode *code,
+                   const CodegenOptions *options);
+void machine_code_free(MachineCode *code);
+void dump_machine_code(FILE *out, const MachineCode *code);
+
+#endif // !CODEGEN_H
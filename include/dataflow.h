@@ -0,0 +1,52 @@
+#ifndef DATAFLOW_H
+#define DATAFLOW_H
+
+#include "arena.h"
+#include "ir.h"
+#include <stdint.h>
+
+/* A set of values. Small sets are a sorted array of elements, larger ones a
+ * dense bit set over all values of the function. */
+typedef struct {
+  uint32_t count;    // Of elements; not kept up to date in a dense in set
+  uint32_t capacity; // Elements the array has room for
+  uint8_t dense;
+  union {
+    uint32_t *elements;
+    uint64_t *words;
+  };
+} ValueSet;
+
+/*
+ * A backward problem over the blocks of a function, solved as
+ *   out(B) = exit_gen(B) + union of in(S) over the successors S of B
+ *   in(B)  = gen(B) + (out(B) - kill(B))
+ * starting from empty sets. Facts may only be added while solving, so a set
+ * changes exactly when it grows.
+ */
+typedef struct {
+  const IRFunction *function;
+  uint32_t universe; // Number of values
+  uint32_t words;    // Words in a dense set
+
+  ValueSet *gen;
+  ValueSet *kill;
+  ValueSet *exit_gen;
+  ValueSet *in; // Solution
+
+  uint64_t *scratch;
+  uint32_t *elements; // Room for every value, where in sets are gathered
+  Arena arena;
+} DataflowProblem;
+
+void dataflow_init(DataflowProblem *problem, const IRFunction *function);
+void dataflow_free(DataflowProblem *problem);
+ValueSet value_set_from_bits(DataflowProblem *problem, const uint64_t *bits);
+void value_set_add_to(const ValueSet *set, uint64_t *bits, uint32_t words);
+void value_set_remove_from(const ValueSet *set, uint64_t *bits,
+                           uint32_t words);
+void dataflow_out(const DataflowProblem *problem, IRBlockId block,
+                  uint64_t *out);
+void solve_backward(DataflowProblem *problem);
+
+#endif // !DATAFLOW_H
@@ -0,0 +1,47 @@
+#ifndef DEPSCAN_H
+#define DEPSCAN_H
+
+#include "preprocessor.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef struct {
+  uint64_t files_scanned; // Read from disk and scanned
+  uint64_t lines_skipped; // Not directives, passed over by the vector scan
+  uint64_t directives;
+  uint64_t guard_skips; // Includes skipped by their include guard
+  double seconds;
+} DependencyStats;
+
+typedef struct DependencyFile DependencyFile;
+
+/* The directives of every file scanned so far, keyed by canonical path and
+ * shared by all the threads of a batch. */
+typedef struct {
+  FileTable files;
+  pthread_mutex_t lock;
+  DependencyStats stats;
+} DependencyCache;
+
+typedef struct {
+  const char *const *include_dirs;
+  int include_dir_count;
+  int phony_targets; // Add an empty rule per header, like -MP
+} DependencyOptions;
+
+typedef struct {
+  const char *source;
+  const char *target;
+  char *rule; // The Make rule, or NULL if the scan failed
+  size_t rule_length;
+} DependencyJob;
+
+void dependency_cache_init(DependencyCache *cache);
+void dependency_cache_free(DependencyCache *cache);
+int scan_dependencies(DependencyJob *jobs, int job_count,
+                      const DependencyOptions *options, int threads,
+                      DependencyCache *cache);
+void print_dependency_stats(FILE *out, const DependencyStats *stats);
+
+#endif // !DEPSCAN_H
@@ -0,0 +1,12 @@
+#ifndef ELF_WRITER_H
+#define ELF_WRITER_H
+
+#include "codegen.h"
+#include "ir.h"
+
+int write_object_file(const char *path, const IRModule *module,
+                      const MachineCode *code);
+int write_executable(const char *path, const IRModule *module,
+                     MachineCode *code);
+
+#endif // !ELF_WRITER_H
@@ -0,0 +1,39 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include "ir.h"
+#include "regalloc.h"
+#include <stdint.h>
+#include <stdio.h>
+
+/* Values are 32-bit ints, so every spill slot has the same size. */
+#define SPILL_SLOT_SIZE 4
+#define SPILL_SLOT_ALIGNMENT 4
+
+/*
+ * The stack frame of one function, from the return address down:
+ *   saved rbp, if the frame pointer is kept
+ *   callee-saved registers in use
+ *   spill slots
+ *   padding, so that rsp is 16-byte aligned at calls
+ * Offsets are relative to the bottom of the spill area, which is where rsp
+ * points once the prologue is done.
+ */
+typedef struct {
+  int32_t *slot_offsets; // Per value; -1 unless spilled
+  uint32_t slot_count;   // After values with disjoint lifetimes share slots
+  uint32_t frame_size;   // Bytes below the saved registers, with padding
+  PhysicalRegister saved[NUM_REGISTERS]; // In push order
+  int saved_count;
+  int uses_frame_pointer;
+} FrameLayout;
+
+void layout_frame(const IRFunction *function, const LiveInterval *intervals,
+                  uint32_t count, const RegisterAllocation *allocation,
+                  int omit_frame_pointer, FrameLayout *frame);
+void frame_layout_free(FrameLayout *frame);
+int32_t frame_argument_offset(const FrameLayout *frame, int index);
+void dump_frame_layout(FILE *out, const IRFunction *function,
+                       const FrameLayout *frame);
+
+#endif // !FRAME_H
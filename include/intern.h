@@ -0,0 +1,12 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include "tokens.h"
+#include <stddef.h>
+
+unsigned int intern(const char *string, size_t length);
+const char *intern_string(unsigned int id);
+TokenType intern_keyword(unsigned int id);
+unsigned int intern_count(void);
+
+#endif // !INTERN_H
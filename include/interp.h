@@ -0,0 +1,8 @@
+#ifndef INTERP_H
+#define INTERP_H
+
+#include "bytecode.h"
+
+int interpret(const BytecodeModule *module, int *status);
+
+#endif // !INTERP_H
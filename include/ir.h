@@ -0,0 +1,175 @@
+#ifndef IR_H
+#define IR_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * SSA intermediate representation. Instructions, operand slots and blocks of
+ * a function each live in one dense array and refer to each other through
+ * 32-bit indices. An instruction's index is the id of the value it defines.
+ */
+
+#define IR_NONE UINT32_MAX
+
+typedef uint32_t IRValue;
+typedef uint32_t IRBlockId;
+
+typedef enum {
+  IR_CONST, // imm
+  IR_UNDEF,
+  IR_PARAM, // imm = parameter index
+  IR_ADD,
+  IR_SUB,
+  IR_MUL,
+  IR_DIV,
+  IR_MOD,
+  IR_EQ, // Comparisons produce 1 or 0
+  IR_NE,
+  IR_LT,
+  IR_LE,
+  IR_GT,
+  IR_GE,
+  IR_PHI,          // One operand per predecessor, in predecessor order
+  IR_CALL,         // imm = interned callee name, operands = arguments
+  IR_LOAD_GLOBAL,  // imm = global index
+  IR_STORE_GLOBAL, // imm = global index, operand = value
+  IR_RET,          // Optional operand
+  IR_JUMP,         // Successor 0
+  IR_BRANCH,       // Operand = condition, successor 0 if non-zero, else 1
+  IR_NUM_OPCODES,
+} IROpcode;
+
+/* An operand slot. Slots that refer to the same value are chained into that
+ * value's use list. */
+typedef struct {
+  IRValue value;
+  IRValue user;
+  uint32_t prev_use;
+  uint32_t next_use;
+} IRUse;
+
+typedef struct {
+  uint8_t opcode;
+  uint8_t dead;
+  uint16_t operand_count;
+  IRBlockId block;
+  uint32_t operand_start; // First slot in IRFunction.uses
+  uint32_t first_use;     // Head of the use list
+  IRValue prev;           // Neighbours in the block's instruction list
+  IRValue next;
+  int64_t imm;
+} IRInstr;
+
+typedef struct {
+  IRValue first;
+  IRValue last;
+  IRBlockId *preds;
+  uint32_t pred_count;
+  uint32_t pred_capacity;
+  IRBlockId succs[2];
+  uint8_t succ_count;
+  uint8_t sealed;
+  uint8_t dead; // Removed as unreachable; kept so block ids stay stable
+} IRBlock;
+
+typedef struct {
+  const char *name;
+  unsigned int name_id;
+  int param_count;
+  int returns_value;
+
+  IRInstr *instrs;
+  uint32_t instr_count;
+  uint32_t instr_capacity;
+
+  IRUse *uses;
+  uint32_t use_count;
+  uint32_t use_capacity;
+
+  IRBlock *blocks;
+  uint32_t block_count;
+  uint32_t block_capacity;
+} IRFunction;
+
+typedef struct {
+  const char *name;
+  unsigned int name_id;
+  int64_t initial_value;
+} IRGlobal;
+
+typedef struct {
+  IRFunction **functions;
+  int function_count;
+  uint32_t function_capacity;
+
+  IRGlobal *globals;
+  int global_count;
+  uint32_t global_capacity;
+} IRModule;
+
+IRFunction *ir_function_create(const char *name, unsigned int name_id,
+                               int param_count);
+void ir_function_free(IRFunction *function);
+void ir_module_init(IRModule *module);
+void ir_module_free(IRModule *module);
+void ir_module_add_function(IRModule *module, IRFunction *function);
+int ir_module_add_global(IRModule *module, const char *name,
+                         unsigned int name_id, int64_t initial_value);
+
+IRBlockId ir_add_block(IRFunction *function);
+void ir_add_edge(IRFunction *function, IRBlockId from, IRBlockId to);
+void ir_remove_edge(IRFunction *function, IRBlockId from, int succ_index);
+void ir_remove_block(IRFunction *function, IRBlockId block);
+IRValue ir_append(IRFunction *function, IRBlockId block, IROpcode opcode,
+                  const IRValue *operands, int operand_count, int64_t imm);
+IRValue ir_prepend(IRFunction *function, IRBlockId block, IROpcode opcode);
+IRValue ir_insert_before(IRFunction *function, IRValue before, IROpcode opcode,
+                         const IRValue *operands, int operand_count,
+                         int64_t imm);
+void ir_set_operands(IRFunction *function, IRValue instr,
+                     const IRValue *operands, int operand_count);
+void ir_replace_all_uses(IRFunction *function, IRValue old_value,
+                         IRValue new_value);
+void ir_remove(IRFunction *function, IRValue instr);
+void ir_move_before(IRFunction *function, IRValue instr, IRValue before);
+void ir_compact(IRFunction *function);
+int ir_use_count(const IRFunction *function, IRValue value);
+int ir_is_terminator(IROpcode opcode);
+int ir_has_result(IROpcode opcode);
+int ir_has_side_effects(IROpcode opcode);
+IRValue ir_terminator(const IRFunction *function, IRBlockId block);
+
+static inline IRValue ir_operand(const IRFunction *function, IRValue instr,
+                                 int index) {
+  return function->uses[function->instrs[instr].operand_start + index].value;
+}
+
+/* The dominator tree numbered in preorder, where the blocks a block
+ * dominates are the run of the order that starts with it. */
+typedef struct {
+  IRBlockId *idom;
+  IRBlockId *order;  // Reachable blocks in preorder
+  uint32_t count;    // Of reachable blocks
+  uint32_t *index;   // Position of each block in order, IR_NONE if unreachable
+  uint32_t *end;     // One past the last position of the block's subtree
+} IRDomTree;
+
+uint32_t ir_reverse_postorder(const IRFunction *function, IRBlockId *order);
+IRBlockId *ir_dominators(const IRFunction *function);
+void ir_dom_tree_build(const IRFunction *function, IRDomTree *tree);
+void ir_dom_tree_free(IRDomTree *tree);
+
+/* Whether `a` dominates `b`; both must be reachable. */
+static inline int ir_dominates(const IRDomTree *tree, IRBlockId a,
+                               IRBlockId b) {
+  return tree->index[a] <= tree->index[b] && tree->index[b] < tree->end[a];
+}
+
+void ir_dump_function(FILE *out, const IRFunction *function);
+void ir_dump_module(FILE *out, const IRModule *module);
+int ir_verify(const IRFunction *function);
+
+extern const char *ir_opcode_names[IR_NUM_OPCODES];
+
+#endif // !IR_H
@@ -0,0 +1,46 @@
+#ifndef IR_LOOPS_H
+#define IR_LOOPS_H
+
+#include "ir.h"
+#include <stdint.h>
+
+/*
+ * The loop nest of a function: one loop per header, a block that dominates
+ * one of its predecessors, holding every block that reaches that back edge
+ * without passing the header. Loops are numbered in preorder of the nest, so
+ * the loops inside loop L are L + 1 up to loops[L].end - 1, and the blocks in
+ * loops are grouped by innermost loop, so those of L, its inner loops'
+ * included, are one run of the array.
+ */
+
+typedef struct {
+  IRBlockId header;
+  IRBlockId preheader; // The block entering the loop if it only jumps there,
+                       // else IR_NONE
+  uint32_t parent;     // Innermost enclosing loop, or IR_NONE
+  uint32_t depth;      // 1 for an outermost loop
+  uint32_t end;        // One past the last loop nested in this one
+  uint32_t first_block; // Of the loop's run in IRLoopNest.blocks
+  uint32_t block_end;
+} IRLoop;
+
+typedef struct {
+  IRLoop *loops;
+  uint32_t loop_count;
+  uint32_t *block_loop; // Innermost loop of each block, or IR_NONE
+  IRBlockId *blocks;    // Blocks in loops, in dominator-tree preorder within
+                        // each innermost loop
+} IRLoopNest;
+
+void ir_find_loops(const IRFunction *function, const IRDomTree *tree,
+                   IRLoopNest *nest);
+void ir_loop_nest_free(IRLoopNest *nest);
+
+/* Whether `block` is in `loop` or a loop nested in it. */
+static inline int ir_loop_contains(const IRLoopNest *nest, uint32_t loop,
+                                   IRBlockId block) {
+  uint32_t inner = nest->block_loop[block];
+  return inner != IR_NONE && inner >= loop && inner < nest->loops[loop].end;
+}
+
+#endif // !IR_LOOPS_H
@@ -0,0 +1,11 @@
+#ifndef IR_LOWER_H
+#define IR_LOWER_H
+
+#include "ir.h"
+#include "parser.h"
+
+int lower_translation_unit(ASTNode_t *ast, IRModule *module);
+int lower_external_declaration(ASTNode_t *node, IRModule *module);
+int evaluate_constant(ASTNode_t *node, int64_t *value);
+
+#endif // !IR_LOWER_H
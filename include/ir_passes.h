@@ -0,0 +1,37 @@
+#ifndef IR_PASSES_H
+#define IR_PASSES_H
+
+#include "ir.h"
+#include <stdint.h>
+#include <stdio.h>
+
+typedef enum {
+  PASS_SCCP,
+  PASS_GVN,
+  PASS_LICM,
+  PASS_DCE,
+  NUM_PASSES,
+} PassId;
+
+typedef struct {
+  const char *name;
+  uint64_t instructions_removed;
+  uint64_t values_folded;
+  uint64_t branches_folded;
+  uint64_t blocks_removed;
+  uint64_t values_hoisted; // Out of loops
+  uint64_t loops;
+  double seconds;
+} PassStats;
+
+void run_sccp(IRFunction *function, PassStats *stats);
+void run_gvn(IRFunction *function, PassStats *stats);
+void run_licm(IRFunction *function, PassStats *stats);
+void run_dce(IRFunction *function, PassStats *stats);
+
+void pass_stats_init(PassStats stats[NUM_PASSES]);
+void ir_optimize_function(IRFunction *function, PassStats stats[NUM_PASSES]);
+void ir_optimize_module(IRModule *module, PassStats stats[NUM_PASSES]);
+void print_pass_stats(FILE *out, const PassStats stats[NUM_PASSES]);
+
+#endif // !IR_PASSES_H
@@ -0,0 +1,53 @@
+#ifndef ISEL_H
+#define ISEL_H
+
+#include "ir.h"
+#include "isel_tables.h"
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Instruction selection by bottom-up tree rewriting. The rules live in
+ * src/isel.burs and are compiled into isel_tables.{c,h} at build time.
+ */
+
+typedef struct {
+  const char *name;
+  uint8_t lhs;      // Nonterminal
+  uint8_t terminal; // TERM_NONE for chain rules
+  uint8_t arity;
+  uint8_t kids[ISEL_MAX_ARITY]; // Operand nonterminals; a chain rule's source
+  uint16_t cost;
+  int (*predicate)(const IRFunction *function, IRValue id);
+} IselRuleInfo;
+
+extern const uint8_t isel_opcode_terminals[IR_NUM_OPCODES];
+extern const IselRuleInfo isel_rules[NUM_RULES];
+extern const uint8_t isel_terminal_rules[];
+extern const uint16_t isel_terminal_rule_start[NUM_TERMINALS + 1];
+extern const uint8_t isel_chain_rules[ISEL_CHAIN_RULE_COUNT];
+
+/* The tiling picked for one function. A value whose tree folds into the
+ * tree of a user is emitted as part of that user's instructions and gets no
+ * register of its own. */
+typedef struct {
+  uint8_t *rules;      // Per instruction and nonterminal; RULE_NONE if none
+  IRValue *roots;      // Per instruction: the root of the tree it is emitted in
+  uint32_t instr_count;
+} Selection;
+
+void select_instructions(const IRFunction *function, Selection *selection);
+void selection_free(Selection *selection);
+void dump_selection(FILE *out, const IRFunction *function,
+                    const Selection *selection);
+
+static inline IselRule selection_rule(const Selection *selection, IRValue id,
+                                      Nonterminal goal) {
+  return (IselRule)selection->rules[id * NUM_NONTERMINALS + goal];
+}
+
+static inline int selection_is_root(const Selection *selection, IRValue id) {
+  return selection->roots[id] == id;
+}
+
+#endif // !ISEL_H
@@ -0,0 +1,10 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "codegen.h"
+#include "ir.h"
+
+int jit_run(const IRModule *module, const MachineCode *code,
+            const char *program, int *status);
+
+#endif // !JIT_H
@@ -6,11 +6,25 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "linked_list.h"
+#include "arena.h"
 #include "tokens.h"
 
-Token next_token();
+typedef struct
+{
+    const char *source;
+    const char *end;
+    const char *cursor;
+    int current_line;
+    int current_column;
+    int current_char;
+    Arena *literals;
+    int errors; // Reported so far; lexing goes on past them
+} Lexer;
 
-node_t *tokenize_input(FILE *file_pointer);
+void init_lexer(Lexer *lexer, const char *source, size_t length,
+                Arena *literals);
+void skip_whitespace_and_comments(Lexer *lexer);
+void skip_to(Lexer *lexer, const char *target);
+Token next_token(Lexer *lexer);
 
 #endif // !LEXER_H
@@ -0,0 +1,15 @@
+#ifndef LINKER_H
+#define LINKER_H
+
+#include "codegen.h"
+#include "ir.h"
+#include <stddef.h>
+#include <stdint.h>
+
+size_t data_size(const IRModule *module);
+void build_data(const IRModule *module, uint8_t *data);
+int find_function(const MachineCode *code, const char *name);
+int apply_relocations(const MachineCode *code, uint8_t *text,
+                      uint64_t text_address, uint64_t data_address);
+
+#endif // !LINKER_H
@@ -0,0 +1,12 @@
+#ifndef LIVENESS_H
+#define LIVENESS_H
+
+#include "dataflow.h"
+#include "ir.h"
+#include "regalloc.h"
+
+void compute_liveness(DataflowProblem *problem, const IRFunction *function);
+LiveInterval *build_live_intervals(const IRFunction *function,
+                                   const IRValue *roots, uint32_t *count);
+
+#endif // !LIVENESS_H
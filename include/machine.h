@@ -0,0 +1,93 @@
+#ifndef MACHINE_H
+#define MACHINE_H
+
+#include "x86_encoder.h"
+#include <stdint.h>
+
+/*
+ * Machine instructions between code generation and encoding. Each opcode is
+ * one x86_* encoder function, and its operands are the arguments of that
+ * function, so passes can rewrite the stream before it is encoded.
+ */
+
+typedef enum {
+  MI_NOP, // Deleted
+  MI_LABEL,
+  MI_MOV_RR,
+  MI_MOV_RI,
+  MI_MOV_RM,
+  MI_MOV_MR,
+  MI_LEA,
+  MI_ALU_RR,
+  MI_ALU_RI,
+  MI_ALU_RM,
+  MI_ALU_MR,
+  MI_ALU_MI,
+  MI_IMUL_RR,
+  MI_IMUL_RRI,
+  MI_SHIFT_RI,
+  MI_IDIV_R,
+  MI_SIGN_EXTEND,
+  MI_TEST_RR,
+  MI_SETCC,
+  MI_MOVZX_R8,
+  MI_PUSH_R,
+  MI_POP_R,
+  MI_PUSH_M,
+  MI_POP_M,
+  MI_JMP,
+  MI_JCC,
+  MI_CALL,
+  MI_RET,
+  NUM_MACHINE_OPCODES,
+} MachineOpcode;
+
+typedef struct {
+  uint8_t opcode;
+  uint8_t wide;
+  uint8_t op; // AluOp, ShiftOp or ConditionCode
+  int8_t dst;
+  int8_t src;
+  int32_t imm; // Immediate, label or interned callee
+  Memory memory;
+} MachineInstr;
+
+typedef struct {
+  MachineInstr *instrs;
+  uint32_t count;
+  uint32_t capacity;
+} MachineList;
+
+void machine_list_init(MachineList *list);
+void machine_list_free(MachineList *list);
+void machine_list_encode(const MachineList *list, Assembler *a);
+uint32_t machine_list_compact(MachineList *list);
+
+void mi_label(MachineList *list, uint32_t label);
+void mi_mov_rr(MachineList *list, int wide, int dst, int src);
+void mi_mov_ri(MachineList *list, int dst, int32_t imm);
+void mi_mov_rm(MachineList *list, int wide, int dst, Memory src);
+void mi_mov_mr(MachineList *list, int wide, Memory dst, int src);
+void mi_lea(MachineList *list, int dst, Memory src);
+void mi_alu_rr(MachineList *list, AluOp op, int wide, int dst, int src);
+void mi_alu_ri(MachineList *list, AluOp op, int wide, int dst, int32_t imm);
+void mi_alu_rm(MachineList *list, AluOp op, int wide, int dst, Memory src);
+void mi_imul_rr(MachineList *list, int wide, int dst, int src);
+void mi_imul_rri(MachineList *list, int wide, int dst, int src, int32_t imm);
+void mi_shift_ri(MachineList *list, ShiftOp op, int wide, int dst,
+                 uint8_t imm);
+void mi_idiv_r(MachineList *list, int wide, int src);
+void mi_sign_extend_ax(MachineList *list, int wide);
+void mi_test_rr(MachineList *list, int wide, int dst, int src);
+void mi_setcc(MachineList *list, ConditionCode cc, int dst);
+void mi_movzx_r8(MachineList *list, int dst, int src);
+void mi_push_r(MachineList *list, int reg);
+void mi_pop_r(MachineList *list, int reg);
+void mi_push_m(MachineList *list, Memory src);
+void mi_pop_m(MachineList *list, Memory dst);
+void mi_jmp(MachineList *list, uint32_t label);
+void mi_jcc(MachineList *list, ConditionCode cc, uint32_t label);
+void mi_call(MachineList *list, unsigned int callee);
+void mi_ret(MachineList *list);
+
+#endif // !MACHINE_H
@@ -1,10 +1,20 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#include "arena.h"
 #include "linked_list.h"
 #include "tokens.h"
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 
+// Room for the syntax error messages the parser writes
+#define PARSE_ERROR_SIZE 256
+
+// Deepest nesting of statements and expressions accepted by default, well
+// within what the recursive passes after the parser handle on an 8 MiB stack
+#define DEFAULT_NESTING_LIMIT 10000
+
 typedef enum {
   AST_TRANSLATION_UNIT,
   AST_FUNCTION_DEF,
@@ -22,17 +32,64 @@ typedef enum {
   AST_DECL,
   AST_INT_LITERAL,
   AST_FLOAT_LITERAL,
+  AST_ASSIGN_EXPR,
+  AST_CALL_EXPR,
+  AST_ARG_LIST,
+  AST_RETURN_STMT,
+  AST_CHAR_LITERAL,
+  AST_STRING_LITERAL,
+  AST_RELATIONAL_EXPR,
+  AST_EQUALITY_EXPR,
+  AST_IF_STMT,
+  AST_WHILE_STMT,
   AST_UNKNOWN,
   AST_NUM_TYPES,
 } ASTNodeType;
 
+struct Symbol;
+struct PendingBody;
+
 typedef struct ASTNode {
   ASTNodeType type;
   Token *token;
   struct ASTNode **children;
   int child_count;
   int child_capacity;
+  struct Symbol *symbol;       // Declaration an identifier resolves to
+  int type_id;                 // Assigned by the type checker
+  uint32_t id;                 // Of an expression shared by hash-consing, or 0
+  struct PendingBody *pending; // Tokens of a body not parsed yet
 } ASTNode_t;
 
-ASTNode_t *get_ast(node_t *head);
+typedef struct {
+  int threads;
+  int lazy_bodies; // Leave function bodies unparsed until function_body
+  int max_depth;   // Levels statements and expressions may nest; deeper is
+                   // a syntax error
+  // Hash-cons pure expressions: identical literals, identifiers and
+  // arithmetic and comparison expressions over them share one node wherever
+  // the names in them denote the same declarations. The AST becomes a DAG,
+  // and passes after the parser find repeated expressions by their `id`.
+  int share_expressions;
+} ParseOptions;
+
+typedef struct {
+  uint32_t declarations; // External declarations found by the split
+  uint32_t bodies_skipped;
+  uint32_t nodes_shared; // Expression nodes reused instead of built
+  int chunks;
+  int threads;
+  double seconds;
+} ParseStats;
+
+ASTNode_t *get_ast(node_t *head, const ParseOptions *options,
+                   ParseStats *stats, char *error);
+ASTNode_t *parse_declarations(node_t *tokens, const ParseOptions *options,
+                              char *error);
+ASTNode_t *function_body(ASTNode_t *function);
+ASTNode_t *take_function_body(ASTNode_t *function, Arena *arena,
+                              char *error);
+void release_function_body(ASTNode_t *function);
+int ends_declaration(TokenType type, int *depth);
+void print_parse_stats(FILE *out, const ParseStats *stats);
 #endif // !PARSER
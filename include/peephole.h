@@ -0,0 +1,19 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include "machine.h"
+#include <stdint.h>
+#include <stdio.h>
+
+#define PEEPHOLE_MAX_PATTERNS 16
+
+typedef struct {
+  uint64_t applied[PEEPHOLE_MAX_PATTERNS]; // Per row of the pattern table
+  uint64_t instructions_removed;
+  double seconds;
+} PeepholeStats;
+
+void run_peephole(MachineList *list, PeepholeStats *stats);
+void print_peephole_stats(FILE *out, const PeepholeStats *stats);
+
+#endif // !PEEPHOLE_H
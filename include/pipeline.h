@@ -0,0 +1,29 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "parser.h"
+#include "preprocessor.h"
+#include <stdint.h>
+#include <stdio.h>
+
+typedef struct {
+  uint64_t token_batches;
+  uint64_t declarations;
+  uint64_t lexer_stalls;    // Token batches held back by a busy parser
+  uint64_t parser_starved;  // Times the parser waited for tokens
+  uint64_t parser_stalls;   // Declarations held back by a busy backend
+  uint64_t backend_starved; // Times the backend waited for declarations
+  double seconds;
+} PipelineStats;
+
+/* Compiles one external declaration, in source order, and returns the
+ * number of errors reported. */
+typedef int (*DeclarationHandler)(ASTNode_t *declaration, void *context);
+
+int run_pipeline(const char *path, const char *const *include_dirs,
+                 int include_dir_count, HeaderCache *cache,
+                 const ParseOptions *options, DeclarationHandler handler,
+                 void *context, PipelineStats *stats);
+void print_pipeline_stats(FILE *out, const PipelineStats *stats);
+
+#endif // !PIPELINE_H
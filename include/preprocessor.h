@@ -0,0 +1,116 @@
+#ifndef PREPROCESSOR_H
+#define PREPROCESSOR_H
+
+#include "arena.h"
+#include "linked_list.h"
+#include <stdint.h>
+#include <stdio.h>
+
+typedef struct {
+  uint64_t files_lexed;  // Read from disk and lexed
+  uint64_t cache_hits;   // Includes replayed from cached tokens
+  uint64_t guard_skips;  // Includes skipped by their include guard
+  uint64_t macros_expanded;
+  double seconds;
+} PreprocessorStats;
+
+typedef enum {
+  DIRECTIVE_INCLUDE,
+  DIRECTIVE_DEFINE,
+  DIRECTIVE_UNDEF,
+  DIRECTIVE_IFDEF,
+  DIRECTIVE_IFNDEF,
+  DIRECTIVE_IF,
+  DIRECTIVE_ELIF,
+  DIRECTIVE_ELSE,
+  DIRECTIVE_ENDIF,
+  DIRECTIVE_PRAGMA,
+  DIRECTIVE_UNKNOWN, // Its name is the operand
+} DirectiveKind;
+
+/* How the condition of an #if, #elif, #ifdef or #ifndef is decided. Macro
+ * values are not tracked, so only a number or a defined operator, possibly
+ * negated, can be. */
+typedef enum {
+  TEST_NONE,    // Any other condition
+  TEST_NUMBER,  // Nonzero if `value` is
+  TEST_DEFINED, // Whether the macro named by the operand is defined
+} DirectiveTest;
+
+typedef enum {
+  CONDITION_FALSE,
+  CONDITION_TRUE,
+  CONDITION_UNKNOWN,
+} Condition;
+
+/* A directive as parse_directive finds it. The operand and body point into
+ * the line it was parsed from. */
+typedef struct {
+  DirectiveKind kind;
+  int line;
+  const char *operand; // Macro name, include path or unknown directive name
+  uint32_t length;
+  const char *body; // #define replacement list
+  uint32_t body_length;
+  uint8_t system;        // <path> rather than "path"
+  uint8_t function_like; // #define NAME(
+  uint8_t test;          // A DirectiveTest
+  uint8_t negated;       // By #ifndef or '!'
+  uint8_t value;         // Of TEST_NUMBER
+  const char *error;     // Why it is malformed, or NULL
+} Directive;
+
+typedef struct {
+  const char *path;
+  void *file;
+} FileSlot;
+
+/* Files keyed by canonical path, with open addressing. */
+typedef struct {
+  FileSlot *slots;
+  uint32_t capacity;
+  uint32_t count;
+} FileTable;
+
+typedef struct CachedFile CachedFile;
+
+// Receives the preprocessed tokens from `first` to `last`, a list of its own
+typedef void (*TokenSink)(node_t *first, node_t *last, void *context);
+
+/* Every file read by the preprocessor, lexed once and kept with its
+ * directives, so that translation units preprocessed with the same cache
+ * share their headers. */
+typedef struct {
+  FileTable files;
+  Arena strings; // Lexemes and paths of the cached files
+  PreprocessorStats stats;
+} HeaderCache;
+
+void header_cache_init(HeaderCache *cache);
+void header_cache_free(HeaderCache *cache);
+node_t *preprocess_file(const char *path, const char *const *include_dirs,
+                        int include_dir_count, HeaderCache *cache);
+int preprocess_stream(const char *path, const char *const *include_dirs,
+                      int include_dir_count, HeaderCache *cache,
+                      TokenSink sink, void *context);
+int header_cache_contains(HeaderCache *cache, const char *path,
+                          const char *raw);
+void print_preprocessor_stats(FILE *out, const PreprocessorStats *stats);
+
+void file_table_init(FileTable *table);
+void *file_table_find(const FileTable *table, const char *path);
+void file_table_insert(FileTable *table, const char *path, void *file);
+void file_table_free(FileTable *table);
+
+const char *directive_end(const char *p, const char *end, int *unterminated);
+const char *copy_directive(Arena *strings, const char *p, const char *end,
+                           size_t *length);
+void parse_directive(Directive *directive, const char *p, const char *end);
+int opens_conditional(DirectiveKind kind);
+Condition directive_condition(const Directive *directive, int defined);
+int find_include_guard(const Directive *directives, uint32_t count);
+int find_include(const char *from, const Directive *directive,
+                 const char *const *include_dirs, int include_dir_count,
+                 char *path);
+
+#endif // !PREPROCESSOR_H
@@ -2,27 +2,13 @@
 #define PRETTY_PRINTER_H
 
 #include "parser.h"
+#include <stdio.h>
 
-static const char *ASTNodeTypeStrings[AST_NUM_TYPES] = {
-    "Translation Unit",
-    "Function Definition",
-    "Function Declaration",
-    "Type Specifier",
-    "Identifier",
-    "Parameter List",
-    "Parameter Declaration",
-    "Compound Statement",
-    "Expression",
-    "Addition Expression",
-    "Multiplication Expression",
-    "Term",
-    "Factor",
-    "Declaration",
-    "Int Literal",
-    "Float Literal",
-    "UNKNOWN",
-};
+extern const char *ASTNodeTypeStrings[AST_NUM_TYPES];
 
 void print_ast(ASTNode_t *ast);
+const char *declaration_kind(ASTNode_t *declaration);
+void print_declaration(FILE *out, ASTNode_t *declaration);
+void print_signatures(FILE *out, ASTNode_t *ast);
 
 #endif //! PRETTY_PRINTER
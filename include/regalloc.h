@@ -0,0 +1,77 @@
+#ifndef REGALLOC_H
+#define REGALLOC_H
+
+#include "ir.h"
+#include <stdint.h>
+#include <stdio.h>
+
+/* x86-64 registers, numbered as in the ModRM and REX encodings. */
+typedef enum {
+  REG_RAX,
+  REG_RCX,
+  REG_RDX,
+  REG_RBX,
+  REG_RSP,
+  REG_RBP,
+  REG_RSI,
+  REG_RDI,
+  REG_R8,
+  REG_R9,
+  REG_R10,
+  REG_R11,
+  REG_R12,
+  REG_R13,
+  REG_R14,
+  REG_R15,
+  NUM_REGISTERS,
+} PhysicalRegister;
+
+#define REG_NONE (-1)
+
+/* Bit r is set when register r is in the set. */
+typedef uint32_t RegisterSet;
+
+#define REGISTER_BIT(r) ((RegisterSet)1 << (r))
+
+typedef enum {
+  REG_CLASS_GENERAL, // Holds SSA values
+  NUM_REGISTER_CLASSES,
+} RegisterClass;
+
+extern const char *register_names[NUM_REGISTERS];
+extern const RegisterSet register_class_members[NUM_REGISTER_CLASSES];
+extern const RegisterSet callee_saved_registers;
+extern const PhysicalRegister argument_registers[6];
+
+typedef struct {
+  RegisterSet free;
+} RegisterPool;
+
+void register_pool_init(RegisterPool *pool);
+int register_pool_take(RegisterPool *pool, RegisterSet allowed);
+void register_pool_release(RegisterPool *pool, int reg);
+
+/* The positions in the linear instruction order at which a value is live. */
+typedef struct {
+  IRValue value;
+  uint32_t start;
+  uint32_t end;
+  uint8_t register_class;
+  uint8_t crosses_call; // A call clobbers caller-saved registers in between
+} LiveInterval;
+
+typedef struct {
+  int8_t *registers;    // Per value; REG_NONE when spilled or without result
+  int32_t *spill_slots; // Per value; -1 unless spilled
+  uint32_t value_count;
+  uint32_t spill_slot_count;
+  RegisterSet callee_saved_used;
+} RegisterAllocation;
+
+void allocate_registers(const IRFunction *function, LiveInterval *intervals,
+                        uint32_t count, RegisterAllocation *allocation);
+void register_allocation_free(RegisterAllocation *allocation);
+void dump_register_allocation(FILE *out, const IRFunction *function,
+                              const RegisterAllocation *allocation);
+
+#endif // !REGALLOC_H
@@ -0,0 +1,10 @@
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include "parser.h"
+#include "symbol_table.h"
+
+int resolve_names(ASTNode_t *ast, SymbolTable *table);
+int resolve_external_declaration(ASTNode_t *node, SymbolTable *table);
+
+#endif // !RESOLVER_H
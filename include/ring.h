@@ -0,0 +1,32 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Bounded FIFO between exactly one producer thread and one consumer thread.
+ * Neither side takes a lock: each writes only its own index and publishes
+ * the slot it filled or emptied with a release store. A push into a full
+ * ring, or a pop from an empty one, spins briefly and then yields the CPU
+ * until the other side catches up.
+ */
+
+typedef struct {
+  char *slots;
+  size_t element_size;
+  uint32_t mask; // Capacity - 1, a power of two
+
+  // Each index on a cache line of its own, with its side's counter
+  _Alignas(64) uint32_t head; // Next slot to pop, written by the consumer
+  uint64_t empty_waits;       // Pops that found the ring empty
+  _Alignas(64) uint32_t tail; // Next slot to push, written by the producer
+  uint64_t full_waits;        // Pushes that found the ring full
+} Ring;
+
+void ring_init(Ring *ring, uint32_t capacity, size_t element_size);
+void ring_free(Ring *ring);
+void ring_push(Ring *ring, const void *element);
+void ring_pop(Ring *ring, void *element);
+
+#endif // !RING_H
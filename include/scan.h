@@ -0,0 +1,21 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stddef.h>
+
+/* Number of zero bytes that must follow the end of every buffer handed to the
+ * scan functions, so that a vector load starting before `end` never reads
+ * past the allocation. */
+#define SCAN_PADDING 64
+
+const char *scan_skip_whitespace(const char *p, const char *end);
+const char *scan_find_byte(const char *p, const char *end, char byte);
+const char *scan_find_comment_end(const char *p, const char *end);
+const char *scan_find_string_special(const char *p, const char *end,
+                                     char quote);
+const char *scan_find_line_special(const char *p, const char *end);
+size_t scan_count_byte(const char *p, const char *end, char byte);
+const char *scan_map_file(const char *path, size_t *length, size_t *mapped);
+void scan_unmap_file(const char *source, size_t mapped);
+
+#endif // !SCAN_H
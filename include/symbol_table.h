@@ -0,0 +1,53 @@
+#ifndef SYMBOL_TABLE_H
+#define SYMBOL_TABLE_H
+
+#include "arena.h"
+#include "parser.h"
+
+typedef enum {
+  SYMBOL_VARIABLE,
+  SYMBOL_PARAMETER,
+  SYMBOL_FUNCTION,
+} SymbolKind;
+
+typedef struct Symbol {
+  unsigned int name; // Interned identifier
+  SymbolKind kind;
+  int scope_depth;
+  ASTNode_t *declaration; // Declaring AST_DECL, AST_PARAM_DECL or function
+  struct Symbol *shadowed; // Binding this one hides, restored on scope exit
+  int type_id;             // Assigned by the type checker
+  int ir_variable;         // Global index, or local variable number in lowering
+  int bytecode_slot;       // Global index, or local register in the bytecode
+} Symbol;
+
+typedef struct {
+  unsigned int name;
+  Symbol *binding; // Innermost visible symbol, NULL when out of scope
+} SymbolSlot;
+
+typedef struct {
+  SymbolSlot *slots;
+  unsigned int slot_capacity;
+  unsigned int slot_count;
+
+  Symbol **undo_log; // Every binding made, in declaration order
+  size_t undo_count;
+  uint32_t undo_capacity;
+
+  size_t *scope_marks; // undo_count at each scope entry
+  int depth;
+  uint32_t mark_capacity;
+
+  Arena symbols;
+} SymbolTable;
+
+void symbol_table_init(SymbolTable *table);
+void symbol_table_free(SymbolTable *table);
+void enter_scope(SymbolTable *table);
+void leave_scope(SymbolTable *table);
+Symbol *declare_symbol(SymbolTable *table, unsigned int name, SymbolKind kind,
+                       ASTNode_t *declaration);
+Symbol *lookup_symbol(SymbolTable *table, unsigned int name);
+
+#endif // !SYMBOL_TABLE_H
@@ -0,0 +1,22 @@
+#ifndef SYMINDEX_H
+#define SYMINDEX_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+typedef struct {
+  uint32_t files_indexed;   // Parsed again
+  uint32_t files_unchanged; // Kept, their content hash being the same
+  uint32_t files_dropped;   // No longer on disk
+  uint32_t symbols;         // In the index written
+  double seconds;
+} IndexStats;
+
+int update_symbol_index(const char *index_path, const char *const *inputs,
+                        int input_count, const char *const *include_dirs,
+                        int include_dir_count, IndexStats *stats);
+int query_symbol_index(const char *index_path, const char *pattern,
+                       FILE *out);
+void print_index_stats(FILE *out, const IndexStats *stats);
+
+#endif // !SYMINDEX_H
@@ -1,6 +1,8 @@
 #ifndef TOKENS_H
 #define TOKENS_H
 
+#include <stddef.h>
+
 typedef enum {
   // Primitive types
   TOKEN_INT,
@@ -20,6 +22,7 @@ typedef enum {
   TOKEN_IDENTIFIER,
   TOKEN_FLOAT_LITERAL,
   TOKEN_STRING_LITERAL,
+  TOKEN_CHAR_LITERAL,
 
   // Delimiters
   TOKEN_LPAREN,
@@ -56,50 +59,17 @@ typedef enum {
   NUM_TOKENS
 } TokenType;
 
-static const char *token_names[NUM_TOKENS] = {"INT",
-                                              "CHAR",
-                                              "FLOAT",
-                                              "VOID",
-                                              "IF",
-                                              "ELSE",
-                                              "WHILE",
-                                              "FOR",
-                                              "RETURN",
-                                              "INT_LITERAL",
-                                              "IDENTIFIER",
-                                              "FLOAT_LITERAL",
-                                              "STRING_LITERAL",
-                                              "LPAREN",
-                                              "RPAREN",
-                                              "LBRACE",
-                                              "RBRACE",
-                                              "SEMICOLON",
-                                              "COMMA",
-                                              "PLUS",
-                                              "MINUS",
-                                              "STAR",
-                                              "SLASH",
-                                              "MOD",
-                                              "ASSIGN",
-                                              "AMPERSAND",
-                                              "PLUS_PLUS",
-                                              "MINUS_MINUS",
-                                              "LT",
-                                              "GT",
-                                              "LTE",
-                                              "GTE",
-                                              "EQ",
-                                              "NEQ",
-                                              "AND",
-                                              "OR",
-                                              "UNRECOGNIZED",
-                                              "EOF"};
+extern const char *token_names[NUM_TOKENS];
 
 typedef struct {
   TokenType type;
   char *lexeme;
   int line;
   int column;
+  size_t length;   // Length of lexeme; decoded literals may contain '\0'
+  const char *raw; // Source span of the token, kept for diagnostics
+  size_t raw_length;
+  unsigned int intern_id; // Interned spelling of identifiers and keywords
 } Token;
 
 #endif /* TOKENS_H */
@@ -0,0 +1,9 @@
+#ifndef TYPE_CHECKER_H
+#define TYPE_CHECKER_H
+
+#include "parser.h"
+
+int check_types(ASTNode_t *ast);
+int check_external_declaration(ASTNode_t *node);
+
+#endif // !TYPE_CHECKER_H
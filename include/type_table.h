@@ -0,0 +1,42 @@
+#ifndef TYPE_TABLE_H
+#define TYPE_TABLE_H
+
+#include "tokens.h"
+#include <stddef.h>
+
+typedef enum {
+  TYPE_ERROR,
+  TYPE_VOID,
+  TYPE_CHAR,
+  TYPE_INT,
+  TYPE_FLOAT,
+  TYPE_POINTER,
+  TYPE_FUNCTION,
+} TypeKind;
+
+/* Ids of the basic types, which the table creates first and in this order.
+ * Id 0 is the error type, given to ill-typed expressions so that one mistake
+ * is reported once instead of at every enclosing expression. */
+enum {
+  TYPE_ID_ERROR,
+  TYPE_ID_VOID,
+  TYPE_ID_CHAR,
+  TYPE_ID_INT,
+  TYPE_ID_FLOAT,
+};
+
+typedef struct {
+  TypeKind kind;
+  int base; // Pointee of a pointer, return type of a function
+  int param_count;
+  const int *params;
+} Type;
+
+const Type *type_get(int id);
+int type_pointer(int base);
+int type_function(int return_type, const int *params, int param_count);
+int type_from_token(TokenType token_type);
+int type_is_arithmetic(int id);
+const char *type_name(int id, char *buffer, size_t size);
+
+#endif // !TYPE_TABLE_H
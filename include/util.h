@@ -0,0 +1,15 @@
+#ifndef UTIL_H
+#define UTIL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+void *allocate(size_t count, size_t size);
+void *allocate_zeroed(size_t count, size_t size);
+void *reallocate(void *array, size_t count, size_t size);
+char *duplicate(const char *string);
+void *grow(void *array, size_t element_size, uint32_t *capacity,
+           uint32_t minimum);
+double now(void);
+
+#endif // !UTIL_H
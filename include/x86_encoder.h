@@ -0,0 +1,139 @@
+#ifndef X86_ENCODER_H
+#define X86_ENCODER_H
+
+#include "regalloc.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* Base of a RIP-relative memory operand; the displacement is relocated
+ * against `global`. */
+#define REG_RIP NUM_REGISTERS
+
+#define LABEL_UNBOUND UINT32_MAX
+
+typedef enum {
+  CC_O,
+  CC_NO,
+  CC_B,
+  CC_AE,
+  CC_E,
+  CC_NE,
+  CC_BE,
+  CC_A,
+  CC_S,
+  CC_NS,
+  CC_P,
+  CC_NP,
+  CC_L,
+  CC_GE,
+  CC_LE,
+  CC_G,
+} ConditionCode;
+
+/* Register-destination forms of the classic ALU instructions; the value is
+ * the /digit of their immediate forms. */
+typedef enum {
+  ALU_ADD = 0,
+  ALU_OR = 1,
+  ALU_AND = 4,
+  ALU_SUB = 5,
+  ALU_XOR = 6,
+  ALU_CMP = 7,
+} AluOp;
+
+typedef enum {
+  SHIFT_SHL = 4,
+  SHIFT_SHR = 5,
+  SHIFT_SAR = 7,
+} ShiftOp;
+
+typedef struct {
+  int8_t base; // A register or REG_RIP
+  int8_t index; // REG_NONE without index; never REG_RSP
+  uint8_t scale; // 1, 2, 4 or 8
+  int32_t disp;
+  uint32_t global; // Global index of a RIP-relative operand
+} Memory;
+
+typedef enum {
+  RELOC_CALL,   // rel32 to the function named by an interned identifier
+  RELOC_GLOBAL, // rel32 to a global variable, by index
+} RelocationKind;
+
+/* A 32-bit PC-relative field still to be filled in: the target's address,
+ * plus `addend`, minus the field's address. */
+typedef struct {
+  uint32_t offset;
+  uint8_t kind;
+  uint32_t symbol;
+  int32_t addend;
+} Relocation;
+
+typedef struct {
+  uint32_t offset; // Of a rel32 field
+  uint32_t label;
+} LabelFixup;
+
+typedef struct {
+  uint8_t *bytes;
+  size_t size;
+  size_t capacity;
+
+  Relocation *relocations;
+  uint32_t relocation_count;
+  uint32_t relocation_capacity;
+
+  uint32_t *labels; // Offset of each label, or LABEL_UNBOUND
+  uint32_t label_count;
+  uint32_t label_capacity;
+
+  LabelFixup *fixups;
+  uint32_t fixup_count;
+  uint32_t fixup_capacity;
+} Assembler;
+
+void assembler_init(Assembler *assembler);
+void assembler_free(Assembler *assembler);
+uint32_t x86_new_label(Assembler *assembler);
+void x86_bind_label(Assembler *assembler, uint32_t label);
+int x86_resolve_labels(Assembler *assembler);
+
+static inline Memory x86_memory(int base, int32_t disp) {
+  return (Memory){base, REG_NONE, 1, disp, 0};
+}
+
+static inline Memory x86_global(uint32_t global) {
+  return (Memory){REG_RIP, REG_NONE, 1, 0, global};
+}
+
+void x86_mov_rr(Assembler *a, int wide, int dst, int src);
+void x86_mov_ri(Assembler *a, int dst, int32_t imm);
+void x86_mov_rm(Assembler *a, int wide, int dst, Memory src);
+void x86_mov_mr(Assembler *a, int wide, Memory dst, int src);
+void x86_lea(Assembler *a, int dst, Memory src);
+void x86_alu_rr(Assembler *a, AluOp op, int wide, int dst, int src);
+void x86_alu_ri(Assembler *a, AluOp op, int wide, int dst, int32_t imm);
+void x86_alu_rm(Assembler *a, AluOp op, int wide, int dst, Memory src);
+void x86_alu_mr(Assembler *a, AluOp op, int wide, Memory dst, int src);
+void x86_alu_mi(Assembler *a, AluOp op, int wide, Memory dst, int32_t imm);
+void x86_imul_rr(Assembler *a, int wide, int dst, int src);
+void x86_imul_rri(Assembler *a, int wide, int dst, int src, int32_t imm);
+void x86_shift_ri(Assembler *a, ShiftOp op, int wide, int dst, uint8_t imm);
+void x86_idiv_r(Assembler *a, int wide, int src);
+void x86_sign_extend_ax(Assembler *a, int wide);
+void x86_test_rr(Assembler *a, int wide, int dst, int src);
+void x86_setcc(Assembler *a, ConditionCode cc, int dst);
+void x86_movzx_r8(Assembler *a, int dst, int src);
+void x86_push_r(Assembler *a, int reg);
+void x86_pop_r(Assembler *a, int reg);
+void x86_push_m(Assembler *a, Memory src);
+void x86_pop_m(Assembler *a, Memory dst);
+void x86_jmp(Assembler *a, uint32_t label);
+void x86_jcc(Assembler *a, ConditionCode cc, uint32_t label);
+void x86_call(Assembler *a, unsigned int callee);
+void x86_ret(Assembler *a);
+void x86_syscall(Assembler *a);
+
+int check_encoding(void);
+
+#endif // !X86_ENCODER_H
@@ -1 +1,25 @@
-int a
\ No newline at end of file
+int calls;
+int calls;
+
+int square(int n);
+
+int sum_of_squares(int limit) {
+  int total = 0;
+  for (int i = 1; i <= limit; i = i + 1) {
+    total = total + square(i);
+  }
+  return total;
+}
+
+int square(int n) {
+  calls = calls + 1;
+  return n * n;
+}
+
+int main() {
+  int total = sum_of_squares(5);
+  if (calls != 5) {
+    return 1;
+  }
+  return total;
+}
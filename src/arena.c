@@ -0,0 +1,92 @@
+#include "arena.h"
+#include "util.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGNMENT 16
+#define ARENA_DEFAULT_CHUNK_SIZE (64 * 1024)
+
+static ArenaChunk *new_chunk(size_t size, ArenaChunk *next) {
+  ArenaChunk *chunk = allocate(1, sizeof(ArenaChunk) + size);
+  chunk->next = next;
+  chunk->size = size;
+  chunk->used = 0;
+  return chunk;
+}
+
+void arena_init(Arena *arena, size_t chunk_size) {
+  arena->head = NULL;
+  arena->chunk_size = chunk_size ? chunk_size : ARENA_DEFAULT_CHUNK_SIZE;
+}
+
+/**
+ * @brief Bump-allocates `size` bytes, 16-byte aligned.
+ *
+ * Requests larger than the chunk size get a chunk of their own, which is
+ * linked behind the current head so the head keeps serving small requests.
+ */
+void *arena_alloc(Arena *arena, size_t size) {
+  size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+
+  ArenaChunk *chunk = arena->head;
+  if (chunk != NULL && chunk->size - chunk->used >= size) {
+    void *memory = chunk->data + chunk->used;
+    chunk->used += size;
+    return memory;
+  }
+
+  if (size > arena->chunk_size / 4 && chunk != NULL) {
+    ArenaChunk *large = new_chunk(size, chunk->next);
+    chunk->next = large;
+    large->used = size;
+    return large->data;
+  }
+
+  size_t chunk_size = size > arena->chunk_size ? size : arena->chunk_size;
+  arena->head = new_chunk(chunk_size, chunk);
+  arena->head->used = size;
+  return arena->head->data;
+}
+
+char *arena_strndup(Arena *arena, const char *string, size_t length) {
+  char *copy = arena_alloc(arena, length + 1);
+  memcpy(copy, string, length);
+  copy[length] = '\0';
+  return copy;
+}
+
+/**
+ * @brief Releases everything but the most recent chunk, which is kept for
+ * reuse so that an arena reset once per unit of work stops hitting malloc.
+ */
+void arena_reset(Arena *arena) {
+  if (arena->head == NULL) {
+    return;
+  }
+  ArenaChunk *chunk = arena->head->next;
+  while (chunk != NULL) {
+    ArenaChunk *next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+  arena->head->next = NULL;
+  arena->head->used = 0;
+}
+
+void arena_free(Arena *arena) {
+  ArenaChunk *chunk = arena->head;
+  while (chunk != NULL) {
+    ArenaChunk *next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+  arena->head = NULL;
+}
+
+size_t arena_bytes_used(const Arena *arena) {
+  size_t used = 0;
+  for (ArenaChunk *chunk = arena->head; chunk != NULL; chunk = chunk->next) {
+    used += chunk->used;
+  }
+  return used;
+}
@@ -0,0 +1,135 @@
+#include "bitset.h"
+#include <string.h>
+
+/*
+ * The union and difference loops process 256 bits per iteration: one AVX2
+ * register, or two SSE2 or NEON registers.
+ */
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+/* Returns nonzero when `b` has a bit that is not in `a`. */
+static inline int adds_bits(__m256i a, __m256i b) {
+  return !_mm256_testc_si256(a, b);
+}
+
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+
+static inline int adds_bits(__m128i a, __m128i merged) {
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(a, merged)) != 0xFFFF;
+}
+
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+
+static inline int adds_bits(uint64x2_t a, uint64x2_t merged) {
+  uint64x2_t added = veorq_u64(a, merged);
+  return (vgetq_lane_u64(added, 0) | vgetq_lane_u64(added, 1)) != 0;
+}
+#endif
+
+void bitset_clear(uint64_t *set, uint32_t words) {
+  memset(set, 0, words * sizeof(uint64_t));
+}
+
+void bitset_copy(uint64_t *destination, const uint64_t *source,
+                 uint32_t words) {
+  memcpy(destination, source, words * sizeof(uint64_t));
+}
+
+/**
+ * @brief Adds the bits of `source` to `destination`.
+ *
+ * @return Nonzero if `destination` changed.
+ */
+int bitset_union(uint64_t *destination, const uint64_t *source,
+                 uint32_t words) {
+  int changed = 0;
+#if defined(__AVX2__)
+  for (uint32_t i = 0; i < words; i += 4) {
+    __m256i a = _mm256_loadu_si256((const __m256i *)(destination + i));
+    __m256i b = _mm256_loadu_si256((const __m256i *)(source + i));
+    changed |= adds_bits(a, b);
+    _mm256_storeu_si256((__m256i *)(destination + i), _mm256_or_si256(a, b));
+  }
+#elif defined(__SSE2__)
+  for (uint32_t i = 0; i < words; i += 2) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(destination + i));
+    __m128i merged =
+        _mm_or_si128(a, _mm_loadu_si128((const __m128i *)(source + i)));
+    changed |= adds_bits(a, merged);
+    _mm_storeu_si128((__m128i *)(destination + i), merged);
+  }
+#elif defined(__ARM_NEON)
+  for (uint32_t i = 0; i < words; i += 2) {
+    uint64x2_t a = vld1q_u64(destination + i);
+    uint64x2_t merged = vorrq_u64(a, vld1q_u64(source + i));
+    changed |= adds_bits(a, merged);
+    vst1q_u64(destination + i, merged);
+  }
+#else
+  for (uint32_t i = 0; i < words; i++) {
+    uint64_t merged = destination[i] | source[i];
+    changed |= merged != destination[i];
+    destination[i] = merged;
+  }
+#endif
+  return changed;
+}
+
+/**
+ * @brief Removes the bits of `source` from `destination`.
+ */
+void bitset_difference(uint64_t *destination, const uint64_t *source,
+                       uint32_t words) {
+#if defined(__AVX2__)
+  for (uint32_t i = 0; i < words; i += 4) {
+    __m256i a = _mm256_loadu_si256((const __m256i *)(destination + i));
+    __m256i b = _mm256_loadu_si256((const __m256i *)(source + i));
+    _mm256_storeu_si256((__m256i *)(destination + i), _mm256_andnot_si256(b, a));
+  }
+#elif defined(__SSE2__)
+  for (uint32_t i = 0; i < words; i += 2) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(destination + i));
+    __m128i b = _mm_loadu_si128((const __m128i *)(source + i));
+    _mm_storeu_si128((__m128i *)(destination + i), _mm_andnot_si128(b, a));
+  }
+#elif defined(__ARM_NEON)
+  for (uint32_t i = 0; i < words; i += 2) {
+    vst1q_u64(destination + i,
+              vbicq_u64(vld1q_u64(destination + i), vld1q_u64(source + i)));
+  }
+#else
+  for (uint32_t i = 0; i < words; i++) {
+    destination[i] &= ~source[i];
+  }
+#endif
+}
+
+uint32_t bitset_count(const uint64_t *set, uint32_t words) {
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < words; i++) {
+    count += __builtin_popcountll(set[i]);
+  }
+  return count;
+}
+
+/**
+ * @brief Returns the first set bit at or after `from`, or BITSET_NONE.
+ */
+uint32_t bitset_next(const uint64_t *set, uint32_t words, uint32_t from) {
+  uint32_t word = from / 64;
+  if (word >= words) {
+    return BITSET_NONE;
+  }
+  uint64_t bits = set[word] & (~(uint64_t)0 << (from % 64));
+  while (bits == 0) {
+    if (++word == words) {
+      return BITSET_NONE;
+    }
+    bits = set[word];
+  }
+  return word * 64 + __builtin_ctzll(bits);
+}
@@ -0,0 +1,550 @@
+#include "bytecode.h"
+#include "intern.h"
+#include "ir_lower.h"
+#include "symbol_table.h"
+#include "util.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Compilation of a resolved, type-checked AST straight to register bytecode,
+ * for programs that finish before native code generation would pay off.
+ * Expressions are compiled bottom up into the register holding their value:
+ * a local is read in place, anything else is computed into a fresh
+ * temporary. Each instruction is offered to the one before it for fusion
+ * into a superinstruction; a jump target in between blocks it.
+ */
+
+typedef struct {
+  BytecodeModule *module;
+  BytecodeFunction *function;
+  int *function_indices; // Per interned name, -1 unless defined
+  int local_count;       // Registers below are locals, above temporaries
+  int next_local;
+  int next_register;     // First free temporary
+  uint32_t barrier;      // Instructions from here on start after a label
+  int errors;
+} Compiler;
+
+#define BYTECODE_NAME(name, op) #name,
+#define BYTECODE_IMMEDIATE_NAME(name, op) #name "I",
+#define BYTECODE_BRANCH_NAME(name, op) "J" #name,
+#define BYTECODE_BRANCH_IMMEDIATE_NAME(name, op) "J" #name "I",
+
+const char *bytecode_opcode_names[NUM_BYTECODE_OPCODES] = {
+    "MOV", "LOADI", "LOADG", "STOREG", "ADD", "SUB", "MUL", "DIV", "MOD",
+    BYTECODE_COMPARISONS(BYTECODE_NAME)
+    "JMP", "JZ", "CALL", "RET", "RET0", "ADDI", "SUBI", "MULI",
+    BYTECODE_COMPARISONS(BYTECODE_IMMEDIATE_NAME)
+    BYTECODE_COMPARISONS(BYTECODE_BRANCH_NAME)
+    BYTECODE_COMPARISONS(BYTECODE_BRANCH_IMMEDIATE_NAME)
+};
+
+/* Comparisons are in the order EQ, NE, LT, LE, GT, GE. */
+static const uint8_t inverse_comparisons[6] = {1, 0, 5, 4, 3, 2};
+static const uint8_t swapped_comparisons[6] = {0, 1, 4, 5, 2, 3};
+
+static void compile_error(Compiler *compiler, Token *token,
+                          const char *message) {
+  if (token != NULL) {
+    fprintf(stderr, "Error: %s at line %d, column %d\n", message, token->line,
+            token->column);
+  } else {
+    fprintf(stderr, "Error: %s\n", message);
+  }
+  compiler->errors++;
+}
+
+static int is_temporary(const Compiler *compiler, int reg) {
+  return reg >= compiler->local_count;
+}
+
+static int writes_register(BytecodeOpcode opcode) {
+  return opcode != BC_STOREG && opcode != BC_JMP && opcode != BC_JZ &&
+         opcode != BC_RET && opcode != BC_RET0 && opcode < BC_JEQ;
+}
+
+/* Rewrites `prev` into one instruction doing the work of both, if a
+ * superinstruction covers the pair. Only temporaries carry values from one
+ * to the other, as they are read exactly once. */
+static int fuse(Compiler *compiler, BytecodeInstr *prev, BytecodeInstr next) {
+  int temporary = writes_register(prev->opcode) &&
+                  is_temporary(compiler, prev->a);
+  if (!temporary) {
+    return 0;
+  }
+  if (next.opcode == BC_MOV && next.b == prev->a) {
+    prev->a = next.a; // Compute into the destination directly
+    return 1;
+  }
+  if (prev->opcode == BC_LOADI && next.opcode >= BC_ADD &&
+      next.opcode <= BC_MUL) {
+    BytecodeOpcode opcode = BC_ADDI + (next.opcode - BC_ADD);
+    if (next.c == prev->a && next.b != prev->a) {
+      *prev = (BytecodeInstr){opcode, next.a, next.b, 0, prev->imm};
+      return 1;
+    }
+    if (next.b == prev->a && next.c != prev->a && next.opcode != BC_SUB) {
+      *prev = (BytecodeInstr){opcode, next.a, next.c, 0, prev->imm};
+      return 1;
+    }
+    return 0;
+  }
+  if (prev->opcode == BC_LOADI && next.opcode >= BC_EQ &&
+      next.opcode <= BC_GE) {
+    int comparison = next.opcode - BC_EQ;
+    if (next.c == prev->a && next.b != prev->a) {
+      *prev = (BytecodeInstr){BC_EQI + comparison, next.a, next.b, 0,
+                              prev->imm};
+      return 1;
+    }
+    if (next.b == prev->a && next.c != prev->a) {
+      *prev = (BytecodeInstr){BC_EQI + swapped_comparisons[comparison],
+                              next.a, next.c, 0, prev->imm};
+      return 1;
+    }
+    return 0;
+  }
+  if (next.opcode != BC_JZ || next.b != prev->a) {
+    return 0;
+  }
+  // The branch is taken when the comparison is false
+  if (prev->opcode >= BC_EQ && prev->opcode <= BC_GE) {
+    int comparison = inverse_comparisons[prev->opcode - BC_EQ];
+    *prev = (BytecodeInstr){BC_JEQ + comparison, 0, prev->b, prev->c,
+                            next.imm};
+    return 1;
+  }
+  if (prev->opcode >= BC_EQI && prev->opcode <= BC_GEI &&
+      prev->imm >= INT16_MIN && prev->imm <= INT16_MAX) {
+    int comparison = inverse_comparisons[prev->opcode - BC_EQI];
+    uint16_t constant = (uint16_t)prev->imm;
+    *prev = (BytecodeInstr){BC_JEQI + comparison, prev->b,
+                            (uint8_t)constant, (uint8_t)(constant >> 8),
+                            next.imm};
+    return 1;
+  }
+  return 0;
+}
+
+/* Appends `instr`, or fuses it into the previous instruction.
+ *
+ * @return The index of the instruction that ended up holding it. */
+static uint32_t emit(Compiler *compiler, BytecodeOpcode opcode, int a, int b,
+                     int c, int32_t imm) {
+  BytecodeFunction *function = compiler->function;
+  BytecodeInstr instr = {(uint8_t)opcode, (uint8_t)a, (uint8_t)b, (uint8_t)c,
+                         imm};
+  if (function->code_count > compiler->barrier) {
+    BytecodeInstr *prev = &function->code[function->code_count - 1];
+    BytecodeOpcode before = prev->opcode;
+    if (fuse(compiler, prev, instr)) {
+      compiler->module->superinstructions += prev->opcode != before;
+      return function->code_count - 1;
+    }
+  }
+  if (function->code_count == function->code_capacity) {
+    function->code = grow(function->code, sizeof(BytecodeInstr),
+                          &function->code_capacity, 64);
+  }
+  function->code[function->code_count] = instr;
+  return function->code_count++;
+}
+
+/* Points the jump at `index` to the next instruction. Jumps are relative. */
+static void bind_jump(Compiler *compiler, uint32_t index) {
+  BytecodeFunction *function = compiler->function;
+  function->code[index].imm = (int32_t)(function->code_count - index);
+  compiler->barrier = function->code_count;
+}
+
+static int new_register(Compiler *compiler, Token *token) {
+  if (compiler->next_register >= BYTECODE_MAX_REGISTERS) {
+    compile_error(compiler, token,
+                  "expression needs more registers than the bytecode has");
+    return 0;
+  }
+  int reg = compiler->next_register++;
+  if (compiler->next_register > compiler->function->register_count) {
+    compiler->function->register_count = compiler->next_register;
+  }
+  return reg;
+}
+
+static int is_global(const Symbol *symbol) { return symbol->scope_depth == 0; }
+
+static int has_assignment(const ASTNode_t *node) {
+  if (node->type == AST_ASSIGN_EXPR) {
+    return 1;
+  }
+  for (int i = 0; i < node->child_count; i++) {
+    if (has_assignment(node->children[i])) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static BytecodeOpcode binary_opcode(TokenType op) {
+  switch (op) {
+  case TOKEN_EQ:
+    return BC_EQ;
+  case TOKEN_NEQ:
+    return BC_NE;
+  case TOKEN_LT:
+    return BC_LT;
+  case TOKEN_LTE:
+    return BC_LE;
+  case TOKEN_GT:
+    return BC_GT;
+  case TOKEN_GTE:
+    return BC_GE;
+  case TOKEN_PLUS:
+    return BC_ADD;
+  case TOKEN_MINUS:
+    return BC_SUB;
+  case TOKEN_STAR:
+    return BC_MUL;
+  case TOKEN_SLASH:
+    return BC_DIV;
+  default:
+    return BC_MOD;
+  }
+}
+
+static int compile_expression(Compiler *compiler, ASTNode_t *node);
+
+static int compile_call(Compiler *compiler, ASTNode_t *node) {
+  ASTNode_t *ident = node->children[0];
+  ASTNode_t *args = node->children[1];
+  int callee = compiler->function_indices[ident->token->intern_id];
+  if (callee < 0) {
+    compile_error(compiler, ident->token, "undefined reference to function");
+  }
+
+  // Arguments go into consecutive temporaries, above which the callee's
+  // registers overlap ours
+  int base = compiler->next_register;
+  for (int i = 0; i < args->child_count; i++) {
+    compiler->next_register = base + i;
+    int reg = compile_expression(compiler, args->children[i]);
+    compiler->next_register = base + i;
+    int slot = new_register(compiler, node->token);
+    if (reg != slot) {
+      emit(compiler, BC_MOV, slot, reg, 0, 0);
+    }
+  }
+  compiler->next_register = base;
+  int dst = new_register(compiler, node->token);
+  emit(compiler, BC_CALL, dst, base, args->child_count, callee);
+  return dst;
+}
+
+static int compile_expression(Compiler *compiler, ASTNode_t *node) {
+  int saved = compiler->next_register;
+  switch (node->type) {
+  case AST_INT_LITERAL: {
+    int dst = new_register(compiler, node->token);
+    emit(compiler, BC_LOADI, dst, 0, 0,
+         (int32_t)strtoll(node->token->lexeme, NULL, 10));
+    return dst;
+  }
+  case AST_CHAR_LITERAL: {
+    int dst = new_register(compiler, node->token);
+    emit(compiler, BC_LOADI, dst, 0, 0, (signed char)node->token->lexeme[0]);
+    return dst;
+  }
+  case AST_IDENTIFIER: {
+    Symbol *symbol = node->symbol;
+    if (!is_global(symbol)) {
+      return symbol->bytecode_slot;
+    }
+    int dst = new_register(compiler, node->token);
+    emit(compiler, BC_LOADG, dst, 0, 0, symbol->bytecode_slot);
+    return dst;
+  }
+  case AST_ADDITION_EXPR:
+  case AST_MULTIPLICATION_EXPR:
+  case AST_RELATIONAL_EXPR:
+  case AST_EQUALITY_EXPR: {
+    int left = compile_expression(compiler, node->children[0]);
+    if (!is_temporary(compiler, left) && has_assignment(node->children[1])) {
+      // The right operand may overwrite the local read on the left
+      int copy = new_register(compiler, node->token);
+      emit(compiler, BC_MOV, copy, left, 0, 0);
+      left = copy;
+    }
+    int right = compile_expression(compiler, node->children[1]);
+    compiler->next_register = saved;
+    int dst = new_register(compiler, node->token);
+    emit(compiler, binary_opcode(node->token->type), dst, left, right, 0);
+    return dst;
+  }
+  case AST_ASSIGN_EXPR: {
+    Symbol *symbol = node->children[0]->symbol;
+    int value = compile_expression(compiler, node->children[1]);
+    if (is_global(symbol)) {
+      emit(compiler, BC_STOREG, 0, value, 0, symbol->bytecode_slot);
+      return value;
+    }
+    compiler->next_register = saved;
+    if (value != symbol->bytecode_slot) {
+      emit(compiler, BC_MOV, symbol->bytecode_slot, value, 0, 0);
+    }
+    return symbol->bytecode_slot;
+  }
+  case AST_CALL_EXPR:
+    return compile_call(compiler, node);
+  case AST_FLOAT_LITERAL:
+    compile_error(compiler, node->token,
+                  "floating point values are not supported by the bytecode");
+    return 0;
+  default:
+    compile_error(compiler, node->token,
+                  "expression is not supported by the bytecode");
+    return 0;
+  }
+}
+
+static void compile_statement(Compiler *compiler, ASTNode_t *node) {
+  int saved = compiler->next_register;
+  switch (node->type) {
+  case AST_COMPOUND_STMT:
+    for (int i = 0; i < node->child_count; i++) {
+      compile_statement(compiler, node->children[i]);
+    }
+    return;
+  case AST_DECL: {
+    Symbol *symbol = node->children[1]->symbol;
+    symbol->bytecode_slot = compiler->next_local++;
+    if (node->child_count > 2) {
+      int value = compile_expression(compiler, node->children[2]);
+      if (value != symbol->bytecode_slot) {
+        emit(compiler, BC_MOV, symbol->bytecode_slot, value, 0, 0);
+      }
+    }
+    break;
+  }
+  case AST_IF_STMT: {
+    int condition = compile_expression(compiler, node->children[0]);
+    compiler->next_register = saved;
+    uint32_t skip_then = emit(compiler, BC_JZ, 0, condition, 0, 0);
+    compile_statement(compiler, node->children[1]);
+    if (node->child_count > 2) {
+      uint32_t skip_else = emit(compiler, BC_JMP, 0, 0, 0, 0);
+      bind_jump(compiler, skip_then);
+      compile_statement(compiler, node->children[2]);
+      bind_jump(compiler, skip_else);
+    } else {
+      bind_jump(compiler, skip_then);
+    }
+    break;
+  }
+  case AST_WHILE_STMT: {
+    uint32_t start = compiler->function->code_count;
+    compiler->barrier = start; // The loop jumps back here
+    int condition = compile_expression(compiler, node->children[0]);
+    compiler->next_register = saved;
+    uint32_t exit = emit(compiler, BC_JZ, 0, condition, 0, 0);
+    compile_statement(compiler, node->children[1]);
+    uint32_t back = emit(compiler, BC_JMP, 0, 0, 0, 0);
+    compiler->function->code[back].imm = (int32_t)start - (int32_t)back;
+    bind_jump(compiler, exit);
+    break;
+  }
+  case AST_RETURN_STMT:
+    if (node->child_count > 0) {
+      emit(compiler, BC_RET, 0, compile_expression(compiler, node->children[0]),
+           0, 0);
+    } else {
+      emit(compiler, BC_RET0, 0, 0, 0, 0);
+    }
+    break;
+  default:
+    compile_expression(compiler, node);
+    break;
+  }
+  compiler->next_register = saved;
+}
+
+static int count_declarations(const ASTNode_t *node) {
+  int count = node->type == AST_DECL;
+  for (int i = 0; i < node->child_count; i++) {
+    count += count_declarations(node->children[i]);
+  }
+  return count;
+}
+
+static void compile_function(Compiler *compiler, ASTNode_t *definition,
+                             BytecodeFunction *function) {
+  ASTNode_t *params = definition->children[2];
+  ASTNode_t *body = function_body(definition);
+  compiler->function = function;
+  compiler->local_count = params->child_count + count_declarations(body);
+  if (compiler->local_count > BYTECODE_MAX_REGISTERS) {
+    compile_error(compiler, definition->children[1]->token,
+                  "function has more locals than the bytecode has registers");
+    return;
+  }
+  compiler->next_local = 0;
+  compiler->next_register = compiler->local_count;
+  compiler->barrier = 0;
+  function->register_count = compiler->local_count;
+
+  for (int i = 0; i < params->child_count; i++) {
+    params->children[i]->children[1]->symbol->bytecode_slot =
+        compiler->next_local++;
+  }
+  compile_statement(compiler, body);
+  // Falling off the end returns zero, as in the IR
+  emit(compiler, BC_RET0, 0, 0, 0, 0);
+}
+
+static void compile_global(Compiler *compiler, ASTNode_t *declaration) {
+  BytecodeModule *module = compiler->module;
+  ASTNode_t *ident = declaration->children[1];
+  int64_t value = 0;
+  if (declaration->child_count > 2 &&
+      !evaluate_constant(declaration->children[2], &value)) {
+    compile_error(compiler, ident->token,
+                  "initializer element is not an integer constant");
+  }
+  if (ident->symbol->bytecode_slot >= 0) {
+    // A tentative definition came first
+    if (declaration->child_count > 2) {
+      module->globals[ident->symbol->bytecode_slot] = (int32_t)value;
+    }
+    return;
+  }
+  if (module->global_count == module->global_capacity) {
+    module->globals = grow(module->globals, sizeof(int32_t),
+                           &module->global_capacity, 8);
+  }
+  ident->symbol->bytecode_slot = module->global_count;
+  module->globals[module->global_count++] = (int32_t)value;
+}
+
+/**
+ * @brief Compiles every function definition and global variable of a
+ * resolved, type-checked translation unit into `module`.
+ *
+ * @return The number of errors reported.
+ */
+int compile_bytecode(ASTNode_t *ast, BytecodeModule *module) {
+  memset(module, 0, sizeof(BytecodeModule));
+  module->main_index = -1;
+
+  Compiler compiler = {.module = module};
+  unsigned int name_count = intern_count();
+  compiler.function_indices = allocate(name_count + 1, sizeof(int));
+  for (unsigned int i = 0; i <= name_count; i++) {
+    compiler.function_indices[i] = -1;
+  }
+
+  // Calls may precede the definition of their callee
+  for (int i = 0; i < ast->child_count; i++) {
+    ASTNode_t *node = ast->children[i];
+    if (node->type != AST_FUNCTION_DEF) {
+      continue;
+    }
+    if (module->function_count == module->function_capacity) {
+      module->functions = grow(module->functions, sizeof(BytecodeFunction),
+                               &module->function_capacity, 8);
+    }
+    Token *name = node->children[1]->token;
+    BytecodeFunction *function = &module->functions[module->function_count];
+    memset(function, 0, sizeof(BytecodeFunction));
+    function->name = name->lexeme;
+    function->name_id = name->intern_id;
+    function->param_count = node->children[2]->child_count;
+    compiler.function_indices[name->intern_id] = module->function_count;
+    if (strcmp(name->lexeme, "main") == 0) {
+      module->main_index = module->function_count;
+    }
+    module->function_count++;
+  }
+
+  int index = 0;
+  for (int i = 0; i < ast->child_count; i++) {
+    ASTNode_t *node = ast->children[i];
+    if (node->type == AST_FUNCTION_DEF) {
+      compile_function(&compiler, node, &module->functions[index++]);
+    } else if (node->type == AST_DECL) {
+      compile_global(&compiler, node);
+    }
+  }
+
+  free(compiler.function_indices);
+  return compiler.errors;
+}
+
+void bytecode_module_free(BytecodeModule *module) {
+  for (int i = 0; i < module->function_count; i++) {
+    free(module->functions[i].code);
+  }
+  free(module->functions);
+  free(module->globals);
+}
+
+static void dump_instr(FILE *out, const BytecodeModule *module,
+                       const BytecodeInstr *instr, uint32_t index) {
+  BytecodeOpcode opcode = instr->opcode;
+  fprintf(out, "  %4u: %-6s ", index, bytecode_opcode_names[opcode]);
+  switch (opcode) {
+  case BC_MOV:
+    fprintf(out, "r%u, r%u\n", instr->a, instr->b);
+    break;
+  case BC_LOADI:
+  case BC_LOADG:
+    fprintf(out, "r%u, %s%d\n", instr->a, opcode == BC_LOADG ? "@" : "",
+            instr->imm);
+    break;
+  case BC_STOREG:
+    fprintf(out, "@%d, r%u\n", instr->imm, instr->b);
+    break;
+  case BC_JMP:
+    fprintf(out, "%u\n", index + instr->imm);
+    break;
+  case BC_JZ:
+    fprintf(out, "r%u, %u\n", instr->b, index + instr->imm);
+    break;
+  case BC_CALL:
+    fprintf(out, "r%u, %s(r%u..+%u)\n", instr->a,
+            module->functions[instr->imm].name, instr->b, instr->c);
+    break;
+  case BC_RET:
+    fprintf(out, "r%u\n", instr->b);
+    break;
+  case BC_RET0:
+    fprintf(out, "\n");
+    break;
+  default:
+    if (opcode >= BC_JEQI) {
+      fprintf(out, "r%u, %d, %u\n", instr->a, BYTECODE_SHORT(instr),
+              index + instr->imm);
+    } else if (opcode >= BC_JEQ) {
+      fprintf(out, "r%u, r%u, %u\n", instr->b, instr->c, index + instr->imm);
+    } else if (opcode >= BC_ADDI) {
+      fprintf(out, "r%u, r%u, %d\n", instr->a, instr->b, instr->imm);
+    } else {
+      fprintf(out, "r%u, r%u, r%u\n", instr->a, instr->b, instr->c);
+    }
+    break;
+  }
+}
+
+void dump_bytecode(FILE *out, const BytecodeModule *module) {
+  for (int i = 0; i < module->global_count; i++) {
+    fprintf(out, "global @%d = %d\n", i, module->globals[i]);
+  }
+  for (int f = 0; f < module->function_count; f++) {
+    const BytecodeFunction *function = &module->functions[f];
+    fprintf(out, "function %s: %d params, %d registers\n", function->name,
+            function->param_count, function->register_count);
+    for (uint32_t i = 0; i < function->code_count; i++) {
+      dump_instr(out, module, &function->code[i], i);
+    }
+  }
+  fprintf(out, "%llu superinstructions\n",
+          (unsigned long long)module->superinstructions);
+}
@@ -0,0 +1,659 @@
+#include "codegen.h"
+#include "frame.h"
+#include "intern.h"
+#include "isel.h"
+#include "liveness.h"
+#include "machine.h"
+#include "regalloc.h"
+#include "util.h"
+#include <stdlib.h>
+
+/*
+ * Code generation from SSA IR into machine code, one selected tree at a time.
+ * Values are 32-bit ints and live where the register allocator put them;
+ * spilled values are loaded into and stored from scratch registers outside
+ * the general class.
+ *
+ * The frame is laid out by layout_frame. Without a frame pointer, slots are
+ * addressed from rsp, so every push and pop after the prologue is counted in
+ * `stack_depth`.
+ */
+
+#define SCRATCH_0 REG_R10
+#define SCRATCH_1 REG_R11
+
+typedef struct {
+  Assembler *a; // Owns the labels
+  MachineList *list;
+  const IRFunction *function;
+  Selection selection;
+  RegisterAllocation allocation;
+  FrameLayout frame;
+  int32_t stack_depth; // Bytes pushed below the spill area
+  uint32_t *block_labels;
+} Generator;
+
+/* Addresses `offset` bytes above the bottom of the spill area. */
+static Memory frame_address(const Generator *g, int32_t offset) {
+  if (g->frame.uses_frame_pointer) {
+    return x86_memory(REG_RBP, offset - (int32_t)(8 * g->frame.saved_count +
+                                                  g->frame.frame_size));
+  }
+  return x86_memory(REG_RSP, offset + g->stack_depth);
+}
+
+static Memory slot_address(const Generator *g, IRValue value) {
+  return frame_address(g, g->frame.slot_offsets[value]);
+}
+
+static int is_spilled(const Generator *g, IRValue value) {
+  return g->allocation.spill_slots[value] >= 0;
+}
+
+/* Returns the register holding `value`, loading it into `scratch` first if
+ * it was spilled. */
+static int load(Generator *g, IRValue value, int scratch) {
+  int reg = g->allocation.registers[value];
+  if (reg != REG_NONE) {
+    return reg;
+  }
+  if (is_spilled(g, value)) {
+    mi_mov_rm(g->list, 0, scratch, slot_address(g, value));
+  }
+  return scratch;
+}
+
+/* Returns the register the result of `value` should be computed into. */
+static int target(const Generator *g, IRValue value, int scratch) {
+  int reg = g->allocation.registers[value];
+  return reg != REG_NONE ? reg : scratch;
+}
+
+static void store(Generator *g, IRValue value, int reg) {
+  if (is_spilled(g, value)) {
+    mi_mov_mr(g->list, 0, slot_address(g, value), reg);
+  }
+}
+
+static void move(Generator *g, int dst, int src) {
+  if (dst != src) {
+    mi_mov_rr(g->list, 0, dst, src);
+  }
+}
+
+static int has_location(const Generator *g, IRValue value) {
+  return g->allocation.registers[value] != REG_NONE || is_spilled(g, value);
+}
+
+static void push_register(Generator *g, int reg) {
+  mi_push_r(g->list, reg);
+  g->stack_depth += 8;
+}
+
+static void pop_register(Generator *g, int reg) {
+  mi_pop_r(g->list, reg);
+  g->stack_depth -= 8;
+}
+
+static void adjust_stack(Generator *g, int32_t bytes) {
+  mi_alu_ri(g->list, bytes > 0 ? ALU_SUB : ALU_ADD, 1, REG_RSP,
+            bytes > 0 ? bytes : -bytes);
+  g->stack_depth += bytes;
+}
+
+static void push_value(Generator *g, IRValue value) {
+  if (g->allocation.registers[value] != REG_NONE) {
+    push_register(g, g->allocation.registers[value]);
+  } else {
+    // The address is formed before rsp moves
+    mi_push_m(g->list, slot_address(g, value));
+    g->stack_depth += 8;
+  }
+}
+
+/* Spill slots are narrower than a push, so a spilled value is popped through
+ * a scratch register. */
+static void pop_value(Generator *g, IRValue value) {
+  if (g->allocation.registers[value] != REG_NONE) {
+    pop_register(g, g->allocation.registers[value]);
+  } else {
+    pop_register(g, SCRATCH_0);
+    store(g, value, SCRATCH_0);
+  }
+}
+
+static int same_location(const Generator *g, IRValue a, IRValue b) {
+  if (g->allocation.registers[a] != REG_NONE) {
+    return g->allocation.registers[a] == g->allocation.registers[b];
+  }
+  return is_spilled(g, b) &&
+         g->frame.slot_offsets[a] == g->frame.slot_offsets[b];
+}
+
+static int phi_move_needed(const Generator *g, IRValue phi, uint32_t pred) {
+  IRValue source = ir_operand(g->function, phi, pred);
+  return has_location(g, phi) && has_location(g, source) &&
+         !same_location(g, phi, source);
+}
+
+/* Copies the phi operands for the edge from `from` into the phis of `to`.
+ * The copies happen in parallel: a single one is a plain move, several go
+ * through the stack so that cycles need no temporaries. */
+static void phi_moves(Generator *g, IRBlockId from, IRBlockId to) {
+  const IRFunction *function = g->function;
+  const IRBlock *succ = &function->blocks[to];
+  uint32_t pred = 0;
+  while (succ->preds[pred] != from) {
+    pred++;
+  }
+
+  int count = 0;
+  IRValue last = IR_NONE;
+  IRValue last_moved = IR_NONE;
+  for (IRValue phi = succ->first;
+       phi != IR_NONE && function->instrs[phi].opcode == IR_PHI;
+       phi = function->instrs[phi].next) {
+    last = phi;
+    if (phi_move_needed(g, phi, pred)) {
+      count++;
+      last_moved = phi;
+    }
+  }
+
+  if (count == 0) {
+    return;
+  }
+  if (count == 1) {
+    int reg = load(g, ir_operand(function, last_moved, pred), SCRATCH_0);
+    int dst = target(g, last_moved, SCRATCH_0);
+    move(g, dst, reg);
+    store(g, last_moved, dst);
+    return;
+  }
+  for (IRValue phi = succ->first; phi != function->instrs[last].next;
+       phi = function->instrs[phi].next) {
+    if (phi_move_needed(g, phi, pred)) {
+      push_value(g, ir_operand(function, phi, pred));
+    }
+  }
+  for (IRValue phi = last;
+       phi != IR_NONE && function->instrs[phi].opcode == IR_PHI;
+       phi = function->instrs[phi].prev) {
+    if (phi_move_needed(g, phi, pred)) {
+      pop_value(g, phi);
+    }
+  }
+}
+
+static int needs_phi_moves(const Generator *g, IRBlockId to) {
+  IRValue first = g->function->blocks[to].first;
+  return first != IR_NONE && g->function->instrs[first].opcode == IR_PHI;
+}
+
+static void emit_prologue(Generator *g) {
+  MachineList *list = g->list;
+  const IRFunction *function = g->function;
+
+  if (g->frame.uses_frame_pointer) {
+    mi_push_r(list, REG_RBP);
+    mi_mov_rr(list, 1, REG_RBP, REG_RSP);
+  }
+  for (int i = 0; i < g->frame.saved_count; i++) {
+    mi_push_r(list, g->frame.saved[i]);
+  }
+  if (g->frame.frame_size > 0) {
+    mi_alu_ri(list, ALU_SUB, 1, REG_RSP, (int32_t)g->frame.frame_size);
+  }
+  g->stack_depth = 0;
+
+  // Register parameters are shuffled through the stack, as they may be
+  // allocated to each other's argument registers
+  IRValue params[6];
+  int register_params = 0;
+  for (IRValue id = function->blocks[0].first; id != IR_NONE;
+       id = function->instrs[id].next) {
+    const IRInstr *instr = &function->instrs[id];
+    if (instr->opcode != IR_PARAM || !has_location(g, id)) {
+      continue;
+    }
+    if (instr->imm < 6) {
+      push_register(g, argument_registers[instr->imm]);
+      params[register_params++] = id;
+    } else {
+      int reg = target(g, id, SCRATCH_0);
+      mi_mov_rm(list, 0, reg,
+                frame_address(g, frame_argument_offset(&g->frame,
+                                                       (int)instr->imm)));
+      store(g, id, reg);
+    }
+  }
+  while (register_params > 0) {
+    pop_value(g, params[--register_params]);
+  }
+}
+
+static void emit_epilogue(Generator *g) {
+  MachineList *list = g->list;
+  if (g->frame.uses_frame_pointer) {
+    mi_lea(list, REG_RSP, x86_memory(REG_RBP, -8 * g->frame.saved_count));
+  } else if (g->frame.frame_size > 0) {
+    mi_alu_ri(list, ALU_ADD, 1, REG_RSP, (int32_t)g->frame.frame_size);
+  }
+  for (int i = g->frame.saved_count - 1; i >= 0; i--) {
+    mi_pop_r(list, g->frame.saved[i]);
+  }
+  if (g->frame.uses_frame_pointer) {
+    mi_pop_r(list, REG_RBP);
+  }
+  mi_ret(list);
+}
+
+static void emit_call(Generator *g, IRValue id) {
+  MachineList *list = g->list;
+  const IRInstr *instr = &g->function->instrs[id];
+  int count = instr->operand_count;
+  int stack_arguments = count > 6 ? count - 6 : 0;
+  int padding = stack_arguments % 2 ? 8 : 0;
+
+  if (padding) {
+    adjust_stack(g, padding);
+  }
+  for (int i = count - 1; i >= 6; i--) {
+    IRValue argument = ir_operand(g->function, id, i);
+    if (has_location(g, argument)) {
+      push_value(g, argument);
+    } else {
+      push_register(g, SCRATCH_0);
+    }
+  }
+  int register_arguments = count < 6 ? count : 6;
+  for (int i = 0; i < register_arguments; i++) {
+    IRValue argument = ir_operand(g->function, id, i);
+    if (has_location(g, argument)) {
+      push_value(g, argument);
+    } else {
+      push_register(g, SCRATCH_0);
+    }
+  }
+  for (int i = register_arguments - 1; i >= 0; i--) {
+    pop_register(g, argument_registers[i]);
+  }
+
+  mi_call(list, (unsigned int)instr->imm);
+  if (stack_arguments > 0 || padding) {
+    adjust_stack(g, -(8 * stack_arguments + padding));
+  }
+  if (has_location(g, id)) {
+    int dst = target(g, id, SCRATCH_0);
+    move(g, dst, REG_RAX);
+    store(g, id, dst);
+  }
+}
+
+static ConditionCode condition_codes[IR_NUM_OPCODES] = {
+    [IR_EQ] = CC_E, [IR_NE] = CC_NE, [IR_LT] = CC_L,
+    [IR_LE] = CC_LE, [IR_GT] = CC_G, [IR_GE] = CC_GE,
+};
+
+static int32_t immediate(const Generator *g, IRValue id) {
+  return (int32_t)g->function->instrs[id].imm;
+}
+
+static Memory global_operand(const Generator *g, IRValue id) {
+  return x86_global((uint32_t)g->function->instrs[id].imm);
+}
+
+/* Adds the registers, scale and displacement of an address tree to `m`.
+ * Spilled registers are loaded into the scratch registers in turn. */
+static void build_address(Generator *g, IRValue id, Nonterminal goal,
+                          Memory *m) {
+  const IselRuleInfo *rule =
+      &isel_rules[selection_rule(&g->selection, id, goal)];
+  if (rule->terminal == TERM_NONE) {
+    build_address(g, id, rule->kids[0], m);
+    return;
+  }
+  for (int k = 0; k < rule->arity; k++) {
+    IRValue operand = ir_operand(g->function, id, k);
+    switch (rule->kids[k]) {
+    case NT_REG: {
+      int used = (m->base != REG_NONE) + (m->index != REG_NONE);
+      int reg = load(g, operand, used == 0 ? SCRATCH_0 : SCRATCH_1);
+      if (rule->lhs == NT_INDEX || m->base != REG_NONE) {
+        m->index = reg;
+      } else {
+        m->base = reg;
+      }
+      break;
+    }
+    case NT_IMM: {
+      // Wraps like the 32-bit arithmetic it replaces
+      uint32_t disp = (uint32_t)m->disp;
+      uint32_t imm = (uint32_t)immediate(g, operand);
+      m->disp = (int32_t)(rule->terminal == TERM_SUB ? disp - imm : disp + imm);
+      break;
+    }
+    case NT_SCALE:
+      m->scale = (uint8_t)immediate(g, operand);
+      break;
+    default:
+      build_address(g, operand, rule->kids[k], m);
+      break;
+    }
+  }
+}
+
+/* Emits the compare of a `cond` tree and returns the condition it sets. */
+static ConditionCode emit_compare(Generator *g, IRValue id) {
+  const IRFunction *function = g->function;
+  int left = load(g, ir_operand(function, id, 0), SCRATCH_0);
+  IRValue right = ir_operand(function, id, 1);
+  switch (selection_rule(&g->selection, id, NT_COND)) {
+  case RULE_CMP_RI:
+    mi_alu_ri(g->list, ALU_CMP, 0, left, immediate(g, right));
+    break;
+  case RULE_CMP_RM:
+    mi_alu_rm(g->list, ALU_CMP, 0, left, global_operand(g, right));
+    break;
+  default:
+    mi_alu_rr(g->list, ALU_CMP, 0, left, load(g, right, SCRATCH_1));
+    break;
+  }
+  return condition_codes[function->instrs[id].opcode];
+}
+
+/* dst = left op right with both operands in registers. */
+static void emit_binary(Generator *g, IRValue id, int dst) {
+  MachineList *list = g->list;
+  const IRFunction *function = g->function;
+  IROpcode opcode = function->instrs[id].opcode;
+  int left = load(g, ir_operand(function, id, 0), SCRATCH_0);
+  int right = load(g, ir_operand(function, id, 1), SCRATCH_1);
+  if (dst == right && dst != left) {
+    if (opcode == IR_SUB) {
+      // dst = left - dst needs the right operand intact
+      move(g, SCRATCH_1, left);
+      mi_alu_rr(list, ALU_SUB, 0, SCRATCH_1, right);
+      move(g, dst, SCRATCH_1);
+      return;
+    }
+    right = left; // Commutative
+  } else {
+    move(g, dst, left);
+  }
+  if (opcode == IR_MUL) {
+    mi_imul_rr(list, 0, dst, right);
+  } else {
+    mi_alu_rr(list, opcode == IR_ADD ? ALU_ADD : ALU_SUB, 0, dst, right);
+  }
+}
+
+/* Emits the tree rooted at the value `id` into its location. */
+static void emit_value(Generator *g, IRValue id) {
+  MachineList *list = g->list;
+  const IRFunction *function = g->function;
+  IselRule rule = selection_rule(&g->selection, id, NT_REG);
+  // The operand that is a register when the other one is folded
+  int reg_side = rule == RULE_ADD_IR || rule == RULE_ADD_MR ||
+                 rule == RULE_IMUL_IR || rule == RULE_SHL_SWAPPED;
+  IRValue folded = IR_NONE;
+  int left = REG_NONE;
+  if (isel_rules[rule].terminal != TERM_NONE && isel_rules[rule].arity == 2) {
+    folded = ir_operand(function, id, !reg_side);
+  }
+  int dst = target(g, id, SCRATCH_0);
+
+  switch (rule) {
+  case RULE_MOV_RI:
+    mi_mov_ri(list, dst, immediate(g, id));
+    break;
+  case RULE_MOV_RM:
+    mi_mov_rm(list, 0, dst, global_operand(g, id));
+    break;
+  case RULE_LEA: {
+    Memory address = {REG_NONE, REG_NONE, 1, 0, 0};
+    build_address(g, id, NT_ADDR, &address);
+    mi_lea(list, dst, address);
+    break;
+  }
+  case RULE_SETCC: {
+    ConditionCode cc = emit_compare(g, id);
+    mi_setcc(list, cc, dst);
+    mi_movzx_r8(list, dst, dst);
+    break;
+  }
+  case RULE_ADD_RI:
+  case RULE_ADD_IR:
+  case RULE_SUB_RI:
+    left = load(g, ir_operand(function, id, reg_side), dst);
+    move(g, dst, left);
+    mi_alu_ri(list, rule == RULE_SUB_RI ? ALU_SUB : ALU_ADD, 0, dst,
+              immediate(g, folded));
+    break;
+  case RULE_ADD_RM:
+  case RULE_ADD_MR:
+  case RULE_SUB_RM:
+    left = load(g, ir_operand(function, id, reg_side), dst);
+    move(g, dst, left);
+    mi_alu_rm(list, rule == RULE_SUB_RM ? ALU_SUB : ALU_ADD, 0, dst,
+              global_operand(g, folded));
+    break;
+  case RULE_IMUL_RI:
+  case RULE_IMUL_IR:
+    left = load(g, ir_operand(function, id, reg_side), dst);
+    mi_imul_rri(list, 0, dst, left, immediate(g, folded));
+    break;
+  case RULE_SHL:
+  case RULE_SHL_SWAPPED:
+    left = load(g, ir_operand(function, id, reg_side), dst);
+    move(g, dst, left);
+    mi_shift_ri(list, SHIFT_SHL, 0, dst,
+                (uint8_t)__builtin_ctz((uint32_t)immediate(g, folded)));
+    break;
+  default:
+    emit_binary(g, id, dst);
+    break;
+  }
+  store(g, id, dst);
+}
+
+/* Jumps to the first successor if `cc` holds and to the second otherwise. */
+static void emit_branch(Generator *g, IRValue id, ConditionCode cc) {
+  MachineList *list = g->list;
+  const IRInstr *instr = &g->function->instrs[id];
+  const IRBlock *block = &g->function->blocks[instr->block];
+  ConditionCode inverse = (ConditionCode)(cc ^ 1); // cc and !cc are paired
+  if (!needs_phi_moves(g, block->succs[1])) {
+    mi_jcc(list, inverse, g->block_labels[block->succs[1]]);
+    phi_moves(g, instr->block, block->succs[0]);
+    mi_jmp(list, g->block_labels[block->succs[0]]);
+    return;
+  }
+  uint32_t otherwise = x86_new_label(g->a);
+  mi_jcc(list, inverse, otherwise);
+  phi_moves(g, instr->block, block->succs[0]);
+  mi_jmp(list, g->block_labels[block->succs[0]]);
+  mi_label(list, otherwise);
+  phi_moves(g, instr->block, block->succs[1]);
+  mi_jmp(list, g->block_labels[block->succs[1]]);
+}
+
+static void emit_statement(Generator *g, IRValue id) {
+  IRValue operand = ir_operand(g->function, id, 0);
+  switch (selection_rule(&g->selection, id, NT_STMT)) {
+  case RULE_STORE:
+    mi_mov_mr(g->list, 0, global_operand(g, id),
+              load(g, operand, SCRATCH_0));
+    break;
+  case RULE_BRANCH:
+    emit_branch(g, id, emit_compare(g, operand));
+    break;
+  default: {
+    int condition = load(g, operand, SCRATCH_0);
+    mi_test_rr(g->list, 0, condition, condition);
+    emit_branch(g, id, CC_NE);
+    break;
+  }
+  }
+}
+
+static void emit_instr(Generator *g, IRValue id) {
+  MachineList *list = g->list;
+  const IRFunction *function = g->function;
+  const IRInstr *instr = &function->instrs[id];
+
+  switch (instr->opcode) {
+  case IR_UNDEF:
+  case IR_PARAM:
+  case IR_PHI:
+    break;
+  case IR_DIV:
+  case IR_MOD: {
+    int left = load(g, ir_operand(function, id, 0), REG_RAX);
+    int right = load(g, ir_operand(function, id, 1), SCRATCH_1);
+    move(g, REG_RAX, left);
+    mi_sign_extend_ax(list, 0);
+    mi_idiv_r(list, 0, right);
+    int dst = target(g, id, SCRATCH_0);
+    move(g, dst, instr->opcode == IR_DIV ? REG_RAX : REG_RDX);
+    store(g, id, dst);
+    break;
+  }
+  case IR_CALL:
+    emit_call(g, id);
+    break;
+  case IR_RET:
+    if (instr->operand_count > 0) {
+      move(g, REG_RAX, load(g, ir_operand(function, id, 0), REG_RAX));
+    }
+    emit_epilogue(g);
+    break;
+  case IR_JUMP: {
+    IRBlockId succ = function->blocks[instr->block].succs[0];
+    phi_moves(g, instr->block, succ);
+    mi_jmp(list, g->block_labels[succ]);
+    break;
+  }
+  default:
+    // Everything else is covered by the selection rules
+    if (ir_has_result(instr->opcode)) {
+      emit_value(g, id);
+    } else {
+      emit_statement(g, id);
+    }
+    break;
+  }
+}
+
+static void generate_function(Assembler *a, const IRFunction *function,
+                              const CodegenOptions *options) {
+  MachineList list;
+  machine_list_init(&list);
+  Generator g = {.a = a, .list = &list, .function = function};
+  select_instructions(function, &g.selection);
+  uint32_t interval_count;
+  LiveInterval *intervals =
+      build_live_intervals(function, g.selection.roots, &interval_count);
+  allocate_registers(function, intervals, interval_count, &g.allocation);
+  layout_frame(function, intervals, interval_count, &g.allocation,
+               options->omit_frame_pointer, &g.frame);
+  free(intervals);
+
+  IRBlockId *order = allocate(function->block_count, sizeof(IRBlockId));
+  g.block_labels = allocate(function->block_count, sizeof(uint32_t));
+  uint32_t count = ir_reverse_postorder(function, order);
+  for (IRBlockId b = 0; b < function->block_count; b++) {
+    g.block_labels[b] = x86_new_label(a);
+  }
+
+  emit_prologue(&g);
+  for (uint32_t i = 0; i < count; i++) {
+    mi_label(&list, g.block_labels[order[i]]);
+    for (IRValue id = function->blocks[order[i]].first; id != IR_NONE;
+         id = function->instrs[id].next) {
+      if (selection_is_root(&g.selection, id)) {
+        emit_instr(&g, id);
+      }
+    }
+  }
+  if (options->peephole != NULL) {
+    run_peephole(&list, options->peephole);
+  }
+  machine_list_encode(&list, a);
+  machine_list_free(&list);
+
+  selection_free(&g.selection);
+  register_allocation_free(&g.allocation);
+  frame_layout_free(&g.frame);
+  free(order);
+  free(g.block_labels);
+}
+
+void machine_code_init(MachineCode *code) {
+  assembler_init(&code->assembler);
+  code->functions = NULL;
+  code->function_count = 0;
+  code->function_capacity = 0;
+}
+
+/**
+ * @brief Encodes `function` at the end of the code buffer. Its jumps are
+ * patched straight away, so the IR may be freed once this returns.
+ */
+void generate_function_code(MachineCode *code, const IRFunction *function,
+                            const CodegenOptions *options) {
+  if (code->function_count == code->function_capacity) {
+    code->functions = grow(code->functions, sizeof(CodeSymbol),
+                           &code->function_capacity, 8);
+  }
+  CodeSymbol *symbol = &code->functions[code->function_count++];
+  symbol->name = function->name;
+  symbol->name_id = function->name_id;
+  symbol->offset = (uint32_t)code->assembler.size;
+  generate_function(&code->assembler, function, options);
+  symbol->size = (uint32_t)code->assembler.size - symbol->offset;
+  x86_resolve_labels(&code->assembler);
+  // Labels never cross functions, so their ids are reused by the next one
+  code->assembler.label_count = 0;
+}
+
+/**
+ * @brief Encodes every function of `module` into one code buffer. Calls and
+ * global accesses are left as relocations.
+ */
+void generate_code(const IRModule *module, MachineCode *code,
+                   const CodegenOptions *options) {
+  machine_code_init(code);
+  for (int i = 0; i < module->function_count; i++) {
+    generate_function_code(code, module->functions[i], options);
+  }
+}
+
+void machine_code_free(MachineCode *code) {
+  assembler_free(&code->assembler);
+  free(code->functions);
+}
+
+void dump_machine_code(FILE *out, const MachineCode *code) {
+  const Assembler *a = &code->assembler;
+  for (int f = 0; f < code->function_count; f++) {
+    const CodeSymbol *symbol = &code->functions[f];
+    fprintf(out, "%s: ; offset 0x%x, %u bytes", symbol->name, symbol->offset,
+            symbol->size);
+    for (uint32_t i = 0; i < symbol->size; i++) {
+      fprintf(out, i % 16 == 0 ? "\n  %02x" : " %02x",
+              a->bytes[symbol->offset + i]);
+    }
+    fprintf(out, "\n");
+  }
+  for (uint32_t i = 0; i < a->relocation_count; i++) {
+    const Relocation *relocation = &a->relocations[i];
+    if (relocation->kind == RELOC_CALL) {
+      fprintf(out, "reloc 0x%x: call %s%+d\n", relocation->offset,
+              intern_string(relocation->symbol), relocation->addend);
+    } else {
+      fprintf(out, "reloc 0x%x: global #%u%+d\n", relocation->offset,
+              relocation->symbol, relocation->addend);
+    }
+  }
+}
@@ -0,0 +1,180 @@
+#include "dataflow.h"
+#include "bitset.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Sets up a problem over `function` with every set empty.
+ */
+void dataflow_init(DataflowProblem *problem, const IRFunction *function) {
+  uint32_t blocks = function->block_count;
+  problem->function = function;
+  problem->universe = function->instr_count;
+  problem->words = bitset_words(function->instr_count);
+  problem->gen = allocate_zeroed(blocks, sizeof(ValueSet));
+  problem->kill = allocate_zeroed(blocks, sizeof(ValueSet));
+  problem->exit_gen = allocate_zeroed(blocks, sizeof(ValueSet));
+  problem->in = allocate_zeroed(blocks, sizeof(ValueSet));
+  arena_init(&problem->arena, 0);
+  problem->scratch =
+      arena_alloc(&problem->arena, problem->words * sizeof(uint64_t));
+  problem->elements =
+      arena_alloc(&problem->arena, problem->words * 64 * sizeof(uint32_t));
+}
+
+void dataflow_free(DataflowProblem *problem) {
+  free(problem->gen);
+  free(problem->kill);
+  free(problem->exit_gen);
+  free(problem->in);
+  arena_free(&problem->arena);
+}
+
+/**
+ * @brief Copies a dense bit set into the problem's arena, as a sorted array
+ * when that takes less memory than the bit set.
+ */
+ValueSet value_set_from_bits(DataflowProblem *problem, const uint64_t *bits) {
+  ValueSet set;
+  set.count = bitset_count(bits, problem->words);
+  set.capacity = set.count;
+  set.dense = set.count >= problem->words * 2;
+  if (set.dense) {
+    set.words = arena_alloc(&problem->arena, problem->words * sizeof(uint64_t));
+    bitset_copy(set.words, bits, problem->words);
+    return set;
+  }
+
+  set.elements = arena_alloc(&problem->arena, set.count * sizeof(uint32_t));
+  uint32_t next = 0;
+  for (uint32_t w = 0; w < problem->words; w++) {
+    for (uint64_t word = bits[w]; word != 0; word &= word - 1) {
+      set.elements[next++] = w * 64 + __builtin_ctzll(word);
+    }
+  }
+  return set;
+}
+
+/* Makes `set` hold `bits`, which contain all of it, and returns whether it
+ * grew. The set keeps its storage while that is large enough: a dense set is
+ * updated in place, and a sorted array grows geometrically until it would
+ * take more memory than the bit set. */
+static int value_set_grow(DataflowProblem *problem, ValueSet *set,
+                          const uint64_t *bits) {
+  if (set->dense) {
+    return bitset_union(set->words, bits, problem->words);
+  }
+
+  uint32_t count = 0;
+  for (uint32_t w = 0; w < problem->words; w++) {
+    for (uint64_t word = bits[w]; word != 0; word &= word - 1) {
+      problem->elements[count++] = w * 64 + __builtin_ctzll(word);
+    }
+  }
+  if (count == set->count) {
+    return 0;
+  }
+  set->count = count;
+  if (count >= problem->words * 2) {
+    set->dense = 1;
+    set->words = arena_alloc(&problem->arena, problem->words * sizeof(uint64_t));
+    bitset_copy(set->words, bits, problem->words);
+    return 1;
+  }
+  if (count > set->capacity) {
+    set->capacity = count > set->capacity * 2 ? count : set->capacity * 2;
+    if (set->capacity > problem->words * 2) {
+      set->capacity = problem->words * 2;
+    }
+    set->elements =
+        arena_alloc(&problem->arena, set->capacity * sizeof(uint32_t));
+  }
+  memcpy(set->elements, problem->elements, count * sizeof(uint32_t));
+  return 1;
+}
+
+void value_set_add_to(const ValueSet *set, uint64_t *bits, uint32_t words) {
+  if (set->dense) {
+    bitset_union(bits, set->words, words);
+    return;
+  }
+  for (uint32_t i = 0; i < set->count; i++) {
+    bitset_set(bits, set->elements[i]);
+  }
+}
+
+void value_set_remove_from(const ValueSet *set, uint64_t *bits,
+                           uint32_t words) {
+  if (set->dense) {
+    bitset_difference(bits, set->words, words);
+    return;
+  }
+  for (uint32_t i = 0; i < set->count; i++) {
+    bitset_reset(bits, set->elements[i]);
+  }
+}
+
+/**
+ * @brief Computes the out set of `block` from the current in sets of its
+ * successors.
+ */
+void dataflow_out(const DataflowProblem *problem, IRBlockId block,
+                  uint64_t *out) {
+  const IRBlock *current = &problem->function->blocks[block];
+  bitset_clear(out, problem->words);
+  value_set_add_to(&problem->exit_gen[block], out, problem->words);
+  for (int s = 0; s < current->succ_count; s++) {
+    value_set_add_to(&problem->in[current->succs[s]], out, problem->words);
+  }
+}
+
+/**
+ * @brief Iterates the transfer functions of the reachable blocks to a fixed
+ * point. Pending blocks are kept in a bit set indexed by postorder number and
+ * the lowest is always taken next, so each sweep visits successors before
+ * their predecessors.
+ */
+void solve_backward(DataflowProblem *problem) {
+  const IRFunction *function = problem->function;
+  IRBlockId *order = allocate_zeroed(function->block_count, sizeof(IRBlockId));
+  uint32_t *postorder =
+      allocate_zeroed(function->block_count, sizeof(uint32_t));
+  uint32_t count = ir_reverse_postorder(function, order);
+  uint32_t pending_words = bitset_words(count);
+  uint64_t *pending = allocate_zeroed(pending_words, sizeof(uint64_t));
+
+  for (IRBlockId b = 0; b < function->block_count; b++) {
+    postorder[b] = BITSET_NONE;
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    postorder[order[i]] = count - 1 - i;
+    bitset_set(pending, count - 1 - i);
+  }
+
+  uint64_t *scratch = problem->scratch;
+  for (uint32_t next = bitset_next(pending, pending_words, 0);
+       next != BITSET_NONE; next = bitset_next(pending, pending_words, 0)) {
+    bitset_reset(pending, next);
+    IRBlockId block = order[count - 1 - next];
+
+    dataflow_out(problem, block, scratch);
+    value_set_remove_from(&problem->kill[block], scratch, problem->words);
+    value_set_add_to(&problem->gen[block], scratch, problem->words);
+    if (!value_set_grow(problem, &problem->in[block], scratch)) {
+      continue;
+    }
+
+    const IRBlock *current = &function->blocks[block];
+    for (uint32_t p = 0; p < current->pred_count; p++) {
+      if (postorder[current->preds[p]] != BITSET_NONE) {
+        bitset_set(pending, postorder[current->preds[p]]);
+      }
+    }
+  }
+
+  free(order);
+  free(postorder);
+  free(pending);
+}
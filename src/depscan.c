@@ -0,0 +1,571 @@
+#include "depscan.h"
+#include "scan.h"
+#include "util.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Dependency scanning for build systems (-M, -MD). Only preprocessor
+ * directives matter, so no line is tokenized: each line is passed over with
+ * one vector search for the bytes that can end it or start a comment or
+ * literal spanning into the next one, and only a line whose first non-blank
+ * byte is '#' is parsed, with the preprocessor's parse_directive. The
+ * directives of each file are kept in a cache shared by all threads, and are
+ * then evaluated per translation unit like the preprocessor does, following
+ * #include, #define, #undef, #ifdef, #ifndef, #if, #elif, #else and #endif
+ * and skipping guarded headers. A condition the preprocessor cannot decide
+ * is one it rejects, so the branches after it are all followed here, which
+ * can list a header the compiler would not read but never misses one. Other
+ * directives are left to the compiler to diagnose.
+ */
+
+#define MAX_INCLUDE_DEPTH 200
+#define MAX_CONDITIONAL_DEPTH 64
+#define RULE_WIDTH 78
+
+struct DependencyFile {
+  char *path; // Canonical
+  const char *source;
+  size_t mapped;
+  Arena strings; // The directives, as copy_directive leaves them
+  Directive *directives;
+  uint32_t directive_count;
+  const Directive *guard; // The #define of the macro guarding the whole
+                          // file, or NULL
+};
+
+typedef struct {
+  const char *name;
+  uint32_t length;
+  uint32_t hash;
+  int defined;
+} Macro;
+
+typedef struct {
+  const DependencyFile *file;
+  char *display; // The path as it was first found
+} Dependency;
+
+/* The state of one translation unit. */
+typedef struct {
+  DependencyCache *cache;
+  const DependencyOptions *options;
+  Macro *macros; // Open addressing by name
+  uint32_t macro_capacity;
+  uint32_t macro_count;
+  Dependency *seen; // Open addressing by file
+  uint32_t seen_capacity;
+  uint32_t seen_count;
+  char **order; // Display paths in the order first included
+  uint32_t order_capacity;
+  uint64_t guard_skips;
+  int errors;
+} Scan;
+
+static uint32_t hash_bytes(const char *bytes, size_t length) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < length; i++) {
+    hash = (hash ^ (unsigned char)bytes[i]) * 16777619u;
+  }
+  return hash;
+}
+
+static void file_error(Scan *scan, const char *path, int line,
+                       const char *message, int length, const char *detail) {
+  fprintf(stderr, "Error: %s%.*s at %s, line %d\n", message, length, detail,
+          path, line);
+  scan->errors++;
+}
+
+void dependency_cache_init(DependencyCache *cache) {
+  memset(cache, 0, sizeof(DependencyCache));
+  file_table_init(&cache->files);
+  pthread_mutex_init(&cache->lock, NULL);
+}
+
+static void free_file(DependencyFile *file) {
+  free(file->directives);
+  arena_free(&file->strings);
+  scan_unmap_file(file->source, file->mapped);
+  free(file->path);
+  free(file);
+}
+
+/* Whether [p, end) holds nothing but blanks and comments. Only lines outside
+ * every conditional are checked, to tell whether an include guard covers the
+ * whole file. */
+static int is_blank(const char *p, const char *end) {
+  for (;;) {
+    p = scan_skip_whitespace(p, end);
+    if (p == end || (p[0] == '/' && p[1] == '/')) {
+      return 1;
+    }
+    if (p[0] != '/' || p[1] != '*') {
+      return 0;
+    }
+    p = scan_find_comment_end(p + 2, end);
+    p = p == end ? end : p + 2;
+  }
+}
+
+/* Collects the directives of `file`. A line is a directive when its first
+ * non-blank byte is '#'. */
+static void scan_file(DependencyFile *file, size_t length,
+                      DependencyStats *stats) {
+  const char *p = file->source;
+  const char *end = p + length;
+  uint32_t capacity = 0;
+  int line = 1;
+  int depth = 0;
+  int text_outside = 0; // Outside every conditional
+  while (p < end) {
+    const char *start = scan_skip_whitespace(p, end);
+    int blank_lines = (int)scan_count_byte(p, start, '\n');
+    line += blank_lines;
+    stats->lines_skipped += blank_lines;
+    if (start == end) {
+      break;
+    }
+    // An unterminated comment is left to the compiler
+    const char *stop = directive_end(start, end, NULL);
+    if (*start == '#') {
+      size_t copied;
+      const char *text =
+          copy_directive(&file->strings, start + 1, stop, &copied);
+      if (file->directive_count == capacity) {
+        file->directives =
+            grow(file->directives, sizeof(Directive), &capacity, 16);
+      }
+      Directive *directive = &file->directives[file->directive_count++];
+      *directive = (Directive){.line = line};
+      parse_directive(directive, text, text + copied);
+      stats->directives++;
+      if (opens_conditional(directive->kind)) {
+        depth++;
+      } else if (directive->kind == DIRECTIVE_ENDIF && depth > 0) {
+        depth--;
+      }
+    } else {
+      stats->lines_skipped++;
+      if (depth == 0 && !text_outside && !is_blank(start, stop)) {
+        text_outside = 1;
+      }
+    }
+    line += (int)scan_count_byte(start, stop, '\n') + 1;
+    p = stop + 1;
+  }
+  int guard = find_include_guard(file->directives, file->directive_count);
+  file->guard = text_outside || guard < 0 ? NULL : &file->directives[guard];
+}
+
+/* Returns the cached file at `path`, reading and scanning it on first use,
+ * or NULL if it cannot be read. Files are scanned outside the lock; when two
+ * threads race for the same file, the second copy is dropped. */
+static DependencyFile *load_file(Scan *scan, const char *path) {
+  DependencyCache *cache = scan->cache;
+  char canonical[PATH_MAX];
+  if (realpath(path, canonical) == NULL) {
+    return NULL;
+  }
+  pthread_mutex_lock(&cache->lock);
+  DependencyFile *file = file_table_find(&cache->files, canonical);
+  pthread_mutex_unlock(&cache->lock);
+
+  if (file == NULL) {
+    size_t length;
+    size_t mapped;
+    const char *source = scan_map_file(canonical, &length, &mapped);
+    if (source == NULL) {
+      return NULL;
+    }
+    DependencyFile *scanned = allocate_zeroed(1, sizeof(DependencyFile));
+    scanned->path = duplicate(canonical);
+    scanned->source = source;
+    scanned->mapped = mapped;
+    arena_init(&scanned->strings, 0);
+    DependencyStats stats = {0};
+    scan_file(scanned, length, &stats);
+
+    pthread_mutex_lock(&cache->lock);
+    file = file_table_find(&cache->files, canonical);
+    if (file == NULL) {
+      file = scanned;
+      file_table_insert(&cache->files, file->path, file);
+      cache->stats.files_scanned++;
+      cache->stats.lines_skipped += stats.lines_skipped;
+      cache->stats.directives += stats.directives;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    if (file != scanned) {
+      free_file(scanned);
+    }
+  }
+  return file;
+}
+
+static Macro *find_macro(Scan *scan, const Directive *directive) {
+  uint32_t hash = hash_bytes(directive->operand, directive->length);
+  uint32_t mask = scan->macro_capacity - 1;
+  uint32_t index = hash & mask;
+  for (; scan->macros[index].name != NULL; index = (index + 1) & mask) {
+    Macro *macro = &scan->macros[index];
+    if (macro->hash == hash && macro->length == directive->length &&
+        memcmp(macro->name, directive->operand, directive->length) == 0) {
+      return macro;
+    }
+  }
+  return &scan->macros[index];
+}
+
+static int is_defined(Scan *scan, const Directive *directive) {
+  return find_macro(scan, directive)->defined;
+}
+
+static void set_macro(Scan *scan, const Directive *directive, int defined) {
+  Macro *macro = find_macro(scan, directive);
+  if (macro->name == NULL) {
+    if (!defined) {
+      return;
+    }
+    if ((scan->macro_count + 1) * 2 > scan->macro_capacity) {
+      Macro *old = scan->macros;
+      uint32_t old_capacity = scan->macro_capacity;
+      scan->macro_capacity *= 2;
+      scan->macros = allocate_zeroed(scan->macro_capacity, sizeof(Macro));
+      uint32_t mask = scan->macro_capacity - 1;
+      for (uint32_t i = 0; i < old_capacity; i++) {
+        if (old[i].name != NULL) {
+          uint32_t index = old[i].hash & mask;
+          while (scan->macros[index].name != NULL) {
+            index = (index + 1) & mask;
+          }
+          scan->macros[index] = old[i];
+        }
+      }
+      free(old);
+      macro = find_macro(scan, directive);
+    }
+    macro->name = directive->operand;
+    macro->length = directive->length;
+    macro->hash = hash_bytes(directive->operand, directive->length);
+    scan->macro_count++;
+  }
+  macro->defined = defined;
+}
+
+static Dependency *find_dependency(Dependency *seen, uint32_t capacity,
+                                   const DependencyFile *file) {
+  uint32_t index = (uint32_t)(((uintptr_t)file >> 4) * 2654435761u);
+  index &= capacity - 1;
+  while (seen[index].file != NULL && seen[index].file != file) {
+    index = (index + 1) & (capacity - 1);
+  }
+  return &seen[index];
+}
+
+/* Records `file` as a dependency, unless it already is one.
+ *
+ * @return The path it is known by. */
+static const char *add_dependency(Scan *scan, const DependencyFile *file,
+                                  const char *path) {
+  Dependency *dependency =
+      find_dependency(scan->seen, scan->seen_capacity, file);
+  if (dependency->file != NULL) {
+    return dependency->display;
+  }
+  if ((scan->seen_count + 1) * 2 > scan->seen_capacity) {
+    uint32_t capacity = scan->seen_capacity * 2;
+    Dependency *seen = allocate_zeroed(capacity, sizeof(Dependency));
+    for (uint32_t i = 0; i < scan->seen_capacity; i++) {
+      if (scan->seen[i].file != NULL) {
+        *find_dependency(seen, capacity, scan->seen[i].file) = scan->seen[i];
+      }
+    }
+    free(scan->seen);
+    scan->seen = seen;
+    scan->seen_capacity = capacity;
+    dependency = find_dependency(seen, capacity, file);
+  }
+  dependency->file = file;
+  dependency->display = duplicate(path);
+  if (scan->seen_count == scan->order_capacity) {
+    scan->order =
+        grow(scan->order, sizeof(char *), &scan->order_capacity, 16);
+  }
+  scan->order[scan->seen_count++] = dependency->display;
+  return dependency->display;
+}
+
+/* Finds the file named by an #include in the file known as `from`, the way
+ * the preprocessor does.
+ *
+ * @return The file, with its path in `*display`, or NULL after reporting
+ * that it was not found. */
+static const DependencyFile *include_file(Scan *scan, const char *from,
+                                          const Directive *directive,
+                                          const char **display) {
+  char path[PATH_MAX];
+  const DependencyOptions *options = scan->options;
+  const DependencyFile *file =
+      find_include(from, directive, options->include_dirs,
+                   options->include_dir_count, path)
+          ? load_file(scan, path)
+          : NULL;
+  if (file == NULL) {
+    file_error(scan, from, directive->line, "file not found: ",
+               (int)directive->length, directive->operand);
+    return NULL;
+  }
+  *display = add_dependency(scan, file, path);
+  return file;
+}
+
+/* Decides the condition of a conditional directive. */
+static Condition decide(Scan *scan, const Directive *directive) {
+  return directive_condition(directive, directive->test == TEST_DEFINED &&
+                                            is_defined(scan, directive));
+}
+
+typedef struct {
+  uint8_t enclosing_active;
+  uint8_t taken; // A branch before the current one was known to be active
+  uint8_t seen_else;
+} Conditional;
+
+static void process_file(Scan *scan, const DependencyFile *file,
+                         const char *display, int include_depth) {
+  Conditional conditionals[MAX_CONDITIONAL_DEPTH];
+  int depth = 0;
+  int active = 1;
+  for (uint32_t i = 0; i < file->directive_count; i++) {
+    const Directive *directive = &file->directives[i];
+    switch (directive->kind) {
+    case DIRECTIVE_IFDEF:
+    case DIRECTIVE_IFNDEF:
+    case DIRECTIVE_IF: {
+      if (depth == MAX_CONDITIONAL_DEPTH) {
+        file_error(scan, display, directive->line,
+                   "conditionals nested too deeply", 0, "");
+        return;
+      }
+      Condition condition = decide(scan, directive);
+      conditionals[depth++] =
+          (Conditional){active, condition == CONDITION_TRUE, 0};
+      active = active && condition != CONDITION_FALSE;
+      break;
+    }
+    case DIRECTIVE_ELIF:
+      if (depth > 0 && !conditionals[depth - 1].seen_else) {
+        Conditional *conditional = &conditionals[depth - 1];
+        // Not evaluated once a branch is taken, as it may not be valid
+        Condition condition = conditional->taken
+                                  ? CONDITION_FALSE
+                                  : decide(scan, directive);
+        active = conditional->enclosing_active && !conditional->taken &&
+                 condition != CONDITION_FALSE;
+        conditional->taken = conditional->taken || condition == CONDITION_TRUE;
+      }
+      break;
+    case DIRECTIVE_ELSE:
+      if (depth > 0 && !conditionals[depth - 1].seen_else) {
+        conditionals[depth - 1].seen_else = 1;
+        active = conditionals[depth - 1].enclosing_active &&
+                 !conditionals[depth - 1].taken;
+      }
+      break;
+    case DIRECTIVE_ENDIF:
+      if (depth > 0) {
+        active = conditionals[--depth].enclosing_active;
+      }
+      break;
+    case DIRECTIVE_DEFINE:
+    case DIRECTIVE_UNDEF:
+      if (active && directive->error == NULL) {
+        set_macro(scan, directive, directive->kind == DIRECTIVE_DEFINE);
+      }
+      break;
+    case DIRECTIVE_INCLUDE: {
+      if (!active) {
+        break;
+      }
+      if (directive->error != NULL) {
+        file_error(scan, display, directive->line, directive->error, 0, "");
+        break;
+      }
+      const char *path;
+      const DependencyFile *included =
+          include_file(scan, display, directive, &path);
+      if (included == NULL) {
+        break;
+      }
+      if (included->guard != NULL && is_defined(scan, included->guard)) {
+        scan->guard_skips++;
+        break;
+      }
+      if (include_depth == MAX_INCLUDE_DEPTH) {
+        file_error(scan, display, directive->line,
+                   "#include nested too deeply", 0, "");
+        break;
+      }
+      process_file(scan, included, path, include_depth + 1);
+      break;
+    }
+    default:
+      break;
+    }
+  }
+}
+
+/* Writes `path` escaped for Make.
+ *
+ * @return The number of bytes written. */
+static int write_path(FILE *out, const char *path) {
+  int written = 0;
+  for (; *path != '\0'; path++) {
+    if (*path == ' ' || *path == '#') {
+      fputc('\\', out);
+      written++;
+    } else if (*path == '$') {
+      fputc('$', out);
+      written++;
+    }
+    fputc(*path, out);
+    written++;
+  }
+  return written;
+}
+
+static void write_rule(FILE *out, const char *target, const Scan *scan) {
+  int column = write_path(out, target) + 1;
+  fputc(':', out);
+  for (uint32_t i = 0; i < scan->seen_count; i++) {
+    if (column + 1 + (int)strlen(scan->order[i]) > RULE_WIDTH) {
+      fputs(" \\\n", out);
+      column = 0;
+    }
+    fputc(' ', out);
+    column += 1 + write_path(out, scan->order[i]);
+  }
+  fputc('\n', out);
+  // Keeps make going when a header is deleted
+  for (uint32_t i = 1; scan->options->phony_targets && i < scan->seen_count;
+       i++) {
+    write_path(out, scan->order[i]);
+    fputs(":\n", out);
+  }
+}
+
+/* Scans one translation unit and fills in the rule of `job`.
+ *
+ * @return Nonzero if it failed. */
+static int run_job(DependencyCache *cache, const DependencyOptions *options,
+                   DependencyJob *job) {
+  Scan scan = {.cache = cache, .options = options};
+  scan.macro_capacity = 64;
+  scan.macros = allocate_zeroed(scan.macro_capacity, sizeof(Macro));
+  scan.seen_capacity = 64;
+  scan.seen = allocate_zeroed(scan.seen_capacity, sizeof(Dependency));
+
+  job->rule = NULL;
+  DependencyFile *file = load_file(&scan, job->source);
+  if (file == NULL) {
+    perror(job->source);
+    scan.errors++;
+  } else {
+    process_file(&scan, file, add_dependency(&scan, file, job->source), 0);
+  }
+  if (scan.errors == 0) {
+    FILE *out = open_memstream(&job->rule, &job->rule_length);
+    if (out == NULL) {
+      fprintf(stderr, "Memory allocation error\n");
+      exit(EXIT_FAILURE);
+    }
+    write_rule(out, job->target, &scan);
+    fclose(out);
+  }
+
+  pthread_mutex_lock(&cache->lock);
+  cache->stats.guard_skips += scan.guard_skips;
+  pthread_mutex_unlock(&cache->lock);
+  for (uint32_t i = 0; i < scan.seen_count; i++) {
+    free(scan.order[i]);
+  }
+  free(scan.order);
+  free(scan.seen);
+  free(scan.macros);
+  return scan.errors > 0;
+}
+
+typedef struct {
+  DependencyJob *jobs;
+  int job_count;
+  int next; // The first job not yet taken by a thread
+  int failures;
+  const DependencyOptions *options;
+  DependencyCache *cache;
+} Batch;
+
+static void *run_batch(void *argument) {
+  Batch *batch = argument;
+  for (;;) {
+    int job = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED);
+    if (job >= batch->job_count) {
+      return NULL;
+    }
+    if (run_job(batch->cache, batch->options, &batch->jobs[job])) {
+      __atomic_fetch_add(&batch->failures, 1, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+/**
+ * @brief Scans the translation units of `jobs` on up to `threads` threads,
+ * which take the next unscanned unit until none is left, and leaves the Make
+ * rule of each in its job. Headers are scanned once for the whole batch.
+ *
+ * @return The number of units that failed.
+ */
+int scan_dependencies(DependencyJob *jobs, int job_count,
+                      const DependencyOptions *options, int threads,
+                      DependencyCache *cache) {
+  double start = now();
+  Batch batch = {jobs, job_count, 0, 0, options, cache};
+  if (threads > job_count) {
+    threads = job_count;
+  }
+  pthread_t *workers = allocate_zeroed(threads, sizeof(pthread_t));
+  int started = 0;
+  // The calling thread is the first worker
+  while (started + 1 < threads &&
+         pthread_create(&workers[started], NULL, run_batch, &batch) == 0) {
+    started++;
+  }
+  run_batch(&batch);
+  for (int i = 0; i < started; i++) {
+    pthread_join(workers[i], NULL);
+  }
+  free(workers);
+  cache->stats.seconds += now() - start;
+  return batch.failures;
+}
+
+void dependency_cache_free(DependencyCache *cache) {
+  for (uint32_t i = 0; i < cache->files.capacity; i++) {
+    if (cache->files.slots[i].file != NULL) {
+      free_file(cache->files.slots[i].file);
+    }
+  }
+  file_table_free(&cache->files);
+  pthread_mutex_destroy(&cache->lock);
+}
+
+void print_dependency_stats(FILE *out, const DependencyStats *stats) {
+  fprintf(out,
+          "dependencies: %llu files scanned, %llu directives, %llu lines "
+          "skipped, %llu skipped by include guards in %.3f ms\n",
+          (unsigned long long)stats->files_scanned,
+          (unsigned long long)stats->directives,
+          (unsigned long long)stats->lines_skipped,
+          (unsigned long long)stats->guard_skips, stats->seconds * 1e3);
+}
@@ -0,0 +1,341 @@
+#include "elf_writer.h"
+#include "intern.h"
+#include "linker.h"
+#include "util.h"
+#include <elf.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+/*
+ * ELF64 output for x86-64 Linux, without the system assembler or linker.
+ *
+ * A relocatable object has .text, .data, a symbol table and .rela.text; the
+ * relocations left by code generation map onto R_X86_64_PLT32 for calls and
+ * R_X86_64_PC32 for globals.
+ *
+ * A static executable needs no section headers, only two loadable segments:
+ * the ELF and program headers followed by the code (read and execute), and
+ * the globals (read and write). Relocations are resolved here, and a small
+ * _start calls main and passes its result to exit_group.
+ */
+
+#define EXECUTABLE_BASE 0x400000
+#define PAGE_SIZE 0x1000
+
+enum {
+  SECTION_NULL,
+  SECTION_TEXT,
+  SECTION_DATA,
+  SECTION_SYMTAB,
+  SECTION_STRTAB,
+  SECTION_RELA_TEXT,
+  SECTION_SHSTRTAB,
+  SECTION_NOTE_STACK, // Marks the stack as not executable
+  NUM_SECTIONS,
+};
+
+typedef struct {
+  uint8_t *bytes;
+  size_t size;
+  size_t capacity;
+} Output;
+
+static size_t append(Output *out, const void *data, size_t size) {
+  while (out->size + size > out->capacity) {
+    out->capacity = out->capacity ? out->capacity * 2 : 4096;
+    out->bytes = reallocate(out->bytes, out->capacity, 1);
+  }
+  size_t offset = out->size;
+  if (data != NULL) {
+    memcpy(out->bytes + offset, data, size);
+  } else {
+    memset(out->bytes + offset, 0, size);
+  }
+  out->size += size;
+  return offset;
+}
+
+static size_t align_output(Output *out, size_t alignment) {
+  size_t padding = (alignment - out->size % alignment) % alignment;
+  append(out, NULL, padding);
+  return out->size;
+}
+
+static uint32_t add_string(Output *strings, const char *string) {
+  return (uint32_t)append(strings, string, strlen(string) + 1);
+}
+
+static int write_file(const char *path, const Output *out, int executable) {
+  FILE *file = fopen(path, "wb");
+  if (file == NULL) {
+    perror(path);
+    return 1;
+  }
+  int failed = fwrite(out->bytes, 1, out->size, file) != out->size;
+  failed |= fclose(file) != 0;
+  if (!failed && executable) {
+    failed = chmod(path, 0755) != 0;
+  }
+  if (failed) {
+    perror(path);
+  }
+  return failed;
+}
+
+static void fill_identification(Elf64_Ehdr *header) {
+  memcpy(header->e_ident, ELFMAG, SELFMAG);
+  header->e_ident[EI_CLASS] = ELFCLASS64;
+  header->e_ident[EI_DATA] = ELFDATA2LSB;
+  header->e_ident[EI_VERSION] = EV_CURRENT;
+  header->e_ident[EI_OSABI] = ELFOSABI_SYSV;
+  header->e_machine = EM_X86_64;
+  header->e_version = EV_CURRENT;
+  header->e_ehsize = sizeof(Elf64_Ehdr);
+}
+
+static void add_section(Elf64_Shdr *sections, int index, uint32_t name,
+                        uint32_t type, uint64_t flags, size_t offset,
+                        size_t size, size_t alignment) {
+  Elf64_Shdr *section = &sections[index];
+  section->sh_name = name;
+  section->sh_type = type;
+  section->sh_flags = flags;
+  section->sh_offset = offset;
+  section->sh_size = size;
+  section->sh_addralign = alignment;
+}
+
+/**
+ * @brief Writes the module as an ELF64 relocatable object.
+ *
+ * @return Nonzero on failure.
+ */
+int write_object_file(const char *path, const IRModule *module,
+                      const MachineCode *code) {
+  const Assembler *a = &code->assembler;
+  Output strings = {0}, symbols = {0}, relocations = {0}, section_names = {0};
+  add_string(&strings, "");
+  add_string(&section_names, "");
+
+  // Locals first: the null symbol and one per section with contents
+  Elf64_Sym symbol = {0};
+  append(&symbols, &symbol, sizeof(symbol));
+  symbol.st_info = ELF64_ST_INFO(STB_LOCAL, STT_SECTION);
+  symbol.st_shndx = SECTION_TEXT;
+  append(&symbols, &symbol, sizeof(symbol));
+  symbol.st_shndx = SECTION_DATA;
+  append(&symbols, &symbol, sizeof(symbol));
+  uint32_t first_global = 3;
+
+  unsigned int name_count = intern_count();
+  uint32_t *symbol_of_name = allocate_zeroed(name_count, sizeof(uint32_t));
+  uint32_t next_symbol = first_global;
+  for (int i = 0; i < code->function_count; i++) {
+    const CodeSymbol *function = &code->functions[i];
+    symbol = (Elf64_Sym){
+        .st_name = add_string(&strings, function->name),
+        .st_info = ELF64_ST_INFO(STB_GLOBAL, STT_FUNC),
+        .st_shndx = SECTION_TEXT,
+        .st_value = function->offset,
+        .st_size = function->size,
+    };
+    append(&symbols, &symbol, sizeof(symbol));
+    symbol_of_name[function->name_id] = next_symbol++;
+  }
+  uint32_t first_variable = next_symbol;
+  for (int i = 0; i < module->global_count; i++) {
+    symbol = (Elf64_Sym){
+        .st_name = add_string(&strings, module->globals[i].name),
+        .st_info = ELF64_ST_INFO(STB_GLOBAL, STT_OBJECT),
+        .st_shndx = SECTION_DATA,
+        .st_value = 4 * (uint64_t)i,
+        .st_size = 4,
+    };
+    append(&symbols, &symbol, sizeof(symbol));
+    next_symbol++;
+  }
+
+  for (uint32_t i = 0; i < a->relocation_count; i++) {
+    const Relocation *relocation = &a->relocations[i];
+    uint32_t target;
+    uint32_t type;
+    if (relocation->kind == RELOC_GLOBAL) {
+      target = first_variable + relocation->symbol;
+      type = R_X86_64_PC32;
+    } else {
+      if (symbol_of_name[relocation->symbol] == 0) {
+        // Declared but not defined here
+        symbol = (Elf64_Sym){
+            .st_name = add_string(&strings, intern_string(relocation->symbol)),
+            .st_info = ELF64_ST_INFO(STB_GLOBAL, STT_NOTYPE),
+            .st_shndx = SHN_UNDEF,
+        };
+        append(&symbols, &symbol, sizeof(symbol));
+        symbol_of_name[relocation->symbol] = next_symbol++;
+      }
+      target = symbol_of_name[relocation->symbol];
+      type = R_X86_64_PLT32;
+    }
+    Elf64_Rela rela = {
+        .r_offset = relocation->offset,
+        .r_info = ELF64_R_INFO(target, type),
+        .r_addend = relocation->addend,
+    };
+    append(&relocations, &rela, sizeof(rela));
+  }
+  free(symbol_of_name);
+
+  Output file = {0};
+  Elf64_Shdr sections[NUM_SECTIONS] = {0};
+  append(&file, NULL, sizeof(Elf64_Ehdr));
+
+  size_t offset = align_output(&file, 16);
+  append(&file, a->bytes, a->size);
+  add_section(sections, SECTION_TEXT, add_string(&section_names, ".text"),
+              SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, offset, a->size, 16);
+
+  offset = align_output(&file, 4);
+  append(&file, NULL, data_size(module));
+  build_data(module, file.bytes + offset);
+  add_section(sections, SECTION_DATA, add_string(&section_names, ".data"),
+              SHT_PROGBITS, SHF_ALLOC | SHF_WRITE, offset, data_size(module), 4);
+
+  offset = align_output(&file, 8);
+  append(&file, symbols.bytes, symbols.size);
+  add_section(sections, SECTION_SYMTAB, add_string(&section_names, ".symtab"),
+              SHT_SYMTAB, 0, offset, symbols.size, 8);
+  sections[SECTION_SYMTAB].sh_link = SECTION_STRTAB;
+  sections[SECTION_SYMTAB].sh_info = first_global;
+  sections[SECTION_SYMTAB].sh_entsize = sizeof(Elf64_Sym);
+
+  offset = append(&file, strings.bytes, strings.size);
+  add_section(sections, SECTION_STRTAB, add_string(&section_names, ".strtab"),
+              SHT_STRTAB, 0, offset, strings.size, 1);
+
+  offset = align_output(&file, 8);
+  append(&file, relocations.bytes, relocations.size);
+  add_section(sections, SECTION_RELA_TEXT,
+              add_string(&section_names, ".rela.text"), SHT_RELA,
+              SHF_INFO_LINK, offset, relocations.size, 8);
+  sections[SECTION_RELA_TEXT].sh_link = SECTION_SYMTAB;
+  sections[SECTION_RELA_TEXT].sh_info = SECTION_TEXT;
+  sections[SECTION_RELA_TEXT].sh_entsize = sizeof(Elf64_Rela);
+
+  add_section(sections, SECTION_NOTE_STACK,
+              add_string(&section_names, ".note.GNU-stack"), SHT_PROGBITS, 0,
+              file.size, 0, 1);
+  uint32_t shstrtab_name = add_string(&section_names, ".shstrtab");
+  offset = append(&file, section_names.bytes, section_names.size);
+  add_section(sections, SECTION_SHSTRTAB, shstrtab_name, SHT_STRTAB, 0, offset,
+              section_names.size, 1);
+
+  Elf64_Ehdr header = {0};
+  fill_identification(&header);
+  header.e_type = ET_REL;
+  header.e_shoff = align_output(&file, 8);
+  header.e_shentsize = sizeof(Elf64_Shdr);
+  header.e_shnum = NUM_SECTIONS;
+  header.e_shstrndx = SECTION_SHSTRTAB;
+  append(&file, sections, sizeof(sections));
+  memcpy(file.bytes, &header, sizeof(header));
+
+  int failed = write_file(path, &file, 0);
+  free(strings.bytes);
+  free(symbols.bytes);
+  free(relocations.bytes);
+  free(section_names.bytes);
+  free(file.bytes);
+  return failed;
+}
+
+/* Appends _start to the code and returns its offset. The kernel leaves argc
+ * at the top of the 16-byte aligned stack, followed by argv. */
+static uint32_t emit_start(Assembler *a, unsigned int main_id) {
+  uint32_t start = (uint32_t)a->size;
+  x86_alu_rr(a, ALU_XOR, 0, REG_RBP, REG_RBP);
+  x86_mov_rm(a, 1, REG_RDI, x86_memory(REG_RSP, 0));
+  x86_lea(a, REG_RSI, x86_memory(REG_RSP, 8));
+  x86_call(a, main_id);
+  x86_mov_rr(a, 0, REG_RDI, REG_RAX);
+  x86_mov_ri(a, REG_RAX, 231); // exit_group
+  x86_syscall(a);
+  return start;
+}
+
+/**
+ * @brief Links the module into a static executable whose entry point runs
+ * main.
+ *
+ * @return Nonzero on failure.
+ */
+int write_executable(const char *path, const IRModule *module,
+                     MachineCode *code) {
+  int main_index = find_function(code, "main");
+  if (main_index < 0) {
+    fprintf(stderr, "Error: no main function\n");
+    return 1;
+  }
+  Assembler *a = &code->assembler;
+  uint32_t start = emit_start(a, code->functions[main_index].name_id);
+
+  int segment_count = module->global_count > 0 ? 2 : 1;
+  size_t text_offset = sizeof(Elf64_Ehdr) + 2 * sizeof(Elf64_Phdr);
+  size_t text_end = text_offset + a->size;
+  size_t data_offset = (text_end + 15) & ~(size_t)15;
+  // The data segment starts on a fresh page, at the same offset within the
+  // page as in the file
+  uint64_t text_pages_end =
+      (EXECUTABLE_BASE + text_end + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+  uint64_t data_address = text_pages_end + data_offset % PAGE_SIZE;
+
+  Output file = {0};
+  append(&file, NULL, text_offset);
+  append(&file, a->bytes, a->size);
+  if (apply_relocations(code, file.bytes + text_offset,
+                        EXECUTABLE_BASE + text_offset, data_address) > 0) {
+    free(file.bytes);
+    return 1;
+  }
+  align_output(&file, 16);
+  append(&file, NULL, data_size(module));
+  build_data(module, file.bytes + data_offset);
+
+  Elf64_Ehdr header = {0};
+  fill_identification(&header);
+  header.e_type = ET_EXEC;
+  header.e_entry = EXECUTABLE_BASE + text_offset + start;
+  header.e_phoff = sizeof(Elf64_Ehdr);
+  header.e_phentsize = sizeof(Elf64_Phdr);
+  header.e_phnum = segment_count;
+  memcpy(file.bytes, &header, sizeof(header));
+
+  Elf64_Phdr segments[2] = {
+      {
+          .p_type = PT_LOAD,
+          .p_flags = PF_R | PF_X,
+          .p_offset = 0,
+          .p_vaddr = EXECUTABLE_BASE,
+          .p_paddr = EXECUTABLE_BASE,
+          .p_filesz = text_end,
+          .p_memsz = text_end,
+          .p_align = PAGE_SIZE,
+      },
+      {
+          .p_type = PT_LOAD,
+          .p_flags = PF_R | PF_W,
+          .p_offset = data_offset,
+          .p_vaddr = data_address,
+          .p_paddr = data_address,
+          .p_filesz = data_size(module),
+          .p_memsz = data_size(module),
+          .p_align = PAGE_SIZE,
+      },
+  };
+  memcpy(file.bytes + sizeof(Elf64_Ehdr), segments, sizeof(segments));
+
+  int failed = write_file(path, &file, 1);
+  free(file.bytes);
+  return failed;
+}
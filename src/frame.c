@@ -0,0 +1,138 @@
+#include "frame.h"
+#include "util.h"
+#include <stdlib.h>
+
+/*
+ * Frame layout. Spilled values whose live intervals do not overlap share a
+ * slot: the intervals form an interval graph, which a greedy pass in order
+ * of start position colors with as many slots as the most intervals live at
+ * one point. Slots whose last interval ended are kept in a min-heap keyed on
+ * that end.
+ */
+
+typedef struct {
+  uint32_t end;
+  uint32_t slot;
+} Occupied;
+
+static void heap_push(Occupied *heap, uint32_t *count, Occupied item) {
+  uint32_t i = (*count)++;
+  while (i > 0 && heap[(i - 1) / 2].end > item.end) {
+    heap[i] = heap[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  heap[i] = item;
+}
+
+static Occupied heap_pop(Occupied *heap, uint32_t *count) {
+  Occupied top = heap[0];
+  Occupied last = heap[--*count];
+  uint32_t i = 0;
+  for (;;) {
+    uint32_t child = 2 * i + 1;
+    if (child >= *count) {
+      break;
+    }
+    if (child + 1 < *count && heap[child + 1].end < heap[child].end) {
+      child++;
+    }
+    if (heap[child].end >= last.end) {
+      break;
+    }
+    heap[i] = heap[child];
+    i = child;
+  }
+  heap[i] = last;
+  return top;
+}
+
+static int makes_calls(const IRFunction *function) {
+  for (IRBlockId b = 0; b < function->block_count; b++) {
+    if (function->blocks[b].dead) {
+      continue;
+    }
+    for (IRValue id = function->blocks[b].first; id != IR_NONE;
+         id = function->instrs[id].next) {
+      if (function->instrs[id].opcode == IR_CALL) {
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Shares spill slots between values with disjoint lifetimes and lays
+ * out the frame. `intervals` must be sorted by start, as allocate_registers
+ * leaves them.
+ */
+void layout_frame(const IRFunction *function, const LiveInterval *intervals,
+                  uint32_t count, const RegisterAllocation *allocation,
+                  int omit_frame_pointer, FrameLayout *frame) {
+  frame->slot_offsets = allocate(function->instr_count, sizeof(int32_t));
+  for (IRValue id = 0; id < function->instr_count; id++) {
+    frame->slot_offsets[id] = -1;
+  }
+
+  Occupied *occupied = allocate(allocation->spill_slot_count, sizeof(Occupied));
+  uint32_t *free_slots = allocate(allocation->spill_slot_count, sizeof(uint32_t));
+  uint32_t occupied_count = 0, free_count = 0;
+  frame->slot_count = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    const LiveInterval *interval = &intervals[i];
+    if (allocation->spill_slots[interval->value] < 0) {
+      continue;
+    }
+    while (occupied_count > 0 && occupied[0].end < interval->start) {
+      free_slots[free_count++] = heap_pop(occupied, &occupied_count).slot;
+    }
+    uint32_t slot = free_count > 0 ? free_slots[--free_count]
+                                   : frame->slot_count++;
+    heap_push(occupied, &occupied_count, (Occupied){interval->end, slot});
+    frame->slot_offsets[interval->value] = (int32_t)(slot * SPILL_SLOT_SIZE);
+  }
+  free(occupied);
+  free(free_slots);
+
+  frame->saved_count = 0;
+  for (int reg = 0; reg < NUM_REGISTERS; reg++) {
+    if (allocation->callee_saved_used & REGISTER_BIT(reg)) {
+      frame->saved[frame->saved_count++] = (PhysicalRegister)reg;
+    }
+  }
+  frame->uses_frame_pointer = !omit_frame_pointer;
+
+  // Pushes stay 8-byte aligned; only calls need rsp 16-byte aligned
+  uint32_t spill_size = frame->slot_count * SPILL_SLOT_SIZE;
+  frame->frame_size = (spill_size + 7) & ~7u;
+  uint32_t pushed =
+      8 * (1 + frame->saved_count + frame->uses_frame_pointer); // With return
+  if (makes_calls(function) && (pushed + frame->frame_size) % 16 != 0) {
+    frame->frame_size += 8;
+  }
+}
+
+void frame_layout_free(FrameLayout *frame) { free(frame->slot_offsets); }
+
+/**
+ * @brief Returns the offset of stack argument `index` (from 6 up) from the
+ * bottom of the spill area.
+ */
+int32_t frame_argument_offset(const FrameLayout *frame, int index) {
+  return (int32_t)(frame->frame_size +
+                   8 * (frame->saved_count + frame->uses_frame_pointer + 1 +
+                        index - 6));
+}
+
+void dump_frame_layout(FILE *out, const IRFunction *function,
+                       const FrameLayout *frame) {
+  fprintf(out, "frame %s: %u bytes, %u spill slots, %d saved registers%s\n",
+          function->name, frame->frame_size, frame->slot_count,
+          frame->saved_count,
+          frame->uses_frame_pointer ? ", frame pointer" : "");
+  for (IRValue id = 0; id < function->instr_count; id++) {
+    if (frame->slot_offsets[id] >= 0) {
+      fprintf(out, "  v%u: [sp+%d]\n", id, frame->slot_offsets[id]);
+    }
+  }
+}
@@ -0,0 +1,125 @@
+#include "intern.h"
+#include "arena.h"
+#include "util.h"
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Identifier interning. Every distinct spelling gets a small dense id, with 0
+ * reserved for "no name", so later passes can key their tables on an integer
+ * instead of hashing and comparing strings again. Keywords are interned up
+ * front and remember their token type, which makes keyword recognition a
+ * by-product of interning.
+ */
+
+typedef struct {
+  const char *string;
+  size_t length;
+  uint32_t hash;
+  TokenType keyword;
+} InternEntry;
+
+static InternEntry *entries;
+static unsigned int entry_count;
+static uint32_t entry_capacity;
+
+static unsigned int *slots;
+static unsigned int slot_capacity;
+
+static Arena strings;
+
+static uint32_t hash_string(const char *string, size_t length) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= (unsigned char)string[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static void insert_slot(unsigned int id) {
+  unsigned int mask = slot_capacity - 1;
+  unsigned int slot = entries[id].hash & mask;
+  while (slots[slot] != 0) {
+    slot = (slot + 1) & mask;
+  }
+  slots[slot] = id;
+}
+
+static void grow_slots(void) {
+  free(slots);
+  slot_capacity = slot_capacity ? slot_capacity * 2 : 1024;
+  slots = allocate_zeroed(slot_capacity, sizeof(unsigned int));
+  for (unsigned int id = 1; id < entry_count; id++) {
+    insert_slot(id);
+  }
+}
+
+static unsigned int add_entry(const char *string, size_t length,
+                              uint32_t hash, TokenType keyword) {
+  if (entry_count == entry_capacity) {
+    entries = grow(entries, sizeof(InternEntry), &entry_capacity, 1024);
+  }
+  unsigned int id = entry_count++;
+  entries[id].string = arena_strndup(&strings, string, length);
+  entries[id].length = length;
+  entries[id].hash = hash;
+  entries[id].keyword = keyword;
+
+  // Keep the load factor at or below one half
+  if (entry_count * 2 > slot_capacity) {
+    grow_slots();
+  } else {
+    insert_slot(id);
+  }
+  return id;
+}
+
+static void init_interner(void) {
+  arena_init(&strings, 0);
+  entries = grow(entries, sizeof(InternEntry), &entry_capacity, 1024);
+  entry_count = 1; // id 0 means "no name"
+  grow_slots();
+
+  for (int type = TOKEN_INT; type <= TOKEN_RETURN; type++) {
+    char keyword[16];
+    size_t length = strlen(token_names[type]);
+    for (size_t i = 0; i < length; i++) {
+      keyword[i] = (char)tolower(token_names[type][i]);
+    }
+    add_entry(keyword, length, hash_string(keyword, length), (TokenType)type);
+  }
+}
+
+/**
+ * @brief Returns the id of the given spelling, adding it if it is new.
+ */
+unsigned int intern(const char *string, size_t length) {
+  if (entries == NULL) {
+    init_interner();
+  }
+
+  uint32_t hash = hash_string(string, length);
+  unsigned int mask = slot_capacity - 1;
+  for (unsigned int slot = hash & mask; slots[slot] != 0;
+       slot = (slot + 1) & mask) {
+    InternEntry *entry = &entries[slots[slot]];
+    if (entry->hash == hash && entry->length == length &&
+        memcmp(entry->string, string, length) == 0) {
+      return slots[slot];
+    }
+  }
+  return add_entry(string, length, hash, TOKEN_IDENTIFIER);
+}
+
+const char *intern_string(unsigned int id) { return entries[id].string; }
+
+/**
+ * @brief Returns the keyword token type for an interned spelling, or
+ * TOKEN_IDENTIFIER when it is not a keyword.
+ */
+TokenType intern_keyword(unsigned int id) { return entries[id].keyword; }
+
+unsigned int intern_count(void) { return entry_count; }
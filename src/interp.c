@@ -0,0 +1,195 @@
+#include "interp.h"
+#include "util.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Bytecode interpreter with threaded dispatch: every handler ends in its own
+ * indirect jump through the table of handler addresses (a GNU C extension),
+ * so that the branch predictor sees one jump site per opcode rather than one
+ * shared by all of them. Registers of all active calls live in one stack;
+ * a callee's registers start at the caller's argument registers.
+ */
+
+#define REGISTER_STACK_SIZE (1 << 20)
+#define CALL_STACK_SIZE (1 << 16)
+
+typedef struct {
+  const BytecodeInstr *call; // Resumes after this
+  int32_t *registers;        // Of the caller
+} Frame;
+
+/* Arithmetic wraps, as in the 32-bit machine instructions. */
+static inline int32_t wrap(uint32_t value) { return (int32_t)value; }
+
+/* Division traps in the same cases as idiv. */
+static inline int division_traps(int32_t left, int32_t right) {
+  return right == 0 || (left == INT32_MIN && right == -1);
+}
+
+/**
+ * @brief Runs the main function of `module` and stores its result in
+ * `status`.
+ *
+ * @return Nonzero if the program failed at run time.
+ */
+int interpret(const BytecodeModule *module, int *status) {
+#define COMPARE_HANDLER(name, op) [BC_##name] = &&do_##name,
+#define COMPARE_IMMEDIATE_HANDLER(name, op) [BC_##name##I] = &&do_##name##I,
+#define BRANCH_HANDLER(name, op) [BC_J##name] = &&do_J##name,
+#define BRANCH_IMMEDIATE_HANDLER(name, op) [BC_J##name##I] = &&do_J##name##I,
+  static const void *dispatch[NUM_BYTECODE_OPCODES] = {
+      [BC_MOV] = &&do_MOV,       [BC_LOADI] = &&do_LOADI,
+      [BC_LOADG] = &&do_LOADG,   [BC_STOREG] = &&do_STOREG,
+      [BC_ADD] = &&do_ADD,       [BC_SUB] = &&do_SUB,
+      [BC_MUL] = &&do_MUL,       [BC_DIV] = &&do_DIV,
+      [BC_MOD] = &&do_MOD,       [BC_JMP] = &&do_JMP,
+      [BC_JZ] = &&do_JZ,         [BC_CALL] = &&do_CALL,
+      [BC_RET] = &&do_RET,       [BC_RET0] = &&do_RET0,
+      [BC_ADDI] = &&do_ADDI,     [BC_SUBI] = &&do_SUBI,
+      [BC_MULI] = &&do_MULI,
+      BYTECODE_COMPARISONS(COMPARE_HANDLER)
+      BYTECODE_COMPARISONS(COMPARE_IMMEDIATE_HANDLER)
+      BYTECODE_COMPARISONS(BRANCH_HANDLER)
+      BYTECODE_COMPARISONS(BRANCH_IMMEDIATE_HANDLER)
+  };
+#undef COMPARE_HANDLER
+#undef COMPARE_IMMEDIATE_HANDLER
+#undef BRANCH_HANDLER
+#undef BRANCH_IMMEDIATE_HANDLER
+
+  if (module->main_index < 0) {
+    fprintf(stderr, "Error: no main function\n");
+    return 1;
+  }
+
+  int32_t *globals = allocate(module->global_count + 1, sizeof(int32_t));
+  if (module->global_count > 0) {
+    memcpy(globals, module->globals, module->global_count * sizeof(int32_t));
+  }
+  int32_t *stack = allocate(REGISTER_STACK_SIZE, sizeof(int32_t));
+  int32_t *stack_end = stack + REGISTER_STACK_SIZE;
+  Frame *frames = allocate(CALL_STACK_SIZE, sizeof(Frame));
+  int frame_count = 0;
+  int failed = 0;
+
+  const BytecodeFunction *entry = &module->functions[module->main_index];
+  int32_t *r = stack;
+  // main(argc, argv), as the executable is called
+  r[0] = 1;
+  r[1] = 0;
+  const BytecodeInstr *pc = entry->code;
+  int32_t value;
+
+#define DISPATCH() goto *dispatch[pc->opcode]
+#define NEXT()                                                                 \
+  do {                                                                         \
+    pc++;                                                                      \
+    DISPATCH();                                                                \
+  } while (0)
+
+  DISPATCH();
+
+do_MOV:
+  r[pc->a] = r[pc->b];
+  NEXT();
+do_LOADI:
+  r[pc->a] = pc->imm;
+  NEXT();
+do_LOADG:
+  r[pc->a] = globals[pc->imm];
+  NEXT();
+do_STOREG:
+  globals[pc->imm] = r[pc->b];
+  NEXT();
+do_ADD:
+  r[pc->a] = wrap((uint32_t)r[pc->b] + (uint32_t)r[pc->c]);
+  NEXT();
+do_SUB:
+  r[pc->a] = wrap((uint32_t)r[pc->b] - (uint32_t)r[pc->c]);
+  NEXT();
+do_MUL:
+  r[pc->a] = wrap((uint32_t)r[pc->b] * (uint32_t)r[pc->c]);
+  NEXT();
+do_DIV:
+  if (division_traps(r[pc->b], r[pc->c])) {
+    goto division_error;
+  }
+  r[pc->a] = r[pc->b] / r[pc->c];
+  NEXT();
+do_MOD:
+  if (division_traps(r[pc->b], r[pc->c])) {
+    goto division_error;
+  }
+  r[pc->a] = r[pc->b] % r[pc->c];
+  NEXT();
+do_ADDI:
+  r[pc->a] = wrap((uint32_t)r[pc->b] + (uint32_t)pc->imm);
+  NEXT();
+do_SUBI:
+  r[pc->a] = wrap((uint32_t)r[pc->b] - (uint32_t)pc->imm);
+  NEXT();
+do_MULI:
+  r[pc->a] = wrap((uint32_t)r[pc->b] * (uint32_t)pc->imm);
+  NEXT();
+
+#define COMPARE(name, op)                                                      \
+  do_##name : r[pc->a] = r[pc->b] op r[pc->c];                                 \
+  NEXT();                                                                      \
+  do_##name##I : r[pc->a] = r[pc->b] op pc->imm;                               \
+  NEXT();                                                                      \
+  do_J##name : pc += r[pc->b] op r[pc->c] ? pc->imm : 1;                       \
+  DISPATCH();                                                                  \
+  do_J##name##I : pc += r[pc->a] op BYTECODE_SHORT(pc) ? pc->imm : 1;          \
+  DISPATCH();
+  BYTECODE_COMPARISONS(COMPARE)
+#undef COMPARE
+
+do_JMP:
+  pc += pc->imm;
+  DISPATCH();
+do_JZ:
+  pc += r[pc->b] == 0 ? pc->imm : 1;
+  DISPATCH();
+do_CALL: {
+  const BytecodeFunction *callee = &module->functions[pc->imm];
+  int32_t *registers = r + pc->b;
+  if (frame_count == CALL_STACK_SIZE ||
+      registers + callee->register_count > stack_end) {
+    fprintf(stderr, "Error: stack overflow in %s\n", callee->name);
+    failed = 1;
+    goto done;
+  }
+  frames[frame_count++] = (Frame){pc, r};
+  r = registers;
+  pc = callee->code;
+  DISPATCH();
+}
+do_RET:
+  value = r[pc->b];
+  goto leave;
+do_RET0:
+  value = 0;
+leave:
+  if (frame_count == 0) {
+    *status = value;
+    goto done;
+  }
+  frame_count--;
+  pc = frames[frame_count].call;
+  r = frames[frame_count].registers;
+  r[pc->a] = value;
+  NEXT();
+
+#undef DISPATCH
+#undef NEXT
+
+division_error:
+  fprintf(stderr, "Error: division overflow or by zero\n");
+  failed = 1;
+done:
+  free(globals);
+  free(stack);
+  free(frames);
+  return failed;
+}
@@ -0,0 +1,517 @@
+#include "ir.h"
+#include "intern.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+const char *ir_opcode_names[IR_NUM_OPCODES] = {
+    "const", "undef", "param", "add",  "sub",   "mul", "div",  "mod",
+    "eq",    "ne",    "lt",    "le",   "gt",    "ge",  "phi",  "call",
+    "load",  "store", "ret",   "jump", "branch",
+};
+
+IRFunction *ir_function_create(const char *name, unsigned int name_id,
+                               int param_count) {
+  IRFunction *function = allocate_zeroed(1, sizeof(IRFunction));
+  function->name = name;
+  function->name_id = name_id;
+  function->param_count = param_count;
+  return function;
+}
+
+void ir_function_free(IRFunction *function) {
+  for (uint32_t i = 0; i < function->block_count; i++) {
+    free(function->blocks[i].preds);
+  }
+  free(function->blocks);
+  free(function->instrs);
+  free(function->uses);
+  free(function);
+}
+
+void ir_module_init(IRModule *module) { memset(module, 0, sizeof(IRModule)); }
+
+void ir_module_free(IRModule *module) {
+  for (int i = 0; i < module->function_count; i++) {
+    ir_function_free(module->functions[i]);
+  }
+  free(module->functions);
+  free(module->globals);
+  memset(module, 0, sizeof(IRModule));
+}
+
+void ir_module_add_function(IRModule *module, IRFunction *function) {
+  if (module->function_count == module->function_capacity) {
+    module->functions = grow(module->functions, sizeof(IRFunction *),
+                             &module->function_capacity, 8);
+  }
+  module->functions[module->function_count++] = function;
+}
+
+int ir_module_add_global(IRModule *module, const char *name,
+                         unsigned int name_id, int64_t initial_value) {
+  if (module->global_count == module->global_capacity) {
+    module->globals = grow(module->globals, sizeof(IRGlobal),
+                           &module->global_capacity, 8);
+  }
+  IRGlobal *global = &module->globals[module->global_count];
+  global->name = name;
+  global->name_id = name_id;
+  global->initial_value = initial_value;
+  return module->global_count++;
+}
+
+IRBlockId ir_add_block(IRFunction *function) {
+  if (function->block_count == function->block_capacity) {
+    function->blocks = grow(function->blocks, sizeof(IRBlock),
+                            &function->block_capacity, 8);
+  }
+  IRBlockId id = function->block_count++;
+  IRBlock *block = &function->blocks[id];
+  memset(block, 0, sizeof(IRBlock));
+  block->first = IR_NONE;
+  block->last = IR_NONE;
+  return id;
+}
+
+void ir_add_edge(IRFunction *function, IRBlockId from, IRBlockId to) {
+  IRBlock *source = &function->blocks[from];
+  source->succs[source->succ_count++] = to;
+
+  IRBlock *target = &function->blocks[to];
+  if (target->pred_count == target->pred_capacity) {
+    target->preds = grow(target->preds, sizeof(IRBlockId),
+                         &target->pred_capacity, 2);
+  }
+  target->preds[target->pred_count++] = from;
+}
+
+static void link_use(IRFunction *function, uint32_t slot, IRValue value);
+
+/**
+ * @brief Removes the edge from `from` to its `succ_index`th successor,
+ * dropping the matching operand of every phi in the successor.
+ */
+void ir_remove_edge(IRFunction *function, IRBlockId from, int succ_index) {
+  IRBlock *source = &function->blocks[from];
+  IRBlockId to = source->succs[succ_index];
+  for (int i = succ_index; i + 1 < source->succ_count; i++) {
+    source->succs[i] = source->succs[i + 1];
+  }
+  source->succ_count--;
+
+  IRBlock *target = &function->blocks[to];
+  uint32_t pred_index = 0;
+  while (target->preds[pred_index] != from) {
+    pred_index++;
+  }
+  for (uint32_t i = pred_index; i + 1 < target->pred_count; i++) {
+    target->preds[i] = target->preds[i + 1];
+  }
+  target->pred_count--;
+
+  for (IRValue id = target->first;
+       id != IR_NONE && function->instrs[id].opcode == IR_PHI;
+       id = function->instrs[id].next) {
+    IRInstr *phi = &function->instrs[id];
+    if (pred_index >= phi->operand_count) {
+      continue; // Incomplete phi, filled in when the block is sealed
+    }
+    IRValue operands[phi->operand_count];
+    int count = 0;
+    for (int i = 0; i < phi->operand_count; i++) {
+      if ((uint32_t)i != pred_index) {
+        operands[count++] = ir_operand(function, id, i);
+      }
+    }
+    ir_set_operands(function, id, operands, count);
+  }
+}
+
+/**
+ * @brief Deletes every instruction and outgoing edge of an unreachable block
+ * and marks it dead.
+ */
+void ir_remove_block(IRFunction *function, IRBlockId block) {
+  while (function->blocks[block].succ_count > 0) {
+    ir_remove_edge(function, block, 0);
+  }
+  while (function->blocks[block].last != IR_NONE) {
+    // Any remaining user of the value is unreachable too and goes as well
+    ir_remove(function, function->blocks[block].last);
+  }
+  function->blocks[block].dead = 1;
+}
+
+static void link_use(IRFunction *function, uint32_t slot, IRValue value) {
+  IRUse *use = &function->uses[slot];
+  IRInstr *definition = &function->instrs[value];
+  use->value = value;
+  use->prev_use = IR_NONE;
+  use->next_use = definition->first_use;
+  if (definition->first_use != IR_NONE) {
+    function->uses[definition->first_use].prev_use = slot;
+  }
+  definition->first_use = slot;
+}
+
+static void unlink_use(IRFunction *function, uint32_t slot) {
+  IRUse *use = &function->uses[slot];
+  if (use->prev_use != IR_NONE) {
+    function->uses[use->prev_use].next_use = use->next_use;
+  } else {
+    function->instrs[use->value].first_use = use->next_use;
+  }
+  if (use->next_use != IR_NONE) {
+    function->uses[use->next_use].prev_use = use->prev_use;
+  }
+}
+
+/**
+ * @brief Gives `instr` a fresh run of operand slots holding `operands`.
+ *
+ * Slots are append-only, so replacing an operand list (as happens when an
+ * incomplete phi is filled in) leaves the old slots unused rather than moving
+ * other instructions' operands.
+ */
+void ir_set_operands(IRFunction *function, IRValue instr,
+                     const IRValue *operands, int operand_count) {
+  IRInstr *target = &function->instrs[instr];
+  for (int i = 0; i < target->operand_count; i++) {
+    unlink_use(function, target->operand_start + i);
+  }
+
+  while (function->use_count + operand_count > function->use_capacity) {
+    function->uses = grow(function->uses, sizeof(IRUse),
+                          &function->use_capacity, 64);
+  }
+  target->operand_start = function->use_count;
+  target->operand_count = (uint16_t)operand_count;
+  function->use_count += operand_count;
+
+  for (int i = 0; i < operand_count; i++) {
+    function->uses[target->operand_start + i].user = instr;
+    link_use(function, target->operand_start + i, operands[i]);
+  }
+}
+
+static IRValue new_instr(IRFunction *function, IRBlockId block,
+                         IROpcode opcode, int64_t imm) {
+  if (function->instr_count == function->instr_capacity) {
+    function->instrs = grow(function->instrs, sizeof(IRInstr),
+                            &function->instr_capacity, 64);
+  }
+  IRValue id = function->instr_count++;
+  IRInstr *instr = &function->instrs[id];
+  instr->opcode = opcode;
+  instr->dead = 0;
+  instr->operand_count = 0;
+  instr->block = block;
+  instr->operand_start = 0;
+  instr->first_use = IR_NONE;
+  instr->prev = IR_NONE;
+  instr->next = IR_NONE;
+  instr->imm = imm;
+  return id;
+}
+
+IRValue ir_append(IRFunction *function, IRBlockId block, IROpcode opcode,
+                  const IRValue *operands, int operand_count, int64_t imm) {
+  IRValue id = new_instr(function, block, opcode, imm);
+  ir_set_operands(function, id, operands, operand_count);
+
+  IRBlock *target = &function->blocks[block];
+  function->instrs[id].prev = target->last;
+  if (target->last != IR_NONE) {
+    function->instrs[target->last].next = id;
+  } else {
+    target->first = id;
+  }
+  target->last = id;
+  return id;
+}
+
+/**
+ * @brief Creates an operand-less instruction at the start of `block`; used
+ * for phis, which must lead their block, and for undef values.
+ */
+IRValue ir_prepend(IRFunction *function, IRBlockId block, IROpcode opcode) {
+  IRValue id = new_instr(function, block, opcode, 0);
+
+  IRBlock *target = &function->blocks[block];
+  function->instrs[id].next = target->first;
+  if (target->first != IR_NONE) {
+    function->instrs[target->first].prev = id;
+  } else {
+    target->last = id;
+  }
+  target->first = id;
+  return id;
+}
+
+/**
+ * @brief Inserts a new instruction immediately before `before`, in the same
+ * block.
+ */
+IRValue ir_insert_before(IRFunction *function, IRValue before, IROpcode opcode,
+                         const IRValue *operands, int operand_count,
+                         int64_t imm) {
+  IRBlockId block = function->instrs[before].block;
+  IRValue id = new_instr(function, block, opcode, imm);
+  ir_set_operands(function, id, operands, operand_count);
+
+  IRInstr *instr = &function->instrs[id];
+  IRInstr *next = &function->instrs[before];
+  instr->next = before;
+  instr->prev = next->prev;
+  if (next->prev != IR_NONE) {
+    function->instrs[next->prev].next = id;
+  } else {
+    function->blocks[block].first = id;
+  }
+  next->prev = id;
+  return id;
+}
+
+void ir_replace_all_uses(IRFunction *function, IRValue old_value,
+                         IRValue new_value) {
+  uint32_t slot = function->instrs[old_value].first_use;
+  while (slot != IR_NONE) {
+    uint32_t next = function->uses[slot].next_use;
+    link_use(function, slot, new_value);
+    slot = next;
+  }
+  function->instrs[old_value].first_use = IR_NONE;
+}
+
+/**
+ * @brief Unlinks `instr` from its block and drops its operands' uses. The
+ * instruction keeps its id but is marked dead.
+ */
+void ir_remove(IRFunction *function, IRValue instr) {
+  IRInstr *target = &function->instrs[instr];
+  IRBlock *block = &function->blocks[target->block];
+
+  for (int i = 0; i < target->operand_count; i++) {
+    unlink_use(function, target->operand_start + i);
+  }
+  target->operand_count = 0;
+
+  if (target->prev != IR_NONE) {
+    function->instrs[target->prev].next = target->next;
+  } else {
+    block->first = target->next;
+  }
+  if (target->next != IR_NONE) {
+    function->instrs[target->next].prev = target->prev;
+  } else {
+    block->last = target->prev;
+  }
+  target->prev = IR_NONE;
+  target->next = IR_NONE;
+  target->dead = 1;
+}
+
+/**
+ * @brief Moves `instr` to immediately before `before`, which may be in
+ * another block. Its operands and uses are left as they are.
+ */
+void ir_move_before(IRFunction *function, IRValue instr, IRValue before) {
+  IRInstr *target = &function->instrs[instr];
+  IRBlock *block = &function->blocks[target->block];
+  if (target->prev != IR_NONE) {
+    function->instrs[target->prev].next = target->next;
+  } else {
+    block->first = target->next;
+  }
+  if (target->next != IR_NONE) {
+    function->instrs[target->next].prev = target->prev;
+  } else {
+    block->last = target->prev;
+  }
+
+  IRInstr *next = &function->instrs[before];
+  target->block = next->block;
+  target->next = before;
+  target->prev = next->prev;
+  if (next->prev != IR_NONE) {
+    function->instrs[next->prev].next = instr;
+  } else {
+    function->blocks[next->block].first = instr;
+  }
+  next->prev = instr;
+}
+
+/**
+ * @brief Renumbers the live instructions of `function` densely, in the order
+ * of their ids, and packs their operand slots, dropping the ids of removed
+ * instructions and the slots of replaced operand lists. Every IRValue held
+ * outside the function is invalidated.
+ */
+void ir_compact(IRFunction *function) {
+  IRValue *renumber = allocate(function->instr_count + 1, sizeof(IRValue));
+  uint32_t count = 0;
+  uint32_t use_count = 0;
+  for (IRValue id = 0; id < function->instr_count; id++) {
+    renumber[id] = function->instrs[id].dead ? IR_NONE : count++;
+    use_count += function->instrs[id].operand_count;
+  }
+
+  // Instructions only move down, and operand slots only towards the front
+  IRUse *uses = allocate(use_count + 1, sizeof(IRUse));
+  uint32_t slot = 0;
+  for (IRValue id = 0; id < function->instr_count; id++) {
+    if (renumber[id] == IR_NONE) {
+      continue;
+    }
+    IRInstr *instr = &function->instrs[renumber[id]];
+    *instr = function->instrs[id];
+    for (int i = 0; i < instr->operand_count; i++) {
+      uses[slot + i].value = renumber[ir_operand(function, id, i)];
+      uses[slot + i].user = renumber[id];
+    }
+    instr->operand_start = slot;
+    instr->first_use = IR_NONE;
+    instr->prev = instr->prev == IR_NONE ? IR_NONE : renumber[instr->prev];
+    instr->next = instr->next == IR_NONE ? IR_NONE : renumber[instr->next];
+    slot += instr->operand_count;
+  }
+  free(function->uses);
+  function->uses = uses;
+  function->use_count = use_count;
+  function->use_capacity = use_count + 1;
+  function->instr_count = count;
+  IRInstr *instrs = realloc(function->instrs, (count + 1) * sizeof(IRInstr));
+  if (instrs != NULL) {
+    function->instrs = instrs;
+    function->instr_capacity = count + 1;
+  }
+
+  // Relink the use lists, each in order of its slots
+  for (uint32_t s = use_count; s > 0; s--) {
+    link_use(function, s - 1, uses[s - 1].value);
+  }
+  for (IRBlockId b = 0; b < function->block_count; b++) {
+    IRBlock *block = &function->blocks[b];
+    if (block->first != IR_NONE) {
+      block->first = renumber[block->first];
+      block->last = renumber[block->last];
+    }
+  }
+  free(renumber);
+}
+
+int ir_use_count(const IRFunction *function, IRValue value) {
+  int count = 0;
+  for (uint32_t slot = function->instrs[value].first_use; slot != IR_NONE;
+       slot = function->uses[slot].next_use) {
+    count++;
+  }
+  return count;
+}
+
+int ir_is_terminator(IROpcode opcode) {
+  return opcode == IR_RET || opcode == IR_JUMP || opcode == IR_BRANCH;
+}
+
+int ir_has_result(IROpcode opcode) {
+  return opcode != IR_STORE_GLOBAL && !ir_is_terminator(opcode);
+}
+
+int ir_has_side_effects(IROpcode opcode) {
+  return opcode == IR_CALL || opcode == IR_STORE_GLOBAL ||
+         ir_is_terminator(opcode);
+}
+
+IRValue ir_terminator(const IRFunction *function, IRBlockId block) {
+  IRValue last = function->blocks[block].last;
+  if (last != IR_NONE && ir_is_terminator(function->instrs[last].opcode)) {
+    return last;
+  }
+  return IR_NONE;
+}
+
+static void dump_instr(FILE *out, const IRFunction *function, IRValue id) {
+  const IRInstr *instr = &function->instrs[id];
+  IROpcode opcode = instr->opcode;
+
+  if (ir_has_result(opcode)) {
+    fprintf(out, "  v%u = %s", id, ir_opcode_names[opcode]);
+  } else {
+    fprintf(out, "  %s", ir_opcode_names[opcode]);
+  }
+
+  switch (opcode) {
+  case IR_CONST:
+  case IR_PARAM:
+    fprintf(out, " %lld", (long long)instr->imm);
+    break;
+  case IR_LOAD_GLOBAL:
+  case IR_STORE_GLOBAL:
+    fprintf(out, " @%lld", (long long)instr->imm);
+    break;
+  case IR_CALL:
+    fprintf(out, " %s", intern_string((unsigned int)instr->imm));
+    break;
+  case IR_PHI: {
+    const IRBlock *block = &function->blocks[instr->block];
+    for (int i = 0; i < instr->operand_count; i++) {
+      fprintf(out, "%s [v%u, b%u]", i ? "," : "", ir_operand(function, id, i),
+              block->preds[i]);
+    }
+    fprintf(out, "\n");
+    return;
+  }
+  default:
+    break;
+  }
+
+  for (int i = 0; i < instr->operand_count; i++) {
+    fprintf(out, "%s v%u", i ? "," : "", ir_operand(function, id, i));
+  }
+
+  const IRBlock *block = &function->blocks[instr->block];
+  if (opcode == IR_JUMP) {
+    fprintf(out, " b%u", block->succs[0]);
+  } else if (opcode == IR_BRANCH) {
+    fprintf(out, ", b%u, b%u", block->succs[0], block->succs[1]);
+  }
+  fprintf(out, "\n");
+}
+
+void ir_dump_function(FILE *out, const IRFunction *function) {
+  fprintf(out, "function %s(%d) {\n", function->name, function->param_count);
+  for (IRBlockId b = 0; b < function->block_count; b++) {
+    const IRBlock *block = &function->blocks[b];
+    if (block->dead) {
+      continue;
+    }
+    fprintf(out, "b%u:", b);
+    if (block->pred_count > 0) {
+      fprintf(out, " ; preds");
+      for (uint32_t i = 0; i < block->pred_count; i++) {
+        fprintf(out, " b%u", block->preds[i]);
+      }
+    }
+    fprintf(out, "\n");
+    for (IRValue id = block->first; id != IR_NONE;
+         id = function->instrs[id].next) {
+      dump_instr(out, function, id);
+    }
+  }
+  fprintf(out, "}\n");
+}
+
+void ir_dump_module(FILE *out, const IRModule *module) {
+  for (int i = 0; i < module->global_count; i++) {
+    fprintf(out, "global @%d %s = %lld\n", i, module->globals[i].name,
+            (long long)module->globals[i].initial_value);
+  }
+  for (int i = 0; i < module->function_count; i++) {
+    if (i > 0 || module->global_count > 0) {
+      fprintf(out, "\n");
+    }
+    ir_dump_function(out, module->functions[i]);
+  }
+}
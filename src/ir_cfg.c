@@ -0,0 +1,182 @@
+#include "ir.h"
+#include "util.h"
+#include <stdlib.h>
+
+/**
+ * @brief Fills `order` with the blocks reachable from the entry block in
+ * reverse postorder.
+ *
+ * @return The number of reachable blocks.
+ */
+uint32_t ir_reverse_postorder(const IRFunction *function, IRBlockId *order) {
+  uint32_t count = function->block_count;
+  uint8_t *visited = allocate_zeroed(count, 1);
+  IRBlockId *stack = allocate(count, sizeof(IRBlockId));
+  uint8_t *next_succ = allocate_zeroed(count, 1);
+
+  // Iterative DFS; postorder is written back to front
+  uint32_t top = 0;
+  uint32_t position = count;
+  stack[top++] = 0;
+  visited[0] = 1;
+  while (top > 0) {
+    IRBlockId block = stack[top - 1];
+    const IRBlock *current = &function->blocks[block];
+    if (next_succ[block] < current->succ_count) {
+      IRBlockId succ = current->succs[next_succ[block]++];
+      if (!visited[succ]) {
+        visited[succ] = 1;
+        stack[top++] = succ;
+      }
+    } else {
+      order[--position] = block;
+      top--;
+    }
+  }
+
+  uint32_t reachable = count - position;
+  for (uint32_t i = 0; i < reachable; i++) {
+    order[i] = order[position + i];
+  }
+
+  free(visited);
+  free(stack);
+  free(next_succ);
+  return reachable;
+}
+
+/**
+ * @brief Computes immediate dominators with the Cooper-Harvey-Kennedy
+ * iterative algorithm.
+ *
+ * @return An allocated array mapping each block to its immediate dominator.
+ * The entry block is its own dominator and unreachable blocks map to IR_NONE.
+ */
+IRBlockId *ir_dominators(const IRFunction *function) {
+  uint32_t count = function->block_count;
+  IRBlockId *order = allocate(count, sizeof(IRBlockId));
+  uint32_t *rpo_index = allocate(count, sizeof(uint32_t));
+  IRBlockId *idom = allocate(count, sizeof(IRBlockId));
+
+  uint32_t reachable = ir_reverse_postorder(function, order);
+  for (uint32_t i = 0; i < count; i++) {
+    rpo_index[i] = IR_NONE;
+    idom[i] = IR_NONE;
+  }
+  for (uint32_t i = 0; i < reachable; i++) {
+    rpo_index[order[i]] = i;
+  }
+  idom[0] = 0;
+
+  int changed = 1;
+  while (changed) {
+    changed = 0;
+    for (uint32_t i = 1; i < reachable; i++) {
+      IRBlockId block = order[i];
+      const IRBlock *current = &function->blocks[block];
+      IRBlockId new_idom = IR_NONE;
+
+      for (uint32_t p = 0; p < current->pred_count; p++) {
+        IRBlockId pred = current->preds[p];
+        if (idom[pred] == IR_NONE) {
+          continue;
+        }
+        if (new_idom == IR_NONE) {
+          new_idom = pred;
+          continue;
+        }
+        // Walk both fingers up the tree until they meet
+        IRBlockId a = pred, b = new_idom;
+        while (a != b) {
+          while (rpo_index[a] > rpo_index[b]) {
+            a = idom[a];
+          }
+          while (rpo_index[b] > rpo_index[a]) {
+            b = idom[b];
+          }
+        }
+        new_idom = a;
+      }
+
+      if (idom[block] != new_idom) {
+        idom[block] = new_idom;
+        changed = 1;
+      }
+    }
+  }
+
+  free(order);
+  free(rpo_index);
+  return idom;
+}
+
+/**
+ * @brief Builds the dominator tree of `function` and numbers it in preorder,
+ * so that dominance between reachable blocks takes two comparisons.
+ */
+void ir_dom_tree_build(const IRFunction *function, IRDomTree *tree) {
+  uint32_t count = function->block_count;
+  tree->idom = ir_dominators(function);
+  tree->order = allocate(count, sizeof(IRBlockId));
+  tree->index = allocate(count, sizeof(uint32_t));
+  tree->end = allocate(count, sizeof(uint32_t));
+  // Children of each block, grouped by parent: those of b start at first[b]
+  uint32_t *first = allocate_zeroed(count + 1, sizeof(uint32_t));
+  IRBlockId *children = allocate(count, sizeof(IRBlockId));
+  IRBlockId *stack = allocate(count, sizeof(IRBlockId));
+
+  for (IRBlockId b = 1; b < count; b++) {
+    if (tree->idom[b] != IR_NONE) {
+      first[tree->idom[b] + 1]++;
+    }
+  }
+  for (uint32_t b = 0; b < count; b++) {
+    first[b + 1] += first[b];
+  }
+  uint32_t *next = stack; // Borrowed as fill positions until the walk
+  for (uint32_t b = 0; b < count; b++) {
+    next[b] = first[b];
+  }
+  for (IRBlockId b = 1; b < count; b++) {
+    if (tree->idom[b] != IR_NONE) {
+      children[next[tree->idom[b]]++] = b;
+    }
+  }
+
+  for (uint32_t b = 0; b < count; b++) {
+    tree->index[b] = IR_NONE;
+  }
+  // Preorder, then the end of each subtree from its children's, bottom up
+  uint32_t top = 0;
+  tree->count = 0;
+  stack[top++] = 0;
+  while (top > 0) {
+    IRBlockId block = stack[--top];
+    tree->index[block] = tree->count;
+    tree->order[tree->count++] = block;
+    for (uint32_t c = first[block + 1]; c > first[block]; c--) {
+      stack[top++] = children[c - 1];
+    }
+  }
+  for (uint32_t i = tree->count; i > 0; i--) {
+    IRBlockId block = tree->order[i - 1];
+    uint32_t end = i;
+    for (uint32_t c = first[block]; c < first[block + 1]; c++) {
+      if (tree->end[children[c]] > end) {
+        end = tree->end[children[c]];
+      }
+    }
+    tree->end[block] = end;
+  }
+
+  free(first);
+  free(children);
+  free(stack);
+}
+
+void ir_dom_tree_free(IRDomTree *tree) {
+  free(tree->idom);
+  free(tree->order);
+  free(tree->index);
+  free(tree->end);
+}
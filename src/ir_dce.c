@@ -0,0 +1,51 @@
+#include "ir.h"
+#include "ir_passes.h"
+#include "util.h"
+#include <stdlib.h>
+
+/*
+ * Aggressive dead code elimination. Instead of deleting values that have no
+ * uses, everything starts dead and only what an instruction with side effects
+ * (calls, stores and terminators) transitively depends on is marked live.
+ * Cycles of phis that only feed each other are therefore removed as well.
+ * Terminators are always roots, so control flow is left alone; unreachable
+ * blocks are the job of SCCP.
+ */
+
+/**
+ * @brief Removes every instruction that does not contribute to a side effect.
+ */
+void run_dce(IRFunction *function, PassStats *stats) {
+  uint8_t *live = allocate_zeroed(function->instr_count, sizeof(uint8_t));
+  IRValue *worklist = allocate(function->instr_count, sizeof(IRValue));
+  uint32_t count = 0;
+
+  for (IRValue id = 0; id < function->instr_count; id++) {
+    const IRInstr *instr = &function->instrs[id];
+    if (!instr->dead && ir_has_side_effects(instr->opcode)) {
+      live[id] = 1;
+      worklist[count++] = id;
+    }
+  }
+
+  while (count > 0) {
+    IRValue id = worklist[--count];
+    for (int i = 0; i < function->instrs[id].operand_count; i++) {
+      IRValue operand = ir_operand(function, id, i);
+      if (!live[operand]) {
+        live[operand] = 1;
+        worklist[count++] = operand;
+      }
+    }
+  }
+
+  for (IRValue id = 0; id < function->instr_count; id++) {
+    if (!function->instrs[id].dead && !live[id]) {
+      ir_remove(function, id);
+    }
+  }
+
+  (void)stats;
+  free(live);
+  free(worklist);
+}
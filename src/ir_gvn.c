@@ -0,0 +1,235 @@
+#include "ir.h"
+#include "ir_passes.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Global value numbering over the dominator tree. Blocks are visited in
+ * preorder of the tree with a single hash table of the values seen so far.
+ * An entry only stands for the blocks its own block dominates, so once the
+ * walk leaves that subtree the entry is stale for good and free to be
+ * overwritten; nothing is ever popped. A value with the same opcode,
+ * immediate and operands as one that dominates it is replaced by it, which
+ * also merges the phis of a block that take the same operands.
+ *
+ * Loads of globals are numbered together with the state of memory they
+ * read. Every store and call starts a new state, as does every block but one
+ * entered only from its immediate dominator, and a store leaves the value it
+ * stored as what loads of that global read until then.
+ */
+
+typedef struct {
+  uint8_t opcode;
+  int64_t imm;
+  IRValue operands[2];
+  uint32_t context; // Memory state a load reads, or the block of a phi
+} Key;
+
+typedef struct {
+  Key key;
+  uint32_t hash;
+  IRValue value;   // IR_NONE while the slot is empty
+  IRBlockId block; // Where the value became available
+} Entry;
+
+typedef struct {
+  IRFunction *function;
+  IRDomTree tree;
+  Entry *table;
+  uint32_t mask;
+  uint32_t *memory_out; // State of memory at the end of each block
+  uint32_t memory;      // The current one
+  uint32_t memory_count;
+} GVN;
+
+static int is_commutative(IROpcode opcode) {
+  return opcode == IR_ADD || opcode == IR_MUL || opcode == IR_EQ ||
+         opcode == IR_NE;
+}
+
+/* Fills in the key `id` is numbered by, or returns 0 if it has none. */
+static int make_key(GVN *gvn, IRValue id, Key *key) {
+  const IRInstr *instr = &gvn->function->instrs[id];
+  *key = (Key){instr->opcode, instr->imm, {IR_NONE, IR_NONE}, 0};
+  switch ((IROpcode)instr->opcode) {
+  case IR_CONST:
+    return 1;
+  case IR_LOAD_GLOBAL:
+    key->context = gvn->memory;
+    return 1;
+  case IR_PHI:
+    key->context = instr->block; // The operands are compared one by one
+    return 1;
+  case IR_ADD:
+  case IR_SUB:
+  case IR_MUL:
+  case IR_DIV:
+  case IR_MOD:
+  case IR_EQ:
+  case IR_NE:
+  case IR_LT:
+  case IR_LE:
+  case IR_GT:
+  case IR_GE:
+    key->operands[0] = ir_operand(gvn->function, id, 0);
+    key->operands[1] = ir_operand(gvn->function, id, 1);
+    if (is_commutative(instr->opcode) &&
+        key->operands[0] > key->operands[1]) {
+      key->operands[0] = ir_operand(gvn->function, id, 1);
+      key->operands[1] = ir_operand(gvn->function, id, 0);
+    }
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+static uint32_t key_hash(const GVN *gvn, const Key *key, IRValue value) {
+  uint64_t hash = key->opcode;
+  hash = hash * 31 + (uint64_t)key->imm;
+  hash = hash * 31 + key->operands[0];
+  hash = hash * 31 + key->operands[1];
+  hash = hash * 31 + key->context;
+  if (key->opcode == IR_PHI) {
+    for (int i = 0; i < gvn->function->instrs[value].operand_count; i++) {
+      hash = hash * 31 + ir_operand(gvn->function, value, i);
+    }
+  }
+  return (uint32_t)((hash * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+static int same_key(const GVN *gvn, const Entry *entry, const Key *key,
+                    IRValue value) {
+  const Key *other = &entry->key;
+  if (other->opcode != key->opcode || other->imm != key->imm ||
+      other->operands[0] != key->operands[0] ||
+      other->operands[1] != key->operands[1] ||
+      other->context != key->context) {
+    return 0;
+  }
+  if (key->opcode == IR_PHI) {
+    int count = gvn->function->instrs[value].operand_count;
+    for (int i = 0; i < count; i++) {
+      if (ir_operand(gvn->function, entry->value, i) !=
+          ir_operand(gvn->function, value, i)) {
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+/* Returns the value available in `block` that `key` names, or makes `value`
+ * that value and returns it. */
+static IRValue number(GVN *gvn, const Key *key, IRValue value,
+                      IRBlockId block) {
+  uint32_t hash = key_hash(gvn, key, value);
+  uint32_t slot = hash & gvn->mask;
+  uint32_t reuse = IR_NONE;
+  for (; gvn->table[slot].value != IR_NONE; slot = (slot + 1) & gvn->mask) {
+    Entry *entry = &gvn->table[slot];
+    if (!ir_dominates(&gvn->tree, entry->block, block)) {
+      if (reuse == IR_NONE) {
+        reuse = slot;
+      }
+    } else if (entry->hash == hash && same_key(gvn, entry, key, value)) {
+      return entry->value;
+    }
+  }
+  gvn->table[reuse != IR_NONE ? reuse : slot] =
+      (Entry){*key, hash, value, block};
+  return value;
+}
+
+/* The value every operand of `phi` is, itself aside, or IR_NONE. */
+static IRValue trivial_phi(const IRFunction *function, IRValue phi) {
+  IRValue same = IR_NONE;
+  for (int i = 0; i < function->instrs[phi].operand_count; i++) {
+    IRValue operand = ir_operand(function, phi, i);
+    if (operand == phi || operand == same) {
+      continue;
+    }
+    if (same != IR_NONE) {
+      return IR_NONE;
+    }
+    same = operand;
+  }
+  return same;
+}
+
+static void replace(GVN *gvn, IRValue old_value, IRValue new_value) {
+  ir_replace_all_uses(gvn->function, old_value, new_value);
+  ir_remove(gvn->function, old_value);
+}
+
+static void visit_block(GVN *gvn, IRBlockId block) {
+  IRFunction *function = gvn->function;
+  const IRBlock *current = &function->blocks[block];
+  IRBlockId idom = gvn->tree.idom[block];
+  if (block != 0 && current->pred_count == 1 && current->preds[0] == idom) {
+    gvn->memory = gvn->memory_out[idom];
+  } else {
+    gvn->memory = ++gvn->memory_count;
+  }
+
+  IRValue next;
+  for (IRValue id = current->first; id != IR_NONE; id = next) {
+    next = function->instrs[id].next;
+    const IRInstr *instr = &function->instrs[id];
+    if (instr->opcode == IR_PHI) {
+      IRValue same = trivial_phi(function, id);
+      if (same != IR_NONE) {
+        replace(gvn, id, same);
+        continue;
+      }
+    }
+    if (instr->opcode == IR_CALL) {
+      gvn->memory = ++gvn->memory_count;
+      continue;
+    }
+    if (instr->opcode == IR_STORE_GLOBAL) {
+      gvn->memory = ++gvn->memory_count;
+      Key load = {IR_LOAD_GLOBAL, instr->imm, {IR_NONE, IR_NONE},
+                  gvn->memory};
+      number(gvn, &load, ir_operand(function, id, 0), block);
+      continue;
+    }
+    Key key;
+    if (!make_key(gvn, id, &key)) {
+      continue;
+    }
+    IRValue available = number(gvn, &key, id, block);
+    if (available != id) {
+      replace(gvn, id, available);
+    }
+  }
+  gvn->memory_out[block] = gvn->memory;
+}
+
+/**
+ * @brief Replaces every value that repeats one dominating it, across blocks.
+ */
+void run_gvn(IRFunction *function, PassStats *stats) {
+  GVN gvn = {function};
+  ir_dom_tree_build(function, &gvn.tree);
+  uint32_t size = 16;
+  while (size < function->instr_count * 2) {
+    size *= 2;
+  }
+  gvn.table = allocate(size, sizeof(Entry));
+  gvn.mask = size - 1;
+  for (uint32_t i = 0; i < size; i++) {
+    gvn.table[i].value = IR_NONE;
+  }
+  gvn.memory_out = allocate(function->block_count, sizeof(uint32_t));
+
+  for (uint32_t i = 0; i < gvn.tree.count; i++) {
+    visit_block(&gvn, gvn.tree.order[i]);
+  }
+
+  (void)stats;
+  ir_dom_tree_free(&gvn.tree);
+  free(gvn.table);
+  free(gvn.memory_out);
+}
@@ -0,0 +1,165 @@
+#include "ir.h"
+#include "ir_loops.h"
+#include "ir_passes.h"
+#include "util.h"
+#include <stdlib.h>
+
+/*
+ * Loop-invariant code motion. Loops are taken innermost first, and a value
+ * a loop computes from operands all defined outside of it moves to the end
+ * of the loop's preheader, to be computed once; hoisting it can make its
+ * users invariant in turn, so they are looked at again. What moves must be
+ * safe to compute even when the loop runs no iteration: arithmetic and
+ * comparisons, division by a constant other than 0 and -1, and loads of
+ * globals that no call or store in the loop can change. Constants go along
+ * with the values that use them. Loops without a preheader are left alone.
+ */
+
+typedef struct {
+  IRFunction *function;
+  IRLoopNest nest;
+  uint32_t *stored_in; // Loop that last found a store to each global
+  uint32_t global_count;
+  int has_call;        // Whether the loop being hoisted from makes a call
+  IRValue *worklist;
+  uint32_t work_count;
+  uint32_t work_capacity;
+} LICM;
+
+static void push(LICM *licm, IRValue value) {
+  if (licm->work_count == licm->work_capacity) {
+    licm->worklist =
+        grow(licm->worklist, sizeof(IRValue), &licm->work_capacity, 64);
+  }
+  licm->worklist[licm->work_count++] = value;
+}
+
+static int is_invariant(const LICM *licm, uint32_t loop, IRValue value) {
+  const IRInstr *instr = &licm->function->instrs[value];
+  return instr->opcode == IR_CONST ||
+         !ir_loop_contains(&licm->nest, loop, instr->block);
+}
+
+static int can_hoist(const LICM *licm, uint32_t loop, IRValue id) {
+  const IRFunction *function = licm->function;
+  const IRInstr *instr = &function->instrs[id];
+  switch ((IROpcode)instr->opcode) {
+  case IR_ADD:
+  case IR_SUB:
+  case IR_MUL:
+  case IR_EQ:
+  case IR_NE:
+  case IR_LT:
+  case IR_LE:
+  case IR_GT:
+  case IR_GE:
+    break;
+  case IR_DIV:
+  case IR_MOD: {
+    // Only a divisor known not to trap
+    const IRInstr *divisor = &function->instrs[ir_operand(function, id, 1)];
+    if (divisor->opcode != IR_CONST || divisor->imm == 0 ||
+        divisor->imm == -1) {
+      return 0;
+    }
+    break;
+  }
+  case IR_LOAD_GLOBAL:
+    return !licm->has_call && licm->stored_in[instr->imm] != loop;
+  default:
+    return 0;
+  }
+  for (int i = 0; i < instr->operand_count; i++) {
+    if (!is_invariant(licm, loop, ir_operand(function, id, i))) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static void hoist(LICM *licm, uint32_t loop, IRValue id) {
+  IRFunction *function = licm->function;
+  IRValue end = ir_terminator(function, licm->nest.loops[loop].preheader);
+  for (int i = 0; i < function->instrs[id].operand_count; i++) {
+    IRValue operand = ir_operand(function, id, i);
+    if (ir_loop_contains(&licm->nest, loop,
+                         function->instrs[operand].block)) {
+      ir_move_before(function, operand, end); // A constant
+    }
+  }
+  ir_move_before(function, id, end);
+  for (uint32_t slot = function->instrs[id].first_use; slot != IR_NONE;
+       slot = function->uses[slot].next_use) {
+    push(licm, function->uses[slot].user);
+  }
+}
+
+static void hoist_from_loop(LICM *licm, uint32_t loop, PassStats *stats) {
+  IRFunction *function = licm->function;
+  const IRLoop *current = &licm->nest.loops[loop];
+  licm->has_call = 0;
+  licm->work_count = 0;
+  for (uint32_t i = current->first_block; i < current->block_end; i++) {
+    IRBlockId block = licm->nest.blocks[i];
+    for (IRValue id = function->blocks[block].first; id != IR_NONE;
+         id = function->instrs[id].next) {
+      const IRInstr *instr = &function->instrs[id];
+      if (instr->opcode == IR_CALL) {
+        licm->has_call = 1;
+      } else if (instr->opcode == IR_STORE_GLOBAL) {
+        licm->stored_in[instr->imm] = loop;
+      } else if (instr->opcode != IR_PHI && ir_has_result(instr->opcode)) {
+        push(licm, id);
+      }
+    }
+  }
+
+  while (licm->work_count > 0) {
+    IRValue id = licm->worklist[--licm->work_count];
+    const IRInstr *instr = &function->instrs[id];
+    if (!instr->dead && ir_loop_contains(&licm->nest, loop, instr->block) &&
+        can_hoist(licm, loop, id)) {
+      hoist(licm, loop, id);
+      stats->values_hoisted++;
+    }
+  }
+}
+
+/**
+ * @brief Moves the values loops recompute to the same result on every
+ * iteration out in front of them.
+ */
+void run_licm(IRFunction *function, PassStats *stats) {
+  LICM licm = {function};
+  IRDomTree tree;
+  ir_dom_tree_build(function, &tree);
+  ir_find_loops(function, &tree, &licm.nest);
+  stats->loops += licm.nest.loop_count;
+
+  for (IRValue id = 0; id < function->instr_count; id++) {
+    const IRInstr *instr = &function->instrs[id];
+    if (!instr->dead && (instr->opcode == IR_LOAD_GLOBAL ||
+                         instr->opcode == IR_STORE_GLOBAL) &&
+        instr->imm >= licm.global_count) {
+      licm.global_count = (uint32_t)instr->imm + 1;
+    }
+  }
+  licm.stored_in = allocate(licm.global_count, sizeof(uint32_t));
+  for (uint32_t g = 0; g < licm.global_count; g++) {
+    licm.stored_in[g] = IR_NONE;
+  }
+  licm.work_capacity = 64;
+  licm.worklist = allocate(licm.work_capacity, sizeof(IRValue));
+
+  // Inner loops come after the loops around them
+  for (uint32_t loop = licm.nest.loop_count; loop > 0; loop--) {
+    if (licm.nest.loops[loop - 1].preheader != IR_NONE) {
+      hoist_from_loop(&licm, loop - 1, stats);
+    }
+  }
+
+  ir_loop_nest_free(&licm.nest);
+  ir_dom_tree_free(&tree);
+  free(licm.stored_in);
+  free(licm.worklist);
+}
@@ -0,0 +1,215 @@
+#include "ir_loops.h"
+#include "util.h"
+#include <stdlib.h>
+
+/*
+ * Loop nest analysis. Headers are taken innermost first, in reverse
+ * preorder of the dominator tree, and each loop's body is found by walking
+ * back from its latches. A block already in an inner loop stands for that
+ * whole loop through its header, found with a union-find over the loops, so
+ * inner bodies are not walked again and the walk stays near-linear in the
+ * size of the CFG. Predecessors the header does not dominate only enter an
+ * irreducible region, which is left out of the loop.
+ */
+
+/* The outermost loop found so far around `loop`, compressing the path. */
+static uint32_t outermost(uint32_t *outer, uint32_t loop) {
+  uint32_t root = loop;
+  while (outer[root] != root) {
+    root = outer[root];
+  }
+  while (outer[loop] != root) {
+    uint32_t next = outer[loop];
+    outer[loop] = root;
+    loop = next;
+  }
+  return root;
+}
+
+/**
+ * @brief Finds the loops of `function`, whose dominator tree is `tree`.
+ */
+void ir_find_loops(const IRFunction *function, const IRDomTree *tree,
+                   IRLoopNest *nest) {
+  uint32_t count = function->block_count;
+  uint32_t edges = 0;
+  for (IRBlockId b = 0; b < count; b++) {
+    edges += function->blocks[b].pred_count;
+  }
+  // Loops as found, innermost first
+  IRBlockId *header = allocate(count, sizeof(IRBlockId));
+  uint32_t *parent = allocate(count, sizeof(uint32_t));
+  uint32_t *outer = allocate(count, sizeof(uint32_t));
+  uint32_t *loop_of = allocate(count, sizeof(uint32_t));
+  uint32_t *seen = allocate(count, sizeof(uint32_t)); // Last loop to reach it
+  IRBlockId *worklist = allocate(edges, sizeof(IRBlockId));
+  for (IRBlockId b = 0; b < count; b++) {
+    loop_of[b] = IR_NONE;
+    seen[b] = IR_NONE;
+  }
+
+  uint32_t found = 0;
+  for (uint32_t i = tree->count; i > 0; i--) {
+    IRBlockId head = tree->order[i - 1];
+    const IRBlock *block = &function->blocks[head];
+    uint32_t pending = 0;
+    for (uint32_t p = 0; p < block->pred_count; p++) {
+      IRBlockId pred = block->preds[p];
+      if (tree->index[pred] != IR_NONE && ir_dominates(tree, head, pred)) {
+        worklist[pending++] = pred;
+      }
+    }
+    if (pending == 0) {
+      continue;
+    }
+
+    uint32_t loop = found++;
+    header[loop] = head;
+    parent[loop] = IR_NONE;
+    outer[loop] = loop;
+    loop_of[head] = loop;
+    seen[head] = loop;
+    while (pending > 0) {
+      IRBlockId b = worklist[--pending];
+      uint32_t inner =
+          loop_of[b] == IR_NONE ? IR_NONE : outermost(outer, loop_of[b]);
+      IRBlockId top = inner == IR_NONE ? b : header[inner];
+      if (seen[top] == loop) {
+        continue;
+      }
+      seen[top] = loop;
+      if (inner == IR_NONE) {
+        loop_of[top] = loop;
+      } else {
+        parent[inner] = loop;
+        outer[inner] = loop;
+      }
+      const IRBlock *current = &function->blocks[top];
+      for (uint32_t p = 0; p < current->pred_count; p++) {
+        IRBlockId pred = current->preds[p];
+        if (tree->index[pred] != IR_NONE && ir_dominates(tree, head, pred)) {
+          worklist[pending++] = pred;
+        }
+      }
+    }
+  }
+
+  // Renumber in preorder of the nest: children of each loop grouped by
+  // parent, outermost loops under a root at `found`
+  uint32_t *first = allocate_zeroed(found + 2, sizeof(uint32_t));
+  uint32_t *children = allocate(found, sizeof(uint32_t));
+  uint32_t *number = allocate(found, sizeof(uint32_t));
+  uint32_t *stack = allocate(found + 1, sizeof(uint32_t));
+  for (uint32_t l = 0; l < found; l++) {
+    first[(parent[l] == IR_NONE ? found : parent[l]) + 1]++;
+  }
+  for (uint32_t l = 0; l <= found; l++) {
+    first[l + 1] += first[l];
+  }
+  for (uint32_t l = 0; l < found; l++) {
+    stack[l] = first[l];
+  }
+  stack[found] = first[found];
+  for (uint32_t l = 0; l < found; l++) {
+    children[stack[parent[l] == IR_NONE ? found : parent[l]]++] = l;
+  }
+
+  nest->loops = allocate(found, sizeof(IRLoop));
+  nest->loop_count = found;
+  uint32_t top = 0;
+  uint32_t next = 0;
+  stack[top++] = found;
+  while (top > 0) {
+    uint32_t loop = stack[--top];
+    if (loop != found) {
+      number[loop] = next++;
+    }
+    for (uint32_t c = first[loop + 1]; c > first[loop]; c--) {
+      stack[top++] = children[c - 1];
+    }
+  }
+  for (uint32_t l = 0; l < found; l++) {
+    IRLoop *loop = &nest->loops[number[l]];
+    loop->header = header[l];
+    loop->parent = parent[l] == IR_NONE ? IR_NONE : number[parent[l]];
+    loop->end = number[l] + 1;
+  }
+  // Parents come before their children, and a subtree ends where the last
+  // of its children's does
+  for (uint32_t l = 0; l < found; l++) {
+    IRLoop *loop = &nest->loops[l];
+    loop->depth =
+        loop->parent == IR_NONE ? 1 : nest->loops[loop->parent].depth + 1;
+  }
+  for (uint32_t l = found; l > 0; l--) {
+    IRLoop *loop = &nest->loops[l - 1];
+    if (loop->parent != IR_NONE &&
+        nest->loops[loop->parent].end < loop->end) {
+      nest->loops[loop->parent].end = loop->end;
+    }
+  }
+
+  // Group the blocks by innermost loop, keeping the order of the tree
+  nest->block_loop = allocate(count, sizeof(uint32_t));
+  uint32_t *start = allocate_zeroed(found + 1, sizeof(uint32_t));
+  for (IRBlockId b = 0; b < count; b++) {
+    nest->block_loop[b] =
+        loop_of[b] == IR_NONE ? IR_NONE : number[loop_of[b]];
+    if (nest->block_loop[b] != IR_NONE) {
+      start[nest->block_loop[b] + 1]++;
+    }
+  }
+  for (uint32_t l = 0; l < found; l++) {
+    start[l + 1] += start[l];
+  }
+  nest->blocks = allocate(start[found], sizeof(IRBlockId));
+  for (uint32_t l = 0; l < found; l++) {
+    nest->loops[l].first_block = start[l];
+  }
+  for (uint32_t l = 0; l < found; l++) {
+    nest->loops[l].block_end = start[nest->loops[l].end];
+  }
+  for (uint32_t i = 0; i < tree->count; i++) {
+    IRBlockId block = tree->order[i];
+    if (nest->block_loop[block] != IR_NONE) {
+      nest->blocks[start[nest->block_loop[block]]++] = block;
+    }
+  }
+
+  // A preheader is the only way in, and leads nowhere else
+  for (uint32_t l = 0; l < found; l++) {
+    IRLoop *loop = &nest->loops[l];
+    const IRBlock *block = &function->blocks[loop->header];
+    loop->preheader = IR_NONE;
+    uint32_t entries = 0;
+    for (uint32_t p = 0; p < block->pred_count; p++) {
+      IRBlockId pred = block->preds[p];
+      if (tree->index[pred] != IR_NONE &&
+          !ir_loop_contains(nest, l, pred)) {
+        entries++;
+        loop->preheader = pred;
+      }
+    }
+    if (entries != 1 || function->blocks[loop->preheader].succ_count != 1) {
+      loop->preheader = IR_NONE;
+    }
+  }
+
+  free(header);
+  free(parent);
+  free(outer);
+  free(loop_of);
+  free(seen);
+  free(worklist);
+  free(first);
+  free(children);
+  free(number);
+  free(stack);
+  free(start);
+}
+
+void ir_loop_nest_free(IRLoopNest *nest) {
+  free(nest->loops);
+  free(nest->block_loop);
+  free(nest->blocks);
+}
@@ -0,0 +1,760 @@
+#include "ir_lower.h"
+#include "intern.h"
+#include "ir.h"
+#include "parser.h"
+#include "symbol_table.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Lowering from a resolved and type-checked AST to SSA form. Local variables
+ * never touch memory: reads and writes are turned into SSA values on the fly
+ * with the algorithm of Braun et al., "Simple and Efficient Construction of
+ * Static Single Assignment Form" (CC 2013). Global variables are accessed
+ * through loads and stores.
+ *
+ * When the parser shared identical expressions, a shared node is lowered
+ * once per block and its value reused for as long as no variable or global
+ * it reads has been written since. What a value reads is summarized as a
+ * mask with a bit per variable, modulo 63, and one for all globals.
+ *
+ * Reading a variable at a loop header that nothing has written since the loop
+ * was entered takes the value from before the loop without building a phi.
+ * Otherwise every loop nested inside the one the variable changes in would get
+ * a phi that only turns out trivial once made, and as many of them as the
+ * loops are deep for each such variable.
+ */
+
+typedef struct {
+  uint64_t key; // block << 32 | variable, 0 marks an empty entry
+  IRValue value;
+} Definition;
+
+typedef struct {
+  IRBlockId block;
+  int variable;
+  IRValue phi;
+  uint32_t next; // Next incomplete phi of the same block
+} IncompletePhi;
+
+#define GLOBALS_READ (1ull << 63)
+#define NOT_A_LOOP UINT64_MAX
+
+typedef struct {
+  const ASTNode_t *node; // A shared expression, NULL for a free entry
+  IRBlockId block;
+  IRValue value;
+  uint64_t reads; // Variables the value depends on
+  uint64_t time;  // Of the writes when it was computed
+} SharedValue;
+
+typedef struct {
+  IRModule *module;
+  IRFunction *function;
+  IRBlockId block; // Block that code is currently appended to
+  int variable_count;
+  int errors;
+
+  Definition *definitions;
+  uint32_t definition_count;
+  uint32_t definition_capacity;
+
+  IncompletePhi *incomplete;
+  uint32_t incomplete_count;
+  uint32_t incomplete_capacity;
+  uint32_t *incomplete_heads; // Per block, IR_NONE terminated
+  uint64_t *entered_at;       // Per block, the write time when the loop it
+                              // heads was entered, or NOT_A_LOOP
+  uint32_t head_capacity;
+
+  uint64_t *last_write; // Per variable, the time of its last write
+  uint32_t variable_capacity;
+
+  SharedValue *shared_values;
+  uint32_t shared_count;
+  uint32_t shared_capacity;
+  uint64_t time;             // Counts the writes to variables and globals
+  uint64_t written_at[64];   // Per bit of a read mask, the time of its last write
+} Lowerer;
+
+static IRValue lower_expression(Lowerer *lowerer, ASTNode_t *node);
+static void lower_statement(Lowerer *lowerer, ASTNode_t *node);
+static IRValue read_variable(Lowerer *lowerer, int variable, IRBlockId block);
+
+static void lower_error(Lowerer *lowerer, Token *token, const char *message) {
+  if (token != NULL) {
+    fprintf(stderr, "Error: %s at line %d, column %d\n", message, token->line,
+            token->column);
+  } else {
+    fprintf(stderr, "Error: %s\n", message);
+  }
+  lowerer->errors++;
+}
+
+static uint64_t definition_key(IRBlockId block, int variable) {
+  // Offset by one so that block 0, variable 0 is not the empty key
+  return ((uint64_t)block << 32 | (uint32_t)variable) + 1;
+}
+
+static Definition *find_definition(Lowerer *lowerer, uint64_t key) {
+  uint32_t mask = lowerer->definition_capacity - 1;
+  uint32_t index = (uint32_t)((key * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+  while (lowerer->definitions[index].key != 0 &&
+         lowerer->definitions[index].key != key) {
+    index = (index + 1) & mask;
+  }
+  return &lowerer->definitions[index];
+}
+
+static void write_variable(Lowerer *lowerer, int variable, IRBlockId block,
+                           IRValue value) {
+  if ((lowerer->definition_count + 1) * 2 > lowerer->definition_capacity) {
+    Definition *old = lowerer->definitions;
+    uint32_t old_capacity = lowerer->definition_capacity;
+    lowerer->definition_capacity = old_capacity ? old_capacity * 2 : 256;
+    lowerer->definitions =
+        allocate_zeroed(lowerer->definition_capacity, sizeof(Definition));
+    for (uint32_t i = 0; i < old_capacity; i++) {
+      if (old[i].key != 0) {
+        *find_definition(lowerer, old[i].key) = old[i];
+      }
+    }
+    free(old);
+  }
+
+  Definition *definition =
+      find_definition(lowerer, definition_key(block, variable));
+  if (definition->key == 0) {
+    definition->key = definition_key(block, variable);
+    lowerer->definition_count++;
+  }
+  definition->value = value;
+}
+
+static IRValue entry_undef(Lowerer *lowerer) {
+  return ir_prepend(lowerer->function, 0, IR_UNDEF);
+}
+
+/* Replaces a phi whose operands are all the same value (or the phi itself)
+ * by that value, then revisits phis that used it, since they may have become
+ * trivial in turn. */
+static IRValue try_remove_trivial_phi(Lowerer *lowerer, IRValue phi) {
+  IRFunction *function = lowerer->function;
+  IRValue same = IR_NONE;
+
+  for (int i = 0; i < function->instrs[phi].operand_count; i++) {
+    IRValue operand = ir_operand(function, phi, i);
+    if (operand == same || operand == phi) {
+      continue;
+    }
+    if (same != IR_NONE) {
+      return phi; // Merges at least two values
+    }
+    same = operand;
+  }
+  if (same == IR_NONE) {
+    same = entry_undef(lowerer); // Unreachable or read before any write
+  }
+
+  int user_count = 0;
+  IRValue *users = allocate(ir_use_count(function, phi) + 1, sizeof(IRValue));
+  for (uint32_t slot = function->instrs[phi].first_use; slot != IR_NONE;
+       slot = function->uses[slot].next_use) {
+    IRValue user = function->uses[slot].user;
+    if (user != phi && function->instrs[user].opcode == IR_PHI) {
+      users[user_count++] = user;
+    }
+  }
+
+  ir_replace_all_uses(function, phi, same);
+  ir_remove(function, phi);
+  // The definition map may still name the phi; leave a forwarding pointer
+  function->instrs[phi].imm = same;
+
+  for (int i = 0; i < user_count; i++) {
+    if (!function->instrs[users[i]].dead) {
+      try_remove_trivial_phi(lowerer, users[i]);
+    }
+  }
+  free(users);
+  return same;
+}
+
+static IRValue add_phi_operands(Lowerer *lowerer, int variable, IRValue phi) {
+  IRFunction *function = lowerer->function;
+  IRBlock *block = &function->blocks[function->instrs[phi].block];
+  uint32_t pred_count = block->pred_count;
+
+  IRValue *operands = allocate(pred_count + 1, sizeof(IRValue));
+  for (uint32_t i = 0; i < pred_count; i++) {
+    operands[i] = read_variable(lowerer, variable, block->preds[i]);
+  }
+  ir_set_operands(function, phi, operands, pred_count);
+  free(operands);
+  return try_remove_trivial_phi(lowerer, phi);
+}
+
+static IRValue read_variable_recursive(Lowerer *lowerer, int variable,
+                                       IRBlockId block) {
+  IRFunction *function = lowerer->function;
+  IRBlock *current = &function->blocks[block];
+  IRValue value;
+
+  if (!current->sealed) {
+    // Predecessors are still unknown, so record an operand-less phi
+    value = ir_prepend(function, block, IR_PHI);
+    if (lowerer->incomplete_count == lowerer->incomplete_capacity) {
+      lowerer->incomplete =
+          grow(lowerer->incomplete, sizeof(IncompletePhi),
+               &lowerer->incomplete_capacity, 16);
+    }
+    IncompletePhi *entry = &lowerer->incomplete[lowerer->incomplete_count];
+    entry->block = block;
+    entry->variable = variable;
+    entry->phi = value;
+    entry->next = lowerer->incomplete_heads[block];
+    lowerer->incomplete_heads[block] = lowerer->incomplete_count++;
+  } else if (current->pred_count == 0) {
+    value = ir_prepend(function, block, IR_UNDEF);
+  } else if (current->pred_count == 1) {
+    value = read_variable(lowerer, variable, current->preds[0]);
+  } else if (lowerer->entered_at[block] != NOT_A_LOOP &&
+             lowerer->last_write[variable] <= lowerer->entered_at[block]) {
+    // Unchanged by the loop: the value it was entered with
+    value = read_variable(lowerer, variable, current->preds[0]);
+  } else {
+    // Break cycles by defining the variable before visiting predecessors
+    value = ir_prepend(function, block, IR_PHI);
+    write_variable(lowerer, variable, block, value);
+    value = add_phi_operands(lowerer, variable, value);
+  }
+
+  write_variable(lowerer, variable, block, value);
+  return value;
+}
+
+static IRValue read_variable(Lowerer *lowerer, int variable, IRBlockId block) {
+  if (lowerer->definition_capacity > 0) {
+    Definition *definition =
+        find_definition(lowerer, definition_key(block, variable));
+    if (definition->key != 0) {
+      IRValue value = definition->value;
+      while (lowerer->function->instrs[value].dead) {
+        value = (IRValue)lowerer->function->instrs[value].imm;
+      }
+      definition->value = value;
+      return value;
+    }
+  }
+  return read_variable_recursive(lowerer, variable, block);
+}
+
+static IRBlockId new_block(Lowerer *lowerer) {
+  IRBlockId block = ir_add_block(lowerer->function);
+  while (block >= lowerer->head_capacity) {
+    uint32_t old_capacity = lowerer->head_capacity;
+    uint32_t capacity = old_capacity;
+    lowerer->entered_at =
+        grow(lowerer->entered_at, sizeof(uint64_t), &capacity, 16);
+    lowerer->incomplete_heads =
+        grow(lowerer->incomplete_heads, sizeof(uint32_t),
+             &lowerer->head_capacity, 16);
+    for (uint32_t i = old_capacity; i < lowerer->head_capacity; i++) {
+      lowerer->incomplete_heads[i] = IR_NONE;
+      lowerer->entered_at[i] = NOT_A_LOOP;
+    }
+  }
+  return block;
+}
+
+/* Declares that every predecessor of `block` is known, completing the phis
+ * that were created while it was not. */
+static void seal_block(Lowerer *lowerer, IRBlockId block) {
+  uint32_t index = lowerer->incomplete_heads[block];
+  lowerer->incomplete_heads[block] = IR_NONE;
+  while (index != IR_NONE) {
+    IncompletePhi entry = lowerer->incomplete[index];
+    if (!lowerer->function->instrs[entry.phi].dead) {
+      add_phi_operands(lowerer, entry.variable, entry.phi);
+    }
+    index = entry.next;
+  }
+  lowerer->function->blocks[block].sealed = 1;
+}
+
+static IRValue emit(Lowerer *lowerer, IROpcode opcode, const IRValue *operands,
+                    int operand_count, int64_t imm) {
+  return ir_append(lowerer->function, lowerer->block, opcode, operands,
+                   operand_count, imm);
+}
+
+/* Code after a return is unreachable; it still goes into a block of its own
+ * so that lowering never appends past a terminator. */
+static void start_unreachable_block(Lowerer *lowerer) {
+  lowerer->block = new_block(lowerer);
+  seal_block(lowerer, lowerer->block);
+}
+
+static int is_global(const Symbol *symbol) { return symbol->scope_depth == 0; }
+
+/* The bit of a read mask that stands for `symbol`. */
+static uint64_t read_bit(const Symbol *symbol) {
+  return is_global(symbol) ? GLOBALS_READ : 1ull << (symbol->ir_variable % 63);
+}
+
+static void note_writes(Lowerer *lowerer, uint64_t bits) {
+  lowerer->time++;
+  for (; bits != 0; bits &= bits - 1) {
+    lowerer->written_at[__builtin_ctzll(bits)] = lowerer->time;
+  }
+}
+
+static void assign(Lowerer *lowerer, Symbol *symbol, IRValue value) {
+  note_writes(lowerer, read_bit(symbol));
+  if (is_global(symbol)) {
+    emit(lowerer, IR_STORE_GLOBAL, &value, 1, symbol->ir_variable);
+  } else {
+    lowerer->last_write[symbol->ir_variable] = lowerer->time;
+    write_variable(lowerer, symbol->ir_variable, lowerer->block, value);
+  }
+}
+
+static int new_variable(Lowerer *lowerer) {
+  if ((uint32_t)lowerer->variable_count == lowerer->variable_capacity) {
+    lowerer->last_write = grow(lowerer->last_write, sizeof(uint64_t),
+                               &lowerer->variable_capacity, 16);
+  }
+  lowerer->last_write[lowerer->variable_count] = 0;
+  return lowerer->variable_count++;
+}
+
+static IROpcode binary_opcode(TokenType op) {
+  switch (op) {
+  case TOKEN_EQ:
+    return IR_EQ;
+  case TOKEN_NEQ:
+    return IR_NE;
+  case TOKEN_LT:
+    return IR_LT;
+  case TOKEN_LTE:
+    return IR_LE;
+  case TOKEN_GT:
+    return IR_GT;
+  case TOKEN_GTE:
+    return IR_GE;
+  case TOKEN_PLUS:
+    return IR_ADD;
+  case TOKEN_MINUS:
+    return IR_SUB;
+  case TOKEN_STAR:
+    return IR_MUL;
+  case TOKEN_SLASH:
+    return IR_DIV;
+  default:
+    return IR_MOD;
+  }
+}
+
+/* Finds the value remembered for the shared expression `node`, or the free
+ * entry it would go into. */
+static SharedValue *find_shared_value(Lowerer *lowerer, const ASTNode_t *node) {
+  uint32_t mask = lowerer->shared_capacity - 1;
+  uint32_t index = (node->id * 2654435761u) & mask;
+  while (lowerer->shared_values[index].node != NULL &&
+         lowerer->shared_values[index].node != node) {
+    index = (index + 1) & mask;
+  }
+  return &lowerer->shared_values[index];
+}
+
+static void remember_value(Lowerer *lowerer, const ASTNode_t *node,
+                           IRValue value, uint64_t reads) {
+  if ((lowerer->shared_count + 1) * 2 > lowerer->shared_capacity) {
+    SharedValue *old = lowerer->shared_values;
+    uint32_t old_capacity = lowerer->shared_capacity;
+    lowerer->shared_capacity = old_capacity ? old_capacity * 2 : 64;
+    lowerer->shared_values =
+        allocate_zeroed(lowerer->shared_capacity, sizeof(SharedValue));
+    for (uint32_t i = 0; i < old_capacity; i++) {
+      if (old[i].node != NULL) {
+        *find_shared_value(lowerer, old[i].node) = old[i];
+      }
+    }
+    free(old);
+  }
+  SharedValue *entry = find_shared_value(lowerer, node);
+  if (entry->node == NULL) {
+    lowerer->shared_count++;
+  }
+  *entry = (SharedValue){node, lowerer->block, value, reads, lowerer->time};
+}
+
+/* Whether the value remembered in `entry` can stand for its expression in
+ * the current block. */
+static int still_valid(const Lowerer *lowerer, const SharedValue *entry) {
+  if (entry->node == NULL || entry->block != lowerer->block) {
+    return 0;
+  }
+  for (uint64_t bits = entry->reads; bits != 0; bits &= bits - 1) {
+    if (lowerer->written_at[__builtin_ctzll(bits)] > entry->time) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static IRValue lower_node(Lowerer *lowerer, ASTNode_t *node);
+
+/* Lowers an expression, reusing the value of a shared one already computed
+ * in the current block. Shared expressions have no side effects, so their
+ * value only changes when a variable or global they read is written. */
+static IRValue lower_expression(Lowerer *lowerer, ASTNode_t *node) {
+  if (node->id == 0) {
+    return lower_node(lowerer, node);
+  }
+  if (lowerer->shared_capacity > 0) {
+    SharedValue *entry = find_shared_value(lowerer, node);
+    if (still_valid(lowerer, entry)) {
+      IRValue value = entry->value;
+      // A phi removed as trivial forwards to its replacement
+      while (lowerer->function->instrs[value].dead) {
+        value = (IRValue)lowerer->function->instrs[value].imm;
+      }
+      return value;
+    }
+  }
+  IRValue value = lower_node(lowerer, node);
+  // The operands of a shared expression are shared, and were just lowered
+  uint64_t reads = 0;
+  if (node->type == AST_IDENTIFIER) {
+    reads = read_bit(node->symbol);
+  } else if (node->child_count == 2) {
+    reads = find_shared_value(lowerer, node->children[0])->reads |
+            find_shared_value(lowerer, node->children[1])->reads;
+  }
+  remember_value(lowerer, node, value, reads);
+  return value;
+}
+
+static IRValue lower_node(Lowerer *lowerer, ASTNode_t *node) {
+  switch (node->type) {
+  case AST_INT_LITERAL:
+    return emit(lowerer, IR_CONST, NULL, 0, strtoll(node->token->lexeme, NULL, 10));
+  case AST_CHAR_LITERAL:
+    return emit(lowerer, IR_CONST, NULL, 0, (signed char)node->token->lexeme[0]);
+  case AST_IDENTIFIER: {
+    Symbol *symbol = node->symbol;
+    if (is_global(symbol)) {
+      return emit(lowerer, IR_LOAD_GLOBAL, NULL, 0, symbol->ir_variable);
+    }
+    return read_variable(lowerer, symbol->ir_variable, lowerer->block);
+  }
+  case AST_ADDITION_EXPR:
+  case AST_MULTIPLICATION_EXPR:
+  case AST_RELATIONAL_EXPR:
+  case AST_EQUALITY_EXPR: {
+    IRValue operands[2] = {lower_expression(lowerer, node->children[0]),
+                           lower_expression(lowerer, node->children[1])};
+    return emit(lowerer, binary_opcode(node->token->type), operands, 2, 0);
+  }
+  case AST_ASSIGN_EXPR: {
+    IRValue value = lower_expression(lowerer, node->children[1]);
+    assign(lowerer, node->children[0]->symbol, value);
+    return value;
+  }
+  case AST_CALL_EXPR: {
+    ASTNode_t *args = node->children[1];
+    IRValue operands[args->child_count > 0 ? args->child_count : 1];
+    for (int i = 0; i < args->child_count; i++) {
+      operands[i] = lower_expression(lowerer, args->children[i]);
+    }
+    note_writes(lowerer, GLOBALS_READ); // The callee may store to any global
+    return emit(lowerer, IR_CALL, operands, args->child_count,
+                node->children[0]->token->intern_id);
+  }
+  case AST_FLOAT_LITERAL:
+    lower_error(lowerer, node->token,
+                "floating point values are not supported by the IR");
+    return emit(lowerer, IR_UNDEF, NULL, 0, 0);
+  default:
+    lower_error(lowerer, node->token,
+                "expression is not supported by the IR");
+    return emit(lowerer, IR_UNDEF, NULL, 0, 0);
+  }
+}
+
+/* Ends the current block with a jump to `target`, unless it already ended in
+ * a return. */
+static void jump_to(Lowerer *lowerer, IRBlockId target) {
+  if (ir_terminator(lowerer->function, lowerer->block) == IR_NONE) {
+    emit(lowerer, IR_JUMP, NULL, 0, 0);
+    ir_add_edge(lowerer->function, lowerer->block, target);
+  }
+}
+
+static void lower_if(Lowerer *lowerer, ASTNode_t *node) {
+  IRValue condition = lower_expression(lowerer, node->children[0]);
+  emit(lowerer, IR_BRANCH, &condition, 1, 0);
+
+  IRBlockId branch = lowerer->block;
+  IRBlockId then_block = new_block(lowerer);
+  IRBlockId join = new_block(lowerer);
+  IRBlockId else_block = node->child_count > 2 ? new_block(lowerer) : join;
+  ir_add_edge(lowerer->function, branch, then_block);
+  ir_add_edge(lowerer->function, branch, else_block);
+
+  seal_block(lowerer, then_block);
+  lowerer->block = then_block;
+  lower_statement(lowerer, node->children[1]);
+  jump_to(lowerer, join);
+
+  if (else_block != join) {
+    seal_block(lowerer, else_block);
+    lowerer->block = else_block;
+    lower_statement(lowerer, node->children[2]);
+    jump_to(lowerer, join);
+  }
+
+  seal_block(lowerer, join);
+  lowerer->block = join;
+}
+
+/* The condition goes in a header block of its own, left unsealed until the
+ * body has added the back edge to it. */
+static void lower_while(Lowerer *lowerer, ASTNode_t *node) {
+  IRBlockId header = new_block(lowerer);
+  lowerer->entered_at[header] = lowerer->time;
+  jump_to(lowerer, header);
+  lowerer->block = header;
+  IRValue condition = lower_expression(lowerer, node->children[0]);
+  emit(lowerer, IR_BRANCH, &condition, 1, 0);
+
+  IRBlockId body = new_block(lowerer);
+  IRBlockId exit = new_block(lowerer);
+  ir_add_edge(lowerer->function, header, body);
+  ir_add_edge(lowerer->function, header, exit);
+
+  seal_block(lowerer, body);
+  lowerer->block = body;
+  lower_statement(lowerer, node->children[1]);
+  jump_to(lowerer, header);
+
+  seal_block(lowerer, header);
+  seal_block(lowerer, exit);
+  lowerer->block = exit;
+}
+
+static void lower_statement(Lowerer *lowerer, ASTNode_t *node) {
+  switch (node->type) {
+  case AST_COMPOUND_STMT:
+    for (int i = 0; i < node->child_count; i++) {
+      lower_statement(lowerer, node->children[i]);
+    }
+    return;
+  case AST_DECL: {
+    Symbol *symbol = node->children[1]->symbol;
+    symbol->ir_variable = new_variable(lowerer);
+    if (node->child_count > 2) {
+      assign(lowerer, symbol, lower_expression(lowerer, node->children[2]));
+    }
+    return;
+  }
+  case AST_IF_STMT:
+    lower_if(lowerer, node);
+    return;
+  case AST_WHILE_STMT:
+    lower_while(lowerer, node);
+    return;
+  case AST_RETURN_STMT:
+    if (node->child_count > 0) {
+      IRValue value = lower_expression(lowerer, node->children[0]);
+      emit(lowerer, IR_RET, &value, 1, 0);
+    } else {
+      emit(lowerer, IR_RET, NULL, 0, 0);
+    }
+    start_unreachable_block(lowerer);
+    return;
+  default:
+    lower_expression(lowerer, node);
+    return;
+  }
+}
+
+static void lower_function(Lowerer *lowerer, ASTNode_t *function) {
+  ASTNode_t *ident = function->children[1];
+  ASTNode_t *params = function->children[2];
+
+  lowerer->function = ir_function_create(
+      ident->token->lexeme, ident->token->intern_id, params->child_count);
+  lowerer->function->returns_value =
+      function->children[0]->token->type != TOKEN_VOID;
+  lowerer->variable_count = 0;
+  lowerer->definition_count = 0;
+  lowerer->incomplete_count = 0;
+  if (lowerer->definition_capacity > 0) {
+    memset(lowerer->definitions, 0,
+           lowerer->definition_capacity * sizeof(Definition));
+  }
+
+  lowerer->block = new_block(lowerer);
+  seal_block(lowerer, lowerer->block);
+
+  for (int i = 0; i < params->child_count; i++) {
+    Symbol *symbol = params->children[i]->children[1]->symbol;
+    symbol->ir_variable = new_variable(lowerer);
+    assign(lowerer, symbol, emit(lowerer, IR_PARAM, NULL, 0, i));
+  }
+
+  lower_statement(lowerer, function_body(function));
+
+  // Falling off the end returns zero from non-void functions, as from main
+  if (ir_terminator(lowerer->function, lowerer->block) == IR_NONE) {
+    if (lowerer->function->returns_value) {
+      IRValue zero = emit(lowerer, IR_CONST, NULL, 0, 0);
+      emit(lowerer, IR_RET, &zero, 1, 0);
+    } else {
+      emit(lowerer, IR_RET, NULL, 0, 0);
+    }
+  }
+
+  // Drop the phis found trivial and the operand lists they replaced
+  ir_compact(lowerer->function);
+  ir_module_add_function(lowerer->module, lowerer->function);
+  lowerer->function = NULL;
+}
+
+/**
+ * @brief Evaluates an integer constant expression, as global initializers
+ * must be.
+ *
+ * @return Zero if `node` is not one.
+ */
+int evaluate_constant(ASTNode_t *node, int64_t *value) {
+  int64_t left, right;
+  switch (node->type) {
+  case AST_INT_LITERAL:
+    *value = strtoll(node->token->lexeme, NULL, 10);
+    return 1;
+  case AST_CHAR_LITERAL:
+    *value = (signed char)node->token->lexeme[0];
+    return 1;
+  case AST_RELATIONAL_EXPR:
+  case AST_EQUALITY_EXPR:
+    if (!evaluate_constant(node->children[0], &left) ||
+        !evaluate_constant(node->children[1], &right)) {
+      return 0;
+    }
+    switch (node->token->type) {
+    case TOKEN_EQ:
+      *value = left == right;
+      return 1;
+    case TOKEN_NEQ:
+      *value = left != right;
+      return 1;
+    case TOKEN_LT:
+      *value = left < right;
+      return 1;
+    case TOKEN_LTE:
+      *value = left <= right;
+      return 1;
+    case TOKEN_GT:
+      *value = left > right;
+      return 1;
+    default:
+      *value = left >= right;
+      return 1;
+    }
+  case AST_ADDITION_EXPR:
+  case AST_MULTIPLICATION_EXPR:
+    if (!evaluate_constant(node->children[0], &left) ||
+        !evaluate_constant(node->children[1], &right)) {
+      return 0;
+    }
+    switch (node->token->type) {
+    case TOKEN_PLUS:
+      *value = (int32_t)(left + right);
+      return 1;
+    case TOKEN_MINUS:
+      *value = (int32_t)(left - right);
+      return 1;
+    case TOKEN_STAR:
+      *value = (int32_t)(left * right);
+      return 1;
+    default:
+      // Division of the most negative int by -1 traps, as it does in sccp.c
+      if ((int32_t)right == 0 ||
+          ((int32_t)left == INT32_MIN && (int32_t)right == -1)) {
+        return 0;
+      }
+      *value = node->token->type == TOKEN_SLASH
+                   ? (int32_t)left / (int32_t)right
+                   : (int32_t)left % (int32_t)right;
+      return 1;
+    }
+  default:
+    return 0;
+  }
+}
+
+static void lower_global(Lowerer *lowerer, ASTNode_t *declaration) {
+  ASTNode_t *ident = declaration->children[1];
+  int64_t value = 0;
+  if (declaration->child_count > 2 &&
+      !evaluate_constant(declaration->children[2], &value)) {
+    lower_error(lowerer, ident->token,
+                "initializer element is not an integer constant");
+  }
+  if (ident->symbol->ir_variable < 0) {
+    ident->symbol->ir_variable = ir_module_add_global(
+        lowerer->module, ident->token->lexeme, ident->token->intern_id, value);
+  } else if (declaration->child_count > 2) {
+    // A tentative definition came first
+    lowerer->module->globals[ident->symbol->ir_variable].initial_value = value;
+  }
+}
+
+static void lowerer_free(Lowerer *lowerer) {
+  free(lowerer->shared_values);
+  free(lowerer->definitions);
+  free(lowerer->incomplete);
+  free(lowerer->incomplete_heads);
+  free(lowerer->entered_at);
+  free(lowerer->last_write);
+}
+
+/**
+ * @brief Lowers one resolved, type-checked top-level declaration into
+ * `module`.
+ *
+ * @return The number of errors reported.
+ */
+int lower_external_declaration(ASTNode_t *node, IRModule *module) {
+  Lowerer lowerer;
+  memset(&lowerer, 0, sizeof(Lowerer));
+  lowerer.module = module;
+
+  if (node->type == AST_FUNCTION_DEF) {
+    lower_function(&lowerer, node);
+  } else if (node->type == AST_DECL) {
+    lower_global(&lowerer, node);
+  }
+
+  lowerer_free(&lowerer);
+  return lowerer.errors;
+}
+
+/**
+ * @brief Lowers every function definition and global variable of a
+ * translation unit into `module`.
+ *
+ * @return The number of errors reported.
+ */
+int lower_translation_unit(ASTNode_t *ast, IRModule *module) {
+  int errors = 0;
+  for (int i = 0; i < ast->child_count; i++) {
+    errors += lower_external_declaration(ast->children[i], module);
+  }
+  return errors;
+}
@@ -0,0 +1,62 @@
+#include "ir_passes.h"
+#include "util.h"
+
+static const char *pass_names[NUM_PASSES] = {"sccp", "gvn", "licm", "dce"};
+
+typedef void (*PassFunction)(IRFunction *function, PassStats *stats);
+
+static const PassFunction pipeline[] = {run_sccp, run_gvn, run_licm, run_dce};
+
+static uint64_t live_instructions(const IRFunction *function) {
+  uint64_t count = 0;
+  for (IRValue id = 0; id < function->instr_count; id++) {
+    count += !function->instrs[id].dead;
+  }
+  return count;
+}
+
+void pass_stats_init(PassStats stats[NUM_PASSES]) {
+  for (int i = 0; i < NUM_PASSES; i++) {
+    stats[i] = (PassStats){.name = pass_names[i]};
+  }
+}
+
+/**
+ * @brief Runs the optimization pipeline over `function`, accumulating into
+ * `stats` the work done and the time spent by each pass.
+ */
+void ir_optimize_function(IRFunction *function, PassStats stats[NUM_PASSES]) {
+  for (size_t p = 0; p < sizeof(pipeline) / sizeof(pipeline[0]); p++) {
+    uint64_t before = live_instructions(function);
+    double start = now();
+    pipeline[p](function, &stats[p]);
+    stats[p].seconds += now() - start;
+    stats[p].instructions_removed += before - live_instructions(function);
+  }
+  // Later phases size their tables by the number of values
+  ir_compact(function);
+}
+
+/**
+ * @brief Runs the optimization pipeline over every function of the module.
+ */
+void ir_optimize_module(IRModule *module, PassStats stats[NUM_PASSES]) {
+  for (int f = 0; f < module->function_count; f++) {
+    ir_optimize_function(module->functions[f], stats);
+  }
+}
+
+void print_pass_stats(FILE *out, const PassStats stats[NUM_PASSES]) {
+  fprintf(out, "%-8s %10s %10s %10s %10s %10s %10s %12s\n", "pass",
+          "removed", "folded", "branches", "blocks", "hoisted", "loops",
+          "time (ms)");
+  for (int i = 0; i < NUM_PASSES; i++) {
+    fprintf(out, "%-8s %10llu %10llu %10llu %10llu %10llu %10llu %12.3f\n",
+            stats[i].name, (unsigned long long)stats[i].instructions_removed,
+            (unsigned long long)stats[i].values_folded,
+            (unsigned long long)stats[i].branches_folded,
+            (unsigned long long)stats[i].blocks_removed,
+            (unsigned long long)stats[i].values_hoisted,
+            (unsigned long long)stats[i].loops, stats[i].seconds * 1e3);
+  }
+}
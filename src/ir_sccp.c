@@ -0,0 +1,366 @@
+#include "ir.h"
+#include "ir_passes.h"
+#include "util.h"
+#include <stdlib.h>
+
+/*
+ * Sparse conditional constant propagation (Wegman and Zadeck). Values start
+ * optimistically undetermined and only move down the lattice
+ * TOP -> constant -> BOTTOM, while blocks only become executable once an
+ * executable edge reaches them. Two worklists drive the solver: CFG edges
+ * that became executable, and SSA values whose lattice value dropped.
+ */
+
+typedef enum {
+  LATTICE_TOP,
+  LATTICE_CONSTANT,
+  LATTICE_BOTTOM,
+} LatticeState;
+
+typedef struct {
+  IRFunction *function;
+  uint8_t *state;
+  int32_t *constant;
+  uint8_t *block_executable;
+  uint8_t *edge_executable; // Two entries per block, one per successor
+
+  uint32_t *edge_worklist; // block * 2 + successor index
+  uint32_t edge_count;
+  IRValue *value_worklist;
+  uint32_t value_count;
+  uint32_t value_capacity;
+} SCCP;
+
+static void push_edge(SCCP *sccp, IRBlockId block, int succ) {
+  uint32_t edge = block * 2 + succ;
+  if (!sccp->edge_executable[edge]) {
+    sccp->edge_executable[edge] = 1;
+    sccp->edge_worklist[sccp->edge_count++] = edge;
+  }
+}
+
+static void push_value(SCCP *sccp, IRValue value) {
+  if (sccp->value_count == sccp->value_capacity) {
+    sccp->value_worklist = grow(sccp->value_worklist, sizeof(IRValue),
+                                &sccp->value_capacity, 64);
+  }
+  sccp->value_worklist[sccp->value_count++] = value;
+}
+
+static void lower_to(SCCP *sccp, IRValue value, LatticeState state,
+                     int32_t constant) {
+  if (state == sccp->state[value] &&
+      (state != LATTICE_CONSTANT || constant == sccp->constant[value])) {
+    return;
+  }
+  // Two different constants meet at BOTTOM
+  if (sccp->state[value] == LATTICE_CONSTANT && state == LATTICE_CONSTANT) {
+    state = LATTICE_BOTTOM;
+  }
+  if (state < sccp->state[value]) {
+    return;
+  }
+  sccp->state[value] = state;
+  sccp->constant[value] = constant;
+  push_value(sccp, value);
+}
+
+/* Folds with the wrap-around semantics of 32-bit two's complement ints.
+ * Returns 0 when the operation traps and must be left to run time. */
+static int fold(IROpcode opcode, int32_t a, int32_t b, int32_t *result) {
+  uint32_t ua = (uint32_t)a, ub = (uint32_t)b;
+  switch (opcode) {
+  case IR_ADD:
+    *result = (int32_t)(ua + ub);
+    return 1;
+  case IR_SUB:
+    *result = (int32_t)(ua - ub);
+    return 1;
+  case IR_MUL:
+    *result = (int32_t)(ua * ub);
+    return 1;
+  case IR_DIV:
+  case IR_MOD:
+    if (b == 0 || (a == INT32_MIN && b == -1)) {
+      return 0;
+    }
+    *result = opcode == IR_DIV ? a / b : a % b;
+    return 1;
+  case IR_EQ:
+    *result = a == b;
+    return 1;
+  case IR_NE:
+    *result = a != b;
+    return 1;
+  case IR_LT:
+    *result = a < b;
+    return 1;
+  case IR_LE:
+    *result = a <= b;
+    return 1;
+  case IR_GT:
+    *result = a > b;
+    return 1;
+  case IR_GE:
+    *result = a >= b;
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+static int incoming_edge_executable(SCCP *sccp, IRBlockId pred,
+                                    IRBlockId block) {
+  const IRBlock *source = &sccp->function->blocks[pred];
+  for (int s = 0; s < source->succ_count; s++) {
+    if (source->succs[s] == block && sccp->edge_executable[pred * 2 + s]) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void visit_phi(SCCP *sccp, IRValue phi) {
+  IRFunction *function = sccp->function;
+  const IRBlock *block = &function->blocks[function->instrs[phi].block];
+  LatticeState state = LATTICE_TOP;
+  int32_t constant = 0;
+
+  for (int i = 0; i < function->instrs[phi].operand_count; i++) {
+    if (!incoming_edge_executable(sccp, block->preds[i],
+                                  function->instrs[phi].block)) {
+      continue;
+    }
+    IRValue operand = ir_operand(function, phi, i);
+    LatticeState operand_state = sccp->state[operand];
+    if (operand_state == LATTICE_BOTTOM ||
+        (operand_state == LATTICE_CONSTANT && state == LATTICE_CONSTANT &&
+         sccp->constant[operand] != constant)) {
+      state = LATTICE_BOTTOM;
+      break;
+    }
+    if (operand_state == LATTICE_CONSTANT) {
+      state = LATTICE_CONSTANT;
+      constant = sccp->constant[operand];
+    }
+  }
+  lower_to(sccp, phi, state, constant);
+}
+
+static void visit_instr(SCCP *sccp, IRValue id) {
+  IRFunction *function = sccp->function;
+  IRInstr *instr = &function->instrs[id];
+
+  switch (instr->opcode) {
+  case IR_CONST:
+    lower_to(sccp, id, LATTICE_CONSTANT, (int32_t)instr->imm);
+    return;
+  case IR_PHI:
+    visit_phi(sccp, id);
+    return;
+  case IR_JUMP:
+    push_edge(sccp, instr->block, 0);
+    return;
+  case IR_BRANCH: {
+    IRValue condition = ir_operand(function, id, 0);
+    if (sccp->state[condition] == LATTICE_CONSTANT) {
+      push_edge(sccp, instr->block, sccp->constant[condition] != 0 ? 0 : 1);
+    } else if (sccp->state[condition] == LATTICE_BOTTOM) {
+      push_edge(sccp, instr->block, 0);
+      push_edge(sccp, instr->block, 1);
+    }
+    return;
+  }
+  case IR_RET:
+  case IR_STORE_GLOBAL:
+    return;
+  case IR_ADD:
+  case IR_SUB:
+  case IR_MUL:
+  case IR_DIV:
+  case IR_MOD:
+  case IR_EQ:
+  case IR_NE:
+  case IR_LT:
+  case IR_LE:
+  case IR_GT:
+  case IR_GE: {
+    IRValue left = ir_operand(function, id, 0);
+    IRValue right = ir_operand(function, id, 1);
+    if (sccp->state[left] == LATTICE_BOTTOM ||
+        sccp->state[right] == LATTICE_BOTTOM) {
+      lower_to(sccp, id, LATTICE_BOTTOM, 0);
+      return;
+    }
+    if (sccp->state[left] == LATTICE_TOP || sccp->state[right] == LATTICE_TOP) {
+      return;
+    }
+    int32_t result;
+    if (fold(instr->opcode, sccp->constant[left], sccp->constant[right],
+             &result)) {
+      lower_to(sccp, id, LATTICE_CONSTANT, result);
+    } else {
+      lower_to(sccp, id, LATTICE_BOTTOM, 0);
+    }
+    return;
+  }
+  default:
+    // Parameters, calls, loads and undef are unknown at compile time
+    lower_to(sccp, id, LATTICE_BOTTOM, 0);
+    return;
+  }
+}
+
+static void solve(SCCP *sccp) {
+  IRFunction *function = sccp->function;
+
+  sccp->block_executable[0] = 1;
+  for (IRValue id = function->blocks[0].first; id != IR_NONE;
+       id = function->instrs[id].next) {
+    visit_instr(sccp, id);
+  }
+
+  while (sccp->edge_count > 0 || sccp->value_count > 0) {
+    while (sccp->edge_count > 0) {
+      uint32_t edge = sccp->edge_worklist[--sccp->edge_count];
+      IRBlockId target = function->blocks[edge / 2].succs[edge % 2];
+      int first_visit = !sccp->block_executable[target];
+      sccp->block_executable[target] = 1;
+
+      // A new incoming edge only changes phis, unless the block is new
+      for (IRValue id = function->blocks[target].first; id != IR_NONE;
+           id = function->instrs[id].next) {
+        if (!first_visit && function->instrs[id].opcode != IR_PHI) {
+          break;
+        }
+        visit_instr(sccp, id);
+      }
+    }
+
+    while (sccp->value_count > 0) {
+      IRValue value = sccp->value_worklist[--sccp->value_count];
+      for (uint32_t slot = function->instrs[value].first_use; slot != IR_NONE;
+           slot = function->uses[slot].next_use) {
+        IRValue user = function->uses[slot].user;
+        if (sccp->block_executable[function->instrs[user].block]) {
+          visit_instr(sccp, user);
+        }
+      }
+    }
+  }
+}
+
+static IRValue first_non_phi(const IRFunction *function, IRBlockId block) {
+  IRValue id = function->blocks[block].first;
+  while (function->instrs[id].opcode == IR_PHI) {
+    id = function->instrs[id].next;
+  }
+  return id;
+}
+
+static void rewrite(SCCP *sccp, PassStats *stats) {
+  IRFunction *function = sccp->function;
+
+  // Replace every value proven constant by a constant
+  for (IRValue id = 0; id < function->instr_count; id++) {
+    IRInstr *instr = &function->instrs[id];
+    if (instr->dead || instr->opcode == IR_CONST ||
+        sccp->state[id] != LATTICE_CONSTANT ||
+        !sccp->block_executable[instr->block]) {
+      continue;
+    }
+    if (instr->opcode == IR_PHI) {
+      IRValue constant =
+          ir_insert_before(function, first_non_phi(function, instr->block),
+                           IR_CONST, NULL, 0, sccp->constant[id]);
+      ir_replace_all_uses(function, id, constant);
+      ir_remove(function, id);
+    } else {
+      ir_set_operands(function, id, NULL, 0);
+      function->instrs[id].opcode = IR_CONST;
+      function->instrs[id].imm = sccp->constant[id];
+    }
+    stats->values_folded++;
+  }
+
+  // Turn branches on a known condition into jumps
+  for (IRBlockId b = 0; b < function->block_count; b++) {
+    IRValue terminator = ir_terminator(function, b);
+    if (!sccp->block_executable[b] || terminator == IR_NONE ||
+        function->instrs[terminator].opcode != IR_BRANCH) {
+      continue;
+    }
+    IRValue condition = ir_operand(function, terminator, 0);
+    if (function->instrs[condition].opcode != IR_CONST) {
+      continue;
+    }
+    int untaken = function->instrs[condition].imm != 0 ? 1 : 0;
+    ir_remove_edge(function, b, untaken);
+    ir_set_operands(function, terminator, NULL, 0);
+    function->instrs[terminator].opcode = IR_JUMP;
+    stats->branches_folded++;
+  }
+
+  for (IRBlockId b = 0; b < function->block_count; b++) {
+    if (!sccp->block_executable[b] && !function->blocks[b].dead) {
+      ir_remove_block(function, b);
+      stats->blocks_removed++;
+    }
+  }
+
+  // Dropping edges can leave phis with a single distinct operand
+  for (IRBlockId b = 0; b < function->block_count; b++) {
+    IRValue id = function->blocks[b].first;
+    while (id != IR_NONE && function->instrs[id].opcode == IR_PHI) {
+      IRValue next = function->instrs[id].next;
+      IRValue same = IR_NONE;
+      int trivial = 1;
+      for (int i = 0; i < function->instrs[id].operand_count; i++) {
+        IRValue operand = ir_operand(function, id, i);
+        if (operand != id && operand != same) {
+          trivial = same == IR_NONE;
+          same = operand;
+          if (!trivial) {
+            break;
+          }
+        }
+      }
+      if (trivial && same != IR_NONE) {
+        ir_replace_all_uses(function, id, same);
+        ir_remove(function, id);
+      }
+      id = next;
+    }
+  }
+}
+
+/**
+ * @brief Propagates constants through the SSA graph, folds branches on
+ * constant conditions and deletes the blocks that become unreachable.
+ */
+void run_sccp(IRFunction *function, PassStats *stats) {
+  SCCP sccp;
+  sccp.function = function;
+  sccp.state = allocate_zeroed(function->instr_count, sizeof(uint8_t));
+  sccp.constant = allocate_zeroed(function->instr_count, sizeof(int32_t));
+  sccp.block_executable =
+      allocate_zeroed(function->block_count, sizeof(uint8_t));
+  sccp.edge_executable =
+      allocate_zeroed(function->block_count * 2, sizeof(uint8_t));
+  sccp.edge_worklist =
+      allocate_zeroed(function->block_count * 2, sizeof(uint32_t));
+  sccp.edge_count = 0;
+  sccp.value_capacity = 64;
+  sccp.value_worklist = allocate_zeroed(sccp.value_capacity, sizeof(IRValue));
+  sccp.value_count = 0;
+
+  solve(&sccp);
+  rewrite(&sccp, stats);
+
+  free(sccp.state);
+  free(sccp.constant);
+  free(sccp.block_executable);
+  free(sccp.edge_executable);
+  free(sccp.edge_worklist);
+  free(sccp.value_worklist);
+}
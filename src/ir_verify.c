@@ -0,0 +1,235 @@
+#include "ir.h"
+#include "util.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * IR verifier. Checks the structural invariants every pass relies on: block
+ * lists and terminators, CFG edge symmetry, phi arity, use-list integrity and
+ * that every definition dominates its uses.
+ */
+
+typedef struct {
+  const IRFunction *function;
+  int errors;
+} Verifier;
+
+static void verify_error(Verifier *verifier, const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  fprintf(stderr, "IR verification error in %s: ", verifier->function->name);
+  vfprintf(stderr, format, args);
+  fprintf(stderr, "\n");
+  va_end(args);
+  verifier->errors++;
+}
+
+static int expected_successors(IROpcode opcode) {
+  switch (opcode) {
+  case IR_JUMP:
+    return 1;
+  case IR_BRANCH:
+    return 2;
+  default:
+    return 0;
+  }
+}
+
+static int dominates(const IRBlockId *idom, IRBlockId a, IRBlockId b) {
+  for (;;) {
+    if (a == b) {
+      return 1;
+    }
+    if (b == 0 || idom[b] == IR_NONE) {
+      return 0;
+    }
+    b = idom[b];
+  }
+}
+
+static void verify_blocks(Verifier *verifier, uint32_t *position) {
+  const IRFunction *function = verifier->function;
+
+  for (IRBlockId b = 0; b < function->block_count; b++) {
+    const IRBlock *block = &function->blocks[b];
+    if (block->dead) {
+      if (block->first != IR_NONE || block->pred_count || block->succ_count) {
+        verify_error(verifier, "dead b%u still has code or edges", b);
+      }
+      continue;
+    }
+    IRValue prev = IR_NONE;
+    int seen_non_phi = 0;
+    uint32_t index = 0;
+
+    for (IRValue id = block->first; id != IR_NONE;
+         id = function->instrs[id].next) {
+      const IRInstr *instr = &function->instrs[id];
+      position[id] = index++;
+
+      if (instr->dead) {
+        verify_error(verifier, "dead v%u is still linked into b%u", id, b);
+      }
+      if (instr->block != b) {
+        verify_error(verifier, "v%u is in b%u but records b%u", id, b,
+                     instr->block);
+      }
+      if (instr->prev != prev) {
+        verify_error(verifier, "broken instruction list at v%u", id);
+      }
+      if (instr->opcode == IR_PHI) {
+        if (seen_non_phi) {
+          verify_error(verifier, "phi v%u after a non-phi in b%u", id, b);
+        }
+        if (instr->operand_count != block->pred_count) {
+          verify_error(verifier, "phi v%u has %u operands for %u preds", id,
+                       instr->operand_count, block->pred_count);
+        }
+      } else {
+        seen_non_phi = 1;
+      }
+      if (ir_is_terminator(instr->opcode) && id != block->last) {
+        verify_error(verifier, "terminator v%u is not last in b%u", id, b);
+      }
+      prev = id;
+    }
+
+    if (prev != block->last) {
+      verify_error(verifier, "b%u last instruction mismatch", b);
+    }
+    IRValue terminator = ir_terminator(function, b);
+    if (terminator == IR_NONE) {
+      verify_error(verifier, "b%u has no terminator", b);
+    } else if (expected_successors(function->instrs[terminator].opcode) !=
+               block->succ_count) {
+      verify_error(verifier, "b%u has %u successors for its terminator", b,
+                   block->succ_count);
+    }
+
+    // Every successor edge must appear as a predecessor edge and vice versa
+    for (int s = 0; s < block->succ_count; s++) {
+      const IRBlock *succ = &function->blocks[block->succs[s]];
+      if (succ->dead) {
+        verify_error(verifier, "b%u branches to dead b%u", b, block->succs[s]);
+      }
+      int found = 0;
+      for (uint32_t p = 0; p < succ->pred_count; p++) {
+        found += succ->preds[p] == b;
+      }
+      if (found == 0) {
+        verify_error(verifier, "edge b%u -> b%u missing from preds", b,
+                     block->succs[s]);
+      }
+    }
+    for (uint32_t p = 0; p < block->pred_count; p++) {
+      const IRBlock *pred = &function->blocks[block->preds[p]];
+      int found = 0;
+      for (int s = 0; s < pred->succ_count; s++) {
+        found += pred->succs[s] == b;
+      }
+      if (found == 0) {
+        verify_error(verifier, "pred edge b%u -> b%u missing from succs",
+                     block->preds[p], b);
+      }
+    }
+  }
+}
+
+static void verify_operands(Verifier *verifier, const IRBlockId *idom,
+                            const uint32_t *position) {
+  const IRFunction *function = verifier->function;
+  uint32_t live_operands = 0;
+
+  for (IRValue id = 0; id < function->instr_count; id++) {
+    const IRInstr *instr = &function->instrs[id];
+    if (instr->dead) {
+      continue;
+    }
+    live_operands += instr->operand_count;
+
+    for (int i = 0; i < instr->operand_count; i++) {
+      uint32_t slot = instr->operand_start + i;
+      IRValue value = function->uses[slot].value;
+      if (value >= function->instr_count) {
+        verify_error(verifier, "v%u operand %d is out of range", id, i);
+        continue;
+      }
+      const IRInstr *definition = &function->instrs[value];
+      if (function->uses[slot].user != id) {
+        verify_error(verifier, "v%u operand %d records the wrong user", id, i);
+      }
+      if (definition->dead || !ir_has_result(definition->opcode)) {
+        verify_error(verifier, "v%u uses v%u, which defines no value", id,
+                     value);
+        continue;
+      }
+
+      // A phi operand is used at the end of the matching predecessor
+      IRBlockId use_block = instr->opcode == IR_PHI
+                                ? function->blocks[instr->block].preds[i]
+                                : instr->block;
+      if (idom[use_block] == IR_NONE) {
+        continue; // Unreachable code is not constrained
+      }
+      if (definition->block == use_block && instr->opcode != IR_PHI) {
+        if (position[value] >= position[id]) {
+          verify_error(verifier, "v%u is used by v%u before its definition",
+                       value, id);
+        }
+      } else if (!dominates(idom, definition->block, use_block)) {
+        verify_error(verifier, "v%u does not dominate its use in v%u", value,
+                     id);
+      }
+    }
+
+    for (uint32_t slot = instr->first_use; slot != IR_NONE;
+         slot = function->uses[slot].next_use) {
+      const IRUse *use = &function->uses[slot];
+      const IRInstr *user = &function->instrs[use->user];
+      if (use->value != id || user->dead || slot < user->operand_start ||
+          slot >= user->operand_start + user->operand_count) {
+        verify_error(verifier, "use list of v%u holds a stale slot %u", id,
+                     slot);
+        break;
+      }
+    }
+  }
+
+  uint32_t listed_uses = 0;
+  for (IRValue id = 0; id < function->instr_count; id++) {
+    if (!function->instrs[id].dead) {
+      listed_uses += ir_use_count(function, id);
+    }
+  }
+  if (listed_uses != live_operands) {
+    verify_error(verifier, "use lists hold %u uses for %u operands",
+                 listed_uses, live_operands);
+  }
+}
+
+/**
+ * @brief Checks the invariants of an SSA function.
+ *
+ * @return The number of violations found, each reported on stderr.
+ */
+int ir_verify(const IRFunction *function) {
+  Verifier verifier = {function, 0};
+  if (function->block_count == 0) {
+    verify_error(&verifier, "function has no blocks");
+    return verifier.errors;
+  }
+
+  uint32_t *position =
+      allocate_zeroed(function->instr_count + 1, sizeof(uint32_t));
+
+  verify_blocks(&verifier, position);
+  if (verifier.errors == 0) {
+    IRBlockId *idom = ir_dominators(function);
+    verify_operands(&verifier, idom, position);
+    free(idom);
+  }
+
+  free(position);
+  return verifier.errors;
+}
@@ -0,0 +1,248 @@
+#include "isel.h"
+#include "util.h"
+#include <stdlib.h>
+
+/*
+ * Bottom-up tree rewriting over the SSA IR. Trees are cut out of the value
+ * graph: an operand joins its user's tree when it can be evaluated where the
+ * user is, which holds for constants anywhere and for other values with a
+ * single use in the same block, except that a global load cannot move past a
+ * call or store. Any other operand is a VALUE leaf, already in a register.
+ *
+ * Labeling visits every node once, children first, and records the cheapest
+ * rule deriving each nonterminal from the generated rule tables, so it is
+ * linear in the size of the function. Reduction then walks down from each
+ * root along the chosen rules; an operand reduced to `reg` becomes the root
+ * of a tree of its own, anything else folds into its user.
+ */
+
+#define INFINITE_COST UINT16_MAX
+
+typedef struct {
+  const IRFunction *function;
+  Selection *selection;
+  uint16_t *costs; // Per instruction and nonterminal
+  uint16_t value_costs[NUM_NONTERMINALS]; // Of a VALUE leaf
+  uint8_t value_rules[NUM_NONTERMINALS];
+  uint32_t *effect_epochs; // Side effects before each instruction in its block
+  uint8_t *needs_value;    // Some user reads the value from a register
+} Labeler;
+
+int isel_is_scale(const IRFunction *function, IRValue id) {
+  int64_t value = function->instrs[id].imm;
+  return value == 1 || value == 2 || value == 4 || value == 8;
+}
+
+int isel_is_power_of_two(const IRFunction *function, IRValue id) {
+  int64_t value = function->instrs[id].imm;
+  return value > 0 && value <= INT32_MAX && (value & (value - 1)) == 0;
+}
+
+static int can_fold(const Labeler *labeler, IRValue kid, IRValue user) {
+  const IRFunction *function = labeler->function;
+  const IRInstr *instr = &function->instrs[kid];
+  if (isel_opcode_terminals[instr->opcode] == TERM_NONE ||
+      !ir_has_result(instr->opcode)) {
+    return 0;
+  }
+  if (instr->opcode == IR_CONST) {
+    return 1;
+  }
+  return instr->block == function->instrs[user].block &&
+         ir_use_count(function, kid) == 1 &&
+         (instr->opcode != IR_LOAD_GLOBAL ||
+          labeler->effect_epochs[kid] == labeler->effect_epochs[user]);
+}
+
+static void close_chains(uint16_t *costs, uint8_t *rules) {
+  for (int c = 0; c < ISEL_CHAIN_RULE_COUNT; c++) {
+    const IselRuleInfo *rule = &isel_rules[isel_chain_rules[c]];
+    if (costs[rule->kids[0]] == INFINITE_COST) {
+      continue;
+    }
+    uint32_t cost = (uint32_t)costs[rule->kids[0]] + rule->cost;
+    if (cost < costs[rule->lhs]) {
+      costs[rule->lhs] = (uint16_t)cost;
+      rules[rule->lhs] = isel_chain_rules[c];
+    }
+  }
+}
+
+/* Costs of `kid` deriving each nonterminal, as an operand of `user`. */
+static const uint16_t *operand_costs(const Labeler *labeler, IRValue kid,
+                                     IRValue user) {
+  if (can_fold(labeler, kid, user)) {
+    return &labeler->costs[kid * NUM_NONTERMINALS];
+  }
+  return labeler->value_costs;
+}
+
+static void label_terminal(const Labeler *labeler, IselTerminal terminal,
+                           IRValue id, uint16_t *costs, uint8_t *rules) {
+  for (int n = 0; n < NUM_NONTERMINALS; n++) {
+    costs[n] = INFINITE_COST;
+    rules[n] = RULE_NONE;
+  }
+  for (int i = isel_terminal_rule_start[terminal];
+       i < isel_terminal_rule_start[terminal + 1]; i++) {
+    const IselRuleInfo *rule = &isel_rules[isel_terminal_rules[i]];
+    if (rule->predicate != NULL && !rule->predicate(labeler->function, id)) {
+      continue;
+    }
+    uint32_t cost = rule->cost;
+    for (int k = 0; k < rule->arity && cost < INFINITE_COST; k++) {
+      IRValue kid = ir_operand(labeler->function, id, k);
+      cost += operand_costs(labeler, kid, id)[rule->kids[k]];
+    }
+    if (cost < costs[rule->lhs]) {
+      costs[rule->lhs] = (uint16_t)cost;
+      rules[rule->lhs] = isel_terminal_rules[i];
+    }
+  }
+  close_chains(costs, rules);
+}
+
+static void label(Labeler *labeler, IRValue id) {
+  IselTerminal terminal =
+      isel_opcode_terminals[labeler->function->instrs[id].opcode];
+  if (terminal != TERM_NONE) {
+    label_terminal(labeler, terminal, id,
+                   &labeler->costs[id * NUM_NONTERMINALS],
+                   &labeler->selection->rules[id * NUM_NONTERMINALS]);
+  }
+}
+
+/* Marks the trees below `id`, which derives `goal` in the tree of `root`. */
+static void reduce(Labeler *labeler, IRValue id, Nonterminal goal,
+                   IRValue root) {
+  const IselRuleInfo *rule =
+      &isel_rules[selection_rule(labeler->selection, id, goal)];
+  if (rule->terminal == TERM_NONE) {
+    reduce(labeler, id, rule->kids[0], root);
+    return;
+  }
+  for (int k = 0; k < rule->arity; k++) {
+    IRValue kid = ir_operand(labeler->function, id, k);
+    if (!can_fold(labeler, kid, id)) {
+      continue;
+    }
+    if (rule->kids[k] == NT_REG) {
+      labeler->needs_value[kid] = 1;
+    } else {
+      labeler->selection->roots[kid] = root;
+      reduce(labeler, kid, rule->kids[k], root);
+    }
+  }
+}
+
+/**
+ * @brief Picks a minimum-cost tiling of `function` with the generated rules.
+ */
+void select_instructions(const IRFunction *function, Selection *selection) {
+  uint32_t count = function->instr_count;
+  selection->instr_count = count;
+  selection->rules = allocate_zeroed((size_t)count * NUM_NONTERMINALS, 1);
+  selection->roots = allocate_zeroed(count, sizeof(IRValue));
+  for (IRValue id = 0; id < count; id++) {
+    selection->roots[id] = id;
+  }
+
+  Labeler labeler = {.function = function, .selection = selection};
+  labeler.costs =
+      allocate_zeroed((size_t)count * NUM_NONTERMINALS, sizeof(uint16_t));
+  labeler.effect_epochs = allocate_zeroed(count, sizeof(uint32_t));
+  labeler.needs_value = allocate_zeroed(count, 1);
+  label_terminal(&labeler, TERM_VALUE, IR_NONE, labeler.value_costs,
+                 labeler.value_rules);
+
+  // Constants fold into users in any block, so they are labeled first
+  for (IRBlockId b = 0; b < function->block_count; b++) {
+    if (function->blocks[b].dead) {
+      continue;
+    }
+    for (IRValue id = function->blocks[b].first; id != IR_NONE;
+         id = function->instrs[id].next) {
+      if (function->instrs[id].opcode == IR_CONST) {
+        label(&labeler, id);
+      }
+    }
+  }
+  // Other operands that fold come before their user in the same block
+  for (IRBlockId b = 0; b < function->block_count; b++) {
+    if (function->blocks[b].dead) {
+      continue;
+    }
+    uint32_t epoch = 0;
+    for (IRValue id = function->blocks[b].first; id != IR_NONE;
+         id = function->instrs[id].next) {
+      const IRInstr *instr = &function->instrs[id];
+      labeler.effect_epochs[id] = epoch;
+      epoch += ir_has_side_effects(instr->opcode);
+      if (instr->opcode != IR_CONST) {
+        label(&labeler, id);
+      }
+    }
+  }
+
+  // Users come after the operands folded into them, so walking each block
+  // backwards decides whether a value is folded before reaching it
+  for (IRBlockId b = 0; b < function->block_count; b++) {
+    if (function->blocks[b].dead) {
+      continue;
+    }
+    for (IRValue id = function->blocks[b].last; id != IR_NONE;
+         id = function->instrs[id].prev) {
+      const IRInstr *instr = &function->instrs[id];
+      if (selection->rules[id * NUM_NONTERMINALS + NT_REG] == RULE_NONE &&
+          selection->rules[id * NUM_NONTERMINALS + NT_STMT] == RULE_NONE) {
+        for (int i = 0; i < instr->operand_count; i++) {
+          labeler.needs_value[ir_operand(function, id, i)] = 1;
+        }
+        continue;
+      }
+      if (instr->opcode == IR_CONST ||
+          (!labeler.needs_value[id] && !selection_is_root(selection, id))) {
+        continue;
+      }
+      selection->roots[id] = id;
+      reduce(&labeler, id, ir_has_result(instr->opcode) ? NT_REG : NT_STMT,
+             id);
+    }
+  }
+  // A constant is materialized once if any user needs it in a register
+  for (IRValue id = 0; id < count; id++) {
+    if (labeler.needs_value[id]) {
+      selection->roots[id] = id;
+    }
+  }
+
+  free(labeler.costs);
+  free(labeler.effect_epochs);
+  free(labeler.needs_value);
+}
+
+void selection_free(Selection *selection) {
+  free(selection->rules);
+  free(selection->roots);
+}
+
+void dump_selection(FILE *out, const IRFunction *function,
+                    const Selection *selection) {
+  fprintf(out, "selection %s:\n", function->name);
+  for (IRBlockId b = 0; b < function->block_count; b++) {
+    if (function->blocks[b].dead) {
+      continue;
+    }
+    for (IRValue id = function->blocks[b].first; id != IR_NONE;
+         id = function->instrs[id].next) {
+      const IRInstr *instr = &function->instrs[id];
+      Nonterminal goal = ir_has_result(instr->opcode) ? NT_REG : NT_STMT;
+      IselRule rule = selection_rule(selection, id, goal);
+      if (!selection_is_root(selection, id)) {
+        fprintf(out, "  %%%u folded into %%%u\n", id, selection->roots[id]);
+      } else if (rule != RULE_NONE) {
+        fprintf(out, "  %%%u %s\n", id, isel_rules[rule].name);
+      }
+    }
+  }
+}
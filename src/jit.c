@@ -0,0 +1,63 @@
+#include "jit.h"
+#include "linker.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/*
+ * In-process execution. Code and globals share one anonymous mapping, code
+ * first and globals from the next page on, so every relocation is within
+ * reach of a 32-bit displacement. Once relocated, the code pages are made
+ * read-only and executable.
+ */
+
+typedef int (*EntryPoint)(int argc, char **argv);
+
+/**
+ * @brief Loads the module's code, calls its main function with `program` as
+ * argv[0] and stores the result in `status`.
+ *
+ * @return Nonzero if the code could not be loaded.
+ */
+int jit_run(const IRModule *module, const MachineCode *code,
+            const char *program, int *status) {
+  int main_index = find_function(code, "main");
+  if (main_index < 0) {
+    fprintf(stderr, "Error: no main function\n");
+    return 1;
+  }
+
+  size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+  size_t code_size = code->assembler.size;
+  size_t text_size = (code_size + page_size - 1) & ~(page_size - 1);
+  size_t size = text_size + data_size(module);
+  uint8_t *memory = mmap(NULL, size ? size : 1, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED) {
+    perror("mmap");
+    return 1;
+  }
+
+  memcpy(memory, code->assembler.bytes, code_size);
+  build_data(module, memory + text_size);
+  if (apply_relocations(code, memory, (uint64_t)(uintptr_t)memory,
+                        (uint64_t)(uintptr_t)(memory + text_size)) > 0) {
+    munmap(memory, size);
+    return 1;
+  }
+  if (mprotect(memory, text_size, PROT_READ | PROT_EXEC) != 0) {
+    perror("mprotect");
+    munmap(memory, size);
+    return 1;
+  }
+
+  char *argv[] = {(char *)program, NULL};
+  EntryPoint entry;
+  void *address = memory + code->functions[main_index].offset;
+  memcpy(&entry, &address, sizeof(entry));
+  *status = entry(1, argv);
+
+  munmap(memory, size);
+  return 0;
+}
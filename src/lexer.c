@@ -3,30 +3,37 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "linked_list.h"
+#include "arena.h"
+#include "intern.h"
+#include "lexer.h"
+#include "scan.h"
 #include "tokens.h"
+#include "util.h"
 
 #define MAX_LEXEME_SIZE 255
 
-typedef struct
+void init_lexer(Lexer *lexer, const char *source, size_t length,
+                Arena *literals)
 {
-    FILE *input_file;
-    int current_line;
-    int current_column;
-    char current_char;
-} Lexer;
-
-void init_lexer(Lexer *lexer, FILE *file_pointer)
-{
-    lexer->input_file = file_pointer;
+    lexer->source = source;
+    lexer->end = source + length;
+    lexer->cursor = source;
     lexer->current_line = 1;
     lexer->current_column = 0;
     lexer->current_char = '\0';
+    lexer->literals = literals;
+    lexer->errors = 0;
 }
 
-char next_char(Lexer *lexer)
+int next_char(Lexer *lexer)
 {
-    char c = fgetc(lexer->input_file);
+    if (lexer->cursor >= lexer->end)
+    {
+        lexer->current_char = EOF;
+        return EOF;
+    }
+
+    int c = (unsigned char)*lexer->cursor++;
     if (c == '\n')
     {
         lexer->current_line++;
@@ -40,86 +47,465 @@ char next_char(Lexer *lexer)
     return c;
 }
 
-char peek_char(Lexer *lexer)
+int peek_char(Lexer *lexer)
 {
-    char c = fgetc(lexer->input_file);
-    if (c != EOF)
+    if (lexer->cursor >= lexer->end)
     {
-        fseek(lexer->input_file, -1, SEEK_CUR);
+        return EOF;
     }
-    return c;
+    return (unsigned char)*lexer->cursor;
 }
 
-void assign_lexeme(Token *token, char *lexeme)
+/* Moves the cursor to `target` in one step, keeping line and column in sync
+ * with what calling next_char for every skipped byte would have produced. */
+void skip_to(Lexer *lexer, const char *target)
 {
-    token->lexeme = (char *)malloc(strlen(lexeme) + 1);
-    if (token->lexeme == NULL)
+    size_t newlines = scan_count_byte(lexer->cursor, target, '\n');
+    if (newlines == 0)
     {
-        fprintf(stderr, "Memory allocation error\n");
-        exit(EXIT_FAILURE);
+        lexer->current_column += target - lexer->cursor;
     }
-    strcpy(token->lexeme, lexeme);
+    else
+    {
+        const char *line_start = target;
+        while (line_start[-1] != '\n')
+        {
+            line_start--;
+        }
+        lexer->current_line += newlines;
+        lexer->current_column = target - line_start;
+    }
+    lexer->cursor = target;
 }
 
-Token check_reserved(char *lexeme, Token token) {
-    int i;
-    for (i = 0; i < NUM_TOKENS; i++) {
-      char temp[255];
-      /* Make a lowercase copy of the token's name to see if it matches a reserved
-       * keyword */
-      strcpy(temp, token_names[i]);
-      for (int j = 0; temp[j]; j++) {
-        temp[j] = tolower(temp[j]);
-      }
-  
-      if (strcmp(lexeme, temp) == 0) {
-        token.type = (TokenType)i;
-        assign_lexeme(&token, (char *)temp);
-        return token;
-      }
+/* Reports an error in the source from `start` to `end` and counts it, so the
+ * caller can drop the file; lexing goes on after it. */
+void lexer_error(Lexer *lexer, Token *token, const char *start,
+                 const char *end, const char *message)
+{
+    fprintf(stderr, "Error: %s at line %d, column %d: %.*s\n", message,
+            token->line, token->column, (int)(end - start), start);
+    lexer->errors++;
+}
+
+void skip_whitespace_and_comments(Lexer *lexer)
+{
+    for (;;)
+    {
+        skip_to(lexer, scan_skip_whitespace(lexer->cursor, lexer->end));
+
+        const char *p = lexer->cursor;
+        if (p + 1 >= lexer->end || p[0] != '/')
+        {
+            return;
+        }
+
+        if (p[1] == '/')
+        {
+            // The newline itself is consumed as whitespace on the next round
+            skip_to(lexer, scan_find_byte(p + 2, lexer->end, '\n'));
+        }
+        else if (p[1] == '*')
+        {
+            const char *close = scan_find_comment_end(p + 2, lexer->end);
+            if (close == lexer->end)
+            {
+                Token comment = {.line = lexer->current_line,
+                                 .column = lexer->current_column + 1};
+                lexer_error(lexer, &comment, p, p + 2, "unterminated comment");
+                skip_to(lexer, lexer->end);
+                return;
+            }
+            skip_to(lexer, close + 2);
+        }
+        else
+        {
+            return;
+        }
     }
-  
-    token.type = TOKEN_IDENTIFIER;
-    assign_lexeme(&token, lexeme);
-    return token;
-  }
+}
+
+void assign_lexeme(Token *token, char *lexeme)
+{
+    token->lexeme = duplicate(lexeme);
+    token->length = strlen(lexeme);
+}
 
 Token recognize_alpha(Lexer *lexer, Token token)
 {
-    
     int i = 0;
     char lexeme[MAX_LEXEME_SIZE];
 
+    const char *start = lexer->cursor - 1;
     lexeme[i++] = lexer->current_char;
 
-    char c = next_char(lexer);
+    while (isalnum(peek_char(lexer)) || peek_char(lexer) == '_')
+    {
+        int c = next_char(lexer);
+        if (i < MAX_LEXEME_SIZE - 1)
+        {
+            lexeme[i++] = c;
+        }
+    }
+    if (lexer->cursor - start > MAX_LEXEME_SIZE - 1)
+    {
+        lexer_error(lexer, &token, start, start + i, "identifier too long");
+    }
+
+    // Interning doubles as the keyword lookup and gives the parser a stable,
+    // shared copy of the spelling
+    token.intern_id = intern(lexeme, i);
+    token.type = intern_keyword(token.intern_id);
+    token.lexeme = (char *)intern_string(token.intern_id);
+    token.length = i;
+
+    return token;
+}
 
-    while (isalnum(c) || c == '_')
+Token recognize_number(Lexer *lexer, Token token)
+{
+    const char *start = lexer->cursor - 1;
+    char lexeme[MAX_LEXEME_SIZE];
+
+    token.type = TOKEN_INT_LITERAL;
+    while (isdigit(peek_char(lexer)))
     {
-        lexeme[i++] = c;
-        c = next_char(lexer);
+        next_char(lexer);
     }
 
-    lexeme[i] = '\0';
+    if (peek_char(lexer) == '.')
+    {
+        next_char(lexer);
+        if (!isdigit(peek_char(lexer)))
+        {
+            lexer_error(lexer, &token, start, lexer->cursor,
+                        "expected digit after decimal point");
+        }
+        while (isdigit(peek_char(lexer)))
+        {
+            next_char(lexer);
+        }
+        token.type = TOKEN_FLOAT_LITERAL;
+    }
 
-    token.type = TOKEN_IDENTIFIER;
+    size_t length = lexer->cursor - start;
+    if (isalpha(peek_char(lexer)) || peek_char(lexer) == '_')
+    {
+        // Take the whole suffix, so it is not lexed again as an identifier
+        while (isalnum(peek_char(lexer)) || peek_char(lexer) == '_')
+        {
+            next_char(lexer);
+        }
+        lexer_error(lexer, &token, start, lexer->cursor,
+                    "invalid suffix on decimal constant");
+    }
+    else if (length > MAX_LEXEME_SIZE - 1)
+    {
+        lexer_error(lexer, &token, start, lexer->cursor, "number too long");
+    }
 
+    if (length > MAX_LEXEME_SIZE - 1)
+    {
+        length = MAX_LEXEME_SIZE - 1;
+    }
+    memcpy(lexeme, start, length);
+    lexeme[length] = '\0';
     assign_lexeme(&token, lexeme);
+    return token;
+}
+
+Token recognise_special(Lexer *lexer, Token token)
+{
+    int c = lexer->current_char;
+    char lexeme[3] = {(char)c, '\0', '\0'};
 
-    token = check_reserved(token.lexeme, token); // Check if token is reserved
+    if (peek_char(lexer) == '=' && strchr("=!<>", c) != NULL)
+    {
+        lexeme[1] = (char)next_char(lexer);
+        switch (c)
+        {
+        case '=':
+            token.type = TOKEN_EQ;
+            break;
+        case '!':
+            token.type = TOKEN_NEQ;
+            break;
+        case '<':
+            token.type = TOKEN_LTE;
+            break;
+        default:
+            token.type = TOKEN_GTE;
+            break;
+        }
+        assign_lexeme(&token, lexeme);
+        return token;
+    }
 
+    switch (c)
+    {
+    case '+':
+        token.type = TOKEN_PLUS;
+        if (peek_char(lexer) == '+')
+        {
+            lexeme[1] = (char)next_char(lexer);
+            token.type = TOKEN_PLUS_PLUS;
+        }
+        break;
+    case '-':
+        token.type = TOKEN_MINUS;
+        if (peek_char(lexer) == '-')
+        {
+            lexeme[1] = (char)next_char(lexer);
+            token.type = TOKEN_MINUS_MINUS;
+        }
+        break;
+    case '&':
+        token.type = TOKEN_AMPERSAND;
+        if (peek_char(lexer) == '&')
+        {
+            lexeme[1] = (char)next_char(lexer);
+            token.type = TOKEN_AND;
+        }
+        break;
+    case '|':
+        token.type = TOKEN_UNRECOGNIZED;
+        if (peek_char(lexer) == '|')
+        {
+            lexeme[1] = (char)next_char(lexer);
+            token.type = TOKEN_OR;
+        }
+        break;
+    case '(':
+        token.type = TOKEN_LPAREN;
+        break;
+    case ')':
+        token.type = TOKEN_RPAREN;
+        break;
+    case '{':
+        token.type = TOKEN_LBRACE;
+        break;
+    case '}':
+        token.type = TOKEN_RBRACE;
+        break;
+    case ';':
+        token.type = TOKEN_SEMICOLON;
+        break;
+    case ',':
+        token.type = TOKEN_COMMA;
+        break;
+    case '*':
+        token.type = TOKEN_STAR;
+        break;
+    case '/':
+        token.type = TOKEN_SLASH;
+        break;
+    case '%':
+        token.type = TOKEN_MOD;
+        break;
+    case '<':
+        token.type = TOKEN_LT;
+        break;
+    case '>':
+        token.type = TOKEN_GT;
+        break;
+    case '=':
+        token.type = TOKEN_ASSIGN;
+        break;
+    default:
+        token.type = TOKEN_UNRECOGNIZED;
+        break;
+    }
+
+    assign_lexeme(&token, lexeme);
     return token;
 }
 
-Token next_token(Lexer *lexer)
+int hex_value(int c)
 {
-    char c;
-    Token token;
+    if (isdigit(c))
+    {
+        return c - '0';
+    }
+    return tolower(c) - 'a' + 10;
+}
+
+/* Slow path of literal lexing: copies the plain runs between backslashes with
+ * memcpy and decodes each escape sequence. `p` and `close` delimit the body of
+ * the literal, without the quotes. */
+size_t decode_escapes(Lexer *lexer, Token *token, char *out, const char *p,
+                      const char *close)
+{
+    char *start = out;
+
+    while (p < close)
+    {
+        const char *backslash = scan_find_byte(p, close, '\\');
+        memcpy(out, p, backslash - p);
+        out += backslash - p;
+        p = backslash;
+        if (p == close)
+        {
+            break;
+        }
+
+        const char *escape = p++;
+        int c = (unsigned char)*p++;
+        switch (c)
+        {
+        case 'n':
+            *out++ = '\n';
+            break;
+        case 't':
+            *out++ = '\t';
+            break;
+        case 'r':
+            *out++ = '\r';
+            break;
+        case 'a':
+            *out++ = '\a';
+            break;
+        case 'b':
+            *out++ = '\b';
+            break;
+        case 'f':
+            *out++ = '\f';
+            break;
+        case 'v':
+            *out++ = '\v';
+            break;
+        case '\\':
+        case '\'':
+        case '"':
+        case '?':
+            *out++ = (char)c;
+            break;
+        case '\r':
+            // Line continuation written with a CRLF line ending
+            if (p < close && *p == '\n')
+            {
+                p++;
+            }
+            break;
+        case '\n':
+            break;
+        case 'x':
+        {
+            if (p == close || !isxdigit((unsigned char)*p))
+            {
+                lexer_error(lexer, token, escape, p,
+                            "\\x used with no hex digits");
+                break;
+            }
+            int value = 0;
+            int out_of_range = 0;
+            while (p < close && isxdigit((unsigned char)*p))
+            {
+                value = (value << 4) | hex_value((unsigned char)*p++);
+                out_of_range |= value > 0xff;
+                value &= 0xfff;
+            }
+            if (out_of_range)
+            {
+                lexer_error(lexer, token, escape, p,
+                            "hex escape sequence out of range");
+            }
+            *out++ = (char)value;
+            break;
+        }
+        default:
+            if (c >= '0' && c <= '7')
+            {
+                int value = c - '0';
+                for (int digits = 1;
+                     digits < 3 && p < close && *p >= '0' && *p <= '7';
+                     digits++)
+                {
+                    value = (value << 3) | (*p++ - '0');
+                }
+                if (value > 0xff)
+                {
+                    lexer_error(lexer, token, escape, p,
+                                "octal escape sequence out of range");
+                }
+                *out++ = (char)value;
+                break;
+            }
+            lexer_error(lexer, token, escape, p, "unknown escape sequence");
+            *out++ = (char)c;
+        }
+    }
+
+    *out = '\0';
+    return out - start;
+}
+
+Token recognise_literal(Lexer *lexer, Token token)
+{
+    char quote = (char)lexer->current_char;
+    const char *open = lexer->cursor - 1;
+    const char *p = lexer->cursor;
+    int has_escapes = 0;
+
+    // Find the closing quote, stepping over escaped characters
+    for (;;)
+    {
+        p = scan_find_string_special(p, lexer->end, quote);
+        if (p >= lexer->end || *p == '\n')
+        {
+            p = p < lexer->end ? p : lexer->end;
+            lexer_error(lexer, &token, open, p,
+                        quote == '"' ? "missing terminating \" character"
+                                     : "missing terminating ' character");
+            // The literal is taken to end with the line
+            token.type = quote == '"' ? TOKEN_STRING_LITERAL
+                                      : TOKEN_CHAR_LITERAL;
+            token.lexeme = arena_strndup(lexer->literals, lexer->cursor,
+                                         p - lexer->cursor);
+            token.length = p - lexer->cursor;
+            skip_to(lexer, p);
+            return token;
+        }
+        if (*p == quote)
+        {
+            break;
+        }
+        has_escapes = 1;
+        // A line continuation may end in CRLF, whose '\n' is not escaped
+        p += p[1] == '\r' && p[2] == '\n' ? 3 : 2;
+    }
+
+    const char *body = lexer->cursor;
+    size_t raw_length = p - body;
+
+    if (has_escapes)
+    {
+        // Decoding never makes a literal longer than its source
+        token.lexeme = arena_alloc(lexer->literals, raw_length + 1);
+        token.length = decode_escapes(lexer, &token, token.lexeme, body, p);
+    }
+    else
+    {
+        token.lexeme = arena_strndup(lexer->literals, body, raw_length);
+        token.length = raw_length;
+    }
 
-    do
+    token.type = quote == '"' ? TOKEN_STRING_LITERAL : TOKEN_CHAR_LITERAL;
+    if (token.type == TOKEN_CHAR_LITERAL && token.length != 1)
     {
-        c = next_char(lexer);
-    } while (isspace(c));
+        lexer_error(lexer, &token, open, p + 1,
+                    token.length == 0 ? "empty character constant"
+                                      : "multi-character character constant");
+    }
+
+    skip_to(lexer, p + 1);
+    return token;
+}
+
+Token recognize_token(Lexer *lexer)
+{
+    Token token = {0};
+
+    int c = next_char(lexer);
 
     token.line = lexer->current_line;
     token.column = lexer->current_column;
@@ -129,30 +515,39 @@ Token next_token(Lexer *lexer)
         return recognize_alpha(lexer, token);
     }
 
+    if (isdigit(c))
+    {
+        return recognize_number(lexer, token);
+    }
+
+    if (c == '"' || c == '\'')
+    {
+        return recognise_literal(lexer, token);
+    }
+
     if (c == EOF)
     {
-        printf("Recognized EOF\n");
         token.type = TOKEN_EOF;
         assign_lexeme(&token, "EOF");
         return token;
     }
+
+    token = recognise_special(lexer, token);
+    if (token.type == TOKEN_UNRECOGNIZED)
+    {
+        lexer_error(lexer, &token, lexer->cursor - 1, lexer->cursor,
+                    "unrecognized character");
+    }
     return token;
 }
 
-node_t *tokenize_input(FILE *file_pointer)
+Token next_token(Lexer *lexer)
 {
-    Lexer lexer;
-    init_lexer(&lexer, file_pointer);
-
-    Token token = next_token(&lexer);
-    node_t *token_list_head = create_node(token);
-
-    while (token.type != TOKEN_EOF) {
-        token = next_token(&lexer);
-        push(&token_list_head, token);
-      }
+    skip_whitespace_and_comments(lexer);
 
-    fclose(lexer.input_file);
-
-    return token_list_head;
-}
\ No newline at end of file
+    const char *start = lexer->cursor;
+    Token token = recognize_token(lexer);
+    token.raw = start;
+    token.raw_length = lexer->cursor - start;
+    return token;
+}
@@ -1,14 +1,11 @@
 #include "linked_list.h"
 #include "tokens.h"
+#include "util.h"
 #include <stdio.h>
 #include <stdlib.h>
 
 node_t *create_node(Token token) {
-  node_t *new = (node_t *)malloc(sizeof(node_t));
-  if (new == NULL) {
-    fprintf(stderr, "Memory allocation error\n");
-    exit(EXIT_FAILURE);
-  }
+  node_t *new = allocate(1, sizeof(node_t));
   new->token = token;
   new->next = NULL;
   return new;
@@ -45,7 +42,13 @@ void print_list(node_t *head) {
     char *lexeme = current->token.lexeme;
 
     printf("%s, ", token_names[token_type]);
-    printf("Lexeme: '%s', ", lexeme);
+    if (token_type == TOKEN_STRING_LITERAL || token_type == TOKEN_CHAR_LITERAL) {
+      // Decoded literals may hold control bytes, so show the source spelling
+      printf("Lexeme: %.*s, ", (int)current->token.raw_length,
+             current->token.raw);
+    } else {
+      printf("Lexeme: '%s', ", lexeme);
+    }
     printf("L: %d, ", current->token.line);
     printf("C: %d\n", current->token.column);
 
@@ -0,0 +1,91 @@
+#include "linker.h"
+#include "intern.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Resolution of the relocations left by code generation, for images whose
+ * code and data addresses are known: static executables and JIT-compiled
+ * code. Every global variable is a 32-bit int, laid out in declaration order.
+ */
+
+size_t data_size(const IRModule *module) {
+  return (size_t)module->global_count * 4;
+}
+
+/**
+ * @brief Writes the initial values of the module's globals to `data`.
+ */
+void build_data(const IRModule *module, uint8_t *data) {
+  for (int i = 0; i < module->global_count; i++) {
+    int32_t value = (int32_t)module->globals[i].initial_value;
+    memcpy(data + 4 * i, &value, 4);
+  }
+}
+
+/**
+ * @return The index in `code->functions` of the function called `name`, or
+ * -1.
+ */
+int find_function(const MachineCode *code, const char *name) {
+  for (int i = 0; i < code->function_count; i++) {
+    if (strcmp(code->functions[i].name, name) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/**
+ * @brief Patches every relocation in `text`, a copy of the module's code that
+ * will run at `text_address`, with the module's data at `data_address`.
+ *
+ * @return The number of relocations that could not be resolved, each of which
+ * is reported.
+ */
+int apply_relocations(const MachineCode *code, uint8_t *text,
+                      uint64_t text_address, uint64_t data_address) {
+  // Function by interned name, for calls
+  unsigned int name_count = intern_count();
+  int *functions = allocate(name_count, sizeof(int));
+  for (unsigned int i = 0; i < name_count; i++) {
+    functions[i] = -1;
+  }
+  for (int i = 0; i < code->function_count; i++) {
+    functions[code->functions[i].name_id] = i;
+  }
+
+  int errors = 0;
+  const Assembler *a = &code->assembler;
+  for (uint32_t i = 0; i < a->relocation_count; i++) {
+    const Relocation *relocation = &a->relocations[i];
+    uint64_t target;
+    if (relocation->kind == RELOC_GLOBAL) {
+      target = data_address + 4 * (uint64_t)relocation->symbol;
+    } else if (functions[relocation->symbol] >= 0) {
+      int callee = functions[relocation->symbol];
+      target = text_address + code->functions[callee].offset;
+    } else {
+      fprintf(stderr, "Error: undefined reference to '%s'\n",
+              intern_string(relocation->symbol));
+      errors++;
+      continue;
+    }
+
+    int64_t displacement = (int64_t)(target + relocation->addend) -
+                           (int64_t)(text_address + relocation->offset);
+    if (displacement < INT32_MIN || displacement > INT32_MAX) {
+      fprintf(stderr, "Error: relocation at 0x%x is out of range\n",
+              relocation->offset);
+      errors++;
+      continue;
+    }
+    int32_t value = (int32_t)displacement;
+    memcpy(text + relocation->offset, &value, 4);
+  }
+
+  free(functions);
+  return errors;
+}
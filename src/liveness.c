@@ -0,0 +1,185 @@
+#include "liveness.h"
+#include "bitset.h"
+#include "util.h"
+#include <stdlib.h>
+
+/*
+ * Liveness of SSA values. A phi is not a use in its own block: its operand
+ * for predecessor P is live at the end of P, so it is generated on exit from
+ * P, and the phi itself is defined on entry to its block.
+ */
+
+/**
+ * @brief Solves liveness for `function`; `problem->in` then holds the values
+ * live on entry to each block.
+ */
+void compute_liveness(DataflowProblem *problem, const IRFunction *function) {
+  dataflow_init(problem, function);
+  uint32_t words = problem->words;
+  uint64_t *gen = arena_alloc(&problem->arena, words * sizeof(uint64_t));
+  uint64_t *kill = arena_alloc(&problem->arena, words * sizeof(uint64_t));
+
+  for (IRBlockId b = 0; b < function->block_count; b++) {
+    const IRBlock *block = &function->blocks[b];
+    if (block->dead) {
+      continue;
+    }
+
+    // Upward-exposed uses, walking the block backwards
+    bitset_clear(gen, words);
+    bitset_clear(kill, words);
+    for (IRValue id = block->last; id != IR_NONE;
+         id = function->instrs[id].prev) {
+      const IRInstr *instr = &function->instrs[id];
+      if (ir_has_result(instr->opcode)) {
+        bitset_set(kill, id);
+        bitset_reset(gen, id);
+      }
+      if (instr->opcode == IR_PHI) {
+        continue;
+      }
+      for (int i = 0; i < instr->operand_count; i++) {
+        bitset_set(gen, ir_operand(function, id, i));
+      }
+    }
+    problem->gen[b] = value_set_from_bits(problem, gen);
+    problem->kill[b] = value_set_from_bits(problem, kill);
+
+    // Phi operands flowing out along this block's edges
+    bitset_clear(gen, words);
+    for (int s = 0; s < block->succ_count; s++) {
+      const IRBlock *succ = &function->blocks[block->succs[s]];
+      for (uint32_t p = 0; p < succ->pred_count; p++) {
+        if (succ->preds[p] != b) {
+          continue;
+        }
+        for (IRValue id = succ->first;
+             id != IR_NONE && function->instrs[id].opcode == IR_PHI;
+             id = function->instrs[id].next) {
+          bitset_set(gen, ir_operand(function, id, p));
+        }
+      }
+    }
+    problem->exit_gen[b] = value_set_from_bits(problem, gen);
+  }
+
+  solve_backward(problem);
+}
+
+static int contains_call(const uint32_t *calls, uint32_t call_count,
+                         uint32_t start, uint32_t end) {
+  // First call after start
+  uint32_t low = 0, high = call_count;
+  while (low < high) {
+    uint32_t middle = low + (high - low) / 2;
+    if (calls[middle] <= start) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low < call_count && calls[low] < end;
+}
+
+/**
+ * @brief Numbers the instructions in reverse postorder and builds one
+ * interval per value, from its definition to the last of its uses and of the
+ * ends of the blocks it is live out of. Definitions dominate their uses, so
+ * no block the value is live into comes before the definition.
+ *
+ * `roots`, if not NULL, maps each instruction to the one whose code computes
+ * it, as instruction selection folds operands into the tree of their user.
+ * Folded values get no interval, and their operands are used at the root.
+ *
+ * @return An allocated array of intervals in value order.
+ */
+LiveInterval *build_live_intervals(const IRFunction *function,
+                                   const IRValue *roots, uint32_t *count) {
+  DataflowProblem liveness;
+  compute_liveness(&liveness, function);
+
+  uint32_t *start = allocate(function->instr_count, sizeof(uint32_t));
+  uint32_t *end = allocate(function->instr_count, sizeof(uint32_t));
+  IRBlockId *order = allocate(function->block_count, sizeof(IRBlockId));
+  uint32_t *calls = allocate(function->instr_count, sizeof(uint32_t));
+  uint32_t *positions = allocate(function->instr_count, sizeof(uint32_t));
+  uint32_t call_count = 0;
+  for (IRValue id = 0; id < function->instr_count; id++) {
+    start[id] = UINT32_MAX;
+    end[id] = 0;
+  }
+
+  uint32_t block_count = ir_reverse_postorder(function, order);
+  uint32_t position = 0;
+  for (uint32_t b = 0; b < block_count; b++) {
+    for (IRValue id = function->blocks[order[b]].first; id != IR_NONE;
+         id = function->instrs[id].next) {
+      positions[id] = position;
+      position += 2;
+    }
+  }
+
+  uint64_t *out = liveness.scratch;
+  position = 0;
+  for (uint32_t b = 0; b < block_count; b++) {
+    IRBlockId block = order[b];
+    uint32_t block_start = position;
+    for (IRValue id = function->blocks[block].first; id != IR_NONE;
+         id = function->instrs[id].next) {
+      const IRInstr *instr = &function->instrs[id];
+      if (instr->opcode == IR_CALL) {
+        calls[call_count++] = position;
+      }
+      if (ir_has_result(instr->opcode) && (roots == NULL || roots[id] == id)) {
+        // Parameters are moved into place before the first instruction, and
+        // the phis of a block are all written on the edges into it, so even
+        // one that is never used must not share a register with another
+        start[id] = instr->opcode == IR_PARAM ? 0
+                    : instr->opcode == IR_PHI ? block_start
+                                              : position;
+      }
+      if (instr->opcode != IR_PHI) {
+        uint32_t use = roots == NULL ? position : positions[roots[id]];
+        for (int i = 0; i < instr->operand_count; i++) {
+          IRValue operand = ir_operand(function, id, i);
+          if (use > end[operand]) {
+            end[operand] = use;
+          }
+        }
+      }
+      position += 2;
+    }
+
+    uint32_t block_end = position - 2;
+    dataflow_out(&liveness, block, out);
+    for (uint32_t v = bitset_next(out, liveness.words, 0); v != BITSET_NONE;
+         v = bitset_next(out, liveness.words, v + 1)) {
+      end[v] = block_end;
+    }
+  }
+
+  LiveInterval *intervals =
+      allocate(function->instr_count, sizeof(LiveInterval));
+  uint32_t interval_count = 0;
+  for (IRValue id = 0; id < function->instr_count; id++) {
+    if (start[id] == UINT32_MAX || !ir_has_result(function->instrs[id].opcode)) {
+      continue;
+    }
+    LiveInterval *interval = &intervals[interval_count++];
+    interval->value = id;
+    interval->start = start[id];
+    interval->end = end[id] > start[id] ? end[id] : start[id];
+    interval->register_class = REG_CLASS_GENERAL;
+    interval->crosses_call =
+        contains_call(calls, call_count, interval->start, interval->end);
+  }
+
+  free(start);
+  free(end);
+  free(order);
+  free(calls);
+  free(positions);
+  dataflow_free(&liveness);
+  *count = interval_count;
+  return intervals;
+}
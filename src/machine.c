@@ -0,0 +1,247 @@
+#include "machine.h"
+#include "util.h"
+#include <stdlib.h>
+#include <string.h>
+
+void machine_list_init(MachineList *list) {
+  memset(list, 0, sizeof(MachineList));
+}
+
+void machine_list_free(MachineList *list) { free(list->instrs); }
+
+static MachineInstr *add(MachineList *list, MachineOpcode opcode) {
+  if (list->count == list->capacity) {
+    list->instrs =
+        grow(list->instrs, sizeof(MachineInstr), &list->capacity, 256);
+  }
+  MachineInstr *instr = &list->instrs[list->count++];
+  memset(instr, 0, sizeof(MachineInstr));
+  instr->opcode = opcode;
+  instr->dst = REG_NONE;
+  instr->src = REG_NONE;
+  return instr;
+}
+
+/**
+ * @brief Drops deleted instructions.
+ *
+ * @return The number of instructions dropped.
+ */
+uint32_t machine_list_compact(MachineList *list) {
+  uint32_t kept = 0;
+  for (uint32_t i = 0; i < list->count; i++) {
+    if (list->instrs[i].opcode != MI_NOP) {
+      list->instrs[kept++] = list->instrs[i];
+    }
+  }
+  uint32_t dropped = list->count - kept;
+  list->count = kept;
+  return dropped;
+}
+
+void mi_label(MachineList *list, uint32_t label) {
+  add(list, MI_LABEL)->imm = (int32_t)label;
+}
+
+void mi_mov_rr(MachineList *list, int wide, int dst, int src) {
+  MachineInstr *instr = add(list, MI_MOV_RR);
+  instr->wide = wide, instr->dst = dst, instr->src = src;
+}
+
+void mi_mov_ri(MachineList *list, int dst, int32_t imm) {
+  MachineInstr *instr = add(list, MI_MOV_RI);
+  instr->dst = dst, instr->imm = imm;
+}
+
+void mi_mov_rm(MachineList *list, int wide, int dst, Memory src) {
+  MachineInstr *instr = add(list, MI_MOV_RM);
+  instr->wide = wide, instr->dst = dst, instr->memory = src;
+}
+
+void mi_mov_mr(MachineList *list, int wide, Memory dst, int src) {
+  MachineInstr *instr = add(list, MI_MOV_MR);
+  instr->wide = wide, instr->memory = dst, instr->src = src;
+}
+
+void mi_lea(MachineList *list, int dst, Memory src) {
+  MachineInstr *instr = add(list, MI_LEA);
+  instr->wide = 1, instr->dst = dst, instr->memory = src;
+}
+
+void mi_alu_rr(MachineList *list, AluOp op, int wide, int dst, int src) {
+  MachineInstr *instr = add(list, MI_ALU_RR);
+  instr->op = op, instr->wide = wide, instr->dst = dst, instr->src = src;
+}
+
+void mi_alu_ri(MachineList *list, AluOp op, int wide, int dst, int32_t imm) {
+  MachineInstr *instr = add(list, MI_ALU_RI);
+  instr->op = op, instr->wide = wide, instr->dst = dst, instr->imm = imm;
+}
+
+void mi_alu_rm(MachineList *list, AluOp op, int wide, int dst, Memory src) {
+  MachineInstr *instr = add(list, MI_ALU_RM);
+  instr->op = op, instr->wide = wide, instr->dst = dst, instr->memory = src;
+}
+
+void mi_imul_rr(MachineList *list, int wide, int dst, int src) {
+  MachineInstr *instr = add(list, MI_IMUL_RR);
+  instr->wide = wide, instr->dst = dst, instr->src = src;
+}
+
+void mi_imul_rri(MachineList *list, int wide, int dst, int src, int32_t imm) {
+  MachineInstr *instr = add(list, MI_IMUL_RRI);
+  instr->wide = wide, instr->dst = dst, instr->src = src, instr->imm = imm;
+}
+
+void mi_shift_ri(MachineList *list, ShiftOp op, int wide, int dst,
+                 uint8_t imm) {
+  MachineInstr *instr = add(list, MI_SHIFT_RI);
+  instr->op = op, instr->wide = wide, instr->dst = dst, instr->imm = imm;
+}
+
+void mi_idiv_r(MachineList *list, int wide, int src) {
+  MachineInstr *instr = add(list, MI_IDIV_R);
+  instr->wide = wide, instr->src = src;
+}
+
+void mi_sign_extend_ax(MachineList *list, int wide) {
+  add(list, MI_SIGN_EXTEND)->wide = wide;
+}
+
+void mi_test_rr(MachineList *list, int wide, int dst, int src) {
+  MachineInstr *instr = add(list, MI_TEST_RR);
+  instr->wide = wide, instr->dst = dst, instr->src = src;
+}
+
+void mi_setcc(MachineList *list, ConditionCode cc, int dst) {
+  MachineInstr *instr = add(list, MI_SETCC);
+  instr->op = cc, instr->dst = dst;
+}
+
+void mi_movzx_r8(MachineList *list, int dst, int src) {
+  MachineInstr *instr = add(list, MI_MOVZX_R8);
+  instr->dst = dst, instr->src = src;
+}
+
+void mi_push_r(MachineList *list, int reg) { add(list, MI_PUSH_R)->src = reg; }
+
+void mi_pop_r(MachineList *list, int reg) { add(list, MI_POP_R)->dst = reg; }
+
+void mi_push_m(MachineList *list, Memory src) {
+  add(list, MI_PUSH_M)->memory = src;
+}
+
+void mi_pop_m(MachineList *list, Memory dst) {
+  add(list, MI_POP_M)->memory = dst;
+}
+
+void mi_jmp(MachineList *list, uint32_t label) {
+  add(list, MI_JMP)->imm = (int32_t)label;
+}
+
+void mi_jcc(MachineList *list, ConditionCode cc, uint32_t label) {
+  MachineInstr *instr = add(list, MI_JCC);
+  instr->op = cc, instr->imm = (int32_t)label;
+}
+
+void mi_call(MachineList *list, unsigned int callee) {
+  add(list, MI_CALL)->imm = (int32_t)callee;
+}
+
+void mi_ret(MachineList *list) { add(list, MI_RET); }
+
+/**
+ * @brief Encodes the instructions into `a`, binding labels as they come.
+ */
+void machine_list_encode(const MachineList *list, Assembler *a) {
+  for (uint32_t i = 0; i < list->count; i++) {
+    const MachineInstr *mi = &list->instrs[i];
+    switch (mi->opcode) {
+    case MI_NOP:
+      break;
+    case MI_LABEL:
+      x86_bind_label(a, (uint32_t)mi->imm);
+      break;
+    case MI_MOV_RR:
+      x86_mov_rr(a, mi->wide, mi->dst, mi->src);
+      break;
+    case MI_MOV_RI:
+      x86_mov_ri(a, mi->dst, mi->imm);
+      break;
+    case MI_MOV_RM:
+      x86_mov_rm(a, mi->wide, mi->dst, mi->memory);
+      break;
+    case MI_MOV_MR:
+      x86_mov_mr(a, mi->wide, mi->memory, mi->src);
+      break;
+    case MI_LEA:
+      x86_lea(a, mi->dst, mi->memory);
+      break;
+    case MI_ALU_RR:
+      x86_alu_rr(a, mi->op, mi->wide, mi->dst, mi->src);
+      break;
+    case MI_ALU_RI:
+      x86_alu_ri(a, mi->op, mi->wide, mi->dst, mi->imm);
+      break;
+    case MI_ALU_RM:
+      x86_alu_rm(a, mi->op, mi->wide, mi->dst, mi->memory);
+      break;
+    case MI_ALU_MR:
+      x86_alu_mr(a, mi->op, mi->wide, mi->memory, mi->src);
+      break;
+    case MI_ALU_MI:
+      x86_alu_mi(a, mi->op, mi->wide, mi->memory, mi->imm);
+      break;
+    case MI_IMUL_RR:
+      x86_imul_rr(a, mi->wide, mi->dst, mi->src);
+      break;
+    case MI_IMUL_RRI:
+      x86_imul_rri(a, mi->wide, mi->dst, mi->src, mi->imm);
+      break;
+    case MI_SHIFT_RI:
+      x86_shift_ri(a, mi->op, mi->wide, mi->dst, (uint8_t)mi->imm);
+      break;
+    case MI_IDIV_R:
+      x86_idiv_r(a, mi->wide, mi->src);
+      break;
+    case MI_SIGN_EXTEND:
+      x86_sign_extend_ax(a, mi->wide);
+      break;
+    case MI_TEST_RR:
+      x86_test_rr(a, mi->wide, mi->dst, mi->src);
+      break;
+    case MI_SETCC:
+      x86_setcc(a, mi->op, mi->dst);
+      break;
+    case MI_MOVZX_R8:
+      x86_movzx_r8(a, mi->dst, mi->src);
+      break;
+    case MI_PUSH_R:
+      x86_push_r(a, mi->src);
+      break;
+    case MI_POP_R:
+      x86_pop_r(a, mi->dst);
+      break;
+    case MI_PUSH_M:
+      x86_push_m(a, mi->memory);
+      break;
+    case MI_POP_M:
+      x86_pop_m(a, mi->memory);
+      break;
+    case MI_JMP:
+      x86_jmp(a, (uint32_t)mi->imm);
+      break;
+    case MI_JCC:
+      x86_jcc(a, mi->op, (uint32_t)mi->imm);
+      break;
+    case MI_CALL:
+      x86_call(a, (unsigned int)mi->imm);
+      break;
+    case MI_RET:
+      x86_ret(a);
+      break;
+    default:
+      break;
+    }
+  }
+}
@@ -1,30 +1,649 @@
+#include "bytecode.h"
+#include "codegen.h"
+#include "depscan.h"
+#include "elf_writer.h"
+#include "frame.h"
+#include "ir.h"
+#include "ir_lower.h"
+#include "interp.h"
+#include "ir_passes.h"
+#include "isel.h"
+#include "jit.h"
 #include "lexer.h"
 #include "linked_list.h"
+#include "liveness.h"
 #include "parser.h"
+#include "pipeline.h"
+#include "preprocessor.h"
 #include "pretty_printer.h"
+#include "regalloc.h"
+#include "resolver.h"
+#include "symbol_table.h"
+#include "symindex.h"
+#include "type_checker.h"
+#include "util.h"
+#include "x86_encoder.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+typedef enum {
+  MODE_TOKENS,
+  MODE_DUMP_IR,
+  MODE_DUMP_ALLOCATION,
+  MODE_DUMP_CODE,
+  MODE_OBJECT,
+  MODE_EXECUTABLE,
+  MODE_RUN,
+  MODE_DUMP_BYTECODE,
+  MODE_INTERPRET,
+  MODE_BENCHMARK,
+  MODE_DEPENDENCIES,
+  MODE_SIGNATURES,
+  MODE_INDEX,
+  MODE_QUERY,
+} Mode;
+
+/* Returns `path` with its directory dropped if `basename` is set and its
+ * extension replaced by `extension`, like the default names of -M and -MD. */
+static char *replace_extension(const char *path, const char *extension,
+                               int basename) {
+  const char *slash = strrchr(path, '/');
+  if (basename && slash != NULL) {
+    path = slash + 1;
+  }
+  const char *dot = strrchr(path, '.');
+  size_t length = dot != NULL && (slash == NULL || dot > slash)
+                      ? (size_t)(dot - path)
+                      : strlen(path);
+  char *name = allocate(length + strlen(extension) + 1, 1);
+  memcpy(name, path, length);
+  strcpy(name + length, extension);
+  return name;
+}
+
+/* Scans the inputs for -M and -MD and writes their rules, in input order, to
+ * `path`, or to stdout if it is NULL.
+ *
+ * @return Nonzero if a scan failed or the rules could not be written. */
+static int write_dependencies(const char *const *inputs, int input_count,
+                              const char *target, const char *path,
+                              const DependencyOptions *options, int threads,
+                              int pass_stats) {
+  DependencyJob *jobs = allocate_zeroed(input_count, sizeof(DependencyJob));
+  char **targets = allocate_zeroed(input_count, sizeof(char *));
+  for (int i = 0; i < input_count; i++) {
+    jobs[i].source = inputs[i];
+    if (target == NULL) {
+      targets[i] = replace_extension(inputs[i], ".o", 1);
+    }
+    jobs[i].target = target != NULL ? target : targets[i];
+  }
+
+  DependencyCache cache;
+  dependency_cache_init(&cache);
+  int failed = scan_dependencies(jobs, input_count, options, threads, &cache);
+  if (pass_stats) {
+    print_dependency_stats(stderr, &cache.stats);
+  }
+  dependency_cache_free(&cache);
+
+  FILE *out = stdout;
+  if (!failed && path != NULL && (out = fopen(path, "w")) == NULL) {
+    perror(path);
+    failed = 1;
+  }
+  for (int i = 0; i < input_count; i++) {
+    if (!failed) {
+      fwrite(jobs[i].rule, 1, jobs[i].rule_length, out);
+    }
+    free(jobs[i].rule);
+    free(targets[i]);
+  }
+  if (out != stdout && out != NULL && fclose(out) != 0) {
+    perror(path);
+    failed = 1;
+  }
+  free(targets);
+  free(jobs);
+  return failed;
+}
+
+static void report_max_rss(void) {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+    fprintf(stderr, "max rss: %ld KiB\n", usage.ru_maxrss);
+  }
+}
+
+/* What is kept while compiling one declaration at a time: the symbols, the
+ * globals and the machine code. */
+typedef struct {
+  SymbolTable symbols;
+  IRModule module;
+  MachineCode code;
+  CodegenOptions options;
+  PeepholeStats peephole;
+  PassStats stats[NUM_PASSES];
+  int optimize;
+  int errors; // Code generation stops at the first one
+} Backend;
+
+static void backend_init(Backend *backend, int optimize) {
+  symbol_table_init(&backend->symbols);
+  ir_module_init(&backend->module);
+  machine_code_init(&backend->code);
+  backend->peephole = (PeepholeStats){0};
+  backend->options =
+      (CodegenOptions){optimize ? &backend->peephole : NULL, optimize};
+  pass_stats_init(backend->stats);
+  backend->optimize = optimize;
+  backend->errors = 0;
+}
+
+/* Resolves, checks, lowers, optimizes and encodes one declaration whose body,
+ * if any, is parsed, and frees its IR. Once an error has been reported, the
+ * later declarations are still checked but not compiled.
+ *
+ * @return The number of errors reported. */
+static int compile_declaration(ASTNode_t *node, void *context) {
+  Backend *backend = context;
+  IRModule *module = &backend->module;
+  int failed = resolve_external_declaration(node, &backend->symbols);
+  if (failed == 0) {
+    failed = check_external_declaration(node);
+  }
+  int function_count = module->function_count;
+  if (failed == 0 && backend->errors == 0) {
+    failed = lower_external_declaration(node, module);
+  }
+  if (module->function_count > function_count) {
+    IRFunction *function = module->functions[--module->function_count];
+    if (failed == 0) {
+      failed = ir_verify(function);
+    }
+    if (failed == 0 && backend->optimize) {
+      ir_optimize_function(function, backend->stats);
+      failed = ir_verify(function);
+    }
+    if (failed == 0) {
+      generate_function_code(&backend->code, function, &backend->options);
+    }
+    ir_function_free(function);
+  }
+  backend->errors += failed;
+  return failed;
+}
+
+/* Compiles the declarations of `ast` one at a time. Each function body is
+ * parsed, compiled, and freed with its tokens before the next one.
+ *
+ * @return The number of errors reported. */
+static int compile_streaming(ASTNode_t *ast, Backend *backend) {
+  Arena bodies;
+  arena_init(&bodies, 0);
+  char error[PARSE_ERROR_SIZE];
+  int errors = 0;
+  for (int i = 0; i < ast->child_count; i++) {
+    ASTNode_t *node = ast->children[i];
+    if (node->type != AST_FUNCTION_DEF) {
+      errors += compile_declaration(node, backend);
+      continue;
+    }
+    if (take_function_body(node, &bodies, error) == NULL) {
+      fputs(error, stderr);
+      errors++;
+      break;
+    }
+    errors += compile_declaration(node, backend);
+    release_function_body(node);
+    arena_reset(&bodies);
+  }
+  arena_free(&bodies);
+  return errors;
+}
+
+/* Runs, prints or writes the machine code as `mode` asks.
+ *
+ * @return Nonzero on failure; `status` is set to the result of main when it
+ * is run. */
+static int emit_code(Mode mode, const IRModule *module, MachineCode *code,
+                     const char *input, const char *output, int *status) {
+  switch (mode) {
+  case MODE_RUN:
+    return jit_run(module, code, input, status);
+  case MODE_DUMP_CODE:
+    dump_machine_code(stdout, code);
+    return 0;
+  case MODE_OBJECT:
+    return write_object_file(output, module, code);
+  default:
+    return write_executable(output, module, code);
+  }
+}
+
+/* Prints the statistics of a backend and emits its code.
+ *
+ * @return The exit status. */
+static int finish_backend(Backend *backend, Mode mode, const char *input,
+                          const char *output, int pass_stats) {
+  if (backend->optimize && pass_stats) {
+    print_pass_stats(stderr, backend->stats);
+    print_peephole_stats(stderr, &backend->peephole);
+  }
+  int status = 0;
+  int failed = emit_code(mode, &backend->module, &backend->code, input,
+                         output, &status);
+  machine_code_free(&backend->code);
+  ir_module_free(&backend->module);
+  return failed ? EXIT_FAILURE : status;
+}
+
+static void usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s [options] <input file path>\n"
+          "       %s -M [options] <input file path>...\n"
+          "       %s --index <index> [-I <dir>] <input file path>...\n"
+          "       %s --query <index> <name>|<prefix>*\n"
+          "       %s --check-encoding\n"
+          "Options:\n"
+          "  -o <path>       Write a static executable\n"
+          "  -I <dir>        Search <dir> for included files\n"
+          "  -c -o <path>    Write a relocatable object instead\n"
+          "  --run           Compile into memory, run main and exit with its "
+          "result\n"
+          "  --interp        Interpret main from bytecode and exit with its "
+          "result\n"
+          "  --bench         Time the interpreter against native code\n"
+          "  --dump-ir       Print the IR\n"
+          "  --dump-alloc    Print the IR, the selected trees and the register "
+          "assignment\n"
+          "  --dump-code     Print the machine code and relocations\n"
+          "  --dump-bytecode Print the bytecode\n"
+          "  --signatures    Print the global declarations without parsing "
+          "function bodies\n"
+          "  --lazy          Parse each function body only when it is first "
+          "needed\n"
+          "  --stream        Generate code one function at a time, freeing "
+          "each once it\n"
+          "                  is emitted (with -o, --run and --dump-code)\n"
+          "  --pipeline      Like --stream, with the lexer, the parser and "
+          "code generation\n"
+          "                  running at once on three threads\n"
+          "  --max-rss       Print the peak resident set size to stderr on "
+          "exit\n"
+          "  --max-depth <levels>\n"
+          "                  Reject statements and expressions nested deeper "
+          "than this\n"
+          "                  (default 10000)\n"
+          "  --share-expressions\n"
+          "                  Build one node for identical pure expressions "
+          "and compute\n"
+          "                  it once per block\n"
+          "  -O0             Do not optimize the IR or the machine code\n"
+          "  --pass-stats    Print what each optimization pass did to stderr\n"
+          "  -j <threads>    Parse, or scan the inputs of -M, on this many "
+          "threads\n"
+          "Dependency options:\n"
+          "  -M              Print a Make rule listing the included files of "
+          "each input\n"
+          "  -MD             Also write the rule to a .d file while compiling\n"
+          "  -MF <path>      Write the rule to <path>\n"
+          "  -MT <target>    Use <target> as the target of the rule\n"
+          "  -MP             Add an empty rule for each included file\n",
+          program, program, program, program, program);
+}
 
 int main(int argc, char *argv[]) {
-  if (argc != 2) {
-    fprintf(stderr, "Usage: %s <input file path>\n", argv[0]);
-    return EXIT_FAILURE;
+  Mode mode = MODE_TOKENS;
+  const char *input = NULL;
+  const char *output = NULL;
+  const char **inputs = allocate(argc, sizeof(const char *));
+  int input_count = 0;
+  int dependencies = 0; // -MD
+  const char *dependency_file = NULL;
+  const char *dependency_target = NULL;
+  DependencyOptions dependency_options = {0};
+  const char *index_path = NULL;
+  ParseOptions parse_options = {(int)sysconf(_SC_NPROCESSORS_ONLN), 0,
+                                DEFAULT_NESTING_LIMIT, 0};
+  int object = 0;
+  int optimize = 1;
+  int pass_stats = 0;
+  int stream = 0;
+  int pipeline = 0;
+  const char **include_dirs = allocate(argc, sizeof(const char *));
+  int include_dir_count = 0;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--check-encoding") == 0) {
+      return check_encoding() == 0 ? 0 : EXIT_FAILURE;
+    } else if (strcmp(argv[i], "--dump-ir") == 0) {
+      mode = MODE_DUMP_IR;
+    } else if (strcmp(argv[i], "--dump-alloc") == 0) {
+      mode = MODE_DUMP_ALLOCATION;
+    } else if (strcmp(argv[i], "--dump-code") == 0) {
+      mode = MODE_DUMP_CODE;
+    } else if (strcmp(argv[i], "--run") == 0) {
+      mode = MODE_RUN;
+    } else if (strcmp(argv[i], "--dump-bytecode") == 0) {
+      mode = MODE_DUMP_BYTECODE;
+    } else if (strcmp(argv[i], "--interp") == 0) {
+      mode = MODE_INTERPRET;
+    } else if (strcmp(argv[i], "--bench") == 0) {
+      mode = MODE_BENCHMARK;
+    } else if (strcmp(argv[i], "--signatures") == 0) {
+      mode = MODE_SIGNATURES;
+      parse_options.lazy_bodies = 1;
+    } else if (strcmp(argv[i], "--index") == 0 && i + 1 < argc) {
+      mode = MODE_INDEX;
+      index_path = argv[++i];
+    } else if (strcmp(argv[i], "--query") == 0 && i + 1 < argc) {
+      mode = MODE_QUERY;
+      index_path = argv[++i];
+    } else if (strcmp(argv[i], "--lazy") == 0) {
+      parse_options.lazy_bodies = 1;
+    } else if (strcmp(argv[i], "--stream") == 0) {
+      stream = 1;
+    } else if (strcmp(argv[i], "--pipeline") == 0) {
+      pipeline = 1;
+    } else if (strcmp(argv[i], "--max-rss") == 0) {
+      atexit(report_max_rss);
+    } else if (strcmp(argv[i], "--max-depth") == 0 && i + 1 < argc) {
+      parse_options.max_depth = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--share-expressions") == 0) {
+      parse_options.share_expressions = 1;
+    } else if (strcmp(argv[i], "-M") == 0) {
+      mode = MODE_DEPENDENCIES;
+    } else if (strcmp(argv[i], "-MD") == 0) {
+      dependencies = 1;
+    } else if (strcmp(argv[i], "-MF") == 0 && i + 1 < argc) {
+      dependency_file = argv[++i];
+    } else if (strcmp(argv[i], "-MT") == 0 && i + 1 < argc) {
+      dependency_target = argv[++i];
+    } else if (strcmp(argv[i], "-MP") == 0) {
+      dependency_options.phony_targets = 1;
+    } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+      parse_options.threads = atoi(argv[++i]);
+    } else if (strncmp(argv[i], "-j", 2) == 0 && argv[i][2] != '\0') {
+      parse_options.threads = atoi(argv[i] + 2);
+    } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      output = argv[++i];
+    } else if (strcmp(argv[i], "-I") == 0 && i + 1 < argc) {
+      include_dirs[include_dir_count++] = argv[++i];
+    } else if (strncmp(argv[i], "-I", 2) == 0 && argv[i][2] != '\0') {
+      include_dirs[include_dir_count++] = argv[i] + 2;
+    } else if (strcmp(argv[i], "-c") == 0) {
+      object = 1;
+    } else if (strcmp(argv[i], "-O0") == 0) {
+      optimize = 0;
+    } else if (strcmp(argv[i], "--pass-stats") == 0) {
+      pass_stats = 1;
+    } else if (argv[i][0] == '-') {
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    } else {
+      inputs[input_count++] = argv[i];
+    }
+  }
+  dependency_options.include_dirs = include_dirs;
+  dependency_options.include_dir_count = include_dir_count;
+  if (parse_options.threads < 1) {
+    parse_options.threads = 1;
   }
 
-  FILE *file_pointer = fopen(argv[1], "r");
-  if (file_pointer == NULL) {
-    perror("File not found");
+  if (mode == MODE_INDEX && input_count > 0) {
+    IndexStats stats;
+    int failed = update_symbol_index(index_path, inputs, input_count,
+                                     include_dirs, include_dir_count, &stats);
+    if (pass_stats) {
+      print_index_stats(stderr, &stats);
+    }
+    return failed != 0 ? EXIT_FAILURE : 0;
+  }
+  if (mode == MODE_QUERY && input_count == 1) {
+    // Like grep, fails when nothing matches
+    return query_symbol_index(index_path, inputs[0], stdout) > 0 ? 0
+                                                                 : EXIT_FAILURE;
+  }
 
+  // Only a dependency scan and the index take several inputs
+  if (mode == MODE_DEPENDENCIES && input_count > 0) {
+    return write_dependencies(inputs, input_count, dependency_target,
+                              dependency_file, &dependency_options,
+                              parse_options.threads, pass_stats)
+               ? EXIT_FAILURE
+               : 0;
+  }
+  if (input_count != 1 || (object && output == NULL)) {
+    usage(argv[0]);
     return EXIT_FAILURE;
   }
+  input = inputs[0];
+  if (dependencies) {
+    // Named after the output, or after the input without its directory
+    char *target = NULL;
+    char *path = NULL;
+    if (dependency_target == NULL) {
+      dependency_target = output != NULL
+                              ? output
+                              : (target = replace_extension(input, ".o", 1));
+    }
+    if (dependency_file == NULL) {
+      dependency_file = path = replace_extension(
+          output != NULL ? output : input, ".d", output == NULL);
+    }
+    int failed = write_dependencies(&input, 1, dependency_target,
+                                    dependency_file, &dependency_options, 1,
+                                    pass_stats);
+    free(path);
+    free(target);
+    if (failed) {
+      return EXIT_FAILURE;
+    }
+  }
+  if (output != NULL) {
+    mode = object ? MODE_OBJECT : MODE_EXECUTABLE;
+  }
+  // Only native code can be emitted function by function
+  int native = mode == MODE_RUN || mode == MODE_DUMP_CODE ||
+               mode == MODE_OBJECT || mode == MODE_EXECUTABLE;
+  stream = stream && native;
+  if (stream) {
+    parse_options.lazy_bodies = 1;
+  }
 
-  node_t *token_list = tokenize_input(file_pointer);
+  HeaderCache headers;
+  header_cache_init(&headers);
+  if (pipeline && native) {
+    Backend backend;
+    backend_init(&backend, optimize);
+    PipelineStats stats;
+    int errors =
+        run_pipeline(input, include_dirs, include_dir_count, &headers,
+                     &parse_options, compile_declaration, &backend, &stats);
+    if (pass_stats) {
+      print_preprocessor_stats(stderr, &headers.stats);
+      print_pipeline_stats(stderr, &stats);
+    }
+    if (errors > 0) {
+      return EXIT_FAILURE;
+    }
+    if (stats.declarations == 0) {
+      return 0; // As get_ast finding no tokens
+    }
+    return finish_backend(&backend, mode, input, output, pass_stats);
+  }
+  node_t *token_list =
+      preprocess_file(input, include_dirs, include_dir_count, &headers);
+  if (token_list == NULL) {
+    return EXIT_FAILURE;
+  }
+  if (pass_stats) {
+    print_preprocessor_stats(stderr, &headers.stats);
+  }
 
-  print_list(token_list);
+  if (mode == MODE_TOKENS) {
+    print_list(token_list);
+  }
 
-  //ASTNode_t *ast = get_ast(token_list);
+  ParseStats parse_stats;
+  char parse_error[PARSE_ERROR_SIZE];
+  ASTNode_t *ast =
+      get_ast(token_list, &parse_options, &parse_stats, parse_error);
+  if (ast == NULL) {
+    if (parse_error[0] != '\0') {
+      fputs(parse_error, stderr);
+      return EXIT_FAILURE;
+    }
+    return 0;
+  }
+  if (pass_stats) {
+    print_parse_stats(stderr, &parse_stats);
+  }
+  if (mode == MODE_SIGNATURES) {
+    print_signatures(stdout, ast);
+    return 0;
+  }
 
   //print_ast(ast);
 
+  if (stream) {
+    Backend backend;
+    backend_init(&backend, optimize);
+    if (compile_streaming(ast, &backend) > 0) {
+      return EXIT_FAILURE;
+    }
+    return finish_backend(&backend, mode, input, output, pass_stats);
+  }
+
+  SymbolTable symbols;
+  symbol_table_init(&symbols);
+  if (resolve_names(ast, &symbols) > 0 || check_types(ast) > 0) {
+    return EXIT_FAILURE;
+  }
+
+  if (mode == MODE_TOKENS) {
+    return 0;
+  }
+
+  // The interpreter starts from the AST, skipping the IR altogether
+  double start = now();
+  int interpreted_status = 0;
+  double interpreter_compile = 0, interpreter_run = 0;
+  if (mode == MODE_DUMP_BYTECODE || mode == MODE_INTERPRET ||
+      mode == MODE_BENCHMARK) {
+    BytecodeModule bytecode;
+    if (compile_bytecode(ast, &bytecode) > 0) {
+      return EXIT_FAILURE;
+    }
+    interpreter_compile = now() - start;
+    if (mode == MODE_DUMP_BYTECODE) {
+      dump_bytecode(stdout, &bytecode);
+      bytecode_module_free(&bytecode);
+      return 0;
+    }
+    start = now();
+    int failed = interpret(&bytecode, &interpreted_status);
+    interpreter_run = now() - start;
+    bytecode_module_free(&bytecode);
+    if (failed) {
+      return EXIT_FAILURE;
+    }
+    if (mode == MODE_INTERPRET) {
+      return interpreted_status;
+    }
+    start = now();
+  }
+
+  IRModule module;
+  ir_module_init(&module);
+  if (lower_translation_unit(ast, &module) > 0) {
+    return EXIT_FAILURE;
+  }
+  for (int i = 0; i < module.function_count; i++) {
+    if (ir_verify(module.functions[i]) > 0) {
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (optimize) {
+    PassStats stats[NUM_PASSES];
+    pass_stats_init(stats);
+    ir_optimize_module(&module, stats);
+    for (int i = 0; i < module.function_count; i++) {
+      if (ir_verify(module.functions[i]) > 0) {
+        return EXIT_FAILURE;
+      }
+    }
+    if (pass_stats) {
+      print_pass_stats(stderr, stats);
+    }
+  }
+
+  if (mode == MODE_DUMP_CODE || mode == MODE_OBJECT ||
+      mode == MODE_EXECUTABLE || mode == MODE_RUN || mode == MODE_BENCHMARK) {
+    MachineCode code;
+    PeepholeStats peephole = {0};
+    CodegenOptions options = {optimize ? &peephole : NULL, optimize};
+    generate_code(&module, &code, &options);
+    if (optimize && pass_stats) {
+      print_peephole_stats(stderr, &peephole);
+    }
+    int failed = 0;
+    int status = 0;
+    if (mode == MODE_BENCHMARK) {
+      double native_compile = now() - start;
+      start = now();
+      failed = jit_run(&module, &code, input, &status);
+      double native_run = now() - start;
+      fprintf(stderr, "%-12s %12s %12s %12s %8s\n", "path", "compile (ms)",
+              "run (ms)", "total (ms)", "result");
+      fprintf(stderr, "%-12s %12.3f %12.3f %12.3f %8d\n", "interpreter",
+              interpreter_compile * 1e3, interpreter_run * 1e3,
+              (interpreter_compile + interpreter_run) * 1e3,
+              interpreted_status);
+      fprintf(stderr, "%-12s %12.3f %12.3f %12.3f %8d\n", "native",
+              native_compile * 1e3, native_run * 1e3,
+              (native_compile + native_run) * 1e3, status);
+      if (!failed && status != interpreted_status) {
+        fprintf(stderr, "Error: the interpreter and native code disagree\n");
+        failed = 1;
+      }
+    } else {
+      failed = emit_code(mode, &module, &code, input, output, &status);
+    }
+    machine_code_free(&code);
+    ir_module_free(&module);
+    return failed ? EXIT_FAILURE : status;
+  }
+
+  ir_dump_module(stdout, &module);
+  if (mode == MODE_DUMP_ALLOCATION) {
+    for (int i = 0; i < module.function_count; i++) {
+      Selection selection;
+      select_instructions(module.functions[i], &selection);
+      uint32_t interval_count;
+      LiveInterval *intervals = build_live_intervals(
+          module.functions[i], selection.roots, &interval_count);
+      RegisterAllocation allocation;
+      allocate_registers(module.functions[i], intervals, interval_count,
+                         &allocation);
+      FrameLayout frame;
+      layout_frame(module.functions[i], intervals, interval_count,
+                   &allocation, optimize, &frame);
+      printf("\n");
+      dump_selection(stdout, module.functions[i], &selection);
+      dump_register_allocation(stdout, module.functions[i], &allocation);
+      dump_frame_layout(stdout, module.functions[i], &frame);
+      frame_layout_free(&frame);
+      register_allocation_free(&allocation);
+      selection_free(&selection);
+      free(intervals);
+    }
+  }
+  ir_module_free(&module);
   return 0;
 }
@@ -1,16 +1,117 @@
 #include "parser.h"
+#include "arena.h"
 #include "linked_list.h"
 #include "tokens.h"
+#include "util.h"
+#include <pthread.h>
+#include <setjmp.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+/*
+ * Recursive descent parser. The token list is first cut at the top-level
+ * boundaries, after a ';' or '}' outside any braces, and the runs of
+ * external declarations between them are parsed on a pool of threads. Each
+ * thread builds its nodes in an arena of its own, and the declarations are
+ * spliced into the translation unit in source order. A syntax error stops
+ * the parse of its run; the first one in source order is reported.
+ *
+ * With lazy bodies, a function definition only matches the braces of its
+ * body and keeps their tokens, for function_body to parse on first use.
+ *
+ * Declarations are parsed by recursive descent, but statements and
+ * expressions, which nest without bound, keep what they leave open on
+ * explicit stacks, so deep nesting costs heap rather than C stack. The
+ * passes after the parser still recurse over the tree, so a tree nested
+ * deeper than the nesting limit is rejected as a syntax error.
+ */
+
+// Tokens per run of declarations handed to a thread
+#define CHUNK_TOKENS 4096
+
+typedef enum {
+  FRAME_COMPOUND, // Taking statements up to its '}'
+  FRAME_THEN,     // An if statement taking its then branch
+  FRAME_ELSE,     // An if statement taking its else branch
+  FRAME_LOOP,     // A while or for loop taking its body
+} FrameKind;
+
+typedef struct {
+  FrameKind kind;
+  ASTNode_t *node;     // For a for loop, the block that scopes it
+  ASTNode_t *step;     // Of a for loop, run after the body
+  int levels;          // Of the tree the statement adds
+  uint32_t generation; // Of the shared expressions when it opened
+} StatementFrame;
+
+typedef enum {
+  OPERATOR_BINARY, // Taking its right operand
+  OPERATOR_ASSIGN, // Taking the value of its target
+  OPERATOR_PAREN,
+  OPERATOR_CALL, // Taking its next argument
+} OperatorKind;
+
+typedef struct {
+  OperatorKind kind;
+  int level;        // Precedence of a binary operator
+  ASTNodeType type; // Node a binary operator builds
+  Token token;      // The binary operator or '='
+  ASTNode_t *node;  // Target of an assignment, or the call
+  int depth;        // Of the deepest argument of a call so far
+} Operator;
+
+typedef struct {
+  ASTNode_t *node;
+  int depth; // Levels of the tree from `node` down
+} Operand;
+
+typedef struct {
+  ASTNode_t *node;
+  uint32_t hash;
+  uint32_t generation; // Stale unless the table's current one
+} SharedEntry;
+
 typedef struct {
   node_t *current_node;
   Token current_token;
+  Arena *arena;      // Holds the nodes this parser builds
+  jmp_buf *failure;  // Where syntax_error goes
+  char *error;       // Of PARSE_ERROR_SIZE bytes, set by syntax_error
+  ParseOptions options;
+  uint32_t bodies_skipped;
+
+  // Explicit stacks of the statement and expression parsers, in the arena
+  StatementFrame *frames; // The compound, if and loop statements still open
+  int frame_count, frame_capacity;
+  int depth; // Levels of the tree the open statements add
+  Operator *operators;
+  int operator_count, operator_capacity;
+  Operand *operands; // Left operands of the binary operators
+  int operand_count, operand_capacity;
+
+  // Hash-consing of pure expressions, see expression_node
+  SharedEntry *shared;
+  uint32_t shared_count, shared_capacity;
+  uint32_t generation; // Bumped whenever a name may change meaning
+  uint32_t node_ids;   // Last ID given to a shared node
+  uint32_t nodes_shared;
 } Parser;
 
-ASTNode_t *translation_unit(Parser *parser);
+struct PendingBody {
+  node_t *open;         // '{'
+  node_t *close;        // The matching '}'
+  ParseOptions options; // Of the parse that skipped it
+};
+
+// One per thread, kept for as long as the nodes are in use
+static Arena **arenas;
+static int arena_count;
+
+ASTNode_t *translation_unit(Parser *parser, int threads, ParseStats *stats,
+                            char *error);
+ASTNode_t *skip_compound_statement(Parser *parser);
+ASTNode_t *external_declarations(Parser *parser);
 ASTNode_t *external_declaration(Parser *parser);
 ASTNode_t *function_definition(Parser *parser);
 ASTNode_t *type_specifier(Parser *parser);
@@ -20,13 +121,17 @@ ASTNode_t *parameter_declaration(Parser *parser);
 ASTNode_t *compound_statement(Parser *parser);
 ASTNode_t *statement(Parser *parser);
 ASTNode_t *expression_statement(Parser *parser);
-ASTNode_t *expression(Parser *parser);
-ASTNode_t *term(Parser *parser);
-ASTNode_t *factor(Parser *parser);
+ASTNode_t *return_statement(Parser *parser);
+ASTNode_t *if_statement(Parser *parser);
+ASTNode_t *while_statement(Parser *parser);
+ASTNode_t *for_statement(Parser *parser, ASTNode_t **step);
+ASTNode_t *primary_expression(Parser *parser);
 ASTNode_t *assignment_expression(Parser *parser);
 ASTNode_t *declaration(Parser *parser);
 ASTNode_t *decimal_constant(Parser *parser);
-ASTNode_t *get_ast(node_t *head);
+ASTNode_t *literal(Parser *parser);
+ASTNode_t *get_ast(node_t *head, const ParseOptions *options,
+                   ParseStats *stats, char *error);
 
 /**
  * @brief Advances the parser to the next token in the linked list.
@@ -59,20 +164,25 @@ void backtrack(Parser *parser, node_t *backup) {
   parser->current_token = backup->token;
 }
 
-ASTNode_t *create_ast_node(ASTNodeType type, Token *token) {
-  ASTNode_t *node = malloc(sizeof(ASTNode_t));
-  if (node == NULL) {
-    perror("Failed to allocate memory for AST node");
-    exit(EXIT_FAILURE);
-  }
+/**
+ * @brief Records a syntax error at the parser's current token and abandons
+ * the parse of the current run of declarations.
+ *
+ * @param parser A pointer to the parser structure.
+ * @param message Description of what the parser expected.
+ */
+void syntax_error(Parser *parser, const char *message) {
+  snprintf(parser->error, PARSE_ERROR_SIZE,
+           "Error: %s at line %d, column %d, found '%s'\n", message,
+           parser->current_token.line, parser->current_token.column,
+           parser->current_token.lexeme);
+  longjmp(*parser->failure, 1);
+}
 
+ASTNode_t *create_ast_node(Parser *parser, ASTNodeType type, Token *token) {
+  ASTNode_t *node = arena_alloc(parser->arena, sizeof(ASTNode_t));
   if (token != NULL) {
-    node->token = malloc(sizeof(Token));
-    if (node->token == NULL) {
-      perror("Failed to allocate memory for AST node token");
-      free(node);
-      exit(EXIT_FAILURE);
-    }
+    node->token = arena_alloc(parser->arena, sizeof(Token));
     memcpy(node->token, token, sizeof(Token));
   } else {
     node->token = NULL;
@@ -82,48 +192,151 @@ ASTNode_t *create_ast_node(ASTNodeType type, Token *token) {
   node->children = NULL;
   node->child_count = 0;
   node->child_capacity = 0;
+  node->symbol = NULL;
+  node->type_id = 0;
+  node->id = 0;
+  node->pending = NULL;
 
   return node;
 }
 
-void add_child(ASTNode_t *parent, ASTNode_t *child) {
-  if (parent->child_capacity == 0) {
-    // Initial capacity
-    parent->child_capacity = 2;
-    parent->children =
-        (ASTNode_t **)malloc(parent->child_capacity * sizeof(ASTNode_t *));
-  } else if (parent->child_count >= parent->child_capacity) {
-    // Double the capacity
-    parent->child_capacity *= 2;
-    parent->children = (ASTNode_t **)realloc(
-        parent->children, parent->child_capacity * sizeof(ASTNode_t *));
-  }
-  if (parent->children == NULL) {
-    // Handle memory allocation failure
-    perror("Failed to allocate memory for children nodes");
-    exit(EXIT_FAILURE);
+void add_child(Parser *parser, ASTNode_t *parent, ASTNode_t *child) {
+  if (parent->child_count >= parent->child_capacity) {
+    // Double the capacity; the old array stays behind in the arena
+    int capacity = parent->child_capacity ? parent->child_capacity * 2 : 2;
+    ASTNode_t **children =
+        arena_alloc(parser->arena, capacity * sizeof(ASTNode_t *));
+    if (parent->child_count > 0) {
+      memcpy(children, parent->children,
+             parent->child_count * sizeof(ASTNode_t *));
+    }
+    parent->children = children;
+    parent->child_capacity = capacity;
   }
   parent->children[parent->child_count++] = child;
 }
 
-void free_ast_node(ASTNode_t *node) {
-  if (node == NULL)
-    return;
-  for (size_t i = 0; i < node->child_count; i++) {
-    free_ast_node(node->children[i]);
+/* Hashes what makes two pure expressions the same: the kind, the operator
+ * or literal, and the IDs of the operands. */
+static uint32_t expression_hash(ASTNodeType type, const Token *token,
+                                const ASTNode_t *left,
+                                const ASTNode_t *right) {
+  uint32_t hash = 2166136261u;
+  uint32_t words[4] = {type, token->type, 0, 0};
+  if (left != NULL) {
+    words[2] = left->id;
+    words[3] = right->id;
+  } else if (type == AST_IDENTIFIER) {
+    words[2] = token->intern_id;
+  } else {
+    for (size_t i = 0; i < token->length; i++) {
+      hash = (hash ^ (unsigned char)token->lexeme[i]) * 16777619u;
+    }
   }
-  free(node);
-  free(node->children);
+  for (int i = 0; i < 4; i++) {
+    hash = (hash ^ words[i]) * 16777619u;
+  }
+  return hash;
 }
 
-ASTNode_t *translation_unit(Parser *parser) {
-  ASTNode_t *ast = create_ast_node(AST_TRANSLATION_UNIT, NULL);
+static int same_expression(const ASTNode_t *node, ASTNodeType type,
+                           const Token *token, const ASTNode_t *left,
+                           const ASTNode_t *right) {
+  if (node->type != type || node->token->type != token->type) {
+    return 0;
+  }
+  if (left != NULL) {
+    return node->children[0] == left && node->children[1] == right;
+  }
+  if (type == AST_IDENTIFIER) {
+    return node->token->intern_id == token->intern_id;
+  }
+  return node->token->length == token->length &&
+         memcmp(node->token->lexeme, token->lexeme, token->length) == 0;
+}
+
+/* Empties the table of shared expressions, once a declaration may have
+ * given a name in them another meaning. */
+static void forget_shared(Parser *parser) {
+  parser->generation++;
+  parser->shared_count = 0;
+}
+
+static void add_shared(Parser *parser, ASTNode_t *node, uint32_t hash) {
+  if (2 * (parser->shared_count + 1) > parser->shared_capacity) {
+    SharedEntry *old = parser->shared;
+    uint32_t old_capacity = parser->shared_capacity;
+    parser->shared_capacity = old_capacity ? old_capacity * 2 : 64;
+    parser->shared = arena_alloc(parser->arena,
+                                 parser->shared_capacity * sizeof(SharedEntry));
+    memset(parser->shared, 0, parser->shared_capacity * sizeof(SharedEntry));
+    parser->shared_count = 0;
+    for (uint32_t i = 0; i < old_capacity; i++) {
+      if (old[i].node != NULL && old[i].generation == parser->generation) {
+        add_shared(parser, old[i].node, old[i].hash);
+      }
+    }
+  }
+  uint32_t mask = parser->shared_capacity - 1;
+  uint32_t slot = hash & mask;
+  while (parser->shared[slot].node != NULL &&
+         parser->shared[slot].generation == parser->generation) {
+    slot = (slot + 1) & mask;
+  }
+  parser->shared[slot] = (SharedEntry){node, hash, parser->generation};
+  parser->shared_count++;
+}
+
+/* Builds an expression node of `type` from `token`, over the operands `left`
+ * and `right` or none. With expression sharing on, a literal, an identifier
+ * or an operator over shared operands is first looked up by its kind and
+ * the IDs of its operands, and the node built for the same expression is
+ * returned if there is one. The table is emptied at every declaration, so a
+ * shared identifier always names one declaration. */
+static ASTNode_t *expression_node(Parser *parser, ASTNodeType type,
+                                  Token *token, ASTNode_t *left,
+                                  ASTNode_t *right) {
+  int shareable = parser->options.share_expressions &&
+                  (left == NULL || (left->id != 0 && right->id != 0));
+  uint32_t hash = 0;
+  if (shareable) {
+    hash = expression_hash(type, token, left, right);
+    uint32_t mask = parser->shared_capacity - 1;
+    for (uint32_t slot = hash & mask;
+         parser->shared_capacity > 0 && parser->shared[slot].node != NULL &&
+         parser->shared[slot].generation == parser->generation;
+         slot = (slot + 1) & mask) {
+      SharedEntry *entry = &parser->shared[slot];
+      if (entry->hash == hash &&
+          same_expression(entry->node, type, token, left, right)) {
+        parser->nodes_shared++;
+        return entry->node;
+      }
+    }
+  }
+  ASTNode_t *node = create_ast_node(parser, type, token);
+  if (left != NULL) {
+    add_child(parser, node, left);
+    add_child(parser, node, right);
+  }
+  if (shareable) {
+    node->id = ++parser->node_ids;
+    add_shared(parser, node, hash);
+  }
+  return node;
+}
+
+/* Parses external declarations up to the end of the token list into the
+ * children of an AST_TRANSLATION_UNIT node. */
+ASTNode_t *external_declarations(Parser *parser) {
+  ASTNode_t *ast = create_ast_node(parser, AST_TRANSLATION_UNIT, NULL);
 
   while (parser->current_token.type != TOKEN_EOF) {
     ASTNode_t *ext_decl = external_declaration(parser);
-    if (ext_decl != NULL) {
-      add_child(ast, ext_decl);
+    if (ext_decl == NULL) {
+      syntax_error(parser, "Expected a function or declaration");
     }
+    add_child(parser, ast, ext_decl);
   }
   return ast;
 }
@@ -146,43 +359,44 @@ ASTNode_t *function_definition(Parser *parser) {
   if (type == NULL)
     return NULL;
 
+  // Nodes built before backtracking are left in the arena
   ASTNode_t *ident = identifier(parser);
   if (ident == NULL) {
-    free_ast_node(type);
     backtrack(parser, backup);
     return NULL;
   }
 
   ASTNode_t *params = parameter_list(parser);
   if (params == NULL) {
-    free_ast_node(type);
-    free_ast_node(ident);
     backtrack(parser, backup);
     return NULL;
   }
 
   if (parser->current_token.type == TOKEN_SEMICOLON) {
     advance(parser);
-    ASTNode_t *node = create_ast_node(AST_FUNCTION_DECL, NULL);
-    add_child(node, type);
-    add_child(node, ident);
-    add_child(node, params);
+    ASTNode_t *node = create_ast_node(parser, AST_FUNCTION_DECL, NULL);
+    add_child(parser, node, type);
+    add_child(parser, node, ident);
+    add_child(parser, node, params);
     return node;
   }
 
-  ASTNode_t *compound_stmt = compound_statement(parser);
+  ASTNode_t *compound_stmt = NULL;
+  if (parser->options.lazy_bodies) {
+    compound_stmt = skip_compound_statement(parser);
+  }
+  if (compound_stmt == NULL) {
+    compound_stmt = compound_statement(parser);
+  }
   if (compound_stmt == NULL) {
-    free_ast_node(type);
-    free_ast_node(ident);
-    free_ast_node(params);
     return NULL;
   }
 
-  ASTNode_t *node = create_ast_node(AST_FUNCTION_DEF, NULL);
-  add_child(node, type);
-  add_child(node, ident);
-  add_child(node, params);
-  add_child(node, compound_stmt);
+  ASTNode_t *node = create_ast_node(parser, AST_FUNCTION_DEF, NULL);
+  add_child(parser, node, type);
+  add_child(parser, node, ident);
+  add_child(parser, node, params);
+  add_child(parser, node, compound_stmt);
 
   return node;
 }
@@ -190,9 +404,11 @@ ASTNode_t *function_definition(Parser *parser) {
 ASTNode_t *type_specifier(Parser *parser) {
   switch (parser->current_token.type) {
   case TOKEN_INT:
+  case TOKEN_CHAR:
   case TOKEN_FLOAT:
   case TOKEN_VOID: {
-    ASTNode_t *node = create_ast_node(AST_TYPE_SPEC, &parser->current_token);
+    ASTNode_t *node =
+        create_ast_node(parser, AST_TYPE_SPEC, &parser->current_token);
     advance(parser);
     return node;
   }
@@ -203,7 +419,8 @@ ASTNode_t *type_specifier(Parser *parser) {
 
 ASTNode_t *identifier(Parser *parser) {
   if (parser->current_token.type == TOKEN_IDENTIFIER) {
-    ASTNode_t *node = create_ast_node(AST_IDENTIFIER, &parser->current_token);
+    ASTNode_t *node =
+        create_ast_node(parser, AST_IDENTIFIER, &parser->current_token);
     advance(parser);
     return node;
   }
@@ -214,7 +431,7 @@ ASTNode_t *parameter_list(Parser *parser) {
   if (parser->current_token.type != TOKEN_LPAREN) {
     return NULL;
   }
-  ASTNode_t *paramList = create_ast_node(AST_PARAM_LIST, NULL);
+  ASTNode_t *paramList = create_ast_node(parser, AST_PARAM_LIST, NULL);
   advance(parser); // Skip left parenthesis
 
   if (parser->current_token.type == TOKEN_RPAREN) {
@@ -225,15 +442,14 @@ ASTNode_t *parameter_list(Parser *parser) {
   ASTNode_t *param_decl = parameter_declaration(parser);
 
   if (param_decl == NULL) {
-    perror("Invalid parameter\n");
-    exit(EXIT_FAILURE);
+    syntax_error(parser, "Invalid parameter");
   }
 
   int ended_on_comma = 0;
 
   while (param_decl != NULL) {
     ended_on_comma = 0;
-    add_child(paramList, param_decl);
+    add_child(parser, paramList, param_decl);
     if (parser->current_token.type == TOKEN_COMMA) {
       advance(parser);
       ended_on_comma = 1;
@@ -242,86 +458,251 @@ ASTNode_t *parameter_list(Parser *parser) {
   }
 
   if (ended_on_comma) {
-    perror("Comma in parameter list must be follow by another parameter\n");
-    exit(EXIT_FAILURE);
+    syntax_error(parser,
+                 "Comma in parameter list must be follow by another parameter");
   }
 
   if (parser->current_token.type == TOKEN_RPAREN) {
     advance(parser);
     return paramList;
   }
-  perror("Expected closing parenthesis in parameter list");
+  syntax_error(parser, "Expected ')' to close parameter list");
   return NULL;
 }
 
 ASTNode_t *parameter_declaration(Parser *parser) {
-  ASTNode_t *param_decl = create_ast_node(AST_PARAM_DECL, NULL);
   ASTNode_t *type = type_specifier(parser);
   if (type == NULL) {
-    free_ast_node(param_decl);
     return NULL;
   }
-  add_child(param_decl, type);
   ASTNode_t *ident = identifier(parser);
   if (ident == NULL) {
-    free_ast_node(param_decl);
     return NULL;
   }
 
-  add_child(param_decl, ident);
+  ASTNode_t *param_decl = create_ast_node(parser, AST_PARAM_DECL, NULL);
+  add_child(parser, param_decl, type);
+  add_child(parser, param_decl, ident);
   return param_decl;
 }
 
+/* Makes room for one more element on a stack kept in the parser's arena.
+ * Like an outgrown child array, the old stack stays behind in the arena. */
+static void *grow_stack(Parser *parser, void *stack, int count, int *capacity,
+                        size_t size) {
+  if (count < *capacity) {
+    return stack;
+  }
+  int grown = *capacity ? *capacity * 2 : 16;
+  void *copy = arena_alloc(parser->arena, grown * size);
+  if (count > 0) {
+    memcpy(copy, stack, count * size);
+  }
+  *capacity = grown;
+  return copy;
+}
+
+/* Rejects a tree `depth` levels below the open statements if that is deeper
+ * than the nesting limit, before the passes that recurse over it overflow
+ * their stack. */
+static void check_depth(Parser *parser, int depth) {
+  if (parser->depth + depth > parser->options.max_depth) {
+    char message[64];
+    snprintf(message, sizeof(message), "Nesting deeper than %d levels",
+             parser->options.max_depth);
+    syntax_error(parser, message);
+  }
+}
+
+/* Opens a statement that adds `levels` to the tree, one but for the blocks
+ * a for loop is built from. */
+static StatementFrame *push_frame(Parser *parser, FrameKind kind,
+                                  ASTNode_t *node, int levels) {
+  check_depth(parser, levels);
+  parser->frames =
+      grow_stack(parser, parser->frames, parser->frame_count,
+                 &parser->frame_capacity, sizeof(StatementFrame));
+  parser->depth += levels;
+  StatementFrame *frame = &parser->frames[parser->frame_count++];
+  *frame = (StatementFrame){kind, node, NULL, levels, parser->generation};
+  return frame;
+}
+
+static void pop_frame(Parser *parser) {
+  parser->depth -= parser->frames[--parser->frame_count].levels;
+}
+
+/* Adds the body to the loop `frame` opened and returns the finished
+ * statement. A for loop runs its step after the body, and the names its
+ * initializer declares go out of scope. */
+static ASTNode_t *close_loop(Parser *parser, StatementFrame *frame,
+                             ASTNode_t *body) {
+  ASTNode_t *loop = frame->node;
+  if (loop->type == AST_COMPOUND_STMT) {
+    loop = loop->children[loop->child_count - 1];
+  }
+  if (frame->step != NULL) {
+    ASTNode_t *block = create_ast_node(parser, AST_COMPOUND_STMT, NULL);
+    add_child(parser, block, body);
+    add_child(parser, block, frame->step);
+    body = block;
+  }
+  add_child(parser, loop, body);
+  if (frame->generation != parser->generation) {
+    forget_shared(parser);
+  }
+  return frame->node;
+}
+
+/* What is reported when no statement follows the one left open. */
+static const char *missing_statement(FrameKind kind) {
+  switch (kind) {
+  case FRAME_THEN:
+    return "Expected a statement";
+  case FRAME_ELSE:
+    return "Expected a statement after 'else'";
+  case FRAME_LOOP:
+    return "Expected a loop body";
+  default:
+    return "Invalid statement or declaration";
+  }
+}
+
 ASTNode_t *compound_statement(Parser *parser) {
   if (parser->current_token.type != TOKEN_LBRACE) {
     return NULL;
   }
-  advance(parser);
-
-  ASTNode_t *compound_statement = create_ast_node(AST_COMPOUND_STMT, NULL);
+  return statement(parser);
+}
 
-  while (parser->current_token.type != TOKEN_RBRACE &&
-         parser->current_token.type != TOKEN_EOF) {
-    ASTNode_t *node = statement(parser);
-    if (node != NULL) {
-      add_child(compound_statement, node);
-      continue;
-    }
-    node = declaration(parser);
-    if (node != NULL) {
-      add_child(compound_statement, node);
-      continue;
+/* Matches the braces of a compound statement and returns an empty one that
+ * keeps its tokens, or NULL, leaving the parser where it was, if the closing
+ * brace is missing. */
+ASTNode_t *skip_compound_statement(Parser *parser) {
+  if (parser->current_token.type != TOKEN_LBRACE) {
+    return NULL;
+  }
+  int depth = 0;
+  node_t *node = parser->current_node;
+  for (; node->token.type != TOKEN_EOF; node = node->next) {
+    if (node->token.type == TOKEN_LBRACE) {
+      depth++;
+    } else if (node->token.type == TOKEN_RBRACE && --depth == 0) {
+      break;
     }
-    perror("Invalid statement or declaration in compound statement\n");
-    free_ast_node(compound_statement);
-    advance(parser);
   }
-
-  if (parser->current_token.type == TOKEN_RBRACE) {
-    advance(parser);
-    return compound_statement;
-  } else {
-    perror("Expected closing brace in compound statement\n");
-    free_ast_node(compound_statement);
+  if (node->token.type == TOKEN_EOF) {
     return NULL;
   }
+  ASTNode_t *compound_statement =
+      create_ast_node(parser, AST_COMPOUND_STMT, NULL);
+  compound_statement->pending =
+      arena_alloc(parser->arena, sizeof(struct PendingBody));
+  compound_statement->pending->open = parser->current_node;
+  compound_statement->pending->close = node;
+  compound_statement->pending->options = parser->options;
+  parser->bodies_skipped++;
+  backtrack(parser, node);
+  advance(parser);
+  return compound_statement;
 }
 
+/* Parses a statement, with every statement nested in it, or returns NULL if
+ * none starts at the current token. The compound, if and loop statements
+ * still open are kept on the parser's frame stack rather than the C stack,
+ * so only the nesting limit bounds how deep they go. */
 ASTNode_t *statement(Parser *parser) {
-  ASTNode_t *node = expression_statement(parser);
-  if (node != NULL) {
-    return node;
-  }
-  node = compound_statement(parser);
-  if (node != NULL) {
-    return node;
+  parser->frame_count = 0;
+  parser->depth = 0;
+  forget_shared(parser); // The parameters are declared
+  for (;;) {
+    // Open statements until one is complete
+    StatementFrame *top = NULL;
+    ASTNode_t *node = NULL;
+    if (parser->current_token.type == TOKEN_LBRACE) {
+      advance(parser);
+      push_frame(parser, FRAME_COMPOUND,
+                 create_ast_node(parser, AST_COMPOUND_STMT, NULL), 1);
+    } else if (parser->current_token.type == TOKEN_IF) {
+      push_frame(parser, FRAME_THEN, if_statement(parser), 1);
+      continue;
+    } else if (parser->current_token.type == TOKEN_WHILE) {
+      push_frame(parser, FRAME_LOOP, while_statement(parser), 1);
+      continue;
+    } else if (parser->current_token.type == TOKEN_FOR) {
+      uint32_t generation = parser->generation;
+      ASTNode_t *step;
+      ASTNode_t *scope = for_statement(parser, &step);
+      // The scope, the loop and the block of body and step
+      StatementFrame *frame = push_frame(parser, FRAME_LOOP, scope, 3);
+      frame->step = step;
+      frame->generation = generation;
+      continue;
+    } else {
+      if (parser->frame_count > 0) {
+        top = &parser->frames[parser->frame_count - 1];
+      }
+      node = return_statement(parser);
+      if (node == NULL) {
+        node = expression_statement(parser);
+      }
+      if (node == NULL && top != NULL && top->kind == FRAME_COMPOUND) {
+        node = declaration(parser);
+      }
+      if (node == NULL) {
+        if (top == NULL) {
+          return NULL;
+        }
+        syntax_error(parser, missing_statement(top->kind));
+      }
+    }
+
+    // Close the statements it completes, up to one that takes another
+    for (;;) {
+      if (parser->frame_count == 0) {
+        return node;
+      }
+      top = &parser->frames[parser->frame_count - 1];
+      if (top->kind == FRAME_LOOP) {
+        node = close_loop(parser, top, node);
+        pop_frame(parser);
+        continue;
+      }
+      if (top->kind != FRAME_COMPOUND) {
+        add_child(parser, top->node, node);
+        if (top->kind == FRAME_THEN &&
+            parser->current_token.type == TOKEN_ELSE) {
+          advance(parser);
+          top->kind = FRAME_ELSE;
+          break;
+        }
+        node = top->node;
+        pop_frame(parser);
+        continue;
+      }
+      if (node != NULL) {
+        add_child(parser, top->node, node);
+      }
+      if (parser->current_token.type == TOKEN_RBRACE) {
+        advance(parser);
+        // Names declared inside go out of scope
+        if (top->generation != parser->generation) {
+          forget_shared(parser);
+        }
+        node = top->node;
+        pop_frame(parser);
+        continue;
+      }
+      if (parser->current_token.type == TOKEN_EOF) {
+        syntax_error(parser, "Expected '}' to close compound statement");
+      }
+      break;
+    }
   }
-  free_ast_node(node);
-  return NULL;
 }
 
 ASTNode_t *expression_statement(Parser *parser) {
-  ASTNode_t *node = expression(parser);
+  ASTNode_t *node = assignment_expression(parser);
   if (node == NULL) {
     return NULL;
   }
@@ -329,146 +710,780 @@ ASTNode_t *expression_statement(Parser *parser) {
     advance(parser);
     return node;
   }
+  syntax_error(parser, "Expected ';' after expression");
   return NULL;
 }
 
-ASTNode_t *expression(Parser *parser) {
-  ASTNode_t *node = term(parser);
-  return NULL;
-}
+ASTNode_t *return_statement(Parser *parser) {
+  if (parser->current_token.type != TOKEN_RETURN) {
+    return NULL;
+  }
+  ASTNode_t *node =
+      create_ast_node(parser, AST_RETURN_STMT, &parser->current_token);
+  advance(parser);
 
-ASTNode_t *term(Parser *parser) { return NULL; }
-/*
-ASTNode_t *expression(Parser *parser) {
-  ASTNode_t *node = term(parser); // Parse the first term
+  if (parser->current_token.type != TOKEN_SEMICOLON) {
+    ASTNode_t *value = assignment_expression(parser);
+    if (value == NULL) {
+      syntax_error(parser, "Expected an expression after 'return'");
+    }
+    add_child(parser, node, value);
+  }
 
-  while (parser->current_token.type == TOKEN_PLUS ||
-         parser->current_token.type == TOKEN_MINUS) {
-    Token op = parser->current_token; // Store the operator
-    advance(parser);
-    ASTNode_t *right = term(parser); // Parse the next term
+  if (parser->current_token.type != TOKEN_SEMICOLON) {
+    syntax_error(parser, "Expected ';' after return statement");
+  }
+  advance(parser);
+  return node;
+}
 
-    if (right == NULL) {
-      free_ast_node(node);
-      return NULL;
-    }
+/* Parses the `if (condition)` that opens an if statement, for statement to
+ * add the branches to. */
+ASTNode_t *if_statement(Parser *parser) {
+  if (parser->current_token.type != TOKEN_IF) {
+    return NULL;
+  }
+  ASTNode_t *node =
+      create_ast_node(parser, AST_IF_STMT, &parser->current_token);
+  advance(parser);
 
-    ASTNode_t *new_node = create_ast_node(AST_ADDITION_EXPR, &op);
-    add_child(new_node, node);
-    add_child(new_node, right);
-    node = new_node; // Update the current node
+  if (parser->current_token.type != TOKEN_LPAREN) {
+    syntax_error(parser, "Expected '(' after 'if'");
+  }
+  advance(parser);
+  ASTNode_t *condition = assignment_expression(parser);
+  if (condition == NULL) {
+    syntax_error(parser, "Expected a condition");
+  }
+  if (parser->current_token.type != TOKEN_RPAREN) {
+    syntax_error(parser, "Expected ')' after condition");
   }
+  advance(parser);
+  add_child(parser, node, condition);
+  return node;
+}
 
+/* Parses the `while (condition)` that opens a while loop, for statement to
+ * add the body to. */
+ASTNode_t *while_statement(Parser *parser) {
+  if (parser->current_token.type != TOKEN_WHILE) {
+    return NULL;
+  }
+  ASTNode_t *node =
+      create_ast_node(parser, AST_WHILE_STMT, &parser->current_token);
+  advance(parser);
+
+  if (parser->current_token.type != TOKEN_LPAREN) {
+    syntax_error(parser, "Expected '(' after 'while'");
+  }
+  advance(parser);
+  ASTNode_t *condition = assignment_expression(parser);
+  if (condition == NULL) {
+    syntax_error(parser, "Expected a condition");
+  }
+  if (parser->current_token.type != TOKEN_RPAREN) {
+    syntax_error(parser, "Expected ')' after condition");
+  }
+  advance(parser);
+  add_child(parser, node, condition);
   return node;
 }
 
-ASTNode_t *term(Parser *parser) {
-  ASTNode_t *node = factor(parser); // Parse the first factor
+/* Parses the `for (init; condition; step)` that opens a for loop, built as
+ * the while loop in `{ init; while (condition) { body step; } }`, and
+ * returns that block for statement to add the body to. Without a condition
+ * the loop runs until it returns. */
+ASTNode_t *for_statement(Parser *parser, ASTNode_t **step) {
+  if (parser->current_token.type != TOKEN_FOR) {
+    return NULL;
+  }
+  ASTNode_t *scope = create_ast_node(parser, AST_COMPOUND_STMT, NULL);
+  ASTNode_t *loop =
+      create_ast_node(parser, AST_WHILE_STMT, &parser->current_token);
+  advance(parser);
 
-  while (parser->current_token.type == TOKEN_STAR ||
-         parser->current_token.type == TOKEN_SLASH ||
-         parser->current_token.type == TOKEN_MOD) {
-    Token op = parser->current_token; // Store the operator
+  if (parser->current_token.type != TOKEN_LPAREN) {
+    syntax_error(parser, "Expected '(' after 'for'");
+  }
+  advance(parser);
+  ASTNode_t *init = declaration(parser);
+  if (init == NULL && parser->current_token.type != TOKEN_SEMICOLON) {
+    init = assignment_expression(parser);
+    if (init == NULL) {
+      syntax_error(parser, "Expected a declaration or expression");
+    }
+  }
+  if (init == NULL || init->type != AST_DECL) {
+    if (parser->current_token.type != TOKEN_SEMICOLON) {
+      syntax_error(parser, "Expected ';' after loop initializer");
+    }
     advance(parser);
-    ASTNode_t *right = factor(parser); // Parse the next factor
+  }
+  if (init != NULL) {
+    add_child(parser, scope, init);
+  }
 
-    if (right == NULL) {
-      free_ast_node(node);
-      return NULL;
+  ASTNode_t *condition;
+  if (parser->current_token.type == TOKEN_SEMICOLON) {
+    Token one = parser->current_token;
+    one.type = TOKEN_INT_LITERAL;
+    one.lexeme = "1";
+    one.length = 1;
+    condition = create_ast_node(parser, AST_INT_LITERAL, &one);
+  } else {
+    condition = assignment_expression(parser);
+    if (condition == NULL) {
+      syntax_error(parser, "Expected a condition");
     }
+    if (parser->current_token.type != TOKEN_SEMICOLON) {
+      syntax_error(parser, "Expected ';' after loop condition");
+    }
+  }
+  advance(parser);
 
-    ASTNode_t *new_node = create_ast_node(AST_MULTIPLICATION_EXPR, &op);
-    add_child(new_node, node);
-    add_child(new_node, right);
-    node = new_node; // Update the current node
+  *step = NULL;
+  if (parser->current_token.type != TOKEN_RPAREN) {
+    *step = assignment_expression(parser);
+    if (*step == NULL) {
+      syntax_error(parser, "Expected an expression");
+    }
+  }
+  if (parser->current_token.type != TOKEN_RPAREN) {
+    syntax_error(parser, "Expected ')' after for clauses");
   }
+  advance(parser);
+  add_child(parser, loop, condition);
+  add_child(parser, scope, loop);
+  return scope;
+}
 
-  return node;
+/* Returns the precedence of a binary operator, higher for one that binds
+ * tighter, and the node it builds, or 0 if `type` is no binary operator. */
+static int binary_operator(TokenType type, ASTNodeType *node_type) {
+  switch (type) {
+  case TOKEN_EQ:
+  case TOKEN_NEQ:
+    *node_type = AST_EQUALITY_EXPR;
+    return 1;
+  case TOKEN_LT:
+  case TOKEN_GT:
+  case TOKEN_LTE:
+  case TOKEN_GTE:
+    *node_type = AST_RELATIONAL_EXPR;
+    return 2;
+  case TOKEN_PLUS:
+  case TOKEN_MINUS:
+    *node_type = AST_ADDITION_EXPR;
+    return 3;
+  case TOKEN_STAR:
+  case TOKEN_SLASH:
+  case TOKEN_MOD:
+    *node_type = AST_MULTIPLICATION_EXPR;
+    return 4;
+  default:
+    return 0;
+  }
+}
+
+static void push_operator(Parser *parser, Operator op) {
+  check_depth(parser, parser->operator_count + 1);
+  parser->operators =
+      grow_stack(parser, parser->operators, parser->operator_count,
+                 &parser->operator_capacity, sizeof(Operator));
+  parser->operators[parser->operator_count++] = op;
+}
+
+static void push_operand(Parser *parser, Operand operand) {
+  parser->operands =
+      grow_stack(parser, parser->operands, parser->operand_count,
+                 &parser->operand_capacity, sizeof(Operand));
+  parser->operands[parser->operand_count++] = operand;
 }
 
+/* Completes the binary operator or assignment on top of the operator stack
+ * with `right` as its right-hand side. */
+static Operand reduce(Parser *parser, Operand right) {
+  Operator *op = &parser->operators[--parser->operator_count];
+  Operand left = {op->node, 1};
+  ASTNodeType type = AST_ASSIGN_EXPR;
+  if (op->kind == OPERATOR_BINARY) {
+    left = parser->operands[--parser->operand_count];
+    type = op->type;
+  }
+  ASTNode_t *node;
+  if (op->kind == OPERATOR_BINARY) {
+    node = expression_node(parser, type, &op->token, left.node, right.node);
+  } else {
+    node = create_ast_node(parser, type, &op->token);
+    add_child(parser, node, left.node);
+    add_child(parser, node, right.node);
+  }
+  int depth = (left.depth > right.depth ? left.depth : right.depth) + 1;
+  check_depth(parser, parser->operator_count + depth);
+  return (Operand){node, depth};
+}
 
-ASTNode_t *factor(Parser *parser) {
-  if (parser->current_token.type == TOKEN_LPAREN) {
+ASTNode_t *primary_expression(Parser *parser) {
+  switch (parser->current_token.type) {
+  case TOKEN_INT_LITERAL:
+  case TOKEN_FLOAT_LITERAL:
+    return decimal_constant(parser);
+  case TOKEN_CHAR_LITERAL:
+  case TOKEN_STRING_LITERAL:
+    return literal(parser);
+  case TOKEN_IDENTIFIER: {
+    ASTNode_t *node = expression_node(parser, AST_IDENTIFIER,
+                                      &parser->current_token, NULL, NULL);
     advance(parser);
-    ASTNode_t *expr = expression(parser); // Parse the nested expression
-    if (parser->current_token.type == TOKEN_RPAREN) {
+    return node;
+  }
+  default:
+    return NULL;
+  }
+}
+
+/* Parses an expression, or returns NULL if none starts at the current token.
+ * Operator precedence parsing on explicit stacks: a left operand waits on
+ * the operand stack while the operators to its right bind tighter, and
+ * assignments, parentheses and argument lists wait on the operator stack
+ * for the tokens that close them. */
+ASTNode_t *assignment_expression(Parser *parser) {
+  parser->operator_count = 0;
+  parser->operand_count = 0;
+  const char *missing = NULL; // Reported if no operand follows
+  int assignable = 1;         // Whether an assignment may start here
+  for (;;) {
+    // Open assignments, parentheses and calls up to an operand
+    TokenType next = parser->current_node->next != NULL
+                         ? parser->current_node->next->token.type
+                         : TOKEN_EOF;
+    Operand operand;
+    if (assignable && parser->current_token.type == TOKEN_IDENTIFIER &&
+        next == TOKEN_ASSIGN) {
+      ASTNode_t *target = identifier(parser);
+      push_operator(parser, (Operator){OPERATOR_ASSIGN, 0, AST_UNKNOWN,
+                                       parser->current_token, target, 0});
+      advance(parser);
+      missing = "Expected an expression after '='";
+      continue;
+    }
+    if (parser->current_token.type == TOKEN_LPAREN) {
+      push_operator(parser, (Operator){.kind = OPERATOR_PAREN});
       advance(parser);
-      return expr;
+      missing = "Expected an expression";
+      assignable = 1;
+      continue;
+    }
+    if (parser->current_token.type == TOKEN_IDENTIFIER &&
+        next == TOKEN_LPAREN) {
+      ASTNode_t *call =
+          create_ast_node(parser, AST_CALL_EXPR, &parser->current_token);
+      add_child(parser, call, identifier(parser));
+      advance(parser); // Skip left parenthesis
+      add_child(parser, call, create_ast_node(parser, AST_ARG_LIST, NULL));
+      if (parser->current_token.type != TOKEN_RPAREN) {
+        push_operator(parser,
+                      (Operator){.kind = OPERATOR_CALL, .node = call});
+        missing = "Expected an argument";
+        assignable = 1;
+        continue;
+      }
+      advance(parser);
+      operand = (Operand){call, 2};
     } else {
-      perror("Expected closing parenthesis");
-      free_ast_node(expr);
-      return NULL;
+      ASTNode_t *primary = primary_expression(parser);
+      if (primary == NULL) {
+        if (missing == NULL) {
+          return NULL;
+        }
+        syntax_error(parser, missing);
+      }
+      operand = (Operand){primary, 1};
+    }
+
+    // Close what the operand completes, up to an operator that needs more
+    for (;;) {
+      ASTNodeType type = AST_UNKNOWN;
+      int level = binary_operator(parser->current_token.type, &type);
+      while (parser->operator_count > 0) {
+        Operator *top = &parser->operators[parser->operator_count - 1];
+        int complete = top->kind == OPERATOR_BINARY
+                           ? top->level >= level
+                           : top->kind == OPERATOR_ASSIGN && level == 0;
+        if (!complete) {
+          break;
+        }
+        operand = reduce(parser, operand);
+      }
+      if (level > 0) {
+        push_operand(parser, operand);
+        push_operator(parser, (Operator){OPERATOR_BINARY, level, type,
+                                         parser->current_token, NULL, 0});
+        advance(parser);
+        missing = "Expected an operand";
+        assignable = 0;
+        break;
+      }
+      if (parser->operator_count == 0) {
+        return operand.node;
+      }
+      Operator *top = &parser->operators[parser->operator_count - 1];
+      if (top->kind == OPERATOR_PAREN) {
+        if (parser->current_token.type != TOKEN_RPAREN) {
+          syntax_error(parser, "Expected closing parenthesis");
+        }
+        advance(parser);
+        parser->operator_count--;
+        continue;
+      }
+      add_child(parser, top->node->children[1], operand.node);
+      if (operand.depth > top->depth) {
+        top->depth = operand.depth;
+      }
+      if (parser->current_token.type == TOKEN_COMMA) {
+        advance(parser);
+        missing = "Expected an argument";
+        assignable = 1;
+        break;
+      }
+      if (parser->current_token.type != TOKEN_RPAREN) {
+        syntax_error(parser, "Expected closing parenthesis in argument list");
+      }
+      advance(parser);
+      operand = (Operand){top->node, top->depth + 2};
+      parser->operator_count--;
+      check_depth(parser, parser->operator_count + operand.depth);
     }
-  } else if (parser->current_token.type == TOKEN_INT_LITERAL ||
-             parser->current_token.type == TOKEN_FLOAT_LITERAL) {
-    return decimal_constant(parser); // Handle integer and float literals
-  } else if (parser->current_token.type == TOKEN_IDENTIFIER) {
-    return identifier(parser); // Handle identifiers
-  } else {
-    perror("Expected a factor");
-    return NULL;
   }
 }
-*/
-
-ASTNode_t *assignment_expression(Parser *parser) { return NULL; }
 
 ASTNode_t *declaration(Parser *parser) {
-  ASTNode_t *node = create_ast_node(AST_DECL, NULL);
   ASTNode_t *type = type_specifier(parser);
   if (type == NULL) {
-    free_ast_node(node);
     return NULL;
   }
+  ASTNode_t *node = create_ast_node(parser, AST_DECL, NULL);
   ASTNode_t *ident = identifier(parser);
   if (ident == NULL) {
-    free_ast_node(node);
-    return NULL;
+    syntax_error(parser, "Expected an identifier in declaration");
   }
-  add_child(node, type);
-  add_child(node, ident);
+  // The name is in scope in its own initializer
+  forget_shared(parser);
+  add_child(parser, node, type);
+  add_child(parser, node, ident);
 
   if (parser->current_token.type == TOKEN_ASSIGN) {
     advance(parser);
-    ASTNode_t *expr = expression(parser);
+    ASTNode_t *expr = assignment_expression(parser);
     if (expr == NULL) {
-      perror("Assignment in variable declaration must be followed by a decimal "
-             "constant\n");
-      return NULL;
+      syntax_error(parser, "Expected an initializer");
     }
-    add_child(node, expr);
+    add_child(parser, node, expr);
   }
   if (parser->current_token.type == TOKEN_SEMICOLON) {
     advance(parser);
     return node;
   }
+  syntax_error(parser, "Expected ';' after declaration");
   return NULL;
 }
 
 ASTNode_t *decimal_constant(Parser *parser) {
   if (parser->current_token.type == TOKEN_INT_LITERAL) {
-    ASTNode_t *constant =
-        create_ast_node(AST_INT_LITERAL, &parser->current_token);
+    ASTNode_t *constant = expression_node(parser, AST_INT_LITERAL,
+                                          &parser->current_token, NULL, NULL);
     advance(parser);
     return constant;
   }
   if (parser->current_token.type == TOKEN_FLOAT_LITERAL) {
-    ASTNode_t *constant =
-        create_ast_node(AST_FLOAT_LITERAL, &parser->current_token);
+    ASTNode_t *constant = expression_node(parser, AST_FLOAT_LITERAL,
+                                          &parser->current_token, NULL, NULL);
     advance(parser);
     return constant;
   }
   return NULL;
 }
 
-ASTNode_t *get_ast(node_t *head) {
-  Parser parser;
-  parser.current_node = head;
-  parser.current_token = head->token;
+ASTNode_t *literal(Parser *parser) {
+  ASTNodeType type = parser->current_token.type == TOKEN_CHAR_LITERAL
+                         ? AST_CHAR_LITERAL
+                         : AST_STRING_LITERAL;
+  ASTNode_t *node =
+      expression_node(parser, type, &parser->current_token, NULL, NULL);
+  advance(parser);
+  return node;
+}
+
+/* A run of whole external declarations, parsed by one thread. While it is
+ * parsed, the token after its last one is replaced by an end of file. */
+typedef struct {
+  node_t *first;
+  node_t *last;
+  node_t *following; // Successor of `last` in the token list
+  node_t eof;
+  ASTNode_t *unit; // The declarations, as children of a translation unit
+  uint32_t bodies_skipped;
+  uint32_t nodes_shared;
+  int failed;
+  char error[PARSE_ERROR_SIZE];
+} Chunk;
+
+typedef struct {
+  Chunk *chunks;
+  int chunk_count;
+  int next; // The first chunk not yet taken by a thread
+  const ParseOptions *options;
+} Pool;
+
+typedef struct {
+  Pool *pool;
+  Arena *arena;
+} Worker;
+
+static void parse_chunk(Chunk *chunk, Arena *arena,
+                        const ParseOptions *options) {
+  jmp_buf failure;
+  Parser parser = {chunk->first, chunk->first->token, arena, &failure,
+                   chunk->error, *options, 0};
+  if (setjmp(failure) != 0) {
+    chunk->failed = 1;
+    return;
+  }
+  chunk->unit = external_declarations(&parser);
+  chunk->bodies_skipped = parser.bodies_skipped;
+  chunk->nodes_shared = parser.nodes_shared;
+}
+
+static void *run_worker(void *argument) {
+  Worker *worker = argument;
+  Pool *pool = worker->pool;
+  for (;;) {
+    int chunk = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED);
+    if (chunk >= pool->chunk_count) {
+      return NULL;
+    }
+    parse_chunk(&pool->chunks[chunk], worker->arena, pool->options);
+  }
+}
+
+static void reserve_arenas(int count) {
+  if (count <= arena_count) {
+    return;
+  }
+  arenas = reallocate(arenas, count, sizeof(Arena *));
+  for (; arena_count < count; arena_count++) {
+    arenas[arena_count] = allocate(1, sizeof(Arena));
+    arena_init(arenas[arena_count], 0);
+  }
+}
+
+/**
+ * @brief Tracks the brace depth across a token of type `type` and tells
+ * whether the token ends a top-level declaration: a ';' or '}' outside any
+ * braces.
+ */
+int ends_declaration(TokenType type, int *depth) {
+  if (type == TOKEN_LBRACE) {
+    ++*depth;
+    return 0;
+  }
+  if (type == TOKEN_RBRACE && *depth > 0) {
+    --*depth;
+  } else if (type != TOKEN_SEMICOLON && type != TOKEN_RBRACE) {
+    return 0;
+  }
+  return *depth == 0;
+}
+
+/* Cuts the tokens from the parser's position into chunks of about
+ * CHUNK_TOKENS tokens that end at top-level boundaries. */
+static Chunk *split_chunks(Parser *parser, int *chunk_count,
+                           uint32_t *declarations) {
+  Chunk *chunks = NULL;
+  uint32_t capacity = 0;
+  *chunk_count = 0;
+  *declarations = 0;
+  int depth = 0;
+  int tokens = 0;
+  node_t *first = parser->current_node;
+  for (node_t *node = first; node->token.type != TOKEN_EOF;
+       node = node->next) {
+    tokens++;
+    if (!ends_declaration(node->token.type, &depth)) {
+      continue;
+    }
+    (*declarations)++;
+    if (tokens < CHUNK_TOKENS && node->next->token.type != TOKEN_EOF) {
+      continue;
+    }
+    if (*chunk_count == capacity) {
+      chunks = grow(chunks, sizeof(Chunk), &capacity, 16);
+    }
+    chunks[(*chunk_count)++] = (Chunk){.first = first, .last = node};
+    first = node->next;
+    tokens = 0;
+  }
+  if (first->token.type != TOKEN_EOF) {
+    // Trailing tokens without a boundary go into the last chunk
+    if (*chunk_count == 0) {
+      free(chunks);
+      return NULL;
+    }
+    node_t *last = first;
+    while (last->next->token.type != TOKEN_EOF) {
+      last = last->next;
+    }
+    chunks[*chunk_count - 1].last = last;
+  }
+  return chunks;
+}
+
+/**
+ * @brief Parses the translation unit on up to `threads` threads, one chunk
+ * of declarations at a time, and splices the declarations of the chunks
+ * together in source order.
+ *
+ * @return The translation unit, or NULL after writing the first syntax
+ * error, in source order, to `error`.
+ */
+ASTNode_t *translation_unit(Parser *parser, int threads, ParseStats *stats,
+                            char *error) {
+  double start = now();
+  int chunk_count;
+  uint32_t declarations;
+  Chunk *chunks = split_chunks(parser, &chunk_count, &declarations);
+  if (threads > chunk_count) {
+    threads = chunk_count;
+  }
+  if (threads <= 1) {
+    // Not worth a thread: parse in place
+    free(chunks);
+    threads = 1;
+    chunk_count = 1;
+    jmp_buf failure;
+    parser->failure = &failure;
+    parser->error = error;
+    if (setjmp(failure) != 0) {
+      return NULL;
+    }
+    ASTNode_t *ast = external_declarations(parser);
+    if (stats != NULL) {
+      *stats = (ParseStats){declarations, parser->bodies_skipped,
+                            parser->nodes_shared, 1, 1, now() - start};
+    }
+    return ast;
+  }
+
+  for (int i = 0; i < chunk_count; i++) {
+    Chunk *chunk = &chunks[i];
+    chunk->following = chunk->last->next;
+    chunk->eof.token = chunk->following->token;
+    chunk->eof.token.type = TOKEN_EOF;
+    chunk->eof.token.lexeme = "EOF";
+    chunk->eof.token.length = 3;
+    chunk->eof.next = NULL;
+    chunk->last->next = &chunk->eof;
+  }
+  reserve_arenas(threads);
+  Pool pool = {chunks, chunk_count, 0, &parser->options};
+  Worker *workers = allocate(threads, sizeof(Worker));
+  pthread_t *handles = allocate(threads, sizeof(pthread_t));
+  int started = 0;
+  // The calling thread is the first worker
+  for (int i = 0; i < threads; i++) {
+    workers[i] = (Worker){&pool, arenas[i]};
+  }
+  while (started + 1 < threads &&
+         pthread_create(&handles[started], NULL, run_worker,
+                        &workers[started + 1]) == 0) {
+    started++;
+  }
+  run_worker(&workers[0]);
+  for (int i = 0; i < started; i++) {
+    pthread_join(handles[i], NULL);
+  }
+  free(handles);
+  free(workers);
+
+  int count = 0;
+  uint32_t bodies_skipped = 0;
+  uint32_t nodes_shared = 0;
+  int failed = 0;
+  for (int i = 0; i < chunk_count; i++) {
+    chunks[i].last->next = chunks[i].following;
+    if (chunks[i].failed && !failed) {
+      memcpy(error, chunks[i].error, PARSE_ERROR_SIZE);
+      failed = 1;
+    }
+    if (failed) {
+      continue; // The links of the other chunks are still restored
+    }
+    count += chunks[i].unit->child_count;
+    bodies_skipped += chunks[i].bodies_skipped;
+    nodes_shared += chunks[i].nodes_shared;
+  }
+  if (failed) {
+    free(chunks);
+    return NULL;
+  }
+  ASTNode_t *ast = chunks[0].unit;
+  ASTNode_t **children =
+      arena_alloc(parser->arena, count * sizeof(ASTNode_t *));
+  count = 0;
+  for (int i = 0; i < chunk_count; i++) {
+    memcpy(children + count, chunks[i].unit->children,
+           chunks[i].unit->child_count * sizeof(ASTNode_t *));
+    count += chunks[i].unit->child_count;
+  }
+  ast->children = children;
+  ast->child_count = ast->child_capacity = count;
+  free(chunks);
+  if (stats != NULL) {
+    *stats = (ParseStats){declarations, bodies_skipped, nodes_shared,
+                          chunk_count, threads, now() - start};
+  }
+  return ast;
+}
+
+/**
+ * @brief Parses the token list into an AST. The nodes, and the tokens of
+ * bodies left unparsed, must stay allocated for as long as the AST is used.
+ *
+ * @return The translation unit, or NULL if there are no tokens or after
+ * writing a syntax error of up to PARSE_ERROR_SIZE bytes to `error`, which
+ * is otherwise left empty.
+ */
+ASTNode_t *get_ast(node_t *head, const ParseOptions *options,
+                   ParseStats *stats, char *error) {
+  reserve_arenas(1);
+  Parser parser = {head, head->token, arenas[0], NULL, NULL, *options, 0};
+  error[0] = '\0';
 
   if (parser.current_token.type != TOKEN_EOF) {
 
-    return translation_unit(&parser);
+    return translation_unit(&parser, options->threads, stats, error);
   }
   return NULL;
 }
+
+/* Parses the pending body of `function` into `arena`, as if the closing
+ * brace ended the file.
+ *
+ * @return The body, or NULL after writing a syntax error to `error`. */
+static ASTNode_t *parse_pending_body(ASTNode_t *function, Arena *arena,
+                                     char *error) {
+  ASTNode_t *body = function->children[3];
+  struct PendingBody *pending = body->pending;
+  node_t *following = pending->close->next;
+  node_t eof = {following->token, NULL};
+  eof.token.type = TOKEN_EOF;
+  eof.token.lexeme = "EOF";
+  eof.token.length = 3;
+  pending->close->next = &eof;
+  jmp_buf failure;
+  Parser parser = {pending->open, pending->open->token, arena, &failure,
+                   error, pending->options, 0};
+  parser.options.lazy_bodies = 0;
+  ASTNode_t *parsed = NULL;
+  if (setjmp(failure) == 0) {
+    parsed = compound_statement(&parser);
+  }
+  pending->close->next = following;
+  if (parsed == NULL) {
+    return NULL;
+  }
+  body->children = parsed->children;
+  body->child_count = parsed->child_count;
+  body->child_capacity = parsed->child_capacity;
+  body->pending = NULL;
+  return body;
+}
+
+/**
+ * @brief Parses the external declarations in `tokens`, a run that ends in
+ * TOKEN_EOF, into the children of a translation unit. Function bodies are
+ * skipped as with lazy bodies, whatever `options` say. The nodes are built
+ * where get_ast builds them, so only one thread may call either at a time.
+ *
+ * @return The declarations, or NULL after writing a syntax error of up to
+ * PARSE_ERROR_SIZE bytes to `error`.
+ */
+ASTNode_t *parse_declarations(node_t *tokens, const ParseOptions *options,
+                              char *error) {
+  reserve_arenas(1);
+  jmp_buf failure;
+  Parser parser = {tokens, tokens->token, arenas[0], &failure, error, *options,
+                   0};
+  parser.options.lazy_bodies = 1;
+  if (setjmp(failure) != 0) {
+    return NULL;
+  }
+  return external_declarations(&parser);
+}
+
+/**
+ * @brief Returns the body of a function definition, parsing it first if it
+ * was skipped. Not safe to call from several threads at once. Exits after
+ * reporting a syntax error in the body.
+ */
+ASTNode_t *function_body(ASTNode_t *function) {
+  ASTNode_t *body = function->children[3];
+  if (body->pending == NULL) {
+    return body;
+  }
+  char error[PARSE_ERROR_SIZE] = "";
+  if (parse_pending_body(function, arenas[0], error) == NULL) {
+    fputs(error, stderr);
+    exit(EXIT_FAILURE);
+  }
+  return body;
+}
+
+/**
+ * @brief Parses the skipped body of a function definition into `arena` and
+ * frees the tokens it was parsed from, all but the opening brace. For a
+ * caller that compiles each function once: the body is used until
+ * release_function_body, and the arena may then be reset.
+ *
+ * @return The body, or NULL after writing a syntax error of up to
+ * PARSE_ERROR_SIZE bytes to `error`; the tokens are then kept.
+ */
+ASTNode_t *take_function_body(ASTNode_t *function, Arena *arena,
+                              char *error) {
+  ASTNode_t *body = function->children[3];
+  struct PendingBody *pending = body->pending;
+  if (pending == NULL) {
+    return body;
+  }
+  node_t *open = pending->open;
+  node_t *close = pending->close;
+  if (parse_pending_body(function, arena, error) == NULL) {
+    return NULL;
+  }
+  // The nodes hold copies of their tokens
+  node_t *tokens = open->next;
+  open->next = close->next;
+  close->next = NULL;
+  delete_list(tokens);
+  return body;
+}
+
+/**
+ * @brief Forgets the body of a function definition once it is compiled,
+ * before the arena it was taken into is reset.
+ */
+void release_function_body(ASTNode_t *function) {
+  ASTNode_t *body = function->children[3];
+  body->children = NULL;
+  body->child_count = 0;
+  body->child_capacity = 0;
+}
+
+void print_parse_stats(FILE *out, const ParseStats *stats) {
+  fprintf(out,
+          "parser: %u declarations, %u bodies skipped, %u expression "
+          "nodes shared, in %d chunks on %d threads in %.3f ms\n",
+          stats->declarations, stats->bodies_skipped, stats->nodes_shared,
+          stats->chunks,
+          stats->threads, stats->seconds * 1e3);
+}
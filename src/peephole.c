@@ -0,0 +1,457 @@
+#include "peephole.h"
+#include "util.h"
+#include <stdlib.h>
+
+/*
+ * Peephole optimization of the machine instruction stream. Patterns are rows
+ * of a table: a short sequence of opcode sets and a rewrite that checks the
+ * remaining conditions and edits the matched instructions in place, deleting
+ * by turning them into MI_NOP. The table is compiled once into a dispatch
+ * table from opcode to the patterns that can start with it, so each position
+ * only tries the handful of patterns that could apply.
+ *
+ * Conditions on registers being dead use a backward liveness scan over the
+ * stream that assumes every register is live at jumps and returns. Each
+ * round rewrites non-overlapping windows front to back, so the liveness
+ * computed for the round stays valid after every window; rounds repeat until
+ * nothing changes.
+ */
+
+#define MAX_PATTERN_LENGTH 3
+#define MAX_ROUNDS 8
+
+#define OP(opcode) ((uint64_t)1 << (opcode))
+#define ALL_REGISTERS (REGISTER_BIT(NUM_REGISTERS) - 1)
+#define FRAME_REGISTERS (REGISTER_BIT(REG_RSP) | REGISTER_BIT(REG_RBP))
+#define ARGUMENT_REGISTERS                                                     \
+  (REGISTER_BIT(REG_RDI) | REGISTER_BIT(REG_RSI) | REGISTER_BIT(REG_RDX) |     \
+   REGISTER_BIT(REG_RCX) | REGISTER_BIT(REG_R8) | REGISTER_BIT(REG_R9))
+
+typedef struct {
+  MachineList *list;
+  RegisterSet *live_after;
+} Peephole;
+
+typedef struct {
+  const char *name;
+  int length;
+  uint64_t opcodes[MAX_PATTERN_LENGTH]; // Allowed opcodes at each position
+  int (*rewrite)(Peephole *peephole, const uint32_t *at);
+} PeepholePattern;
+
+static MachineInstr *instr(Peephole *peephole, uint32_t index) {
+  return &peephole->list->instrs[index];
+}
+
+static int is_dead_after(Peephole *peephole, uint32_t index, int reg) {
+  return !(peephole->live_after[index] & REGISTER_BIT(reg));
+}
+
+static int same_memory(Memory a, Memory b) {
+  return a.base == b.base && a.index == b.index && a.scale == b.scale &&
+         a.disp == b.disp && (a.base != REG_RIP || a.global == b.global);
+}
+
+static RegisterSet memory_uses(Memory m) {
+  RegisterSet uses = 0;
+  if (m.base != REG_RIP) {
+    uses |= REGISTER_BIT(m.base);
+  }
+  if (m.index != REG_NONE) {
+    uses |= REGISTER_BIT(m.index);
+  }
+  return uses;
+}
+
+static void delete(Peephole *peephole, uint32_t index) {
+  instr(peephole, index)->opcode = MI_NOP;
+}
+
+/* mov r, x where r is never read again, or mov r, r. */
+static int rewrite_dead_move(Peephole *peephole, const uint32_t *at) {
+  MachineInstr *move = instr(peephole, at[0]);
+  if ((move->opcode == MI_MOV_RR && move->dst == move->src) ||
+      (!(FRAME_REGISTERS & REGISTER_BIT(move->dst)) &&
+       is_dead_after(peephole, at[0], move->dst))) {
+    delete(peephole, at[0]);
+    return 1;
+  }
+  return 0;
+}
+
+/* mov a, b; mov b, a: the second copy changes nothing. */
+static int rewrite_move_back(Peephole *peephole, const uint32_t *at) {
+  MachineInstr *first = instr(peephole, at[0]);
+  MachineInstr *second = instr(peephole, at[1]);
+  if (second->dst != first->src || second->src != first->dst ||
+      second->wide != first->wide) {
+    return 0;
+  }
+  delete(peephole, at[1]);
+  return 1;
+}
+
+/* mov [m], r; mov s, [m]: reuse the stored register. */
+static int rewrite_store_load(Peephole *peephole, const uint32_t *at) {
+  MachineInstr *store = instr(peephole, at[0]);
+  MachineInstr *load = instr(peephole, at[1]);
+  if (!same_memory(store->memory, load->memory) || store->wide != load->wide) {
+    return 0;
+  }
+  if (load->dst == store->src) {
+    delete(peephole, at[1]);
+  } else {
+    load->opcode = MI_MOV_RR;
+    load->src = store->src;
+  }
+  return 1;
+}
+
+/* mov r, [m]; op r, s; mov [m], r with r dead: op [m], s. */
+static int rewrite_load_op_store(Peephole *peephole, const uint32_t *at) {
+  MachineInstr *load = instr(peephole, at[0]);
+  MachineInstr *op = instr(peephole, at[1]);
+  MachineInstr *store = instr(peephole, at[2]);
+  int reg = load->dst;
+  if (op->dst != reg || store->src != reg || op->op == ALU_CMP ||
+      (op->opcode == MI_ALU_RR && op->src == reg) ||
+      !same_memory(load->memory, store->memory) || load->wide != op->wide ||
+      store->wide != op->wide || !is_dead_after(peephole, at[2], reg)) {
+    return 0;
+  }
+  op->opcode = op->opcode == MI_ALU_RR ? MI_ALU_MR : MI_ALU_MI;
+  op->memory = load->memory;
+  op->dst = REG_NONE;
+  delete(peephole, at[0]);
+  delete(peephole, at[2]);
+  return 1;
+}
+
+/* mov r, [m]; op d, r with r dead: op d, [m]. */
+static int fold_load(Peephole *peephole, uint32_t at_load, uint32_t at_op) {
+  MachineInstr *load = instr(peephole, at_load);
+  MachineInstr *op = instr(peephole, at_op);
+  if (op->src != load->dst || op->dst == load->dst ||
+      load->wide != op->wide || !is_dead_after(peephole, at_op, load->dst)) {
+    return 0;
+  }
+  op->opcode = MI_ALU_RM;
+  op->memory = load->memory;
+  op->src = REG_NONE;
+  delete(peephole, at_load);
+  return 1;
+}
+
+static int rewrite_load_op(Peephole *peephole, const uint32_t *at) {
+  return fold_load(peephole, at[0], at[1]);
+}
+
+/* mov r, [m]; mov d, s; op d, r: the copy must leave r and m alone. */
+static int rewrite_load_op_after_move(Peephole *peephole, const uint32_t *at) {
+  MachineInstr *load = instr(peephole, at[0]);
+  MachineInstr *copy = instr(peephole, at[1]);
+  if (copy->dst == load->dst || copy->src == load->dst ||
+      (memory_uses(load->memory) & REGISTER_BIT(copy->dst))) {
+    return 0;
+  }
+  return fold_load(peephole, at[0], at[2]);
+}
+
+/* mov r, [m]; mov d, r with r dead: mov d, [m]. */
+static int rewrite_load_copy(Peephole *peephole, const uint32_t *at) {
+  MachineInstr *load = instr(peephole, at[0]);
+  MachineInstr *copy = instr(peephole, at[1]);
+  if (copy->src != load->dst || copy->wide != load->wide ||
+      !is_dead_after(peephole, at[1], load->dst)) {
+    return 0;
+  }
+  copy->opcode = MI_MOV_RM;
+  copy->memory = load->memory;
+  copy->src = REG_NONE;
+  delete(peephole, at[0]);
+  return 1;
+}
+
+/* mov r, imm; op d, r: op d, imm. The mov goes once r is dead. */
+static int fold_immediate(Peephole *peephole, uint32_t at_constant,
+                          uint32_t at_op) {
+  MachineInstr *constant = instr(peephole, at_constant);
+  MachineInstr *op = instr(peephole, at_op);
+  // mov r32, imm zero-extends while 64-bit ALU immediates sign-extend
+  if (op->src != constant->dst || op->dst == constant->dst ||
+      (op->wide && constant->imm < 0)) {
+    return 0;
+  }
+  op->opcode = op->opcode == MI_IMUL_RR ? MI_IMUL_RRI : MI_ALU_RI;
+  op->imm = constant->imm;
+  op->src = op->opcode == MI_IMUL_RRI ? op->dst : REG_NONE;
+  return 1;
+}
+
+/* mov r, 2^k; imul d, r: shl d, k. */
+static int fold_multiply_to_shift(Peephole *peephole, uint32_t at_constant,
+                                  uint32_t at_multiply) {
+  MachineInstr *constant = instr(peephole, at_constant);
+  MachineInstr *multiply = instr(peephole, at_multiply);
+  int32_t factor = constant->imm;
+  if (multiply->src != constant->dst || multiply->dst == constant->dst ||
+      factor <= 0 || (factor & (factor - 1)) != 0) {
+    return 0;
+  }
+  multiply->opcode = MI_SHIFT_RI;
+  multiply->op = SHIFT_SHL;
+  multiply->imm = __builtin_ctz((uint32_t)factor);
+  multiply->src = REG_NONE;
+  return 1;
+}
+
+/* Code generation copies the left operand into the result register between
+ * materializing a constant and using it: mov r, imm; mov d, s; op d, r. */
+static int constant_survives_move(Peephole *peephole, const uint32_t *at) {
+  return instr(peephole, at[1])->dst != instr(peephole, at[0])->dst;
+}
+
+static int rewrite_immediate_operand(Peephole *peephole, const uint32_t *at) {
+  return fold_immediate(peephole, at[0], at[1]);
+}
+
+static int rewrite_immediate_operand_after_move(Peephole *peephole,
+                                                const uint32_t *at) {
+  return constant_survives_move(peephole, at) &&
+         fold_immediate(peephole, at[0], at[2]);
+}
+
+static int rewrite_multiply_to_shift(Peephole *peephole, const uint32_t *at) {
+  return fold_multiply_to_shift(peephole, at[0], at[1]);
+}
+
+static int rewrite_multiply_to_shift_after_move(Peephole *peephole,
+                                                const uint32_t *at) {
+  return constant_survives_move(peephole, at) &&
+         fold_multiply_to_shift(peephole, at[0], at[2]);
+}
+
+/* jmp L; L: */
+static int rewrite_jump_to_next(Peephole *peephole, const uint32_t *at) {
+  MachineList *list = peephole->list;
+  int32_t target = instr(peephole, at[0])->imm;
+  for (uint32_t i = at[0] + 1; i < list->count; i++) {
+    const MachineInstr *next = &list->instrs[i];
+    if (next->opcode == MI_LABEL && next->imm == target) {
+      delete(peephole, at[0]);
+      return 1;
+    }
+    if (next->opcode != MI_LABEL && next->opcode != MI_NOP) {
+      return 0;
+    }
+  }
+  return 0;
+}
+
+/* jcc L; jmp M; L: becomes jncc M; L: */
+static int rewrite_branch_over_jump(Peephole *peephole, const uint32_t *at) {
+  MachineInstr *branch = instr(peephole, at[0]);
+  MachineInstr *jump = instr(peephole, at[1]);
+  if (branch->imm != instr(peephole, at[2])->imm) {
+    return 0;
+  }
+  branch->op ^= 1; // Condition codes come in complementary pairs
+  branch->imm = jump->imm;
+  delete(peephole, at[1]);
+  return 1;
+}
+
+static const PeepholePattern patterns[] = {
+    {"load-op-store", 3,
+     {OP(MI_MOV_RM), OP(MI_ALU_RR) | OP(MI_ALU_RI), OP(MI_MOV_MR)},
+     rewrite_load_op_store},
+    {"branch-over-jump", 3, {OP(MI_JCC), OP(MI_JMP), OP(MI_LABEL)},
+     rewrite_branch_over_jump},
+    {"multiply-to-shift/copy", 3,
+     {OP(MI_MOV_RI), OP(MI_MOV_RR), OP(MI_IMUL_RR)},
+     rewrite_multiply_to_shift_after_move},
+    {"immediate-operand/copy", 3,
+     {OP(MI_MOV_RI), OP(MI_MOV_RR), OP(MI_ALU_RR) | OP(MI_IMUL_RR)},
+     rewrite_immediate_operand_after_move},
+    {"load-op/copy", 3, {OP(MI_MOV_RM), OP(MI_MOV_RR), OP(MI_ALU_RR)},
+     rewrite_load_op_after_move},
+    {"load-op", 2, {OP(MI_MOV_RM), OP(MI_ALU_RR)}, rewrite_load_op},
+    {"store-load", 2, {OP(MI_MOV_MR), OP(MI_MOV_RM)}, rewrite_store_load},
+    {"load-copy", 2, {OP(MI_MOV_RM), OP(MI_MOV_RR)}, rewrite_load_copy},
+    {"move-back", 2, {OP(MI_MOV_RR), OP(MI_MOV_RR)}, rewrite_move_back},
+    {"multiply-to-shift", 2, {OP(MI_MOV_RI), OP(MI_IMUL_RR)},
+     rewrite_multiply_to_shift},
+    {"immediate-operand", 2, {OP(MI_MOV_RI), OP(MI_ALU_RR) | OP(MI_IMUL_RR)},
+     rewrite_immediate_operand},
+    {"dead-move", 1,
+     {OP(MI_MOV_RR) | OP(MI_MOV_RI) | OP(MI_MOV_RM) | OP(MI_LEA) |
+      OP(MI_MOVZX_R8)},
+     rewrite_dead_move},
+    {"jump-to-next", 1, {OP(MI_JMP)}, rewrite_jump_to_next},
+};
+
+#define PATTERN_COUNT (int)(sizeof(patterns) / sizeof(patterns[0]))
+_Static_assert(PATTERN_COUNT <= PEEPHOLE_MAX_PATTERNS, "too many patterns");
+
+/* Patterns that can start with each opcode, in table order. */
+static uint8_t dispatch[NUM_MACHINE_OPCODES][PEEPHOLE_MAX_PATTERNS];
+static uint8_t dispatch_count[NUM_MACHINE_OPCODES];
+static int dispatch_ready;
+
+static void compile_patterns(void) {
+  for (int p = 0; p < PATTERN_COUNT; p++) {
+    for (int opcode = 0; opcode < NUM_MACHINE_OPCODES; opcode++) {
+      if (patterns[p].opcodes[0] & OP(opcode)) {
+        dispatch[opcode][dispatch_count[opcode]++] = (uint8_t)p;
+      }
+    }
+  }
+  dispatch_ready = 1;
+}
+
+/* Registers live before `mi`, given those live after it. */
+static RegisterSet live_before(const MachineInstr *mi, RegisterSet live) {
+  RegisterSet defs = 0, uses = 0;
+  switch (mi->opcode) {
+  case MI_NOP:
+  case MI_LABEL:
+    return live;
+  case MI_JMP:
+  case MI_JCC:
+  case MI_RET:
+    return ALL_REGISTERS;
+  case MI_MOV_RR:
+  case MI_MOVZX_R8:
+    defs = REGISTER_BIT(mi->dst), uses = REGISTER_BIT(mi->src);
+    break;
+  case MI_MOV_RI:
+    defs = REGISTER_BIT(mi->dst);
+    break;
+  case MI_MOV_RM:
+  case MI_LEA:
+    defs = REGISTER_BIT(mi->dst), uses = memory_uses(mi->memory);
+    break;
+  case MI_MOV_MR:
+  case MI_ALU_MR:
+    uses = REGISTER_BIT(mi->src) | memory_uses(mi->memory);
+    break;
+  case MI_ALU_MI:
+  case MI_PUSH_M:
+  case MI_POP_M:
+    uses = memory_uses(mi->memory);
+    break;
+  case MI_ALU_RR:
+  case MI_IMUL_RR:
+    uses = REGISTER_BIT(mi->dst) | REGISTER_BIT(mi->src);
+    defs = mi->opcode == MI_ALU_RR && mi->op == ALU_CMP ? 0
+                                                        : REGISTER_BIT(mi->dst);
+    break;
+  case MI_ALU_RI:
+  case MI_SHIFT_RI:
+  case MI_SETCC: // Writes only the low byte
+    uses = REGISTER_BIT(mi->dst);
+    defs = mi->op == ALU_CMP && mi->opcode == MI_ALU_RI ? 0 : uses;
+    break;
+  case MI_ALU_RM:
+    uses = REGISTER_BIT(mi->dst) | memory_uses(mi->memory);
+    defs = mi->op == ALU_CMP ? 0 : REGISTER_BIT(mi->dst);
+    break;
+  case MI_IMUL_RRI:
+    defs = REGISTER_BIT(mi->dst), uses = REGISTER_BIT(mi->src);
+    break;
+  case MI_IDIV_R:
+    defs = REGISTER_BIT(REG_RAX) | REGISTER_BIT(REG_RDX);
+    uses = defs | REGISTER_BIT(mi->src);
+    break;
+  case MI_SIGN_EXTEND:
+    defs = REGISTER_BIT(REG_RDX), uses = REGISTER_BIT(REG_RAX);
+    break;
+  case MI_TEST_RR:
+    uses = REGISTER_BIT(mi->dst) | REGISTER_BIT(mi->src);
+    break;
+  case MI_PUSH_R:
+    uses = REGISTER_BIT(mi->src);
+    break;
+  case MI_POP_R:
+    defs = REGISTER_BIT(mi->dst);
+    break;
+  case MI_CALL:
+    defs = ALL_REGISTERS & ~callee_saved_registers & ~FRAME_REGISTERS;
+    uses = ARGUMENT_REGISTERS;
+    break;
+  default:
+    return ALL_REGISTERS;
+  }
+  return (live & ~defs) | uses | FRAME_REGISTERS;
+}
+
+static int run_round(Peephole *peephole, PeepholeStats *stats) {
+  MachineList *list = peephole->list;
+  RegisterSet live = ALL_REGISTERS;
+  for (uint32_t i = list->count; i-- > 0;) {
+    peephole->live_after[i] = live;
+    live = live_before(&list->instrs[i], live);
+  }
+
+  int changed = 0;
+  for (uint32_t i = 0; i < list->count; i++) {
+    uint8_t opcode = list->instrs[i].opcode;
+    if (opcode == MI_NOP) {
+      continue;
+    }
+
+    // The next instructions, skipping deleted ones
+    uint32_t at[MAX_PATTERN_LENGTH];
+    int available = 0;
+    for (uint32_t j = i; j < list->count && available < MAX_PATTERN_LENGTH;
+         j++) {
+      if (list->instrs[j].opcode != MI_NOP) {
+        at[available++] = j;
+      }
+    }
+
+    for (int d = 0; d < dispatch_count[opcode]; d++) {
+      const PeepholePattern *pattern = &patterns[dispatch[opcode][d]];
+      int matches = pattern->length <= available;
+      for (int k = 1; matches && k < pattern->length; k++) {
+        matches = (pattern->opcodes[k] & OP(list->instrs[at[k]].opcode)) != 0;
+      }
+      if (matches && pattern->rewrite(peephole, at)) {
+        stats->applied[dispatch[opcode][d]]++;
+        changed = 1;
+        i = at[pattern->length - 1];
+        break;
+      }
+    }
+  }
+  return changed;
+}
+
+/**
+ * @brief Rewrites `list` with the pattern table until no pattern applies.
+ */
+void run_peephole(MachineList *list, PeepholeStats *stats) {
+  double start = now();
+  if (!dispatch_ready) {
+    compile_patterns();
+  }
+
+  Peephole peephole = {list, allocate(list->count, sizeof(RegisterSet))};
+  for (int round = 0; round < MAX_ROUNDS && run_round(&peephole, stats);
+       round++) {
+  }
+  free(peephole.live_after);
+
+  stats->instructions_removed += machine_list_compact(list);
+  stats->seconds += now() - start;
+}
+
+void print_peephole_stats(FILE *out, const PeepholeStats *stats) {
+  fprintf(out, "peephole: %llu instructions removed in %.3f ms\n",
+          (unsigned long long)stats->instructions_removed,
+          stats->seconds * 1e3);
+  for (int p = 0; p < PATTERN_COUNT; p++) {
+    fprintf(out, "  %-24s %10llu\n", patterns[p].name,
+            (unsigned long long)stats->applied[p]);
+  }
+}
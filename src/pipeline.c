@@ -0,0 +1,278 @@
+#include "pipeline.h"
+#include "arena.h"
+#include "ring.h"
+#include "util.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Compilation of one translation unit in three stages, each on a thread of
+ * its own. The preprocessor lexes the file as it goes and sends its tokens
+ * in batches; the parser cuts them at the top-level boundaries and parses
+ * each run of declarations, bodies included; the calling thread compiles
+ * the declarations in source order. Single-producer, single-consumer rings
+ * connect the stages, and a full ring holds back the stage feeding it.
+ *
+ * Function bodies are parsed into arenas that travel with their run to the
+ * backend and come back through a third ring once it has compiled them, so
+ * the arenas in flight bound how far the parser runs ahead. The tokens of a
+ * run are freed as soon as it is parsed.
+ */
+
+#define TOKEN_RING 16  // Batches of tokens in flight
+#define BODY_ARENAS 16 // Runs of declarations in flight
+
+typedef struct {
+  node_t *first; // NULL once preprocessing has failed
+  node_t *last;
+} TokenBatch;
+
+typedef struct {
+  ASTNode_t *unit; // The declarations of the run, NULL after the last one
+  Arena *bodies;   // Holds their function bodies
+  int failed;      // With `unit` NULL, whether the parse stopped at an error
+} ParsedRun;
+
+typedef struct {
+  const char *path;
+  const char *const *include_dirs;
+  int include_dir_count;
+  HeaderCache *cache;
+  const ParseOptions *options;
+
+  Ring tokens;      // Lexer to parser
+  Ring runs;        // Parser to backend
+  Ring free_bodies; // Backend to parser, arenas to parse bodies into
+  Arena arenas[BODY_ARENAS];
+
+  uint64_t token_batches; // Counted by the lexer
+  uint64_t declarations;  // Counted by the parser
+  int preprocess_errors;
+  char error[PARSE_ERROR_SIZE]; // The syntax error that stopped the parser
+} Pipeline;
+
+static void send_tokens(node_t *first, node_t *last, void *context) {
+  Pipeline *pipeline = context;
+  TokenBatch batch = {first, last};
+  pipeline->token_batches++;
+  ring_push(&pipeline->tokens, &batch);
+}
+
+static void *lex(void *argument) {
+  Pipeline *pipeline = argument;
+  pipeline->preprocess_errors = preprocess_stream(
+      pipeline->path, pipeline->include_dirs, pipeline->include_dir_count,
+      pipeline->cache, send_tokens, pipeline);
+  if (pipeline->preprocess_errors > 0) {
+    TokenBatch failed = {NULL, NULL};
+    ring_push(&pipeline->tokens, &failed);
+  }
+  return NULL;
+}
+
+/* Frees the tokens from `first` up to, but not including, `end`. */
+static void free_tokens(node_t *first, node_t *end) {
+  while (first != end) {
+    node_t *next = first->next;
+    free(first);
+    first = next;
+  }
+}
+
+/* Parses the run of tokens from `first` to the TOKEN_EOF node `end`, frees
+ * them, and sends the declarations to the backend.
+ *
+ * @return Nonzero after a syntax error, left in the pipeline's `error`. */
+static int parse_run(Pipeline *pipeline, node_t *first, node_t *end) {
+  Arena *bodies;
+  ring_pop(&pipeline->free_bodies, &bodies);
+  ASTNode_t *unit =
+      parse_declarations(first, pipeline->options, pipeline->error);
+  for (int i = 0; unit != NULL && i < unit->child_count; i++) {
+    if (unit->children[i]->type == AST_FUNCTION_DEF &&
+        take_function_body(unit->children[i], bodies, pipeline->error) ==
+            NULL) {
+      unit = NULL;
+    }
+  }
+  free_tokens(first, end);
+  if (unit == NULL) {
+    return 1;
+  }
+  pipeline->declarations += unit->child_count;
+  ParsedRun run = {unit, bodies, 0};
+  ring_push(&pipeline->runs, &run);
+  return 0;
+}
+
+/* Gathers the tokens into runs that end at top-level boundaries, like the
+ * chunks of the parallel parser, and parses each one as soon as the token
+ * after it arrives. After an error, the remaining tokens are only freed. */
+static void *parse(void *argument) {
+  Pipeline *pipeline = argument;
+  node_t *first = NULL;    // The run being gathered, up to `last`
+  node_t *last = NULL;
+  node_t *boundary = NULL; // Where the run ends, once a token follows
+  int depth = 0;
+  int failed = 0;
+  int done = 0;
+  while (!done) {
+    TokenBatch batch;
+    ring_pop(&pipeline->tokens, &batch);
+    done = batch.first == NULL || batch.last->token.type == TOKEN_EOF;
+    if (batch.first == NULL || failed) {
+      free_tokens(batch.first, NULL);
+      failed = 1;
+      continue;
+    }
+    if (last == NULL) {
+      first = batch.first;
+    } else {
+      last->next = batch.first;
+    }
+    for (node_t *node = batch.first; node != NULL && !failed;
+         node = node->next) {
+      if (boundary != NULL) {
+        // The next token stands in for the end, as in the parallel parser
+        node_t end = {node->token, NULL};
+        end.token.type = TOKEN_EOF;
+        end.token.lexeme = "EOF";
+        end.token.length = 3;
+        boundary->next = &end;
+        failed = parse_run(pipeline, first, &end);
+        boundary = NULL;
+        first = node;
+        if (failed) {
+          break;
+        }
+      }
+      last = node;
+      if (node->token.type == TOKEN_EOF) {
+        if (first != node) {
+          failed = parse_run(pipeline, first, node);
+        }
+        free(node);
+        first = last = NULL;
+        break;
+      }
+      if (ends_declaration(node->token.type, &depth)) {
+        boundary = node;
+      }
+    }
+    if (failed) {
+      free_tokens(first, NULL);
+      first = last = NULL;
+    }
+  }
+
+  free_tokens(first, NULL);
+  ParsedRun end = {NULL, NULL, failed};
+  ring_push(&pipeline->runs, &end);
+  return NULL;
+}
+
+/**
+ * @brief Preprocesses, parses and compiles the translation unit at `path`
+ * with the three stages running at once, calling `handler` on every
+ * external declaration in source order from the calling thread. Function
+ * bodies are freed once the handler returns.
+ *
+ * @return The number of errors reported.
+ */
+int run_pipeline(const char *path, const char *const *include_dirs,
+                 int include_dir_count, HeaderCache *cache,
+                 const ParseOptions *options, DeclarationHandler handler,
+                 void *context, PipelineStats *stats) {
+  double start = now();
+  // Aligned for the cache lines of the ring indices
+  Pipeline *pipeline = aligned_alloc(_Alignof(Pipeline), sizeof(Pipeline));
+  if (pipeline == NULL) {
+    fprintf(stderr, "Memory allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+  memset(pipeline, 0, sizeof(Pipeline));
+  pipeline->path = path;
+  pipeline->include_dirs = include_dirs;
+  pipeline->include_dir_count = include_dir_count;
+  pipeline->cache = cache;
+  pipeline->options = options;
+  ring_init(&pipeline->tokens, TOKEN_RING, sizeof(TokenBatch));
+  ring_init(&pipeline->runs, BODY_ARENAS, sizeof(ParsedRun));
+  ring_init(&pipeline->free_bodies, BODY_ARENAS, sizeof(Arena *));
+  for (int i = 0; i < BODY_ARENAS; i++) {
+    Arena *arena = &pipeline->arenas[i];
+    arena_init(arena, 0);
+    ring_push(&pipeline->free_bodies, &arena);
+  }
+
+  int errors = 0;
+  pthread_t lexer, parser;
+  if (pthread_create(&parser, NULL, parse, pipeline) != 0) {
+    fprintf(stderr, "Error: cannot start the pipeline\n");
+    errors = 1;
+  } else if (pthread_create(&lexer, NULL, lex, pipeline) != 0) {
+    fprintf(stderr, "Error: cannot start the pipeline\n");
+    TokenBatch failed = {NULL, NULL};
+    ring_push(&pipeline->tokens, &failed);
+    pthread_join(parser, NULL);
+    errors = 1;
+  } else {
+    for (;;) {
+      ParsedRun run;
+      ring_pop(&pipeline->runs, &run);
+      if (run.unit == NULL) {
+        if (run.failed && pipeline->error[0] != '\0') {
+          fputs(pipeline->error, stderr);
+          errors++;
+        }
+        break;
+      }
+      for (int i = 0; i < run.unit->child_count; i++) {
+        errors += handler(run.unit->children[i], context);
+        if (run.unit->children[i]->type == AST_FUNCTION_DEF) {
+          release_function_body(run.unit->children[i]);
+        }
+      }
+      arena_reset(run.bodies);
+      ring_push(&pipeline->free_bodies, &run.bodies);
+    }
+    pthread_join(lexer, NULL);
+    pthread_join(parser, NULL);
+    errors += pipeline->preprocess_errors;
+  }
+
+  if (stats != NULL) {
+    *stats = (PipelineStats){
+        .token_batches = pipeline->token_batches,
+        .declarations = pipeline->declarations,
+        .lexer_stalls = pipeline->tokens.full_waits,
+        .parser_starved = pipeline->tokens.empty_waits,
+        .parser_stalls =
+            pipeline->runs.full_waits + pipeline->free_bodies.empty_waits,
+        .backend_starved = pipeline->runs.empty_waits,
+        .seconds = now() - start,
+    };
+  }
+  for (int i = 0; i < BODY_ARENAS; i++) {
+    arena_free(&pipeline->arenas[i]);
+  }
+  ring_free(&pipeline->tokens);
+  ring_free(&pipeline->runs);
+  ring_free(&pipeline->free_bodies);
+  free(pipeline);
+  return errors;
+}
+
+void print_pipeline_stats(FILE *out, const PipelineStats *stats) {
+  fprintf(out,
+          "pipeline: %llu token batches, %llu declarations in %.3f ms; "
+          "lexer stalled %llu times, parser starved %llu and stalled %llu "
+          "times, backend starved %llu times\n",
+          (unsigned long long)stats->token_batches,
+          (unsigned long long)stats->declarations, stats->seconds * 1e3,
+          (unsigned long long)stats->lexer_stalls,
+          (unsigned long long)stats->parser_starved,
+          (unsigned long long)stats->parser_stalls,
+          (unsigned long long)stats->backend_starved);
+}
@@ -0,0 +1,1036 @@
+#include "preprocessor.h"
+#include "intern.h"
+#include "lexer.h"
+#include "scan.h"
+#include "util.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Preprocessor between the lexer and the parser. Each file is mapped, lexed
+ * once into tokens and directives, and kept in the header cache; including
+ * it again replays the cached tokens. A file wrapped in the include guard
+ * idiom
+ *   #ifndef NAME
+ *   #define NAME
+ *   ...
+ *   #endif
+ * with nothing outside the conditional is skipped outright once NAME is
+ * defined, without visiting its tokens. Macros are object-like; directives
+ * are #include, #define, #undef, #ifdef, #ifndef, #if, #elif, #else, #endif
+ * and #pragma, which is ignored. Only the conditions of #if and #elif made
+ * of a number or a defined operator, possibly negated, are evaluated; any
+ * other is reported, and the rest of its group skipped. Directives are
+ * parsed while lexing but reported only where they are not skipped. The
+ * dependency scanner parses them with the same functions.
+ *
+ * When the output is streamed, the top-level file is lexed a few items at
+ * a time as it is processed, so that the first tokens go out before the
+ * file has been read through.
+ */
+
+#define MAX_INCLUDE_DEPTH 200
+#define MAX_CONDITIONAL_DEPTH 64
+// Items lexed at a time from a file lexed as it is processed
+#define LEX_STEP 256
+// Tokens per batch handed to a TokenSink
+#define SINK_BATCH 1024
+
+/* What the preprocessor keeps of a directive beside its syntax. */
+typedef struct {
+  unsigned int name; // Interned macro name, 0 if it has none
+  Token *body;       // #define replacement list
+  uint32_t body_count;
+} LexedDirective;
+
+typedef struct {
+  Token token;
+  int32_t directive; // Index into the file's directives, -1 for a token
+} Item;
+
+/* Where lexing of a file stopped, for a file lexed as it is processed. */
+typedef struct {
+  Lexer lexer;
+  uint32_t item_capacity;
+  uint32_t directive_capacity;
+  int last_line;
+} LexState;
+
+struct CachedFile {
+  const char *path;   // Canonical
+  const char *source; // Mapped, followed by SCAN_PADDING zero bytes
+  size_t mapped;
+  Item *items;
+  uint32_t item_count;
+  Directive *directives;
+  LexedDirective *lexed; // Beside each of the directives
+  uint32_t directive_count;
+  unsigned int guard; // Macro guarding the whole file, 0 if none
+  int errors;         // Reported while lexing it
+  LexState *lexing;   // Set until the file is lexed to its end
+};
+
+typedef struct {
+  Token *body;
+  uint32_t body_count;
+  uint8_t defined;
+  uint8_t expanding; // Not expanded again within its own expansion
+} Macro;
+
+typedef struct {
+  HeaderCache *cache;
+  const char *const *include_dirs;
+  int include_dir_count;
+  Macro *macros; // Per interned name
+  unsigned int macro_capacity;
+  node_t *head;
+  node_t *tail;
+  TokenSink sink; // Takes the tokens in batches, if set
+  void *sink_context;
+  uint32_t unsent; // Tokens in the list, not yet handed to the sink
+  int include_depth;
+  int errors;
+} Preprocessor;
+
+static void file_error(Preprocessor *pp, const CachedFile *file, int line,
+                       const char *message, const char *detail) {
+  fprintf(stderr, "Error: %s%s at %s, line %d\n", message, detail,
+          file->path, line);
+  pp->errors++;
+}
+
+/* Errors found while lexing count against every translation unit that
+ * includes the file. */
+static void directive_error(Preprocessor *pp, CachedFile *file, int line,
+                            const char *message, const char *detail) {
+  file_error(pp, file, line, message, detail);
+  file->errors++;
+}
+
+/* Counts the errors `lexer` reported since it had `before`, like directive
+ * errors. The lexer has already written them out. */
+static int lexer_errors(Preprocessor *pp, CachedFile *file,
+                        const Lexer *lexer, int before) {
+  int errors = lexer->errors - before;
+  pp->errors += errors;
+  file->errors += errors;
+  return errors;
+}
+
+static uint32_t hash_path(const char *path) {
+  uint32_t hash = 2166136261u;
+  for (; *path != '\0'; path++) {
+    hash = (hash ^ (unsigned char)*path) * 16777619u;
+  }
+  return hash;
+}
+
+static FileSlot *find_slot(FileSlot *slots, uint32_t capacity,
+                           const char *path) {
+  uint32_t index = hash_path(path) & (capacity - 1);
+  while (slots[index].path != NULL && strcmp(slots[index].path, path) != 0) {
+    index = (index + 1) & (capacity - 1);
+  }
+  return &slots[index];
+}
+
+void file_table_init(FileTable *table) {
+  table->capacity = 64;
+  table->count = 0;
+  table->slots = allocate_zeroed(table->capacity, sizeof(FileSlot));
+}
+
+/**
+ * @brief Returns the file stored under the canonical `path`, or NULL.
+ */
+void *file_table_find(const FileTable *table, const char *path) {
+  return find_slot(table->slots, table->capacity, path)->file;
+}
+
+/**
+ * @brief Stores `file` under `path`, which is not in the table yet and must
+ * live as long as it.
+ */
+void file_table_insert(FileTable *table, const char *path, void *file) {
+  if ((table->count + 1) * 2 > table->capacity) {
+    uint32_t capacity = table->capacity * 2;
+    FileSlot *slots = allocate_zeroed(capacity, sizeof(FileSlot));
+    for (uint32_t i = 0; i < table->capacity; i++) {
+      if (table->slots[i].path != NULL) {
+        *find_slot(slots, capacity, table->slots[i].path) = table->slots[i];
+      }
+    }
+    free(table->slots);
+    table->slots = slots;
+    table->capacity = capacity;
+  }
+  *find_slot(table->slots, table->capacity, path) = (FileSlot){path, file};
+  table->count++;
+}
+
+void file_table_free(FileTable *table) { free(table->slots); }
+
+void header_cache_init(HeaderCache *cache) {
+  memset(cache, 0, sizeof(HeaderCache));
+  file_table_init(&cache->files);
+  arena_init(&cache->strings, 0);
+}
+
+static int is_identifier_char(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '_';
+}
+
+static const char *skip_blanks(const char *p, const char *end) {
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\f' ||
+                     *p == '\v')) {
+    p++;
+  }
+  return p;
+}
+
+/* Whether a backslash at `p` splices its line to the next. */
+static int is_splice(const char *p, const char *end) {
+  return p + 1 < end &&
+         (p[1] == '\n' || (p[1] == '\r' && p + 2 < end && p[2] == '\n'));
+}
+
+/* Returns the end of a string or character literal starting at `p`, just
+ * past the opening quote; an unterminated one ends at the newline, where the
+ * lexer reports it. */
+static const char *skip_literal(const char *p, const char *end, char quote) {
+  for (;;) {
+    p = scan_find_string_special(p, end, quote);
+    if (p == end || *p == '\n') {
+      return p;
+    }
+    if (*p == quote) {
+      return p + 1;
+    }
+    p += is_splice(p, end) && p[1] == '\r' ? 3 : 2;
+    if (p > end) {
+      return end;
+    }
+  }
+}
+
+/**
+ * @brief Returns the newline that ends the logical line starting at `p`, or
+ * `end`. A backslash before a newline continues the line, and comments and
+ * literals are passed over whole, so a newline inside a block comment does
+ * not end it. A block comment left open sets `*unterminated`, if given.
+ */
+const char *directive_end(const char *p, const char *end, int *unterminated) {
+  const char *start = p;
+  for (;;) {
+    p = scan_find_line_special(p, end);
+    if (p == end) {
+      return end;
+    }
+    switch (*p) {
+    case '\n': {
+      const char *before = p;
+      if (before > start && before[-1] == '\r') {
+        before--;
+      }
+      if (before > start && before[-1] == '\\') {
+        p++;
+        continue;
+      }
+      return p;
+    }
+    case '/':
+      if (p[1] == '*') {
+        const char *close = scan_find_comment_end(p + 2, end);
+        if (close == end) {
+          if (unterminated != NULL) {
+            *unterminated = 1;
+          }
+          return end;
+        }
+        p = close + 2;
+      } else if (p[1] == '/') {
+        p = scan_find_byte(p + 2, end, '\n');
+      } else {
+        p++;
+      }
+      continue;
+    default:
+      p = skip_literal(p + 1, end, *p);
+      continue;
+    }
+  }
+}
+
+/**
+ * @brief Copies the directive in [p, end) into `strings`, followed by
+ * SCAN_PADDING zero bytes, the way it is read: without its line splices and
+ * with each comment replaced by a space.
+ */
+const char *copy_directive(Arena *strings, const char *p, const char *end,
+                           size_t *length) {
+  char *copy = arena_alloc(strings, (end - p) + SCAN_PADDING);
+  char *out = copy;
+  char quote = '\0'; // Of the literal being copied
+  while (p < end) {
+    if (*p == '\\' && is_splice(p, end)) {
+      p += p[1] == '\r' ? 3 : 2;
+    } else if (quote != '\0') {
+      if (*p == '\\' && p + 1 < end) {
+        *out++ = *p++;
+      } else if (*p == quote) {
+        quote = '\0';
+      }
+      *out++ = *p++;
+    } else if (*p == '/' && p[1] == '*') {
+      p = scan_find_comment_end(p + 2, end);
+      p = p == end ? end : p + 2;
+      *out++ = ' ';
+    } else if (*p == '/' && p[1] == '/') {
+      p = end;
+    } else {
+      if (*p == '"' || *p == '\'') {
+        quote = *p;
+      }
+      *out++ = *p++;
+    }
+  }
+  *length = out - copy;
+  memset(out, 0, SCAN_PADDING);
+  return copy;
+}
+
+static const char *directive_names[] = {
+    [DIRECTIVE_INCLUDE] = "include", [DIRECTIVE_DEFINE] = "define",
+    [DIRECTIVE_UNDEF] = "undef",     [DIRECTIVE_IFDEF] = "ifdef",
+    [DIRECTIVE_IFNDEF] = "ifndef",   [DIRECTIVE_IF] = "if",
+    [DIRECTIVE_ELIF] = "elif",       [DIRECTIVE_ELSE] = "else",
+    [DIRECTIVE_ENDIF] = "endif",     [DIRECTIVE_PRAGMA] = "pragma",
+};
+
+/* Parses the condition of an #if or #elif from `p` to `end`: a number, or a
+ * defined operator, with any number of '!' before it. Any other condition
+ * is left as TEST_NONE. */
+static void parse_condition(Directive *directive, const char *p,
+                            const char *end) {
+  int negated = 0;
+  while (p < end && *p == '!') {
+    negated = !negated;
+    p = skip_blanks(p + 1, end);
+  }
+  if (p == end) {
+    directive->error = directive->kind == DIRECTIVE_IF
+                           ? "#if with no expression"
+                           : "#elif with no expression";
+    return;
+  }
+  static const char keyword[] = "defined";
+  size_t length = sizeof(keyword) - 1;
+  const char *name = NULL;
+  const char *name_end = NULL;
+  if ((size_t)(end - p) > length && memcmp(p, keyword, length) == 0 &&
+      !is_identifier_char(p[length])) {
+    p = skip_blanks(p + length, end);
+    int parenthesized = p < end && *p == '(';
+    if (parenthesized) {
+      p = skip_blanks(p + 1, end);
+    }
+    name = p;
+    while (p < end && is_identifier_char(*p)) {
+      p++;
+    }
+    name_end = p;
+    if (parenthesized) {
+      p = skip_blanks(p, end);
+      if (p == end || *p != ')') {
+        return;
+      }
+      p++;
+    }
+    if (name_end == name) {
+      return;
+    }
+  } else if (*p >= '0' && *p <= '9') {
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+      directive->value |= *p != '0';
+    }
+    while (p < end && (*p == 'u' || *p == 'U' || *p == 'l' || *p == 'L')) {
+      p++;
+    }
+  } else {
+    return;
+  }
+  if (skip_blanks(p, end) != end) {
+    directive->value = 0;
+    return;
+  }
+  if (name != NULL) {
+    directive->test = TEST_DEFINED;
+    directive->operand = name;
+    directive->length = (uint32_t)(name_end - name);
+  } else {
+    directive->test = TEST_NUMBER;
+  }
+  directive->negated = (uint8_t)negated;
+}
+
+/**
+ * @brief Parses the directive from `p`, just past the '#', to `end`, the end
+ * of its line as copy_directive leaves it. A malformed directive keeps its
+ * kind, so that conditionals still nest, and says why in `error`; an unknown
+ * one is DIRECTIVE_UNKNOWN. Neither is reported here: both are errors only
+ * in a group that is not skipped.
+ */
+void parse_directive(Directive *directive, const char *p, const char *end) {
+  p = skip_blanks(p, end);
+  const char *name = p;
+  while (p < end && is_identifier_char(*p)) {
+    p++;
+  }
+  size_t length = p - name;
+  if (length == 0 && skip_blanks(p, end) == end) {
+    directive->kind = DIRECTIVE_PRAGMA; // The null directive does nothing
+    return;
+  }
+  int kind = DIRECTIVE_UNKNOWN;
+  for (int k = 0; k < DIRECTIVE_UNKNOWN; k++) {
+    if (strlen(directive_names[k]) == length &&
+        memcmp(directive_names[k], name, length) == 0) {
+      kind = k;
+    }
+  }
+  directive->kind = (DirectiveKind)kind;
+  if (kind == DIRECTIVE_UNKNOWN) {
+    directive->operand = name;
+    directive->length = (uint32_t)length;
+    return;
+  }
+  p = skip_blanks(p, end);
+
+  switch (directive->kind) {
+  case DIRECTIVE_INCLUDE: {
+    char close = *p == '"' ? '"' : *p == '<' ? '>' : '\0';
+    const char *operand = p + 1;
+    const char *stop = close ? operand : end;
+    while (stop < end && *stop != close) {
+      stop++;
+    }
+    if (close == '\0' || stop == end || stop == operand) {
+      directive->error = "#include expects \"FILENAME\" or <FILENAME>";
+      return;
+    }
+    directive->operand = operand;
+    directive->length = (uint32_t)(stop - operand);
+    directive->system = close == '>';
+    return;
+  }
+  case DIRECTIVE_DEFINE:
+  case DIRECTIVE_UNDEF:
+  case DIRECTIVE_IFDEF:
+  case DIRECTIVE_IFNDEF: {
+    const char *macro = p;
+    while (p < end && is_identifier_char(*p)) {
+      p++;
+    }
+    if (p == macro || (*macro >= '0' && *macro <= '9')) {
+      directive->error = "macro names must be identifiers";
+      return;
+    }
+    directive->operand = macro;
+    directive->length = (uint32_t)(p - macro);
+    if (directive->kind == DIRECTIVE_DEFINE) {
+      directive->function_like = p < end && *p == '(';
+      directive->body = p;
+      directive->body_length = (uint32_t)(end - p);
+    } else if (directive->kind != DIRECTIVE_UNDEF) {
+      directive->test = TEST_DEFINED;
+      directive->negated = directive->kind == DIRECTIVE_IFNDEF;
+    }
+    return;
+  }
+  case DIRECTIVE_IF:
+  case DIRECTIVE_ELIF:
+    parse_condition(directive, p, end);
+    return;
+  default:
+    return;
+  }
+}
+
+/**
+ * @brief Whether a directive of `kind` opens a conditional group.
+ */
+int opens_conditional(DirectiveKind kind) {
+  return kind == DIRECTIVE_IFDEF || kind == DIRECTIVE_IFNDEF ||
+         kind == DIRECTIVE_IF;
+}
+
+/**
+ * @brief Decides the condition of a conditional directive, given whether
+ * the macro it tests, if any, is `defined`.
+ *
+ * @return CONDITION_UNKNOWN if it is not a number or a defined operator.
+ */
+Condition directive_condition(const Directive *directive, int defined) {
+  int value;
+  switch (directive->test) {
+  case TEST_NUMBER:
+    value = directive->value;
+    break;
+  case TEST_DEFINED:
+    value = defined != 0;
+    break;
+  default:
+    return CONDITION_UNKNOWN;
+  }
+  return value != directive->negated ? CONDITION_TRUE : CONDITION_FALSE;
+}
+
+/**
+ * @brief Finds the include guard in the directives of a file: one #ifndef
+ * NAME or #if !defined NAME group, without #elif or #else, whose first
+ * directive defines NAME. The caller checks that nothing lies outside it.
+ *
+ * @return The index of the #define, or -1 if there is no guard.
+ */
+int find_include_guard(const Directive *directives, uint32_t count) {
+  if (count < 3) {
+    return -1;
+  }
+  const Directive *test = &directives[0];
+  const Directive *define = &directives[1];
+  if (!opens_conditional(test->kind) || test->test != TEST_DEFINED ||
+      !test->negated || define->kind != DIRECTIVE_DEFINE ||
+      define->error != NULL || define->function_like ||
+      define->length != test->length ||
+      memcmp(define->operand, test->operand, test->length) != 0) {
+    return -1;
+  }
+  int depth = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    DirectiveKind kind = directives[i].kind;
+    if (opens_conditional(kind)) {
+      depth++;
+    } else if ((kind == DIRECTIVE_ELIF || kind == DIRECTIVE_ELSE) &&
+               depth == 1) {
+      return -1;
+    } else if (kind == DIRECTIVE_ENDIF && --depth == 0) {
+      return i == count - 1 ? 1 : -1;
+    }
+  }
+  return -1;
+}
+
+static int file_exists(const char *path) { return access(path, R_OK) == 0; }
+
+/**
+ * @brief Finds the file named by an #include in the file at `from`: an
+ * absolute name as is, a quoted one next to `from` first, then any name in
+ * `include_dirs`.
+ *
+ * @return Nonzero if it was found, with its path in `path`, which holds
+ * PATH_MAX bytes.
+ */
+int find_include(const char *from, const Directive *directive,
+                 const char *const *include_dirs, int include_dir_count,
+                 char *path) {
+  int length = (int)directive->length;
+  const char *name = directive->operand;
+  int found = 0;
+  if (name[0] == '/') {
+    snprintf(path, PATH_MAX, "%.*s", length, name);
+    found = file_exists(path);
+  }
+  if (!found && !directive->system) {
+    const char *slash = strrchr(from, '/');
+    int directory = slash == NULL ? 0 : (int)(slash - from + 1);
+    snprintf(path, PATH_MAX, "%.*s%.*s", directory, from, length, name);
+    found = file_exists(path);
+  }
+  for (int i = 0; !found && i < include_dir_count; i++) {
+    snprintf(path, PATH_MAX, "%s/%.*s", include_dirs[i], length, name);
+    found = file_exists(path);
+  }
+  return found;
+}
+
+/* Lexes the replacement list of a #define. */
+static void lex_body(Preprocessor *pp, CachedFile *file,
+                     const Directive *directive, LexedDirective *lexed) {
+  Lexer lexer;
+  init_lexer(&lexer, directive->body, directive->body_length,
+             &pp->cache->strings);
+  lexer.current_line = directive->line;
+  uint32_t capacity = 0;
+  for (;;) {
+    Token token = next_token(&lexer);
+    if (token.type == TOKEN_EOF) {
+      break;
+    }
+    if (lexed->body_count == capacity) {
+      lexed->body = grow(lexed->body, sizeof(Token), &capacity, 4);
+    }
+    lexed->body[lexed->body_count++] = token;
+  }
+  lexer_errors(pp, file, &lexer, 0);
+}
+
+/* Interns the macro name of `directive` and lexes the replacement list of a
+ * #define into `lexed`. */
+static void lex_directive(Preprocessor *pp, CachedFile *file,
+                          const Directive *directive, LexedDirective *lexed) {
+  *lexed = (LexedDirective){0};
+  if (directive->error != NULL) {
+    return;
+  }
+  if (directive->kind == DIRECTIVE_DEFINE ||
+      directive->kind == DIRECTIVE_UNDEF ||
+      directive->test == TEST_DEFINED) {
+    lexed->name = intern(directive->operand, directive->length);
+  }
+  if (directive->kind == DIRECTIVE_DEFINE && !directive->function_like) {
+    lex_body(pp, file, directive, lexed);
+  }
+}
+
+/* Splits the source of `file` into tokens and directives, `limit` items at
+ * a time, or all at once if it is 0. A '#' starts a directive when it is the
+ * first token on its line.
+ *
+ * @return Nonzero while there is more of the file to lex. */
+static int lex_items(Preprocessor *pp, CachedFile *file, uint32_t limit) {
+  LexState *state = file->lexing;
+  Lexer *lexer = &state->lexer;
+  uint32_t end_count = limit ? file->item_count + limit : UINT32_MAX;
+  while (file->item_count < end_count) {
+    int errors = lexer->errors;
+    skip_whitespace_and_comments(lexer);
+    if (lexer->cursor < lexer->end && *lexer->cursor == '#' &&
+        lexer->current_line != state->last_line) {
+      int line = lexer->current_line;
+      int unterminated = 0;
+      const char *end =
+          directive_end(lexer->cursor + 1, lexer->end, &unterminated);
+      if (unterminated) {
+        directive_error(pp, file, line, "unterminated comment", "");
+      }
+      size_t length;
+      const char *text = copy_directive(&pp->cache->strings,
+                                        lexer->cursor + 1, end, &length);
+      if (file->directive_count == state->directive_capacity) {
+        uint32_t capacity = state->directive_capacity;
+        file->directives = grow(file->directives, sizeof(Directive),
+                                &state->directive_capacity, 16);
+        file->lexed =
+            grow(file->lexed, sizeof(LexedDirective), &capacity, 16);
+      }
+      if (file->item_count == state->item_capacity) {
+        file->items =
+            grow(file->items, sizeof(Item), &state->item_capacity, 256);
+      }
+      Directive *directive = &file->directives[file->directive_count];
+      *directive = (Directive){.line = line};
+      parse_directive(directive, text, text + length);
+      lex_directive(pp, file, directive, &file->lexed[file->directive_count]);
+      file->items[file->item_count++] =
+          (Item){.directive = (int32_t)file->directive_count++};
+      skip_to(lexer, end);
+      continue;
+    }
+    Token token = next_token(lexer);
+    if (lexer_errors(pp, file, lexer, errors) > 0) {
+      continue; // Not a token the parser should see
+    }
+    if (token.type == TOKEN_EOF) {
+      // Nothing may lie outside the guarded group
+      int guard = find_include_guard(file->directives, file->directive_count);
+      if (guard >= 0 && file->items[0].directive == 0 &&
+          file->items[file->item_count - 1].directive ==
+              (int32_t)file->directive_count - 1) {
+        file->guard = file->lexed[guard].name;
+      }
+      free(file->lexing);
+      file->lexing = NULL;
+      return 0;
+    }
+    state->last_line = token.line;
+    if (file->item_count == state->item_capacity) {
+      file->items = grow(file->items, sizeof(Item), &state->item_capacity, 256);
+    }
+    file->items[file->item_count++] = (Item){token, -1};
+  }
+  return 1;
+}
+
+/* Returns the cached file at `path`, reading and lexing it on first use, or
+ * NULL if it cannot be read. With `incremental`, a file read now is lexed
+ * by process_file as it goes instead. */
+static CachedFile *load_file(Preprocessor *pp, const char *path,
+                             int incremental) {
+  HeaderCache *cache = pp->cache;
+  char canonical[PATH_MAX];
+  if (realpath(path, canonical) == NULL) {
+    return NULL;
+  }
+  CachedFile *file = file_table_find(&cache->files, canonical);
+  if (file != NULL) {
+    cache->stats.cache_hits++;
+    if (file->errors > 0) {
+      fprintf(stderr, "Error: %s has errors\n", file->path);
+      pp->errors += file->errors;
+    }
+    return file;
+  }
+
+  size_t length;
+  size_t mapped;
+  const char *source = scan_map_file(canonical, &length, &mapped);
+  if (source == NULL) {
+    return NULL;
+  }
+  file = allocate_zeroed(1, sizeof(CachedFile));
+  file->path = arena_strndup(&cache->strings, canonical, strlen(canonical));
+  file->source = source;
+  file->mapped = mapped;
+  file->lexing = allocate_zeroed(1, sizeof(LexState));
+  init_lexer(&file->lexing->lexer, source, length, &cache->strings);
+  if (!incremental) {
+    lex_items(pp, file, 0);
+  }
+  file_table_insert(&cache->files, file->path, file);
+  cache->stats.files_lexed++;
+  return file;
+}
+
+static Macro *find_macro(Preprocessor *pp, unsigned int name) {
+  if (name >= pp->macro_capacity) {
+    unsigned int capacity = intern_count() + 1;
+    if (capacity <= name) {
+      capacity = name + 1;
+    }
+    pp->macros = reallocate(pp->macros, capacity, sizeof(Macro));
+    memset(&pp->macros[pp->macro_capacity], 0,
+           (capacity - pp->macro_capacity) * sizeof(Macro));
+    pp->macro_capacity = capacity;
+  }
+  return &pp->macros[name];
+}
+
+static int is_defined(Preprocessor *pp, unsigned int name) {
+  return name < pp->macro_capacity && pp->macros[name].defined;
+}
+
+/* Appends `token` to the output, replacing a macro name by its replacement
+ * list, which is rescanned for further macros. */
+static void emit_token(Preprocessor *pp, const Token *token) {
+  if (token->type == TOKEN_IDENTIFIER && is_defined(pp, token->intern_id)) {
+    Macro *macro = find_macro(pp, token->intern_id);
+    if (!macro->expanding) {
+      pp->cache->stats.macros_expanded++;
+      macro->expanding = 1;
+      for (uint32_t i = 0; i < macro->body_count; i++) {
+        // Expanded tokens are reported where the macro was used
+        Token expanded = macro->body[i];
+        expanded.line = token->line;
+        expanded.column = token->column;
+        emit_token(pp, &expanded);
+      }
+      macro->expanding = 0;
+      return;
+    }
+  }
+  node_t *node = create_node(*token);
+  if (pp->tail == NULL) {
+    pp->head = node;
+  } else {
+    pp->tail->next = node;
+  }
+  pp->tail = node;
+  if (pp->sink != NULL && ++pp->unsent == SINK_BATCH) {
+    pp->sink(pp->head, pp->tail, pp->sink_context);
+    pp->head = pp->tail = NULL;
+    pp->unsent = 0;
+  }
+}
+
+static void process_file(Preprocessor *pp, CachedFile *file);
+
+static void include_file(Preprocessor *pp, CachedFile *from,
+                         const Directive *directive) {
+  char path[PATH_MAX];
+  CachedFile *file = find_include(from->path, directive, pp->include_dirs,
+                                  pp->include_dir_count, path)
+                         ? load_file(pp, path, 0)
+                         : NULL;
+  if (file == NULL) {
+    snprintf(path, sizeof(path), "%.*s", (int)directive->length,
+             directive->operand);
+    file_error(pp, from, directive->line, "file not found: ", path);
+    return;
+  }
+
+  if (file->guard != 0 && is_defined(pp, file->guard)) {
+    pp->cache->stats.guard_skips++;
+    return;
+  }
+  if (pp->include_depth == MAX_INCLUDE_DEPTH) {
+    file_error(pp, from, directive->line, "#include nested too deeply", "");
+    return;
+  }
+  pp->include_depth++;
+  process_file(pp, file);
+  pp->include_depth--;
+}
+
+/* Whether a directive in a group that is not skipped can be carried out,
+ * after reporting why not. */
+static int check_directive(Preprocessor *pp, const CachedFile *file,
+                           const Directive *directive) {
+  if (directive->error != NULL) {
+    file_error(pp, file, directive->line, directive->error, "");
+    return 0;
+  }
+  if (directive->function_like) {
+    file_error(pp, file, directive->line,
+               "function-like macros are not supported", "");
+    return 0;
+  }
+  return 1;
+}
+
+/* Decides the condition of a conditional directive in a group that is not
+ * skipped. One that cannot be decided is reported, and the rest of its
+ * group is skipped. */
+static Condition decide(Preprocessor *pp, const CachedFile *file,
+                        const Directive *directive, unsigned int name) {
+  Condition condition = directive_condition(directive, is_defined(pp, name));
+  if (condition == CONDITION_UNKNOWN && check_directive(pp, file, directive)) {
+    file_error(pp, file, directive->line, "unsupported condition in #",
+               directive_names[directive->kind]);
+  }
+  return condition;
+}
+
+typedef struct {
+  uint8_t enclosing_active;
+  uint8_t taken; // A branch was active or rejected, so no later one is
+  uint8_t seen_else;
+} Conditional;
+
+static void process_file(Preprocessor *pp, CachedFile *file) {
+  Conditional conditionals[MAX_CONDITIONAL_DEPTH];
+  int depth = 0;
+  int active = 1;
+  for (uint32_t i = 0;; i++) {
+    while (i == file->item_count && file->lexing != NULL) {
+      lex_items(pp, file, LEX_STEP);
+    }
+    if (i == file->item_count) {
+      break;
+    }
+    // Lexing further, as an include of this file may, moves the items
+    const Item *item = &file->items[i];
+    if (item->directive < 0) {
+      if (active) {
+        emit_token(pp, &item->token);
+      }
+      continue;
+    }
+
+    const Directive *directive = &file->directives[item->directive];
+    const LexedDirective *lexed = &file->lexed[item->directive];
+    switch (directive->kind) {
+    case DIRECTIVE_IFDEF:
+    case DIRECTIVE_IFNDEF:
+    case DIRECTIVE_IF: {
+      if (depth == MAX_CONDITIONAL_DEPTH) {
+        file_error(pp, file, directive->line, "conditionals nested too deeply",
+                   "");
+        return;
+      }
+      Condition condition =
+          active ? decide(pp, file, directive, lexed->name) : CONDITION_FALSE;
+      conditionals[depth++] =
+          (Conditional){active, condition != CONDITION_FALSE, 0};
+      active = condition == CONDITION_TRUE;
+      break;
+    }
+    case DIRECTIVE_ELIF: {
+      if (depth == 0 || conditionals[depth - 1].seen_else) {
+        file_error(pp, file, directive->line,
+                   depth == 0 ? "#elif without #if" : "#elif after #else", "");
+        break;
+      }
+      Conditional *conditional = &conditionals[depth - 1];
+      // Not evaluated once a branch is taken, as it may not be valid
+      Condition condition = conditional->enclosing_active && !conditional->taken
+                                ? decide(pp, file, directive, lexed->name)
+                                : CONDITION_FALSE;
+      conditional->taken = conditional->taken || condition != CONDITION_FALSE;
+      active = condition == CONDITION_TRUE;
+      break;
+    }
+    case DIRECTIVE_ELSE:
+      if (depth == 0 || conditionals[depth - 1].seen_else) {
+        file_error(pp, file, directive->line,
+                   depth == 0 ? "#else without #if" : "#else after #else", "");
+        break;
+      }
+      conditionals[depth - 1].seen_else = 1;
+      active = conditionals[depth - 1].enclosing_active &&
+               !conditionals[depth - 1].taken;
+      break;
+    case DIRECTIVE_ENDIF:
+      if (depth == 0) {
+        file_error(pp, file, directive->line, "#endif without #if", "");
+        break;
+      }
+      active = conditionals[--depth].enclosing_active;
+      break;
+    case DIRECTIVE_DEFINE:
+      if (active && check_directive(pp, file, directive)) {
+        Macro *macro = find_macro(pp, lexed->name);
+        macro->body = lexed->body;
+        macro->body_count = lexed->body_count;
+        macro->defined = 1;
+      }
+      break;
+    case DIRECTIVE_UNDEF:
+      if (active && check_directive(pp, file, directive) &&
+          is_defined(pp, lexed->name)) {
+        find_macro(pp, lexed->name)->defined = 0;
+      }
+      break;
+    case DIRECTIVE_INCLUDE:
+      if (active && check_directive(pp, file, directive)) {
+        include_file(pp, file, directive);
+      }
+      break;
+    case DIRECTIVE_PRAGMA:
+      break;
+    case DIRECTIVE_UNKNOWN:
+      if (active) {
+        char spelling[64];
+        snprintf(spelling, sizeof(spelling), "%.*s",
+                 (int)(directive->length < 32 ? directive->length : 32),
+                 directive->operand);
+        file_error(pp, file, directive->line,
+                   "invalid preprocessing directive #", spelling);
+      }
+      break;
+    }
+  }
+  if (depth > 0) {
+    file_error(pp, file, file->directives[file->directive_count - 1].line,
+               "unterminated conditional directive", "");
+  }
+}
+
+/* Preprocesses the file at `path` into the output of `pp`, ending it with
+ * TOKEN_EOF, and returns the number of errors reported. */
+static int preprocess(Preprocessor *pp, const char *path) {
+  double start = now();
+  CachedFile *file = load_file(pp, path, pp->sink != NULL);
+  if (file == NULL) {
+    perror(path);
+    return 1;
+  }
+  process_file(pp, file);
+
+  Token eof = {.type = TOKEN_EOF, .lexeme = "EOF", .length = 3};
+  if (file->item_count > 0) {
+    eof.line = file->items[file->item_count - 1].token.line;
+  }
+  emit_token(pp, &eof);
+  free(pp->macros);
+  pp->cache->stats.seconds += now() - start;
+  return pp->errors;
+}
+
+/**
+ * @brief Preprocesses the translation unit at `path` into a token list
+ * ending in TOKEN_EOF. Quoted includes are looked up next to the including
+ * file first, then like <...> includes in `include_dirs`.
+ *
+ * @return The tokens, or NULL after reporting errors.
+ */
+node_t *preprocess_file(const char *path, const char *const *include_dirs,
+                        int include_dir_count, HeaderCache *cache) {
+  Preprocessor pp = {.cache = cache,
+                     .include_dirs = include_dirs,
+                     .include_dir_count = include_dir_count};
+  if (preprocess(&pp, path) > 0) {
+    delete_list(pp.head);
+    return NULL;
+  }
+  return pp.head;
+}
+
+/**
+ * @brief Preprocesses like preprocess_file, but hands the tokens to `sink`
+ * in batches as they are produced, lexing the file as it goes. Each batch
+ * is a list of its own; the last one ends with TOKEN_EOF. The sink owns the
+ * nodes it is given.
+ *
+ * @return The number of errors reported. The tokens then stop short of
+ * TOKEN_EOF.
+ */
+int preprocess_stream(const char *path, const char *const *include_dirs,
+                      int include_dir_count, HeaderCache *cache,
+                      TokenSink sink, void *context) {
+  Preprocessor pp = {.cache = cache,
+                     .include_dirs = include_dirs,
+                     .include_dir_count = include_dir_count,
+                     .sink = sink,
+                     .sink_context = context};
+  int errors = preprocess(&pp, path);
+  if (errors > 0) {
+    delete_list(pp.head);
+  } else if (pp.head != NULL) {
+    sink(pp.head, pp.tail, context);
+  }
+  return errors;
+}
+
+/**
+ * @brief Whether `raw`, the source span of a token, lies in the cached file
+ * at the canonical `path`, so that the token was read from that file.
+ */
+int header_cache_contains(HeaderCache *cache, const char *path,
+                          const char *raw) {
+  const CachedFile *file = file_table_find(&cache->files, path);
+  return file != NULL && raw != NULL && raw >= file->source &&
+         raw < file->source + file->mapped;
+}
+
+void header_cache_free(HeaderCache *cache) {
+  for (uint32_t i = 0; i < cache->files.capacity; i++) {
+    CachedFile *file = cache->files.slots[i].file;
+    if (file == NULL) {
+      continue;
+    }
+    for (uint32_t d = 0; d < file->directive_count; d++) {
+      free(file->lexed[d].body);
+    }
+    free(file->lexed);
+    free(file->directives);
+    free(file->items);
+    free(file->lexing);
+    scan_unmap_file(file->source, file->mapped);
+    free(file);
+  }
+  file_table_free(&cache->files);
+  arena_free(&cache->strings);
+}
+
+void print_preprocessor_stats(FILE *out, const PreprocessorStats *stats) {
+  fprintf(out,
+          "preprocessor: %llu files lexed, %llu cached includes, %llu "
+          "skipped by include guards, %llu macros expanded in %.3f ms\n",
+          (unsigned long long)stats->files_lexed,
+          (unsigned long long)stats->cache_hits,
+          (unsigned long long)stats->guard_skips,
+          (unsigned long long)stats->macros_expanded, stats->seconds * 1e3);
+}
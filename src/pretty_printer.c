@@ -3,6 +3,36 @@
 #include "tokens.h"
 #include <stdio.h>
 
+const char *ASTNodeTypeStrings[AST_NUM_TYPES] = {
+    "Translation Unit",
+    "Function Definition",
+    "Function Declaration",
+    "Type Specifier",
+    "Identifier",
+    "Parameter List",
+    "Parameter Declaration",
+    "Compound Statement",
+    "Expression",
+    "Addition Expression",
+    "Multiplication Expression",
+    "Term",
+    "Factor",
+    "Declaration",
+    "Int Literal",
+    "Float Literal",
+    "Assignment Expression",
+    "Call Expression",
+    "Argument List",
+    "Return Statement",
+    "Char Literal",
+    "String Literal",
+    "Relational Expression",
+    "Equality Expression",
+    "If Statement",
+    "While Statement",
+    "UNKNOWN",
+};
+
 int depth = 0;
 
 void print_ast(ASTNode_t *ast) {
@@ -27,3 +57,57 @@ void print_ast(ASTNode_t *ast) {
     depth--;
   }
 }
+
+static void print_type_and_name(FILE *out, ASTNode_t *declaration) {
+  fprintf(out, "%s %s", declaration->children[0]->token->lexeme,
+          declaration->children[1]->token->lexeme);
+}
+
+/**
+ * @brief Names the kind of a global declaration: "function", "prototype" or
+ * "variable".
+ */
+const char *declaration_kind(ASTNode_t *declaration) {
+  switch (declaration->type) {
+  case AST_FUNCTION_DEF:
+    return "function";
+  case AST_FUNCTION_DECL:
+    return "prototype";
+  default:
+    return "variable";
+  }
+}
+
+/**
+ * @brief Prints the type and name of a declaration, followed by the
+ * parameters of a function.
+ */
+void print_declaration(FILE *out, ASTNode_t *declaration) {
+  print_type_and_name(out, declaration);
+  if (declaration->type == AST_DECL) {
+    return;
+  }
+  ASTNode_t *params = declaration->children[2];
+  fputc('(', out);
+  for (int p = 0; p < params->child_count; p++) {
+    fputs(p > 0 ? ", " : "", out);
+    print_type_and_name(out, params->children[p]);
+  }
+  fputs(params->child_count == 0 ? "void)" : ")", out);
+}
+
+/**
+ * @brief Prints each global declaration of `ast` on a line of its own, with
+ * its location and kind, and the signature of functions. Function bodies are
+ * not looked at, so they may be left unparsed.
+ */
+void print_signatures(FILE *out, ASTNode_t *ast) {
+  for (int i = 0; i < ast->child_count; i++) {
+    ASTNode_t *declaration = ast->children[i];
+    Token *name = declaration->children[1]->token;
+    fprintf(out, "%d:%d %s ", name->line, name->column,
+            declaration_kind(declaration));
+    print_declaration(out, declaration);
+    fputc('\n', out);
+  }
+}
@@ -0,0 +1,163 @@
+#include "regalloc.h"
+#include "util.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Register pool and linear-scan register allocation (Poletto and Sarkar).
+ * Free registers are a bit set, so taking one is a find-first-set over the
+ * registers of the requested class. Intervals are visited by increasing
+ * start; the active intervals are kept sorted by decreasing end, so expiring
+ * pops from the back and the spill candidate is at the front. At most
+ * NUM_REGISTERS intervals are active, which bounds the work per interval and
+ * leaves the initial sort as the dominant O(n log n) cost.
+ */
+
+const char *register_names[NUM_REGISTERS] = {
+    "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+    "r8",  "r9",  "r10", "r11", "r12", "r13", "r14", "r15",
+};
+
+/* rax and rdx are clobbered by division and, like r10 and r11, left out of
+ * the general class so code generation always has scratch registers for
+ * spilled operands. rsp and rbp hold the frame. */
+const RegisterSet register_class_members[NUM_REGISTER_CLASSES] = {
+    [REG_CLASS_GENERAL] = REGISTER_BIT(REG_RBX) | REGISTER_BIT(REG_RCX) |
+                          REGISTER_BIT(REG_RSI) | REGISTER_BIT(REG_RDI) |
+                          REGISTER_BIT(REG_R8) | REGISTER_BIT(REG_R9) |
+                          REGISTER_BIT(REG_R12) | REGISTER_BIT(REG_R13) |
+                          REGISTER_BIT(REG_R14) | REGISTER_BIT(REG_R15),
+};
+
+const RegisterSet callee_saved_registers =
+    REGISTER_BIT(REG_RBX) | REGISTER_BIT(REG_RBP) | REGISTER_BIT(REG_R12) |
+    REGISTER_BIT(REG_R13) | REGISTER_BIT(REG_R14) | REGISTER_BIT(REG_R15);
+
+/* System V order. */
+const PhysicalRegister argument_registers[6] = {
+    REG_RDI, REG_RSI, REG_RDX, REG_RCX, REG_R8, REG_R9,
+};
+
+void register_pool_init(RegisterPool *pool) {
+  pool->free = REGISTER_BIT(NUM_REGISTERS) - 1;
+  pool->free &= ~(REGISTER_BIT(REG_RSP) | REGISTER_BIT(REG_RBP));
+}
+
+/**
+ * @brief Takes the lowest numbered free register in `allowed`.
+ *
+ * @return The register, or REG_NONE if all of them are taken.
+ */
+int register_pool_take(RegisterPool *pool, RegisterSet allowed) {
+  RegisterSet candidates = pool->free & allowed;
+  if (candidates == 0) {
+    return REG_NONE;
+  }
+  int reg = __builtin_ctz(candidates);
+  pool->free &= ~REGISTER_BIT(reg);
+  return reg;
+}
+
+void register_pool_release(RegisterPool *pool, int reg) {
+  pool->free |= REGISTER_BIT(reg);
+}
+
+static int compare_start(const void *a, const void *b) {
+  const LiveInterval *left = a, *right = b;
+  if (left->start != right->start) {
+    return left->start < right->start ? -1 : 1;
+  }
+  return left->value < right->value ? -1 : left->value > right->value;
+}
+
+/**
+ * @brief Assigns a register or a spill slot to the value of every interval.
+ * Sorts `intervals` by start position.
+ */
+void allocate_registers(const IRFunction *function, LiveInterval *intervals,
+                        uint32_t count, RegisterAllocation *allocation) {
+  allocation->value_count = function->instr_count;
+  allocation->registers = allocate(function->instr_count, sizeof(int8_t));
+  allocation->spill_slots = allocate(function->instr_count, sizeof(int32_t));
+  allocation->spill_slot_count = 0;
+  allocation->callee_saved_used = 0;
+  memset(allocation->registers, REG_NONE, function->instr_count);
+  for (uint32_t i = 0; i < function->instr_count; i++) {
+    allocation->spill_slots[i] = -1;
+  }
+
+  qsort(intervals, count, sizeof(LiveInterval), compare_start);
+
+  RegisterPool pool;
+  register_pool_init(&pool);
+  const LiveInterval *active[NUM_REGISTERS]; // Sorted by decreasing end
+  int active_count = 0;
+
+  for (uint32_t i = 0; i < count; i++) {
+    const LiveInterval *current = &intervals[i];
+    int8_t *registers = allocation->registers;
+
+    while (active_count > 0 && active[active_count - 1]->end < current->start) {
+      register_pool_release(&pool, registers[active[--active_count]->value]);
+    }
+
+    RegisterSet allowed = register_class_members[current->register_class];
+    if (current->crosses_call) {
+      allowed &= callee_saved_registers;
+    }
+
+    int reg = register_pool_take(&pool, allowed);
+    if (reg == REG_NONE) {
+      // Spill whichever of the current interval and the active interval
+      // holding a usable register lives longest
+      int victim = 0;
+      while (victim < active_count &&
+             !(allowed & REGISTER_BIT(registers[active[victim]->value]))) {
+        victim++;
+      }
+      const LiveInterval *spilled = current;
+      if (victim < active_count && active[victim]->end > current->end) {
+        spilled = active[victim];
+        reg = registers[spilled->value];
+        registers[spilled->value] = REG_NONE;
+        memmove(&active[victim], &active[victim + 1],
+                (active_count - victim - 1) * sizeof(active[0]));
+        active_count--;
+      }
+      allocation->spill_slots[spilled->value] = allocation->spill_slot_count++;
+      if (spilled == current) {
+        continue;
+      }
+    }
+
+    registers[current->value] = (int8_t)reg;
+    if (callee_saved_registers & REGISTER_BIT(reg)) {
+      allocation->callee_saved_used |= REGISTER_BIT(reg);
+    }
+    int insert = active_count;
+    while (insert > 0 && active[insert - 1]->end < current->end) {
+      active[insert] = active[insert - 1];
+      insert--;
+    }
+    active[insert] = current;
+    active_count++;
+  }
+}
+
+void register_allocation_free(RegisterAllocation *allocation) {
+  free(allocation->registers);
+  free(allocation->spill_slots);
+}
+
+void dump_register_allocation(FILE *out, const IRFunction *function,
+                              const RegisterAllocation *allocation) {
+  fprintf(out, "allocation %s: %u spill slots\n", function->name,
+          allocation->spill_slot_count);
+  for (IRValue id = 0; id < function->instr_count; id++) {
+    if (allocation->registers[id] != REG_NONE) {
+      fprintf(out, "  v%u: %s\n", id, register_names[allocation->registers[id]]);
+    } else if (allocation->spill_slots[id] >= 0) {
+      fprintf(out, "  v%u: [slot %d]\n", id, allocation->spill_slots[id]);
+    }
+  }
+}
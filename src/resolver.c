@@ -0,0 +1,150 @@
+#include "resolver.h"
+#include "intern.h"
+#include "parser.h"
+#include "symbol_table.h"
+#include <stdio.h>
+
+/*
+ * Name resolution. Walks the AST in source order with a scope stack and
+ * points every AST_IDENTIFIER, declaring occurrences and uses alike, at the
+ * Symbol it denotes. Errors are reported and counted so one run surfaces all
+ * of them.
+ */
+
+typedef struct {
+  SymbolTable *table;
+  int errors;
+} Resolver;
+
+static void resolve_node(Resolver *resolver, ASTNode_t *node);
+
+static void name_error(Resolver *resolver, ASTNode_t *ident,
+                       const char *message) {
+  fprintf(stderr, "Error: %s '%s' at line %d, column %d\n", message,
+          ident->token->lexeme, ident->token->line, ident->token->column);
+  resolver->errors++;
+}
+
+/* A file-scope variable may be declared any number of times with the same
+ * type, as long as at most one of the declarations has an initializer; the
+ * ones without are tentative and all name the one object. */
+static void redeclare_global(Resolver *resolver, Symbol *existing,
+                             ASTNode_t *ident, ASTNode_t *declaration) {
+  ASTNode_t *previous = existing->declaration;
+  if (previous->children[0]->token->type !=
+      declaration->children[0]->token->type) {
+    name_error(resolver, ident, "conflicting types for");
+  } else if (declaration->child_count > 2) {
+    if (previous->child_count > 2) {
+      name_error(resolver, ident, "redefinition of");
+    } else {
+      existing->declaration = declaration; // The definition
+    }
+  }
+}
+
+static Symbol *declare(Resolver *resolver, ASTNode_t *ident, SymbolKind kind,
+                       ASTNode_t *declaration) {
+  unsigned int name = ident->token->intern_id;
+  Symbol *existing = lookup_symbol(resolver->table, name);
+
+  if (existing != NULL && existing->scope_depth == resolver->table->depth) {
+    if (kind == SYMBOL_VARIABLE && existing->kind == SYMBOL_VARIABLE &&
+        resolver->table->depth == 0) {
+      redeclare_global(resolver, existing, ident, declaration);
+    } else if (kind != SYMBOL_FUNCTION || existing->kind != SYMBOL_FUNCTION) {
+      name_error(resolver, ident, "redeclaration of");
+    } else if (declaration->type == AST_FUNCTION_DEF) {
+      if (existing->declaration->type == AST_FUNCTION_DEF) {
+        name_error(resolver, ident, "redefinition of");
+      } else {
+        // Later uses should see the body, earlier prototypes share the symbol
+        existing->declaration = declaration;
+      }
+    }
+    ident->symbol = existing;
+    return existing;
+  }
+
+  ident->symbol = declare_symbol(resolver->table, name, kind, declaration);
+  return ident->symbol;
+}
+
+static void resolve_function(Resolver *resolver, ASTNode_t *function) {
+  declare(resolver, function->children[1], SYMBOL_FUNCTION, function);
+
+  // Parameters and the outermost block of the body share one scope
+  enter_scope(resolver->table);
+  ASTNode_t *params = function->children[2];
+  for (int i = 0; i < params->child_count; i++) {
+    ASTNode_t *param = params->children[i];
+    declare(resolver, param->children[1], SYMBOL_PARAMETER, param);
+  }
+  if (function->type == AST_FUNCTION_DEF) {
+    ASTNode_t *body = function_body(function);
+    for (int i = 0; i < body->child_count; i++) {
+      resolve_node(resolver, body->children[i]);
+    }
+  }
+  leave_scope(resolver->table);
+}
+
+static void resolve_node(Resolver *resolver, ASTNode_t *node) {
+  switch (node->type) {
+  case AST_FUNCTION_DEF:
+  case AST_FUNCTION_DECL:
+    resolve_function(resolver, node);
+    return;
+  case AST_DECL:
+    // The declared name is in scope from its declarator on, so it is
+    // visible inside its own initializer
+    declare(resolver, node->children[1], SYMBOL_VARIABLE, node);
+    for (int i = 2; i < node->child_count; i++) {
+      resolve_node(resolver, node->children[i]);
+    }
+    return;
+  case AST_COMPOUND_STMT:
+    enter_scope(resolver->table);
+    for (int i = 0; i < node->child_count; i++) {
+      resolve_node(resolver, node->children[i]);
+    }
+    leave_scope(resolver->table);
+    return;
+  case AST_IDENTIFIER:
+    node->symbol = lookup_symbol(resolver->table, node->token->intern_id);
+    if (node->symbol == NULL) {
+      name_error(resolver, node, "use of undeclared identifier");
+    }
+    return;
+  default:
+    for (int i = 0; i < node->child_count; i++) {
+      resolve_node(resolver, node->children[i]);
+    }
+    return;
+  }
+}
+
+/**
+ * @brief Resolves one top-level declaration against the global scope of
+ * `table`, leaving its global names declared there.
+ *
+ * @return The number of name errors reported.
+ */
+int resolve_external_declaration(ASTNode_t *node, SymbolTable *table) {
+  Resolver resolver = {table, 0};
+  resolve_node(&resolver, node);
+  return resolver.errors;
+}
+
+/**
+ * @brief Links every identifier in a translation unit to its declaration.
+ *
+ * @return The number of name errors reported.
+ */
+int resolve_names(ASTNode_t *ast, SymbolTable *table) {
+  int errors = 0;
+  for (int i = 0; i < ast->child_count; i++) {
+    errors += resolve_external_declaration(ast->children[i], table);
+  }
+  return errors;
+}
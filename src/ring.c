@@ -0,0 +1,78 @@
+#include "ring.h"
+#include "util.h"
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Polls before a waiting side gives up its CPU
+#define SPIN_LIMIT 256
+
+/* Spins with the CPU's spin-wait hint where there is one, and yields once
+ * the limit is reached or on other targets. */
+static void back_off(uint32_t *spins) {
+  if (++*spins < SPIN_LIMIT) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ volatile("yield");
+#else
+    sched_yield();
+#endif
+  } else {
+    sched_yield();
+  }
+}
+
+/**
+ * @brief Creates an empty ring of `capacity` elements, rounded up to a power
+ * of two, each `element_size` bytes.
+ */
+void ring_init(Ring *ring, uint32_t capacity, size_t element_size) {
+  uint32_t size = 2;
+  while (size < capacity) {
+    size *= 2;
+  }
+  memset(ring, 0, sizeof(Ring));
+  ring->slots = allocate(size, element_size);
+  ring->element_size = element_size;
+  ring->mask = size - 1;
+}
+
+void ring_free(Ring *ring) { free(ring->slots); }
+
+/**
+ * @brief Copies `element` into the ring, waiting while it is full. Only the
+ * producer thread may call this.
+ */
+void ring_push(Ring *ring, const void *element) {
+  uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+  if (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) > ring->mask) {
+    ring->full_waits++;
+    uint32_t spins = 0;
+    while (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) >
+           ring->mask) {
+      back_off(&spins);
+    }
+  }
+  memcpy(ring->slots + (tail & ring->mask) * ring->element_size, element,
+         ring->element_size);
+  __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Copies the oldest element out of the ring into `element`, waiting
+ * while it is empty. Only the consumer thread may call this.
+ */
+void ring_pop(Ring *ring, void *element) {
+  uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+  if (__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == head) {
+    ring->empty_waits++;
+    uint32_t spins = 0;
+    while (__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == head) {
+      back_off(&spins);
+    }
+  }
+  memcpy(element, ring->slots + (head & ring->mask) * ring->element_size,
+         ring->element_size);
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
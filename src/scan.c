@@ -0,0 +1,305 @@
+#include "scan.h"
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Byte scanning primitives for the lexer. Every function walks a block of
+ * SCAN_WIDTH bytes per iteration and turns the per-byte comparison result into
+ * a bit mask, so the position of the first hit is a count-trailing-zeros away.
+ * Callers guarantee SCAN_PADDING readable bytes after `end`, which
+ * scan_map_file provides for files read from disk.
+ */
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+#define SCAN_WIDTH 32
+#define MASK_BITS_PER_BYTE 1
+
+typedef __m256i vec_t;
+
+static inline vec_t vec_load(const char *p) {
+  return _mm256_loadu_si256((const __m256i *)p);
+}
+static inline vec_t vec_splat(char c) { return _mm256_set1_epi8(c); }
+static inline vec_t vec_eq(vec_t a, vec_t b) { return _mm256_cmpeq_epi8(a, b); }
+static inline vec_t vec_or(vec_t a, vec_t b) { return _mm256_or_si256(a, b); }
+static inline vec_t vec_and(vec_t a, vec_t b) { return _mm256_and_si256(a, b); }
+static inline vec_t vec_sub(vec_t a, vec_t b) { return _mm256_sub_epi8(a, b); }
+static inline vec_t vec_le(vec_t a, vec_t b) {
+  return _mm256_cmpeq_epi8(_mm256_min_epu8(a, b), a);
+}
+static inline uint64_t vec_mask(vec_t v) {
+  return (uint32_t)_mm256_movemask_epi8(v);
+}
+
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+
+#define SCAN_WIDTH 16
+#define MASK_BITS_PER_BYTE 1
+
+typedef __m128i vec_t;
+
+static inline vec_t vec_load(const char *p) {
+  return _mm_loadu_si128((const __m128i *)p);
+}
+static inline vec_t vec_splat(char c) { return _mm_set1_epi8(c); }
+static inline vec_t vec_eq(vec_t a, vec_t b) { return _mm_cmpeq_epi8(a, b); }
+static inline vec_t vec_or(vec_t a, vec_t b) { return _mm_or_si128(a, b); }
+static inline vec_t vec_and(vec_t a, vec_t b) { return _mm_and_si128(a, b); }
+static inline vec_t vec_sub(vec_t a, vec_t b) { return _mm_sub_epi8(a, b); }
+static inline vec_t vec_le(vec_t a, vec_t b) {
+  return _mm_cmpeq_epi8(_mm_min_epu8(a, b), a);
+}
+static inline uint64_t vec_mask(vec_t v) {
+  return (uint32_t)_mm_movemask_epi8(v);
+}
+
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+
+#define SCAN_WIDTH 16
+#define MASK_BITS_PER_BYTE 4
+
+typedef uint8x16_t vec_t;
+
+static inline vec_t vec_load(const char *p) {
+  return vld1q_u8((const uint8_t *)p);
+}
+static inline vec_t vec_splat(char c) { return vdupq_n_u8((uint8_t)c); }
+static inline vec_t vec_eq(vec_t a, vec_t b) { return vceqq_u8(a, b); }
+static inline vec_t vec_or(vec_t a, vec_t b) { return vorrq_u8(a, b); }
+static inline vec_t vec_and(vec_t a, vec_t b) { return vandq_u8(a, b); }
+static inline vec_t vec_sub(vec_t a, vec_t b) { return vsubq_u8(a, b); }
+static inline vec_t vec_le(vec_t a, vec_t b) { return vcleq_u8(a, b); }
+/* NEON has no movemask; narrowing shift leaves one nibble per byte. */
+static inline uint64_t vec_mask(vec_t v) {
+  uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(v), 4);
+  return vget_lane_u64(vreinterpret_u64_u8(nibbles), 0);
+}
+#endif
+
+#ifdef SCAN_WIDTH
+
+#define FULL_MASK                                                              \
+  (SCAN_WIDTH * MASK_BITS_PER_BYTE == 64                                       \
+       ? ~(uint64_t)0                                                          \
+       : (((uint64_t)1 << (SCAN_WIDTH * MASK_BITS_PER_BYTE)) - 1))
+
+static inline int first_byte(uint64_t mask) {
+  return __builtin_ctzll(mask) / MASK_BITS_PER_BYTE;
+}
+
+static inline vec_t is_space(vec_t v) {
+  /* ' ' or one of '\t' '\n' '\v' '\f' '\r', which are the range 9..13. */
+  vec_t control = vec_le(vec_sub(v, vec_splat('\t')), vec_splat(4));
+  return vec_or(vec_eq(v, vec_splat(' ')), control);
+}
+
+#else
+
+static inline int is_space_byte(char c) {
+  return c == ' ' || (unsigned char)(c - '\t') <= 4;
+}
+
+#endif
+
+/**
+ * @brief Returns the first byte in [p, end) that is not whitespace, or `end`.
+ */
+const char *scan_skip_whitespace(const char *p, const char *end) {
+#ifdef SCAN_WIDTH
+  while (p < end) {
+    uint64_t mask = ~vec_mask(is_space(vec_load(p))) & FULL_MASK;
+    if (mask != 0) {
+      p += first_byte(mask);
+      return p < end ? p : end;
+    }
+    p += SCAN_WIDTH;
+  }
+  return end;
+#else
+  while (p < end && is_space_byte(*p)) {
+    p++;
+  }
+  return p;
+#endif
+}
+
+/**
+ * @brief Returns the first occurrence of `byte` in [p, end), or `end`.
+ */
+const char *scan_find_byte(const char *p, const char *end, char byte) {
+#ifdef SCAN_WIDTH
+  vec_t needle = vec_splat(byte);
+  while (p < end) {
+    uint64_t mask = vec_mask(vec_eq(vec_load(p), needle));
+    if (mask != 0) {
+      p += first_byte(mask);
+      return p < end ? p : end;
+    }
+    p += SCAN_WIDTH;
+  }
+  return end;
+#else
+  while (p < end && *p != byte) {
+    p++;
+  }
+  return p;
+#endif
+}
+
+/**
+ * @brief Returns a pointer to the `*` of the first `*` `/` pair in [p, end),
+ * or `end` if the block comment is unterminated.
+ */
+const char *scan_find_comment_end(const char *p, const char *end) {
+#ifdef SCAN_WIDTH
+  vec_t star = vec_splat('*');
+  vec_t slash = vec_splat('/');
+  while (p < end) {
+    /* The second load is shifted by one byte, so bit i is set when p[i] is
+     * '*' and p[i + 1] is '/'. A range can end inside a buffer, so a pair
+     * whose '/' is not before `end` is no match. */
+    vec_t pair = vec_and(vec_eq(vec_load(p), star),
+                         vec_eq(vec_load(p + 1), slash));
+    uint64_t mask = vec_mask(pair);
+    if (mask != 0) {
+      p += first_byte(mask);
+      return p + 1 < end ? p : end;
+    }
+    p += SCAN_WIDTH;
+  }
+  return end;
+#else
+  while (p + 1 < end && !(p[0] == '*' && p[1] == '/')) {
+    p++;
+  }
+  return p + 1 < end ? p : end;
+#endif
+}
+
+/**
+ * @brief Returns the first byte in [p, end) that ends the plain run of a
+ * string or character literal: the closing `quote`, a backslash or a newline.
+ */
+const char *scan_find_string_special(const char *p, const char *end,
+                                     char quote) {
+#ifdef SCAN_WIDTH
+  vec_t quotes = vec_splat(quote);
+  vec_t backslashes = vec_splat('\\');
+  vec_t newlines = vec_splat('\n');
+  while (p < end) {
+    vec_t v = vec_load(p);
+    vec_t special =
+        vec_or(vec_or(vec_eq(v, quotes), vec_eq(v, backslashes)),
+               vec_eq(v, newlines));
+    uint64_t mask = vec_mask(special);
+    if (mask != 0) {
+      p += first_byte(mask);
+      return p < end ? p : end;
+    }
+    p += SCAN_WIDTH;
+  }
+  return end;
+#else
+  while (p < end && *p != quote && *p != '\\' && *p != '\n') {
+    p++;
+  }
+  return p;
+#endif
+}
+
+/**
+ * @brief Returns the first newline, '/', '"' or '\'' in [p, end), or `end`:
+ * the bytes that can end a line or start a comment or literal spanning one.
+ */
+const char *scan_find_line_special(const char *p, const char *end) {
+#ifdef SCAN_WIDTH
+  vec_t newlines = vec_splat('\n');
+  vec_t slashes = vec_splat('/');
+  vec_t quotes = vec_splat('"');
+  vec_t apostrophes = vec_splat('\'');
+  while (p < end) {
+    vec_t v = vec_load(p);
+    vec_t special = vec_or(vec_or(vec_eq(v, newlines), vec_eq(v, slashes)),
+                           vec_or(vec_eq(v, quotes), vec_eq(v, apostrophes)));
+    uint64_t mask = vec_mask(special);
+    if (mask != 0) {
+      p += first_byte(mask);
+      return p < end ? p : end;
+    }
+    p += SCAN_WIDTH;
+  }
+  return end;
+#else
+  while (p < end && *p != '\n' && *p != '/' && *p != '"' && *p != '\'') {
+    p++;
+  }
+  return p;
+#endif
+}
+
+/**
+ * @brief Counts the occurrences of `byte` in [p, end).
+ */
+size_t scan_count_byte(const char *p, const char *end, char byte) {
+  size_t count = 0;
+#ifdef SCAN_WIDTH
+  vec_t needle = vec_splat(byte);
+  while (p < end) {
+    uint64_t mask = vec_mask(vec_eq(vec_load(p), needle));
+    if (end - p < SCAN_WIDTH) {
+      mask &= ((uint64_t)1 << ((end - p) * MASK_BITS_PER_BYTE)) - 1;
+    }
+    count += __builtin_popcountll(mask) / MASK_BITS_PER_BYTE;
+    p += SCAN_WIDTH;
+  }
+#else
+  for (; p < end; p++) {
+    count += *p == byte;
+  }
+#endif
+  return count;
+}
+
+/**
+ * @brief Maps the file at `path` read-only, followed by at least SCAN_PADDING
+ * zero bytes: the file goes over a zeroed anonymous mapping of `*mapped`
+ * bytes that extends beyond it.
+ *
+ * @return The contents, of `*length` bytes, or NULL if the file cannot be
+ * read.
+ */
+const char *scan_map_file(const char *path, size_t *length, size_t *mapped) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  struct stat status;
+  if (fstat(fd, &status) != 0) {
+    close(fd);
+    return NULL;
+  }
+  size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+  *length = (size_t)status.st_size;
+  *mapped = (*length + SCAN_PADDING + page_size - 1) & ~(page_size - 1);
+  char *memory = mmap(NULL, *mapped, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS,
+                      -1, 0);
+  if (memory != MAP_FAILED && *length > 0 &&
+      mmap(memory, *length, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) ==
+          MAP_FAILED) {
+    munmap(memory, *mapped);
+    memory = MAP_FAILED;
+  }
+  close(fd);
+  return memory == MAP_FAILED ? NULL : memory;
+}
+
+void scan_unmap_file(const char *source, size_t mapped) {
+  munmap((void *)source, mapped);
+}
@@ -0,0 +1,120 @@
+#include "symbol_table.h"
+#include "util.h"
+#include <stdlib.h>
+
+/*
+ * Scoped symbol table. Every name seen so far owns one slot in an open
+ * addressing table, and the slot points at the innermost visible binding.
+ * Bindings chain to the symbol they shadow, and each declaration is appended
+ * to an undo log, so leaving a scope only walks the symbols declared in it.
+ */
+
+static unsigned int hash_name(unsigned int name) {
+  return name * 2654435761u;
+}
+
+static SymbolSlot *find_slot(SymbolTable *table, unsigned int name) {
+  unsigned int mask = table->slot_capacity - 1;
+  unsigned int index = hash_name(name) & mask;
+  while (table->slots[index].name != 0 && table->slots[index].name != name) {
+    index = (index + 1) & mask;
+  }
+  return &table->slots[index];
+}
+
+static void rehash(SymbolTable *table, unsigned int capacity) {
+  SymbolSlot *old_slots = table->slots;
+  unsigned int old_capacity = table->slot_capacity;
+
+  table->slots = allocate_zeroed(capacity, sizeof(SymbolSlot));
+  table->slot_capacity = capacity;
+
+  for (unsigned int i = 0; i < old_capacity; i++) {
+    if (old_slots[i].name != 0) {
+      *find_slot(table, old_slots[i].name) = old_slots[i];
+    }
+  }
+  free(old_slots);
+}
+
+void symbol_table_init(SymbolTable *table) {
+  table->slots = NULL;
+  table->slot_capacity = 0;
+  table->slot_count = 0;
+  rehash(table, 256);
+
+  table->undo_log = NULL;
+  table->undo_count = 0;
+  table->undo_capacity = 0;
+
+  table->scope_marks = NULL;
+  table->depth = 0;
+  table->mark_capacity = 0;
+
+  arena_init(&table->symbols, 0);
+}
+
+void symbol_table_free(SymbolTable *table) {
+  free(table->slots);
+  free(table->undo_log);
+  free(table->scope_marks);
+  arena_free(&table->symbols);
+}
+
+void enter_scope(SymbolTable *table) {
+  if (table->depth == table->mark_capacity) {
+    table->scope_marks = grow(table->scope_marks, sizeof(size_t),
+                              &table->mark_capacity, 16);
+  }
+  table->scope_marks[table->depth++] = table->undo_count;
+}
+
+/**
+ * @brief Pops the innermost scope, restoring every binding it shadowed.
+ *
+ * The cost is proportional to the number of symbols declared in the scope,
+ * independent of how many symbols are visible from outside it.
+ */
+void leave_scope(SymbolTable *table) {
+  size_t mark = table->scope_marks[--table->depth];
+  while (table->undo_count > mark) {
+    Symbol *symbol = table->undo_log[--table->undo_count];
+    find_slot(table, symbol->name)->binding = symbol->shadowed;
+  }
+}
+
+Symbol *declare_symbol(SymbolTable *table, unsigned int name, SymbolKind kind,
+                       ASTNode_t *declaration) {
+  SymbolSlot *slot = find_slot(table, name);
+  if (slot->name == 0) {
+    // Keep the load factor at or below one half
+    if ((table->slot_count + 1) * 2 > table->slot_capacity) {
+      rehash(table, table->slot_capacity * 2);
+      slot = find_slot(table, name);
+    }
+    slot->name = name;
+    table->slot_count++;
+  }
+
+  Symbol *symbol = arena_alloc(&table->symbols, sizeof(Symbol));
+  symbol->name = name;
+  symbol->kind = kind;
+  symbol->scope_depth = table->depth;
+  symbol->declaration = declaration;
+  symbol->shadowed = slot->binding;
+  symbol->type_id = 0;
+  symbol->ir_variable = -1;
+  symbol->bytecode_slot = -1;
+  slot->binding = symbol;
+
+  if (table->undo_count == table->undo_capacity) {
+    table->undo_log = grow(table->undo_log, sizeof(Symbol *),
+                           &table->undo_capacity, 64);
+  }
+  table->undo_log[table->undo_count++] = symbol;
+  return symbol;
+}
+
+Symbol *lookup_symbol(SymbolTable *table, unsigned int name) {
+  return find_slot(table, name)->binding;
+}
@@ -0,0 +1,547 @@
+#include "symindex.h"
+#include "linked_list.h"
+#include "parser.h"
+#include "preprocessor.h"
+#include "pretty_printer.h"
+#include "scan.h"
+#include "util.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Persistent index of the global symbols of many files, for --index and
+ * --query. The index is one file:
+ *
+ *   IndexHeader
+ *   IndexFile    files[file_count]       path and content hash
+ *   IndexName    names[name_count]       sorted by name
+ *   IndexPosting postings[posting_count] grouped by name, in name order
+ *   char         strings[string_size]    names, paths and signatures
+ *
+ * A query maps it and binary searches the names, so it reads no more of the
+ * postings than it prints. An update keeps the symbols of every file whose
+ * content hash is unchanged and parses only the others, with function
+ * bodies left unparsed. A file indexes the symbols declared in it, not in
+ * the headers it includes, which are indexed when given themselves.
+ */
+
+#define INDEX_MAGIC "CSYMIDX1"
+
+typedef struct {
+  char magic[8];
+  uint32_t file_count;
+  uint32_t name_count;
+  uint32_t posting_count;
+  uint32_t string_size;
+} IndexHeader;
+
+typedef struct {
+  uint64_t hash;
+  uint32_t path;
+  uint32_t padding;
+} IndexFile;
+
+typedef struct {
+  uint32_t name;
+  uint32_t first_posting;
+  uint32_t posting_count;
+} IndexName;
+
+typedef struct {
+  uint32_t file;
+  uint32_t kind; // IndexKind
+  uint32_t line;
+  uint32_t column;
+  uint32_t signature;
+} IndexPosting;
+
+typedef enum {
+  KIND_FUNCTION,
+  KIND_PROTOTYPE,
+  KIND_VARIABLE,
+  NUM_KINDS,
+} IndexKind;
+
+static const char *kind_names[NUM_KINDS] = {"function", "prototype",
+                                            "variable"};
+
+/* A mapped index. */
+typedef struct {
+  const char *data;
+  size_t length;
+  size_t mapped;
+  const IndexHeader *header;
+  const IndexFile *files;
+  const IndexName *names;
+  const IndexPosting *postings;
+  const char *strings;
+} Index;
+
+/* A symbol while an index is built. */
+typedef struct {
+  char *name;
+  char *signature;
+  uint32_t file;
+  IndexKind kind;
+  uint32_t line;
+  uint32_t column;
+} IndexedSymbol;
+
+typedef struct {
+  char *path; // Canonical
+  uint64_t hash;
+} File;
+
+typedef struct {
+  File *files;
+  uint32_t file_count;
+  uint32_t file_capacity;
+  IndexedSymbol *symbols;
+  uint32_t symbol_count;
+  uint32_t symbol_capacity;
+} Builder;
+
+typedef struct {
+  uint8_t *bytes;
+  size_t size;
+  size_t capacity;
+} Output;
+
+static size_t append(Output *out, const void *data, size_t size) {
+  while (out->size + size > out->capacity) {
+    out->capacity = out->capacity ? out->capacity * 2 : 4096;
+    out->bytes = reallocate(out->bytes, out->capacity, 1);
+  }
+  size_t offset = out->size;
+  memcpy(out->bytes + offset, data, size);
+  out->size += size;
+  return offset;
+}
+
+/* FNV-1a over the contents of `path`.
+ *
+ * @return Zero if the file cannot be read. */
+static int hash_file(const char *path, uint64_t *hash) {
+  size_t length;
+  size_t mapped;
+  const char *source = scan_map_file(path, &length, &mapped);
+  if (source == NULL) {
+    return 0;
+  }
+  *hash = 14695981039346656037u;
+  for (size_t i = 0; i < length; i++) {
+    *hash = (*hash ^ (unsigned char)source[i]) * 1099511628211u;
+  }
+  scan_unmap_file(source, mapped);
+  return 1;
+}
+
+/* Maps the index at `path`.
+ *
+ * @return Zero if it does not exist or is not a valid index. */
+static int open_index(const char *path, Index *index) {
+  memset(index, 0, sizeof(Index));
+  index->data = scan_map_file(path, &index->length, &index->mapped);
+  if (index->data == NULL) {
+    return 0;
+  }
+  const IndexHeader *header = (const IndexHeader *)index->data;
+  size_t tables = sizeof(IndexHeader);
+  if (index->length >= tables) {
+    tables += (uint64_t)header->file_count * sizeof(IndexFile) +
+              (uint64_t)header->name_count * sizeof(IndexName) +
+              (uint64_t)header->posting_count * sizeof(IndexPosting);
+  }
+  if (index->length < sizeof(IndexHeader) ||
+      memcmp(header->magic, INDEX_MAGIC, sizeof(header->magic)) != 0 ||
+      tables + header->string_size != index->length ||
+      header->string_size == 0 ||
+      index->data[index->length - 1] != '\0') {
+    fprintf(stderr, "Error: %s is not a symbol index\n", path);
+    scan_unmap_file(index->data, index->mapped);
+    index->data = NULL;
+    return 0;
+  }
+  index->header = header;
+  index->files = (const IndexFile *)(header + 1);
+  index->names = (const IndexName *)(index->files + header->file_count);
+  index->postings = (const IndexPosting *)(index->names + header->name_count);
+  index->strings = (const char *)(index->postings + header->posting_count);
+  return 1;
+}
+
+static void close_index(Index *index) {
+  if (index->data != NULL) {
+    scan_unmap_file(index->data, index->mapped);
+  }
+}
+
+/* Offsets are checked as they are used, so a damaged index cannot send a
+ * query out of the mapping. */
+static const char *index_string(const Index *index, uint32_t offset) {
+  return offset < index->header->string_size ? index->strings + offset : "";
+}
+
+static uint32_t add_file(Builder *builder, const char *path, uint64_t hash) {
+  if (builder->file_count == builder->file_capacity) {
+    builder->files =
+        grow(builder->files, sizeof(File), &builder->file_capacity, 64);
+  }
+  builder->files[builder->file_count] = (File){duplicate(path), hash};
+  return builder->file_count++;
+}
+
+static void add_symbol(Builder *builder, IndexedSymbol symbol) {
+  if (builder->symbol_count == builder->symbol_capacity) {
+    builder->symbols = grow(builder->symbols, sizeof(IndexedSymbol),
+                            &builder->symbol_capacity, 1024);
+  }
+  builder->symbols[builder->symbol_count++] = symbol;
+}
+
+/* Copies the symbols of the old index whose file is kept, renumbering the
+ * files by `kept`, which holds -1 for the files left out. */
+static void keep_symbols(Builder *builder, const Index *index,
+                         const int64_t *kept) {
+  for (uint32_t n = 0; n < index->header->name_count; n++) {
+    const IndexName *name = &index->names[n];
+    for (uint32_t p = 0; p < name->posting_count; p++) {
+      uint64_t at = (uint64_t)name->first_posting + p;
+      if (at >= index->header->posting_count) {
+        break;
+      }
+      const IndexPosting *posting = &index->postings[at];
+      if (posting->file >= index->header->file_count ||
+          kept[posting->file] < 0 || posting->kind >= NUM_KINDS) {
+        continue;
+      }
+      add_symbol(builder,
+                 (IndexedSymbol){
+                     duplicate(index_string(index, name->name)),
+                     duplicate(index_string(index, posting->signature)),
+                     (uint32_t)kept[posting->file], (IndexKind)posting->kind,
+                     posting->line, posting->column});
+    }
+  }
+}
+
+static IndexKind symbol_kind(ASTNode_t *declaration) {
+  switch (declaration->type) {
+  case AST_FUNCTION_DEF:
+    return KIND_FUNCTION;
+  case AST_FUNCTION_DECL:
+    return KIND_PROTOTYPE;
+  default:
+    return KIND_VARIABLE;
+  }
+}
+
+/* Parses the file at the canonical `path` and adds the global symbols
+ * declared in it.
+ *
+ * @return Zero if it could not be preprocessed or parsed, after reporting
+ * why. */
+static int index_file(Builder *builder, const char *path, uint32_t file,
+                      const char *const *include_dirs, int include_dir_count,
+                      HeaderCache *headers) {
+  node_t *tokens =
+      preprocess_file(path, include_dirs, include_dir_count, headers);
+  if (tokens == NULL) {
+    fprintf(stderr, "Error: %s not indexed\n", path);
+    return 0;
+  }
+  ParseOptions options = {1, 1, DEFAULT_NESTING_LIMIT, 0};
+  char error[PARSE_ERROR_SIZE];
+  ASTNode_t *ast = get_ast(tokens, &options, NULL, error);
+  if (ast == NULL && error[0] != '\0') {
+    fputs(error, stderr);
+    fprintf(stderr, "Error: %s not indexed\n", path);
+    delete_list(tokens);
+    return 0;
+  }
+  for (int i = 0; ast != NULL && i < ast->child_count; i++) {
+    ASTNode_t *declaration = ast->children[i];
+    Token *name = declaration->children[1]->token;
+    if (!header_cache_contains(headers, path, name->raw)) {
+      continue; // Declared in an included file
+    }
+    char *signature;
+    size_t length;
+    FILE *out = open_memstream(&signature, &length);
+    if (out == NULL) {
+      fprintf(stderr, "Memory allocation error\n");
+      exit(EXIT_FAILURE);
+    }
+    print_declaration(out, declaration);
+    fclose(out);
+    add_symbol(builder,
+               (IndexedSymbol){duplicate(name->lexeme), signature, file,
+                               symbol_kind(declaration), name->line,
+                               name->column});
+  }
+  // The AST is done with, its bodies never parsed, so the tokens can go
+  delete_list(tokens);
+  return 1;
+}
+
+static int compare_symbols(const void *a, const void *b) {
+  const IndexedSymbol *left = a;
+  const IndexedSymbol *right = b;
+  int order = strcmp(left->name, right->name);
+  if (order != 0) {
+    return order;
+  }
+  if (left->file != right->file) {
+    return left->file < right->file ? -1 : 1;
+  }
+  return left->line < right->line ? -1 : left->line > right->line;
+}
+
+static uint32_t add_string(Output *strings, const char *string) {
+  return (uint32_t)append(strings, string, strlen(string) + 1);
+}
+
+/* Writes the index to a temporary file next to `path`, then renames it over
+ * `path`, so a query never sees half an index. */
+static int write_index(const char *path, Builder *builder) {
+  qsort(builder->symbols, builder->symbol_count, sizeof(IndexedSymbol),
+        compare_symbols);
+  Output files = {0}, names = {0}, postings = {0}, strings = {0};
+  IndexHeader header = {.file_count = builder->file_count};
+  memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+  add_string(&strings, ""); // Offset zero is the empty string
+
+  for (uint32_t i = 0; i < builder->file_count; i++) {
+    IndexFile file = {builder->files[i].hash,
+                      add_string(&strings, builder->files[i].path), 0};
+    append(&files, &file, sizeof(file));
+  }
+  for (uint32_t i = 0; i < builder->symbol_count; i++) {
+    const IndexedSymbol *symbol = &builder->symbols[i];
+    if (i == 0 || strcmp(symbol->name, builder->symbols[i - 1].name) != 0) {
+      IndexName name = {add_string(&strings, symbol->name),
+                        header.posting_count, 0};
+      append(&names, &name, sizeof(name));
+      header.name_count++;
+    }
+    ((IndexName *)(names.bytes + names.size))[-1].posting_count++;
+    IndexPosting posting = {symbol->file, symbol->kind, symbol->line,
+                            symbol->column,
+                            add_string(&strings, symbol->signature)};
+    append(&postings, &posting, sizeof(posting));
+    header.posting_count++;
+  }
+  header.string_size = (uint32_t)strings.size;
+
+  char temporary[PATH_MAX];
+  snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+  FILE *out = fopen(temporary, "wb");
+  int failed = out == NULL;
+  if (!failed) {
+    failed = fwrite(&header, sizeof(header), 1, out) != 1 ||
+             fwrite(files.bytes, 1, files.size, out) != files.size ||
+             fwrite(names.bytes, 1, names.size, out) != names.size ||
+             fwrite(postings.bytes, 1, postings.size, out) != postings.size ||
+             fwrite(strings.bytes, 1, strings.size, out) != strings.size;
+    failed |= fclose(out) != 0;
+  }
+  if (!failed && rename(temporary, path) != 0) {
+    failed = 1;
+  }
+  if (failed) {
+    perror(path);
+    remove(temporary);
+  }
+  free(files.bytes);
+  free(names.bytes);
+  free(postings.bytes);
+  free(strings.bytes);
+  return failed;
+}
+
+/**
+ * @brief Brings the index at `index_path` up to date with `inputs`, creating
+ * it if needed. Inputs whose content hash is unchanged are not parsed again;
+ * files already in the index that are not among the inputs are kept while
+ * they exist.
+ *
+ * @return The number of inputs that could not be indexed, or -1 if the index
+ * could not be written.
+ */
+int update_symbol_index(const char *index_path, const char *const *inputs,
+                        int input_count, const char *const *include_dirs,
+                        int include_dir_count, IndexStats *stats) {
+  double start = now();
+  memset(stats, 0, sizeof(IndexStats));
+  int failures = 0;
+  File *current = allocate_zeroed(input_count, sizeof(File));
+  for (int i = 0; i < input_count; i++) {
+    char canonical[PATH_MAX];
+    if (realpath(inputs[i], canonical) == NULL ||
+        !hash_file(canonical, &current[i].hash)) {
+      perror(inputs[i]);
+      failures++;
+      continue;
+    }
+    current[i].path = duplicate(canonical);
+  }
+
+  Builder builder = {0};
+  Index index = {0};
+  if (access(index_path, F_OK) == 0 && !open_index(index_path, &index)) {
+    failures = -1;
+    goto done;
+  }
+  uint32_t old_file_count = index.data != NULL ? index.header->file_count : 0;
+  int64_t *kept = allocate(old_file_count + 1, sizeof(int64_t));
+  for (uint32_t f = 0; f < old_file_count; f++) {
+    kept[f] = -1;
+    const char *path = index_string(&index, index.files[f].path);
+    int input = -1;
+    for (int i = 0; i < input_count && input < 0; i++) {
+      if (current[i].path != NULL && strcmp(current[i].path, path) == 0) {
+        input = i;
+      }
+    }
+    if (input >= 0 && current[input].hash != index.files[f].hash) {
+      continue; // Changed, parsed again below
+    }
+    if (input < 0 && access(path, F_OK) != 0) {
+      stats->files_dropped++;
+      continue;
+    }
+    kept[f] = add_file(&builder, path, index.files[f].hash);
+    if (input >= 0) {
+      stats->files_unchanged++;
+      free(current[input].path);
+      current[input].path = NULL;
+    }
+  }
+  if (index.data != NULL) {
+    keep_symbols(&builder, &index, kept);
+  }
+  free(kept);
+
+  HeaderCache headers;
+  header_cache_init(&headers);
+  for (int i = 0; i < input_count; i++) {
+    if (current[i].path == NULL) {
+      continue;
+    }
+    int duplicate_input = 0;
+    for (uint32_t f = 0; f < builder.file_count && !duplicate_input; f++) {
+      duplicate_input = strcmp(builder.files[f].path, current[i].path) == 0;
+    }
+    if (duplicate_input) {
+      continue;
+    }
+    uint32_t file = add_file(&builder, current[i].path, current[i].hash);
+    if (!index_file(&builder, current[i].path, file, include_dirs,
+                    include_dir_count, &headers)) {
+      // Its hash is forgotten, so that the next update tries again
+      builder.files[file].hash = 0;
+      failures++;
+      continue;
+    }
+    stats->files_indexed++;
+  }
+  header_cache_free(&headers);
+
+  if (write_index(index_path, &builder) != 0) {
+    failures = -1;
+  }
+  stats->symbols = builder.symbol_count;
+
+done:
+  close_index(&index);
+  for (uint32_t i = 0; i < builder.symbol_count; i++) {
+    free(builder.symbols[i].name);
+    free(builder.symbols[i].signature);
+  }
+  for (uint32_t i = 0; i < builder.file_count; i++) {
+    free(builder.files[i].path);
+  }
+  free(builder.symbols);
+  free(builder.files);
+  for (int i = 0; i < input_count; i++) {
+    free(current[i].path);
+  }
+  free(current);
+  stats->seconds = now() - start;
+  return failures;
+}
+
+static void print_postings(FILE *out, const Index *index,
+                           const IndexName *name) {
+  for (uint32_t p = 0; p < name->posting_count; p++) {
+    uint64_t at = (uint64_t)name->first_posting + p;
+    if (at >= index->header->posting_count) {
+      return;
+    }
+    const IndexPosting *posting = &index->postings[at];
+    const char *path = posting->file < index->header->file_count
+                           ? index_string(index,
+                                          index->files[posting->file].path)
+                           : "";
+    fprintf(out, "%s:%u:%u: %s %s\n", path, posting->line, posting->column,
+            posting->kind < NUM_KINDS ? kind_names[posting->kind] : "symbol",
+            index_string(index, posting->signature));
+  }
+}
+
+/**
+ * @brief Prints every symbol of the index named `pattern`, or, if it ends in
+ * '*', every symbol whose name starts with the rest of it.
+ *
+ * @return The number of names matched, or -1 if the index cannot be read.
+ */
+int query_symbol_index(const char *index_path, const char *pattern,
+                       FILE *out) {
+  Index index;
+  if (!open_index(index_path, &index)) {
+    if (access(index_path, F_OK) != 0) {
+      perror(index_path);
+    }
+    return -1;
+  }
+  size_t length = strlen(pattern);
+  int prefix = length > 0 && pattern[length - 1] == '*';
+  if (prefix) {
+    length--;
+  }
+
+  // The first name not ordered before the pattern
+  uint32_t low = 0, high = index.header->name_count;
+  while (low < high) {
+    uint32_t middle = low + (high - low) / 2;
+    const char *name = index_string(&index, index.names[middle].name);
+    if (strncmp(name, pattern, length) < 0 ||
+        (!prefix && strcmp(name, pattern) < 0)) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  int matches = 0;
+  for (uint32_t n = low; n < index.header->name_count; n++) {
+    const char *name = index_string(&index, index.names[n].name);
+    if (prefix ? strncmp(name, pattern, length) != 0
+               : strcmp(name, pattern) != 0) {
+      break;
+    }
+    print_postings(out, &index, &index.names[n]);
+    matches++;
+  }
+  close_index(&index);
+  return matches;
+}
+
+void print_index_stats(FILE *out, const IndexStats *stats) {
+  fprintf(out,
+          "index: %u files parsed, %u unchanged, %u dropped, %u symbols in "
+          "%.3f ms\n",
+          stats->files_indexed, stats->files_unchanged, stats->files_dropped,
+          stats->symbols, stats->seconds * 1e3);
+}
@@ -0,0 +1,41 @@
+#include "tokens.h"
+
+const char *token_names[NUM_TOKENS] = {"INT",
+                                       "CHAR",
+                                       "FLOAT",
+                                       "VOID",
+                                       "IF",
+                                       "ELSE",
+                                       "WHILE",
+                                       "FOR",
+                                       "RETURN",
+                                       "INT_LITERAL",
+                                       "IDENTIFIER",
+                                       "FLOAT_LITERAL",
+                                       "STRING_LITERAL",
+                                       "CHAR_LITERAL",
+                                       "LPAREN",
+                                       "RPAREN",
+                                       "LBRACE",
+                                       "RBRACE",
+                                       "SEMICOLON",
+                                       "COMMA",
+                                       "PLUS",
+                                       "MINUS",
+                                       "STAR",
+                                       "SLASH",
+                                       "MOD",
+                                       "ASSIGN",
+                                       "AMPERSAND",
+                                       "PLUS_PLUS",
+                                       "MINUS_MINUS",
+                                       "LT",
+                                       "GT",
+                                       "LTE",
+                                       "GTE",
+                                       "EQ",
+                                       "NEQ",
+                                       "AND",
+                                       "OR",
+                                       "UNRECOGNIZED",
+                                       "EOF"};
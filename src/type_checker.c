@@ -0,0 +1,321 @@
+#include "type_checker.h"
+#include "parser.h"
+#include "symbol_table.h"
+#include "type_table.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Type checker. A single post-order walk over a resolved AST: every node is
+ * visited once, its type is computed from the already-computed types of its
+ * children and stored in node->type_id. Declarations record their type on the
+ * Symbol, so a use looks its type up instead of revisiting the declaration.
+ */
+
+typedef struct {
+  int return_type; // Of the function whose body is being checked
+  int errors;
+} Checker;
+
+static int check_node(Checker *checker, ASTNode_t *node);
+
+static void type_error(Checker *checker, Token *token, const char *format,
+                       ...) {
+  va_list args;
+  va_start(args, format);
+  fprintf(stderr, "Error: ");
+  vfprintf(stderr, format, args);
+  if (token != NULL) {
+    fprintf(stderr, " at line %d, column %d", token->line, token->column);
+  }
+  fprintf(stderr, "\n");
+  va_end(args);
+  checker->errors++;
+}
+
+/* Whether a value of type `from` may be stored into an object of type `to`. */
+static int assignable(int to, int from) {
+  if (to == from || to == TYPE_ID_ERROR || from == TYPE_ID_ERROR) {
+    return 1;
+  }
+  return type_is_arithmetic(to) && type_is_arithmetic(from);
+}
+
+static void check_assignable(Checker *checker, Token *token, int to, int from,
+                             const char *context) {
+  if (!assignable(to, from)) {
+    char to_name[128], from_name[128];
+    type_error(checker, token, "incompatible types in %s: '%s' from '%s'",
+               context, type_name(to, to_name, sizeof to_name),
+               type_name(from, from_name, sizeof from_name));
+  }
+}
+
+static int check_function(Checker *checker, ASTNode_t *function) {
+  ASTNode_t *ident = function->children[1];
+  ASTNode_t *params = function->children[2];
+  int return_type = type_from_token(function->children[0]->token->type);
+
+  int param_types[params->child_count > 0 ? params->child_count : 1];
+  for (int i = 0; i < params->child_count; i++) {
+    ASTNode_t *param = params->children[i];
+    param_types[i] = type_from_token(param->children[0]->token->type);
+    if (param_types[i] == TYPE_ID_VOID) {
+      type_error(checker, param->children[1]->token,
+                 "parameter '%s' has type void",
+                 param->children[1]->token->lexeme);
+    }
+    param->type_id = param->children[1]->type_id = param_types[i];
+    param->children[1]->symbol->type_id = param_types[i];
+  }
+
+  int type = type_function(return_type, param_types, params->child_count);
+  Symbol *symbol = ident->symbol;
+  if (symbol->type_id != 0 && symbol->type_id != type) {
+    type_error(checker, ident->token, "conflicting types for '%s'",
+               ident->token->lexeme);
+  }
+  symbol->type_id = type;
+  function->type_id = ident->type_id = type;
+
+  if (function->type == AST_FUNCTION_DEF) {
+    checker->return_type = return_type;
+    check_node(checker, function_body(function));
+  }
+  return type;
+}
+
+static int check_arithmetic(Checker *checker, ASTNode_t *node) {
+  int left = check_node(checker, node->children[0]);
+  int right = check_node(checker, node->children[1]);
+  if (left == TYPE_ID_ERROR || right == TYPE_ID_ERROR) {
+    return TYPE_ID_ERROR;
+  }
+
+  if (!type_is_arithmetic(left) || !type_is_arithmetic(right)) {
+    char left_name[128], right_name[128];
+    type_error(checker, node->token,
+               "invalid operands to '%s' ('%s' and '%s')", node->token->lexeme,
+               type_name(left, left_name, sizeof left_name),
+               type_name(right, right_name, sizeof right_name));
+    return TYPE_ID_ERROR;
+  }
+
+  if (node->token->type == TOKEN_MOD &&
+      (left == TYPE_ID_FLOAT || right == TYPE_ID_FLOAT)) {
+    type_error(checker, node->token, "invalid operands to '%%' of type float");
+    return TYPE_ID_ERROR;
+  }
+
+  // Usual arithmetic conversions, with char promoted to int
+  if (left == TYPE_ID_FLOAT || right == TYPE_ID_FLOAT) {
+    return TYPE_ID_FLOAT;
+  }
+  return TYPE_ID_INT;
+}
+
+static int check_comparison(Checker *checker, ASTNode_t *node) {
+  int left = check_node(checker, node->children[0]);
+  int right = check_node(checker, node->children[1]);
+  if (left == TYPE_ID_ERROR || right == TYPE_ID_ERROR) {
+    return TYPE_ID_INT;
+  }
+
+  int comparable = (type_is_arithmetic(left) && type_is_arithmetic(right)) ||
+                   (left == right && type_get(left)->kind == TYPE_POINTER);
+  if (!comparable) {
+    char left_name[128], right_name[128];
+    type_error(checker, node->token,
+               "invalid operands to '%s' ('%s' and '%s')", node->token->lexeme,
+               type_name(left, left_name, sizeof left_name),
+               type_name(right, right_name, sizeof right_name));
+  }
+  return TYPE_ID_INT;
+}
+
+/* An if or while statement: a scalar condition, then the statements it
+ * runs. */
+static int check_conditional(Checker *checker, ASTNode_t *node) {
+  int condition = check_node(checker, node->children[0]);
+  if (condition != TYPE_ID_ERROR && !type_is_arithmetic(condition) &&
+      type_get(condition)->kind != TYPE_POINTER) {
+    char name[128];
+    type_error(checker, node->token,
+               "used '%s' where a scalar condition is required",
+               type_name(condition, name, sizeof name));
+  }
+  for (int i = 1; i < node->child_count; i++) {
+    check_node(checker, node->children[i]);
+  }
+  return TYPE_ID_VOID;
+}
+
+static int check_call(Checker *checker, ASTNode_t *call) {
+  ASTNode_t *callee = call->children[0];
+  ASTNode_t *args = call->children[1];
+
+  int arg_types[args->child_count > 0 ? args->child_count : 1];
+  for (int i = 0; i < args->child_count; i++) {
+    arg_types[i] = check_node(checker, args->children[i]);
+  }
+
+  if (callee->symbol == NULL) {
+    return TYPE_ID_ERROR; // Already reported by name resolution
+  }
+  callee->type_id = callee->symbol->type_id;
+  const Type *function = type_get(callee->type_id);
+  if (function->kind != TYPE_FUNCTION) {
+    type_error(checker, callee->token, "called object '%s' is not a function",
+               callee->token->lexeme);
+    return TYPE_ID_ERROR;
+  }
+
+  if (args->child_count != function->param_count) {
+    type_error(checker, callee->token,
+               "function '%s' expects %d argument%s, but %d given",
+               callee->token->lexeme, function->param_count,
+               function->param_count == 1 ? "" : "s", args->child_count);
+    return function->base;
+  }
+
+  for (int i = 0; i < args->child_count; i++) {
+    check_assignable(checker, callee->token, function->params[i], arg_types[i],
+                     "argument passing");
+  }
+  return function->base;
+}
+
+static int check_return(Checker *checker, ASTNode_t *node) {
+  if (node->child_count == 0) {
+    if (checker->return_type != TYPE_ID_VOID) {
+      type_error(checker, node->token,
+                 "non-void function should return a value");
+    }
+    return TYPE_ID_VOID;
+  }
+
+  int value = check_node(checker, node->children[0]);
+  if (checker->return_type == TYPE_ID_VOID) {
+    type_error(checker, node->token, "void function should not return a value");
+  } else {
+    check_assignable(checker, node->token, checker->return_type, value,
+                     "return");
+  }
+  return TYPE_ID_VOID;
+}
+
+static int check_declaration(Checker *checker, ASTNode_t *node) {
+  ASTNode_t *ident = node->children[1];
+  int type = type_from_token(node->children[0]->token->type);
+  if (type == TYPE_ID_VOID) {
+    type_error(checker, ident->token, "variable '%s' declared void",
+               ident->token->lexeme);
+    type = TYPE_ID_ERROR;
+  }
+  ident->symbol->type_id = type;
+  ident->type_id = type;
+
+  if (node->child_count > 2) {
+    int value = check_node(checker, node->children[2]);
+    check_assignable(checker, ident->token, type, value, "initialization");
+  }
+  return type;
+}
+
+static int check_assignment(Checker *checker, ASTNode_t *node) {
+  ASTNode_t *target = node->children[0];
+  int type = check_node(checker, target);
+  int value = check_node(checker, node->children[1]);
+
+  if (target->symbol != NULL && target->symbol->kind == SYMBOL_FUNCTION) {
+    type_error(checker, target->token, "cannot assign to function '%s'",
+               target->token->lexeme);
+    return TYPE_ID_ERROR;
+  }
+  check_assignable(checker, node->token, type, value, "assignment");
+  return type;
+}
+
+static int check_node(Checker *checker, ASTNode_t *node) {
+  int type = TYPE_ID_VOID;
+
+  switch (node->type) {
+  case AST_FUNCTION_DEF:
+  case AST_FUNCTION_DECL:
+    return check_function(checker, node);
+  case AST_DECL:
+    type = check_declaration(checker, node);
+    break;
+  case AST_ADDITION_EXPR:
+  case AST_MULTIPLICATION_EXPR:
+    type = check_arithmetic(checker, node);
+    break;
+  case AST_RELATIONAL_EXPR:
+  case AST_EQUALITY_EXPR:
+    type = check_comparison(checker, node);
+    break;
+  case AST_ASSIGN_EXPR:
+    type = check_assignment(checker, node);
+    break;
+  case AST_IF_STMT:
+  case AST_WHILE_STMT:
+    type = check_conditional(checker, node);
+    break;
+  case AST_CALL_EXPR:
+    type = check_call(checker, node);
+    break;
+  case AST_RETURN_STMT:
+    type = check_return(checker, node);
+    break;
+  case AST_IDENTIFIER:
+    type = node->symbol != NULL ? node->symbol->type_id : TYPE_ID_ERROR;
+    break;
+  case AST_TYPE_SPEC:
+    type = type_from_token(node->token->type);
+    break;
+  case AST_INT_LITERAL:
+    type = TYPE_ID_INT;
+    break;
+  case AST_FLOAT_LITERAL:
+    type = TYPE_ID_FLOAT;
+    break;
+  case AST_CHAR_LITERAL:
+    type = TYPE_ID_CHAR;
+    break;
+  case AST_STRING_LITERAL:
+    type = type_pointer(TYPE_ID_CHAR);
+    break;
+  default:
+    for (int i = 0; i < node->child_count; i++) {
+      check_node(checker, node->children[i]);
+    }
+    break;
+  }
+
+  node->type_id = type;
+  return type;
+}
+
+/**
+ * @brief Type checks one resolved top-level declaration.
+ *
+ * @return The number of type errors reported.
+ */
+int check_external_declaration(ASTNode_t *node) {
+  Checker checker = {TYPE_ID_VOID, 0};
+  check_node(&checker, node);
+  return checker.errors;
+}
+
+/**
+ * @brief Assigns a type to every expression and declaration of a resolved
+ * translation unit in one traversal.
+ *
+ * @return The number of type errors reported.
+ */
+int check_types(ASTNode_t *ast) {
+  Checker checker = {TYPE_ID_VOID, 0};
+  check_node(&checker, ast);
+  return checker.errors;
+}
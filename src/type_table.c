@@ -0,0 +1,172 @@
+#include "type_table.h"
+#include "arena.h"
+#include "util.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Hash-consed type table. Structurally equal types are created once and
+ * identified by a small integer, so comparing two types is comparing two ints
+ * and deriving a type (pointer to, function returning) is a hash lookup.
+ */
+
+static Type *types;
+static int type_count;
+static int type_capacity;
+
+static int *slots; // Type id + 1, 0 marks an empty slot
+static int slot_capacity;
+
+static Arena params;
+
+static uint32_t hash_type(TypeKind kind, int base, const int *param_ids,
+                          int param_count) {
+  uint32_t hash = 2166136261u;
+  uint32_t words[3] = {(uint32_t)kind, (uint32_t)base, (uint32_t)param_count};
+  for (int i = 0; i < 3 + param_count; i++) {
+    hash ^= i < 3 ? words[i] : (uint32_t)param_ids[i - 3];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static int same_type(const Type *type, TypeKind kind, int base,
+                     const int *param_ids, int param_count) {
+  return type->kind == kind && type->base == base &&
+         type->param_count == param_count &&
+         (param_count == 0 ||
+          memcmp(type->params, param_ids, param_count * sizeof(int)) == 0);
+}
+
+static void insert_slot(int id) {
+  const Type *type = &types[id];
+  int mask = slot_capacity - 1;
+  int slot = hash_type(type->kind, type->base, type->params,
+                       type->param_count) &
+             mask;
+  while (slots[slot] != 0) {
+    slot = (slot + 1) & mask;
+  }
+  slots[slot] = id + 1;
+}
+
+static void grow_tables(void) {
+  type_capacity = type_capacity ? type_capacity * 2 : 64;
+  types = reallocate(types, type_capacity, sizeof(Type));
+
+  free(slots);
+  slot_capacity = type_capacity * 2;
+  slots = allocate_zeroed(slot_capacity, sizeof(int));
+  for (int id = 0; id < type_count; id++) {
+    insert_slot(id);
+  }
+}
+
+static int intern_type(TypeKind kind, int base, const int *param_ids,
+                       int param_count);
+
+static void init_types(void) {
+  arena_init(&params, 0);
+  grow_tables();
+  for (TypeKind kind = TYPE_ERROR; kind <= TYPE_FLOAT; kind++) {
+    intern_type(kind, 0, NULL, 0);
+  }
+}
+
+static int intern_type(TypeKind kind, int base, const int *param_ids,
+                       int param_count) {
+  if (types == NULL) {
+    init_types();
+  }
+
+  uint32_t hash = hash_type(kind, base, param_ids, param_count);
+  int mask = slot_capacity - 1;
+  for (int slot = hash & mask; slots[slot] != 0; slot = (slot + 1) & mask) {
+    int id = slots[slot] - 1;
+    if (same_type(&types[id], kind, base, param_ids, param_count)) {
+      return id;
+    }
+  }
+
+  if (type_count == type_capacity) {
+    grow_tables();
+  }
+  int id = type_count++;
+  Type *type = &types[id];
+  type->kind = kind;
+  type->base = base;
+  type->param_count = param_count;
+  type->params = NULL;
+  if (param_count > 0) {
+    int *copy = arena_alloc(&params, param_count * sizeof(int));
+    memcpy(copy, param_ids, param_count * sizeof(int));
+    type->params = copy;
+  }
+  insert_slot(id);
+  return id;
+}
+
+const Type *type_get(int id) {
+  if (types == NULL) {
+    init_types();
+  }
+  return &types[id];
+}
+
+int type_pointer(int base) { return intern_type(TYPE_POINTER, base, NULL, 0); }
+
+int type_function(int return_type, const int *params, int param_count) {
+  return intern_type(TYPE_FUNCTION, return_type, params, param_count);
+}
+
+int type_from_token(TokenType token_type) {
+  switch (token_type) {
+  case TOKEN_VOID:
+    return TYPE_ID_VOID;
+  case TOKEN_CHAR:
+    return TYPE_ID_CHAR;
+  case TOKEN_INT:
+    return TYPE_ID_INT;
+  case TOKEN_FLOAT:
+    return TYPE_ID_FLOAT;
+  default:
+    return TYPE_ID_ERROR;
+  }
+}
+
+int type_is_arithmetic(int id) {
+  return id == TYPE_ID_CHAR || id == TYPE_ID_INT || id == TYPE_ID_FLOAT;
+}
+
+/**
+ * @brief Spells a type the way C would write it, for diagnostics.
+ */
+const char *type_name(int id, char *buffer, size_t size) {
+  static const char *basic[] = {"<error>", "void", "char", "int", "float"};
+  const Type *type = type_get(id);
+  char inner[128];
+
+  switch (type->kind) {
+  case TYPE_POINTER:
+    snprintf(buffer, size, "%s *", type_name(type->base, inner, sizeof inner));
+    break;
+  case TYPE_FUNCTION: {
+    int used = snprintf(buffer, size, "%s (",
+                        type_name(type->base, inner, sizeof inner));
+    for (int i = 0; i < type->param_count && used < (int)size; i++) {
+      used += snprintf(buffer + used, size - used, "%s%s", i ? ", " : "",
+                       type_name(type->params[i], inner, sizeof inner));
+    }
+    if (used < (int)size) {
+      snprintf(buffer + used, size - used, ")");
+    }
+    break;
+  }
+  default:
+    snprintf(buffer, size, "%s", basic[type->kind]);
+    break;
+  }
+  return buffer;
+}
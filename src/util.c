@@ -0,0 +1,69 @@
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Allocation and timing helpers shared by every pass. Running out of memory
+ * is not recovered from: the helpers report it and exit.
+ */
+
+static void *check(void *memory) {
+  if (memory == NULL) {
+    fprintf(stderr, "Memory allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+  return memory;
+}
+
+/**
+ * @brief Allocates an uninitialized array of `count` elements of `size`
+ * bytes. An empty array still gets a distinct allocation.
+ */
+void *allocate(size_t count, size_t size) {
+  return check(malloc((count ? count : 1) * size));
+}
+
+/**
+ * @brief Allocates a zeroed array of `count` elements of `size` bytes.
+ */
+void *allocate_zeroed(size_t count, size_t size) {
+  return check(calloc(count ? count : 1, size));
+}
+
+/**
+ * @brief Resizes `array` to `count` elements of `size` bytes, moving it if
+ * need be.
+ */
+void *reallocate(void *array, size_t count, size_t size) {
+  return check(realloc(array, (count ? count : 1) * size));
+}
+
+/**
+ * @brief Returns a copy of `string` in its own allocation.
+ */
+char *duplicate(const char *string) { return check(strdup(string)); }
+
+/**
+ * @brief Doubles the capacity of `array`, of `*capacity` elements of
+ * `element_size` bytes, or gives an empty one room for `minimum`.
+ *
+ * @return The moved array; `*capacity` is updated.
+ */
+void *grow(void *array, size_t element_size, uint32_t *capacity,
+           uint32_t minimum) {
+  uint32_t new_capacity = *capacity ? *capacity * 2 : minimum;
+  array = reallocate(array, new_capacity, element_size);
+  *capacity = new_capacity;
+  return array;
+}
+
+/**
+ * @brief Returns the time of a monotonic clock, in seconds.
+ */
+double now(void) {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec * 1e-9;
+}
@@ -0,0 +1,325 @@
+#include "x86_encoder.h"
+#include "util.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Self-test for the encoder. Encodes every supported instruction form over
+ * all register combinations and a spread of addressing modes, records the
+ * Intel syntax objdump should print for each, then disassembles the buffer
+ * with objdump and compares instruction by instruction.
+ */
+
+typedef struct {
+  uint32_t offset;
+  char text[64];
+} Expectation;
+
+typedef struct {
+  Assembler assembler;
+  Expectation *expected;
+  uint32_t count;
+  uint32_t capacity;
+  uint32_t start; // Offset of the instruction being recorded
+} Check;
+
+static const char *names32[NUM_REGISTERS] = {
+    "eax", "ecx", "edx", "ebx", "esp", "ebp", "esi",  "edi",
+    "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d",
+};
+
+static const char *names8[NUM_REGISTERS] = {
+    "al",  "cl",  "dl",   "bl",   "spl",  "bpl",  "sil",  "dil",
+    "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b",
+};
+
+static const char *alu_names[8] = {"add", "or", NULL, NULL,
+                                   "and", "sub", "xor", "cmp"};
+
+static const char *condition_names[16] = {
+    "o", "no", "b", "ae", "e", "ne", "be", "a",
+    "s", "ns", "p", "np", "l", "ge", "le", "g",
+};
+
+static const char *name(int wide, int reg) {
+  return wide ? register_names[reg] : names32[reg];
+}
+
+static void begin(Check *check) { check->start = check->assembler.size; }
+
+static void expect(Check *check, const char *format, ...) {
+  if (check->count == check->capacity) {
+    check->expected =
+        grow(check->expected, sizeof(Expectation), &check->capacity, 1024);
+  }
+  Expectation *expectation = &check->expected[check->count++];
+  expectation->offset = check->start;
+  va_list arguments;
+  va_start(arguments, format);
+  vsnprintf(expectation->text, sizeof(expectation->text), format, arguments);
+  va_end(arguments);
+}
+
+static void format_memory(char *buffer, size_t size, Memory m) {
+  int length = snprintf(buffer, size, "[%s", register_names[m.base]);
+  if (m.index != REG_NONE) {
+    length += snprintf(buffer + length, size - length, "+%s*%d",
+                       register_names[m.index], m.scale);
+  }
+  // objdump shows the displacement whenever one is encoded
+  if (m.disp != 0 || (m.base & 7) == REG_RBP) {
+    length += snprintf(buffer + length, size - length, "%c0x%x",
+                       m.disp < 0 ? '-' : '+',
+                       m.disp < 0 ? -(unsigned)m.disp : (unsigned)m.disp);
+  }
+  snprintf(buffer + length, size - length, "]");
+}
+
+static void check_register_forms(Check *check) {
+  Assembler *a = &check->assembler;
+  static const AluOp alu_ops[] = {ALU_ADD, ALU_OR,  ALU_AND,
+                                  ALU_SUB, ALU_XOR, ALU_CMP};
+
+  for (int d = 0; d < NUM_REGISTERS; d++) {
+    for (int s = 0; s < NUM_REGISTERS; s++) {
+      for (int wide = 0; wide <= 1; wide++) {
+        begin(check), x86_mov_rr(a, wide, d, s);
+        expect(check, "mov %s,%s", name(wide, d), name(wide, s));
+        for (size_t i = 0; i < sizeof(alu_ops) / sizeof(alu_ops[0]); i++) {
+          begin(check), x86_alu_rr(a, alu_ops[i], wide, d, s);
+          expect(check, "%s %s,%s", alu_names[alu_ops[i]], name(wide, d),
+                 name(wide, s));
+        }
+        begin(check), x86_imul_rr(a, wide, d, s);
+        expect(check, "imul %s,%s", name(wide, d), name(wide, s));
+        begin(check), x86_test_rr(a, wide, d, s);
+        expect(check, "test %s,%s", name(wide, d), name(wide, s));
+        begin(check), x86_imul_rri(a, wide, d, s, 10);
+        expect(check, "imul %s,%s,0xa", name(wide, d), name(wide, s));
+        begin(check), x86_imul_rri(a, wide, d, s, 1000);
+        expect(check, "imul %s,%s,0x3e8", name(wide, d), name(wide, s));
+      }
+      begin(check), x86_movzx_r8(a, d, s);
+      expect(check, "movzx %s,%s", names32[d], names8[s]);
+    }
+  }
+
+  for (int r = 0; r < NUM_REGISTERS; r++) {
+    begin(check), x86_mov_ri(a, r, 5);
+    expect(check, "mov %s,0x5", names32[r]);
+    for (int wide = 0; wide <= 1; wide++) {
+      for (size_t i = 0; i < sizeof(alu_ops) / sizeof(alu_ops[0]); i++) {
+        begin(check), x86_alu_ri(a, alu_ops[i], wide, r, 5);
+        expect(check, "%s %s,0x5", alu_names[alu_ops[i]], name(wide, r));
+        begin(check), x86_alu_ri(a, alu_ops[i], wide, r, 1000);
+        expect(check, "%s %s,0x3e8", alu_names[alu_ops[i]], name(wide, r));
+      }
+      begin(check), x86_shift_ri(a, SHIFT_SHL, wide, r, 3);
+      expect(check, "shl %s,0x3", name(wide, r));
+      begin(check), x86_shift_ri(a, SHIFT_SHR, wide, r, 3);
+      expect(check, "shr %s,0x3", name(wide, r));
+      begin(check), x86_shift_ri(a, SHIFT_SAR, wide, r, 3);
+      expect(check, "sar %s,0x3", name(wide, r));
+      begin(check), x86_idiv_r(a, wide, r);
+      expect(check, "idiv %s", name(wide, r));
+    }
+    for (int cc = 0; cc < 16; cc++) {
+      begin(check), x86_setcc(a, cc, r);
+      expect(check, "set%s %s", condition_names[cc], names8[r]);
+    }
+    begin(check), x86_push_r(a, r);
+    expect(check, "push %s", register_names[r]);
+    begin(check), x86_pop_r(a, r);
+    expect(check, "pop %s", register_names[r]);
+  }
+
+  begin(check), x86_sign_extend_ax(a, 0);
+  expect(check, "cdq");
+  begin(check), x86_sign_extend_ax(a, 1);
+  expect(check, "cqo");
+  begin(check), x86_ret(a);
+  expect(check, "ret");
+  begin(check), x86_syscall(a);
+  expect(check, "syscall");
+}
+
+static void check_memory_forms(Check *check) {
+  Assembler *a = &check->assembler;
+  static const int32_t displacements[] = {0, 8, -8, 1000, -1000};
+  char memory[64];
+
+  for (int base = 0; base < NUM_REGISTERS; base++) {
+    for (int variant = 0; variant < 7; variant++) {
+      Memory m = x86_memory(base, displacements[variant % 5]);
+      if (variant >= 5) {
+        m.index = variant == 5 ? REG_R12 : REG_RBP;
+        m.scale = variant == 5 ? 4 : 8;
+      }
+      format_memory(memory, sizeof(memory), m);
+
+      for (int wide = 0; wide <= 1; wide++) {
+        const char *size = wide ? "QWORD PTR" : "DWORD PTR";
+        int reg = (base * 7 + variant) % NUM_REGISTERS;
+        begin(check), x86_mov_rm(a, wide, reg, m);
+        expect(check, "mov %s,%s %s", name(wide, reg), size, memory);
+        begin(check), x86_mov_mr(a, wide, m, reg);
+        expect(check, "mov %s %s,%s", size, memory, name(wide, reg));
+        begin(check), x86_alu_rm(a, ALU_SUB, wide, reg, m);
+        expect(check, "sub %s,%s %s", name(wide, reg), size, memory);
+        begin(check), x86_alu_mr(a, ALU_ADD, wide, m, reg);
+        expect(check, "add %s %s,%s", size, memory, name(wide, reg));
+        begin(check), x86_alu_mi(a, ALU_CMP, wide, m, 5);
+        expect(check, "cmp %s %s,0x5", size, memory);
+        begin(check), x86_alu_mi(a, ALU_XOR, wide, m, 1000);
+        expect(check, "xor %s %s,0x3e8", size, memory);
+      }
+      begin(check), x86_lea(a, base, m);
+      expect(check, "lea %s,%s", register_names[base], memory);
+      begin(check), x86_push_m(a, m);
+      expect(check, "push QWORD PTR %s", memory);
+      begin(check), x86_pop_m(a, m);
+      expect(check, "pop QWORD PTR %s", memory);
+    }
+  }
+
+  begin(check), x86_mov_rm(a, 0, REG_R9, x86_global(0));
+  expect(check, "mov r9d,DWORD PTR [rip+0x0]");
+  begin(check), x86_mov_mr(a, 0, x86_global(0), REG_RBX);
+  expect(check, "mov DWORD PTR [rip+0x0],ebx");
+  begin(check), x86_alu_mi(a, ALU_ADD, 0, x86_global(0), 1000);
+  expect(check, "add DWORD PTR [rip+0x0],0x3e8");
+}
+
+static void check_branches(Check *check) {
+  Assembler *a = &check->assembler;
+  uint32_t backward = x86_new_label(a);
+  uint32_t forward = x86_new_label(a);
+  x86_bind_label(a, backward);
+  uint32_t backward_offset = a->size;
+
+  begin(check), x86_jmp(a, backward);
+  expect(check, "jmp 0x%x", backward_offset);
+  for (int cc = 0; cc < 16; cc++) {
+    begin(check), x86_jcc(a, cc, backward);
+    expect(check, "j%s 0x%x", condition_names[cc], backward_offset);
+  }
+  uint32_t first_forward = check->count;
+  begin(check), x86_jmp(a, forward);
+  expect(check, "jmp ");
+  for (int cc = 0; cc < 16; cc++) {
+    begin(check), x86_jcc(a, cc, forward);
+    expect(check, "j%s ", condition_names[cc]);
+  }
+  begin(check), x86_call(a, 0);
+  expect(check, "call 0x%x", (unsigned)a->size);
+
+  x86_bind_label(a, forward);
+  x86_resolve_labels(a);
+  for (uint32_t i = first_forward; i < first_forward + 17; i++) {
+    size_t length = strlen(check->expected[i].text);
+    snprintf(check->expected[i].text + length,
+             sizeof(check->expected[i].text) - length, "0x%x",
+             (unsigned)a->size);
+  }
+}
+
+/* Collapses runs of blanks and drops objdump's trailing `# address`
+ * comments. */
+static void normalize(char *text) {
+  char *comment = strchr(text, '#');
+  if (comment != NULL) {
+    *comment = '\0';
+  }
+  char *out = text;
+  int blank = 1;
+  for (char *p = text; *p != '\0'; p++) {
+    if (*p == ' ' || *p == '\t' || *p == '\n') {
+      if (!blank) {
+        *out++ = ' ';
+      }
+      blank = 1;
+    } else {
+      *out++ = *p;
+      blank = 0;
+    }
+  }
+  if (out > text && out[-1] == ' ') {
+    out--;
+  }
+  *out = '\0';
+}
+
+/**
+ * @brief Checks the encoder against objdump.
+ *
+ * @return The number of mismatching instructions, or -1 if objdump could not
+ * be run.
+ */
+int check_encoding(void) {
+  Check check = {0};
+  assembler_init(&check.assembler);
+  check_register_forms(&check);
+  check_memory_forms(&check);
+  check_branches(&check);
+
+  char path[] = "/tmp/encodingXXXXXX";
+  int descriptor = mkstemp(path);
+  if (descriptor < 0 ||
+      write(descriptor, check.assembler.bytes, check.assembler.size) !=
+          (ssize_t)check.assembler.size) {
+    perror("Cannot write the encoding check");
+    return -1;
+  }
+  close(descriptor);
+
+  char command[128];
+  snprintf(command, sizeof(command),
+           "objdump -D -b binary -m i386:x86-64 -M intel %s", path);
+  FILE *disassembly = popen(command, "r");
+  if (disassembly == NULL) {
+    perror("Cannot run objdump");
+    unlink(path);
+    return -1;
+  }
+
+  int mismatches = 0;
+  uint32_t next = 0;
+  char line[256];
+  while (fgets(line, sizeof(line), disassembly) != NULL) {
+    // "   offset:\tbytes\tinstruction"; long encodings continue on a line
+    // without an instruction
+    char *bytes = strchr(line, '\t');
+    char *text = bytes != NULL ? strchr(bytes + 1, '\t') : NULL;
+    if (text == NULL) {
+      continue;
+    }
+    uint32_t offset = (uint32_t)strtoul(line, NULL, 16);
+    normalize(++text);
+    if (next < check.count && check.expected[next].offset == offset) {
+      if (strcmp(text, check.expected[next].text) != 0) {
+        fprintf(stderr, "0x%x: expected '%s', objdump says '%s'\n", offset,
+                check.expected[next].text, text);
+        mismatches++;
+      }
+      next++;
+    } else {
+      fprintf(stderr, "0x%x: unexpected instruction '%s'\n", offset, text);
+      mismatches++;
+    }
+  }
+  pclose(disassembly);
+  unlink(path);
+
+  if (next != check.count) {
+    fprintf(stderr, "objdump decoded %u of %u instructions\n", next,
+            check.count);
+    mismatches += check.count - next;
+  }
+  printf("%u instructions checked, %d mismatches\n", check.count, mismatches);
+  free(check.expected);
+  assembler_free(&check.assembler);
+  return mismatches;
+}
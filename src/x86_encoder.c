@@ -0,0 +1,301 @@
+#include "x86_encoder.h"
+#include "util.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * x86-64 instruction encoder. Every instruction is an optional REX prefix,
+ * one to three opcode bytes, a ModRM byte selecting a register or memory
+ * operand, and for memory operands an optional SIB byte and displacement.
+ * Jumps always use 32-bit displacements: targets that are not yet bound are
+ * recorded as fixups and patched by x86_resolve_labels.
+ */
+
+void assembler_init(Assembler *assembler) {
+  memset(assembler, 0, sizeof(Assembler));
+}
+
+void assembler_free(Assembler *assembler) {
+  free(assembler->bytes);
+  free(assembler->relocations);
+  free(assembler->labels);
+  free(assembler->fixups);
+}
+
+static void emit_byte(Assembler *a, uint8_t byte) {
+  if (a->size == a->capacity) {
+    a->capacity = a->capacity ? a->capacity * 2 : 4096;
+    a->bytes = reallocate(a->bytes, a->capacity, 1);
+  }
+  a->bytes[a->size++] = byte;
+}
+
+static void emit_u32(Assembler *a, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    emit_byte(a, (uint8_t)(value >> (8 * i)));
+  }
+}
+
+static void patch_u32(Assembler *a, size_t offset, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    a->bytes[offset + i] = (uint8_t)(value >> (8 * i));
+  }
+}
+
+static void add_relocation(Assembler *a, RelocationKind kind, uint32_t symbol,
+                           int32_t addend) {
+  if (a->relocation_count == a->relocation_capacity) {
+    a->relocations =
+        grow(a->relocations, sizeof(Relocation), &a->relocation_capacity, 16);
+  }
+  a->relocations[a->relocation_count++] =
+      (Relocation){(uint32_t)a->size, kind, symbol, addend};
+}
+
+static int fits_int8(int32_t value) { return value >= -128 && value <= 127; }
+
+/* REX is 0100WRXB: W selects 64-bit operands and R, X and B extend the ModRM
+ * reg, SIB index and ModRM rm or SIB base fields. Byte operations need a REX
+ * prefix, even an empty one, to address spl, bpl, sil and dil. */
+static void emit_rex(Assembler *a, int wide, int reg, int index, int base,
+                     int force) {
+  uint8_t rex = 0x40 | (wide ? 8 : 0) | ((reg >> 3) & 1) << 2 |
+                ((index >> 3) & 1) << 1 | ((base >> 3) & 1);
+  if (rex != 0x40 || force) {
+    emit_byte(a, rex);
+  }
+}
+
+static void emit_opcode(Assembler *a, uint32_t opcode, int length) {
+  for (int i = length - 1; i >= 0; i--) {
+    emit_byte(a, (uint8_t)(opcode >> (8 * i)));
+  }
+}
+
+/* `reg` is a register or an opcode extension; `rm` a register, which is a
+ * byte register when `byte_rm` is set. */
+static void encode_rr(Assembler *a, uint32_t opcode, int length, int wide,
+                      int reg, int rm, int byte_rm) {
+  emit_rex(a, wide, reg, 0, rm, byte_rm && rm >= 4 && rm < 8);
+  emit_opcode(a, opcode, length);
+  emit_byte(a, 0xC0 | (reg & 7) << 3 | (rm & 7));
+}
+
+/* `trailing` is the number of immediate bytes that follow the operand, which
+ * a RIP-relative displacement is relative to as well. */
+static void encode_rm(Assembler *a, uint32_t opcode, int length, int wide,
+                      int reg, Memory m, int trailing) {
+  if (m.base == REG_RIP) {
+    emit_rex(a, wide, reg, 0, 0, 0);
+    emit_opcode(a, opcode, length);
+    emit_byte(a, (reg & 7) << 3 | 5);
+    add_relocation(a, RELOC_GLOBAL, m.global, m.disp - 4 - trailing);
+    emit_u32(a, 0);
+    return;
+  }
+
+  // rm = 100 means a SIB byte follows, and mod = 00 with base 101 means
+  // RIP-relative, so rbp and r13 always carry a displacement
+  int index = m.index == REG_NONE ? 0 : m.index;
+  int needs_sib = m.index != REG_NONE || (m.base & 7) == REG_RSP;
+  int mod;
+  if (m.disp == 0 && (m.base & 7) != REG_RBP) {
+    mod = 0;
+  } else if (fits_int8(m.disp)) {
+    mod = 1;
+  } else {
+    mod = 2;
+  }
+
+  emit_rex(a, wide, reg, index, m.base, 0);
+  emit_opcode(a, opcode, length);
+  emit_byte(a, mod << 6 | (reg & 7) << 3 | (needs_sib ? 4 : m.base & 7));
+  if (needs_sib) {
+    int scale = m.scale == 8 ? 3 : m.scale == 4 ? 2 : m.scale == 2 ? 1 : 0;
+    int index_bits = m.index == REG_NONE ? 4 : m.index & 7;
+    emit_byte(a, scale << 6 | index_bits << 3 | (m.base & 7));
+  }
+  if (mod == 1) {
+    emit_byte(a, (uint8_t)m.disp);
+  } else if (mod == 2) {
+    emit_u32(a, (uint32_t)m.disp);
+  }
+}
+
+uint32_t x86_new_label(Assembler *a) {
+  if (a->label_count == a->label_capacity) {
+    a->labels = grow(a->labels, sizeof(uint32_t), &a->label_capacity, 16);
+  }
+  a->labels[a->label_count] = LABEL_UNBOUND;
+  return a->label_count++;
+}
+
+void x86_bind_label(Assembler *a, uint32_t label) {
+  a->labels[label] = (uint32_t)a->size;
+}
+
+static void emit_label_rel32(Assembler *a, uint32_t label) {
+  if (a->labels[label] != LABEL_UNBOUND) {
+    emit_u32(a, a->labels[label] - (uint32_t)(a->size + 4));
+    return;
+  }
+  if (a->fixup_count == a->fixup_capacity) {
+    a->fixups = grow(a->fixups, sizeof(LabelFixup), &a->fixup_capacity, 16);
+  }
+  a->fixups[a->fixup_count++] = (LabelFixup){(uint32_t)a->size, label};
+  emit_u32(a, 0);
+}
+
+/**
+ * @brief Patches every jump to a label that was bound after the jump.
+ *
+ * @return The number of jumps to labels that were never bound.
+ */
+int x86_resolve_labels(Assembler *a) {
+  int unresolved = 0;
+  for (uint32_t i = 0; i < a->fixup_count; i++) {
+    const LabelFixup *fixup = &a->fixups[i];
+    if (a->labels[fixup->label] == LABEL_UNBOUND) {
+      unresolved++;
+      continue;
+    }
+    patch_u32(a, fixup->offset, a->labels[fixup->label] - (fixup->offset + 4));
+  }
+  a->fixup_count = 0;
+  return unresolved;
+}
+
+void x86_mov_rr(Assembler *a, int wide, int dst, int src) {
+  encode_rr(a, 0x89, 1, wide, src, dst, 0);
+}
+
+/* Writing a 32-bit register clears the upper half, so this also loads any
+ * non-negative 64-bit value below 2^32. */
+void x86_mov_ri(Assembler *a, int dst, int32_t imm) {
+  emit_rex(a, 0, 0, 0, dst, 0);
+  emit_byte(a, 0xB8 + (dst & 7));
+  emit_u32(a, (uint32_t)imm);
+}
+
+void x86_mov_rm(Assembler *a, int wide, int dst, Memory src) {
+  encode_rm(a, 0x8B, 1, wide, dst, src, 0);
+}
+
+void x86_mov_mr(Assembler *a, int wide, Memory dst, int src) {
+  encode_rm(a, 0x89, 1, wide, src, dst, 0);
+}
+
+void x86_lea(Assembler *a, int dst, Memory src) {
+  encode_rm(a, 0x8D, 1, 1, dst, src, 0);
+}
+
+void x86_alu_rr(Assembler *a, AluOp op, int wide, int dst, int src) {
+  encode_rr(a, op * 8 + 1, 1, wide, src, dst, 0);
+}
+
+void x86_alu_ri(Assembler *a, AluOp op, int wide, int dst, int32_t imm) {
+  if (fits_int8(imm)) {
+    encode_rr(a, 0x83, 1, wide, op, dst, 0);
+    emit_byte(a, (uint8_t)imm);
+  } else {
+    encode_rr(a, 0x81, 1, wide, op, dst, 0);
+    emit_u32(a, (uint32_t)imm);
+  }
+}
+
+void x86_alu_rm(Assembler *a, AluOp op, int wide, int dst, Memory src) {
+  encode_rm(a, op * 8 + 3, 1, wide, dst, src, 0);
+}
+
+void x86_alu_mr(Assembler *a, AluOp op, int wide, Memory dst, int src) {
+  encode_rm(a, op * 8 + 1, 1, wide, src, dst, 0);
+}
+
+void x86_alu_mi(Assembler *a, AluOp op, int wide, Memory dst, int32_t imm) {
+  if (fits_int8(imm)) {
+    encode_rm(a, 0x83, 1, wide, op, dst, 1);
+    emit_byte(a, (uint8_t)imm);
+  } else {
+    encode_rm(a, 0x81, 1, wide, op, dst, 4);
+    emit_u32(a, (uint32_t)imm);
+  }
+}
+
+void x86_imul_rr(Assembler *a, int wide, int dst, int src) {
+  encode_rr(a, 0x0FAF, 2, wide, dst, src, 0);
+}
+
+void x86_imul_rri(Assembler *a, int wide, int dst, int src, int32_t imm) {
+  if (fits_int8(imm)) {
+    encode_rr(a, 0x6B, 1, wide, dst, src, 0);
+    emit_byte(a, (uint8_t)imm);
+  } else {
+    encode_rr(a, 0x69, 1, wide, dst, src, 0);
+    emit_u32(a, (uint32_t)imm);
+  }
+}
+
+void x86_shift_ri(Assembler *a, ShiftOp op, int wide, int dst, uint8_t imm) {
+  encode_rr(a, 0xC1, 1, wide, op, dst, 0);
+  emit_byte(a, imm);
+}
+
+void x86_idiv_r(Assembler *a, int wide, int src) {
+  encode_rr(a, 0xF7, 1, wide, 7, src, 0);
+}
+
+/* cdq, or cqo when wide: sign-extends eax into edx:eax before a division. */
+void x86_sign_extend_ax(Assembler *a, int wide) {
+  emit_rex(a, wide, 0, 0, 0, 0);
+  emit_byte(a, 0x99);
+}
+
+void x86_test_rr(Assembler *a, int wide, int dst, int src) {
+  encode_rr(a, 0x85, 1, wide, src, dst, 0);
+}
+
+void x86_setcc(Assembler *a, ConditionCode cc, int dst) {
+  encode_rr(a, 0x0F90 | cc, 2, 0, 0, dst, 1);
+}
+
+void x86_movzx_r8(Assembler *a, int dst, int src) {
+  encode_rr(a, 0x0FB6, 2, 0, dst, src, 1);
+}
+
+void x86_push_r(Assembler *a, int reg) {
+  emit_rex(a, 0, 0, 0, reg, 0);
+  emit_byte(a, 0x50 + (reg & 7));
+}
+
+void x86_pop_r(Assembler *a, int reg) {
+  emit_rex(a, 0, 0, 0, reg, 0);
+  emit_byte(a, 0x58 + (reg & 7));
+}
+
+void x86_push_m(Assembler *a, Memory src) {
+  encode_rm(a, 0xFF, 1, 0, 6, src, 0);
+}
+
+void x86_pop_m(Assembler *a, Memory dst) {
+  encode_rm(a, 0x8F, 1, 0, 0, dst, 0);
+}
+
+void x86_jmp(Assembler *a, uint32_t label) {
+  emit_byte(a, 0xE9);
+  emit_label_rel32(a, label);
+}
+
+void x86_jcc(Assembler *a, ConditionCode cc, uint32_t label) {
+  emit_opcode(a, 0x0F80 | cc, 2);
+  emit_label_rel32(a, label);
+}
+
+void x86_call(Assembler *a, unsigned int callee) {
+  emit_byte(a, 0xE8);
+  add_relocation(a, RELOC_CALL, callee, -4);
+  emit_u32(a, 0);
+}
+
+void x86_ret(Assembler *a) { emit_byte(a, 0xC3); }
+
+void x86_syscall(Assembler *a) { emit_opcode(a, 0x0F05, 2); }
@@ -0,0 +1,126 @@
+# Prints a random program of the subset the compiler accepts, built from the
+# seed given as the only argument. Arithmetic can overflow, so it is compared
+# with gcc -fwrapv. Loops are bounded and divisors are nonzero constants other
+# than -1, so every program ends without trapping. Only main assigns globals:
+# the order in which the operands of an expression are evaluated is
+# unspecified, so a call that changes a global read beside it could give
+# either result.
+
+import random
+import sys
+
+CONSTANTS = [0, 1, 2, 3, 4, 5, 7, 8, 16, 32, 100, 1000]
+DIVISORS = ["1", "2", "3", "7", "(0 - 3)", "(2 + 3)"]
+OPERATORS = ["+", "-", "*", "+", "*", "<", "==", ">=", "!=", "<=", ">"]
+COMPARISONS = ["<", "==", ">=", "!=", "<=", ">"]
+MAX_LOOP_DEPTH = 6
+
+
+def expression(names, depth, functions):
+    r = random.random()
+    if depth == 0 or r < 0.25:
+        if random.random() < 0.5:
+            return random.choice(names)
+        return str(random.choice(CONSTANTS))
+    if r < 0.33 and functions:
+        name, arity = random.choice(functions)
+        arguments = [expression(names, depth - 1, functions)
+                     for _ in range(arity)]
+        return "%s(%s)" % (name, ", ".join(arguments))
+    if random.random() < 0.1:
+        return "(%s %s %s)" % (expression(names, depth - 1, functions),
+                               random.choice(["/", "%"]),
+                               random.choice(DIVISORS))
+    return "(%s %s %s)" % (expression(names, depth - 1, functions),
+                           random.choice(OPERATORS),
+                           expression(names, depth - 1, functions))
+
+
+class Generator:
+    def __init__(self):
+        self.loop_depth = 0
+        self.loop_count = 0
+
+    def loop(self, names, locals, depth, functions, indent):
+        counter = self.loop_count
+        self.loop_count += 1
+        self.loop_depth += 1
+        limit = random.randint(0, 4)
+        out = []
+        if random.random() < 0.5:
+            name = "i%d" % counter
+            out.append(indent + "for (int %s = 0; %s < %d; %s = %s + 1) {"
+                       % (name, name, limit, name, name))
+            out += self.block(names + [name], locals, depth - 1, functions,
+                              indent + "  ")
+        else:
+            name = "w%d" % counter
+            out.append(indent + "int %s = 0;" % name)
+            out.append(indent + "while (%s < %d) {" % (name, limit))
+            out += self.block(names + [name], locals, depth - 1, functions,
+                              indent + "  ")
+            out.append(indent + "  %s = %s + 1;" % (name, name))
+        out.append(indent + "}")
+        self.loop_depth -= 1
+        return out
+
+    def block(self, names, locals, depth, functions, indent):
+        out = []
+        for _ in range(random.randint(1, 4)):
+            r = random.random()
+            if r < 0.35 and depth > 0 and self.loop_depth < MAX_LOOP_DEPTH:
+                out += self.loop(names, locals, depth, functions, indent)
+            elif r < 0.5 and depth > 0:
+                out.append(indent + "if (%s %s %s) {"
+                           % (expression(names, 2, functions),
+                              random.choice(COMPARISONS),
+                              expression(names, 2, functions)))
+                out += self.block(names, locals, depth - 1, functions,
+                                  indent + "  ")
+                out.append(indent + "} else {")
+                out += self.block(names, locals, depth - 1, functions,
+                                  indent + "  ")
+                out.append(indent + "}")
+            else:
+                out.append(indent + "%s = %s;"
+                           % (random.choice(locals),
+                              expression(names, 3, functions)))
+        return out
+
+
+def program():
+    generator = Generator()
+    lines = ["int g0 = 3;", "int g1 = 11;"]
+    functions = []
+    for i in range(4):
+        arity = random.randint(1, 7)
+        parameters = ["p%d" % j for j in range(arity)]
+        locals = ["l%d" % j for j in range(random.randint(1, 5))]
+        names = parameters + locals + ["g0", "g1"]
+        lines.append("int f%d(%s) {"
+                     % (i, ", ".join("int " + p for p in parameters)))
+        for name in locals:
+            lines.append("  int %s = %s;"
+                         % (name, expression(parameters + ["g0"], 2,
+                                             functions)))
+        lines += generator.block(names, locals, 3, functions, "  ")
+        lines.append("  return %s;" % expression(names, 3, functions))
+        lines.append("}")
+        functions.append(("f%d" % i, arity))
+    lines.append("int main() {")
+    lines.append("  int s = 0;")
+    for name, arity in functions:
+        arguments = [str(random.randint(0, 20)) for _ in range(arity)]
+        lines.append("  s = s * 31 + %s(%s);" % (name, ", ".join(arguments)))
+        lines.append("  g%d = %s;"
+                     % (random.randint(0, 1),
+                        expression(["s", "g0", "g1"], 2, [])))
+    lines.append("  s = s + g0 * 7 + g1;")
+    lines.append("  return ((s % 256) + 256) % 256;")
+    lines.append("}")
+    return "\n".join(lines)
+
+
+if __name__ == "__main__":
+    random.seed(int(sys.argv[1]))
+    print(program())
@@ -0,0 +1,15 @@
+int mix(int a, int b, int c, int d, int e, int f, int g, int h) {
+  return a - b * 2 + c * 3 - d * 4 + e * 5 - f * 6 + g * 7 - h * 8;
+}
+
+int twice(int a, int b, int c, int d, int e, int f, int g, int h) {
+  return mix(h, g, f, e, d, c, b, a) + mix(a, b, c, d, e, f, g, h);
+}
+
+int main() {
+  int total = 0;
+  for (int i = 0; i < 10; i = i + 1) {
+    total = total + twice(i, i + 1, i + 2, 3, 4, i * i, 6, 7);
+  }
+  return (total % 256 + 256) % 256;
+}
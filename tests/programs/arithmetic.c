@@ -0,0 +1,15 @@
+int wrap(int x) {
+  int y = x * 65536;
+  return y * 65536 + x;
+}
+
+int main() {
+  int a = 0 - 17;
+  int b = 5;
+  int r = a / b * 100 + a % b * 10 + (a < b) + (a >= b) * 2;
+  r = r + (1000000 * 3000) / 7 % 100;
+  r = r + wrap(12);
+  char c = 'A';
+  c = c + 2;
+  return ((r + c) % 256 + 256) % 256;
+}
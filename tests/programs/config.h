@@ -0,0 +1,7 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#define LIMIT 12
+#define SCALE 3
+
+#endif
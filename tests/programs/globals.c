@@ -0,0 +1,19 @@
+int counter;
+int step = 3;
+int counter;
+
+int advance(int times) {
+  int i = 0;
+  while (i < times) {
+    counter = counter + step;
+    i = i + 1;
+  }
+  return counter;
+}
+
+int main() {
+  advance(4);
+  step = 5;
+  advance(2);
+  return counter;
+}
@@ -0,0 +1,20 @@
+#include "config.h"
+#include "config.h"
+
+#ifdef LIMIT
+int limit = LIMIT;
+#else
+int limit = 1;
+#endif
+
+#ifndef SCALE
+#define SCALE 100
+#endif
+
+int main() {
+  int total = 0;
+  for (int i = 0; i < limit; i = i + 1) {
+    total = total + i * SCALE;
+  }
+  return total % 256;
+}
@@ -0,0 +1,23 @@
+int is_prime(int n) {
+  if (n < 2) {
+    return 0;
+  }
+  for (int d = 2; d * d <= n; d = d + 1) {
+    if (n % d == 0) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+int main() {
+  int count = 0;
+  int sum = 0;
+  for (int n = 0; n < 500; n = n + 1) {
+    if (is_prime(n)) {
+      count = count + 1;
+      sum = sum + n;
+    }
+  }
+  return (count * 7 + sum) % 256;
+}
@@ -0,0 +1,292 @@
+#!/bin/sh
+# Compiles the programs in tests/programs, and programs generated by
+# tests/gen.py, with the compiler and with gcc, runs both and compares their
+# exit status and output. Each program is built as a static executable, as
+# an object linked by gcc, under the JIT and on the interpreter, with and
+# without optimization, and run under the JIT with its bodies parsed lazily
+# and with its functions compiled and freed one at a time (--stream), and
+# with identical pure expressions shared.
+# The x86 encoder is checked against objdump first, and a program long
+# enough to be parsed in several chunks must parse the same on one thread
+# and on four. The other modes are checked on small inputs at the end.
+#
+# Usage: tests/run.sh [compiler] [generated programs]
+
+compiler=${1:-./main}
+count=${2:-200}
+tests=$(dirname "$0")
+work=$(mktemp -d) || exit 1
+trap 'rm -rf "$work"' EXIT
+failures=0
+
+fail() {
+  echo "FAIL: $*"
+  failures=$((failures + 1))
+}
+
+# Runs the command and stores its exit status and output in $status and
+# $work/out.
+run() {
+  timeout 10 "$@" > "$work/out" 2>> "$work/errors"
+  status=$?
+}
+
+# Fails with `$1` unless $work/out holds the lines given after it.
+expect() {
+  label=$1
+  shift
+  printf '%s\n' "$@" > "$work/expected.out"
+  if ! cmp -s "$work/out" "$work/expected.out"; then
+    fail "$label: printed '$(cat "$work/out")'"
+  fi
+}
+
+# Compares every way of running `$1` with the gcc build.
+check_program() {
+  source=$1
+  if ! gcc -w -O0 -fwrapv "$source" -o "$work/expected" 2>> "$work/errors"
+  then
+    fail "$source: gcc cannot build it"
+    return
+  fi
+  run "$work/expected"
+  expected_status=$status
+  mv "$work/out" "$work/expected.out"
+
+  for mode in "--run" "-O0 --run" "--interp" "--pipeline --run" \
+              "--lazy --run" "--stream --run" "--share-expressions --run"; do
+    run "$compiler" $mode "$source"
+    if [ $status -ne $expected_status ] ||
+       ! cmp -s "$work/out" "$work/expected.out"; then
+      fail "$source: $mode exits with $status, gcc's with $expected_status"
+    fi
+  done
+
+  for options in "" "-O0"; do
+    rm -f "$work/program"
+    if ! "$compiler" $options -o "$work/program" "$source" 2>> "$work/errors"
+    then
+      fail "$source: $options -o does not build"
+      continue
+    fi
+    run "$work/program"
+    if [ $status -ne $expected_status ] ||
+       ! cmp -s "$work/out" "$work/expected.out"; then
+      fail "$source: $options -o exits with $status, gcc's with" \
+           "$expected_status"
+    fi
+  done
+
+  rm -f "$work/program"
+  if ! "$compiler" -c -o "$work/program.o" "$source" 2>> "$work/errors" ||
+     ! gcc "$work/program.o" -o "$work/program" 2>> "$work/errors"; then
+    fail "$source: -c -o does not link with gcc"
+    return
+  fi
+  run "$work/program"
+  if [ $status -ne $expected_status ] ||
+     ! cmp -s "$work/out" "$work/expected.out"; then
+    fail "$source: -c -o exits with $status, gcc's with $expected_status"
+  fi
+}
+
+if command -v objdump > /dev/null; then
+  "$compiler" --check-encoding > /dev/null || fail "--check-encoding"
+else
+  echo "objdump not found, skipping --check-encoding"
+fi
+
+for source in "$tests"/programs/*.c "$tests/../input.c"; do
+  check_program "$source"
+done
+
+if command -v python3 > /dev/null; then
+  seed=1
+  while [ $seed -le "$count" ]; do
+    python3 "$tests/gen.py" $seed > "$work/gen$seed.c"
+    failed=$failures
+    check_program "$work/gen$seed.c"
+    if [ $failures -ne $failed ]; then
+      cp "$work/gen$seed.c" "gen$seed.c"
+      echo "kept the program as gen$seed.c"
+    fi
+    rm -f "$work/gen$seed.c"
+    seed=$((seed + 1))
+  done
+else
+  echo "python3 not found, skipping generated programs"
+fi
+
+# Prints a program of `$1` chained functions, long enough to be parsed in
+# several chunks. The functions numbered in `$2`, separated by commas, are
+# left with a syntax error each.
+chunked_program() {
+  awk -v n="$1" -v broken="$2" 'BEGIN {
+    split(broken, numbers, ",")
+    for (i in numbers) bad[numbers[i]] = 1
+    print "int f0(int a) { return a; }"
+    for (i = 1; i < n; i++) {
+      if (i in bad) {
+        printf "int f%d(int a) { return a + %s; }\n", i, i % 2 ? "" : "*"
+        continue
+      }
+      printf "int f%d(int a) {\n  int b = a * 3 + %d;\n", i, i % 13
+      printf "  if (b > 1000) {\n    b = b - 1000;\n  }\n"
+      printf "  return f%d(b %% 997);\n}\n", i - 1
+    }
+    printf "int main() { return f%d(1) %% 256; }\n", n - 1
+  }'
+}
+
+# The parser splits its input into chunks parsed on separate threads, which
+# must give the same program, and the same first error, as one thread.
+chunked_program 1500 > "$work/chunked.c"
+"$compiler" --pass-stats -j4 --dump-ir "$work/chunked.c" \
+  > "$work/chunked.j4" 2> "$work/chunked.stats"
+"$compiler" -j1 --dump-ir "$work/chunked.c" > "$work/chunked.j1" \
+  2>> "$work/errors"
+if ! grep -Eq "in ([2-9]|[1-9][0-9]+) chunks" "$work/chunked.stats"; then
+  fail "chunked.c: not parsed in several chunks"
+elif [ ! -s "$work/chunked.j1" ] ||
+     ! cmp -s "$work/chunked.j1" "$work/chunked.j4"; then
+  fail "chunked.c: -j4 differs from -j1"
+fi
+check_program "$work/chunked.c"
+
+chunked_program 1500 300,1201 > "$work/chunked.c"
+first=$(grep -n "{ return a + " "$work/chunked.c" | head -n 1 | cut -d: -f1)
+for threads in 1 4; do
+  if "$compiler" -j$threads --dump-ir "$work/chunked.c" > /dev/null \
+     2> "$work/chunked.err" ||
+     ! grep -q "line $first," "$work/chunked.err"; then
+    fail "chunked.c: -j$threads does not report the error on line $first:" \
+         "$(cat "$work/chunked.err")"
+  fi
+done
+
+# -M lists the files a unit includes as the preprocessor finds them: a
+# guarded header once, and nothing from a skipped group. Paths are printed as
+# they were found, so the compiler runs from the directory of the sources.
+case $compiler in
+  */*) absolute=$(cd "$(dirname "$compiler")" && pwd)/$(basename "$compiler") ;;
+  *) absolute=$compiler ;;
+esac
+mkdir -p "$work/deps/inc"
+cd "$work/deps" || exit 1
+printf '#ifndef GUARDED_H\n#define GUARDED_H\n#include "local.h"\n#endif\n' \
+  > inc/guarded.h
+printf 'int local = 2;\n' > inc/local.h
+printf '#include <guarded.h>\n#include <guarded.h>\n#if 0\n' > main.c
+printf '#include "missing.h"\n#elif !defined GUARDED_H\n' >> main.c
+printf '#include <unused.h>\n#endif\nint main() { return local; }\n' >> main.c
+printf '#include "inc/local.h"\nint other() { return local; }\n' > other.c
+run "$absolute" -M -Iinc main.c
+expect "-M" "main.o: main.c inc/guarded.h inc/local.h"
+run "$absolute" -M -MP -MT out.o -Iinc main.c
+expect "-M -MP -MT" "out.o: main.c inc/guarded.h inc/local.h" \
+  "inc/guarded.h:" "inc/local.h:"
+run "$absolute" -M -j2 -Iinc main.c other.c
+expect "-M -j2" "main.o: main.c inc/guarded.h inc/local.h" \
+  "other.o: other.c inc/local.h"
+rm -f prog prog.d
+run "$absolute" -MD -Iinc -o prog main.c
+cp prog.d "$work/out" 2>> "$work/errors"
+expect "-MD -o" "prog: main.c inc/guarded.h inc/local.h"
+run ./prog
+[ $status -eq 2 ] || fail "-MD -o: the program exits with $status"
+cd "$OLDPWD" || exit 1
+
+# --signatures prints the declarations without parsing a body, and --lazy
+# leaves each body unparsed until it is compiled.
+printf 'int g = 4;\nint add(int a, int b) { return a + b; }\n' \
+  > "$work/lazy.c"
+printf 'int twice(int x) { return add(x, x); }\n' >> "$work/lazy.c"
+printf 'int main() { return twice(g) + 1; }\n' >> "$work/lazy.c"
+for options in "--signatures" "--lazy --signatures"; do
+  run "$compiler" $options "$work/lazy.c"
+  expect "$options" "1:5 variable int g" \
+    "2:5 function int add(int a, int b)" "3:5 function int twice(int x)" \
+    "4:5 function int main(void)"
+done
+"$compiler" --lazy --pass-stats --run "$work/lazy.c" > /dev/null \
+  2> "$work/lazy.stats"
+if ! grep -q " 3 bodies skipped" "$work/lazy.stats"; then
+  fail "--lazy: $(grep parser "$work/lazy.stats")"
+fi
+
+# --index records the symbols of each unit that compiles, skipping one with
+# a syntax or lexical error, and later runs reparse only what changed.
+mkdir -p "$work/index"
+index=$(cd "$work/index" && pwd -P)
+printf 'int helper(int a) { return a + 1; }\nint shared = 3;\n' \
+  > "$index/one.c"
+printf 'int other(int b, int c) { return b * c; }\n' > "$index/two.c"
+printf 'int broken( { return 1; }\n' > "$index/syntax.c"
+printf 'int lexed = 1 @ 2;\n' > "$index/lexical.c"
+run "$compiler" --index "$index/symbols" "$index/one.c" "$index/two.c" \
+  "$index/syntax.c" "$index/lexical.c"
+[ $status -ne 0 ] || fail "--index: units with errors are not reported"
+run "$compiler" --query "$index/symbols" helper
+expect "--query helper" "$index/one.c:1:5: function int helper(int a)"
+run "$compiler" --query "$index/symbols" "*"
+expect "--query *" "$index/one.c:1:5: function int helper(int a)" \
+  "$index/two.c:1:5: function int other(int b, int c)" \
+  "$index/one.c:2:5: variable int shared"
+for name in broken lexed; do
+  run "$compiler" --query "$index/symbols" $name
+  [ $status -ne 0 ] || fail "--query $name: found in a unit with errors"
+done
+printf 'int helper2(int a) { return a; }\n' > "$index/one.c"
+"$compiler" --pass-stats --index "$index/symbols" "$index/one.c" \
+  "$index/two.c" > /dev/null 2> "$work/index.stats"
+if ! grep -q " 1 files parsed, 1 unchanged" "$work/index.stats"; then
+  fail "--index: $(cat "$work/index.stats")"
+fi
+run "$compiler" --query "$index/symbols" "h*"
+expect "--query h* after an update" \
+  "$index/one.c:1:5: function int helper2(int a)"
+
+# The parser keeps its own stack, so nesting is bounded by --max-depth alone:
+# 3000 nested blocks compile in every mode, and an expression nested 60
+# deep compiles under a limit of 100 but not under one of 20.
+awk 'BEGIN {
+  printf "int main() {\n  int x = 0;\n"
+  for (i = 0; i < 3000; i++) printf "{ "
+  printf "x = x + 5; "
+  for (i = 0; i < 3000; i++) printf "} "
+  printf "\n  return x;\n}\n"
+}' > "$work/blocks.c"
+check_program "$work/blocks.c"
+awk 'BEGIN {
+  printf "int main() { return "
+  for (i = 0; i < 60; i++) printf "("
+  printf "1"
+  for (i = 0; i < 60; i++) printf " + 1)"
+  printf ";\n}\n"
+}' > "$work/deep.c"
+run "$compiler" --max-depth 100 --run "$work/deep.c"
+[ $status -eq 61 ] || fail "--max-depth 100: exits with $status"
+"$compiler" --max-depth 20 --run "$work/deep.c" 2> "$work/deep.err"
+status=$?
+if [ $status -ne 1 ] ||
+   ! grep -q "Nesting deeper than 20 levels" "$work/deep.err"; then
+  fail "--max-depth 20: exits with $status: $(cat "$work/deep.err")"
+fi
+
+# --share-expressions builds one node for the repeated sum, and the program
+# must still give the same result as the gcc build.
+printf 'int f(int a, int b) { return (a + b) * (a + b) - (a + b); }\n' \
+  > "$work/shared.c"
+printf 'int main() { return f(2, 3); }\n' >> "$work/shared.c"
+check_program "$work/shared.c"
+"$compiler" --share-expressions --pass-stats --run "$work/shared.c" \
+  2> "$work/shared.stats"
+if ! grep -Eq " [1-9][0-9]* expression nodes shared" "$work/shared.stats"; then
+  fail "--share-expressions: $(grep parser "$work/shared.stats")"
+fi
+
+if [ $failures -ne 0 ]; then
+  echo "$failures failures"
+  exit 1
+fi
+echo "all tests passed"
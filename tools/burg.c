@@ -0,0 +1,447 @@
+/*
+ * Compiles an instruction selection rule file into the tables that
+ * src/isel.c labels trees with. Usage: burg <rules> <output stem>, which
+ * writes <stem>.h and <stem>.c.
+ *
+ * The rule file has two kinds of lines; `#` starts a comment.
+ *
+ *   %term NAME IR_OPCODE...          a terminal and the IR opcodes it matches
+ *   name  lhs: TERM(kid, kid)  cost  [predicate]
+ *   name  lhs: nonterminal     cost  [predicate]
+ *
+ * The first rule form matches a node of the terminal whose operands derive the
+ * kid nonterminals; the second is a chain rule. A predicate names a function
+ * isel_<predicate>(function, node) that must accept the node for the rule to
+ * apply. Chain rules must not form cycles: they are emitted in an order where
+ * every nonterminal's cost is final before the rules reading it run, so one
+ * pass over them closes a node's costs.
+ */
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_NAME 64
+#define MAX_TERMINALS 32
+#define MAX_NONTERMINALS 32
+#define MAX_RULES 200
+#define MAX_OPCODES 16
+#define MAX_ARITY 2
+
+typedef struct {
+  char name[MAX_NAME];
+  char opcodes[MAX_OPCODES][MAX_NAME];
+  int opcode_count;
+  int arity; // -1 until a rule uses the terminal
+} Terminal;
+
+typedef struct {
+  char name[MAX_NAME];
+  int lhs;
+  int terminal; // -1 for chain rules
+  int arity;
+  int kids[MAX_ARITY]; // The right-hand side of a chain rule in kids[0]
+  int cost;
+  char predicate[MAX_NAME];
+} Rule;
+
+static Terminal terminals[MAX_TERMINALS];
+static int terminal_count;
+static char nonterminals[MAX_NONTERMINALS][MAX_NAME];
+static int nonterminal_count;
+static Rule rules[MAX_RULES];
+static int rule_count;
+
+static const char *input_path;
+static int line_number;
+
+static void fail(const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  fprintf(stderr, "%s:%d: ", input_path, line_number);
+  vfprintf(stderr, format, args);
+  fprintf(stderr, "\n");
+  va_end(args);
+  exit(EXIT_FAILURE);
+}
+
+static int find_terminal(const char *name) {
+  for (int i = 0; i < terminal_count; i++) {
+    if (strcmp(terminals[i].name, name) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static int nonterminal(const char *name) {
+  for (int i = 0; i < nonterminal_count; i++) {
+    if (strcmp(nonterminals[i], name) == 0) {
+      return i;
+    }
+  }
+  if (nonterminal_count == MAX_NONTERMINALS) {
+    fail("too many nonterminals");
+  }
+  strcpy(nonterminals[nonterminal_count], name);
+  return nonterminal_count++;
+}
+
+/* Reads an identifier at *p into `name`, skipping blanks before it. */
+static int read_name(const char **p, char *name) {
+  while (**p == ' ' || **p == '\t') {
+    (*p)++;
+  }
+  int length = 0;
+  while (isalnum((unsigned char)**p) || **p == '_') {
+    if (length == MAX_NAME - 1) {
+      fail("name too long");
+    }
+    name[length++] = *(*p)++;
+  }
+  name[length] = '\0';
+  return length > 0;
+}
+
+static void expect(const char **p, char c) {
+  while (**p == ' ' || **p == '\t') {
+    (*p)++;
+  }
+  if (**p != c) {
+    fail("expected '%c'", c);
+  }
+  (*p)++;
+}
+
+static void parse_terminal(const char *p) {
+  if (terminal_count == MAX_TERMINALS) {
+    fail("too many terminals");
+  }
+  Terminal *terminal = &terminals[terminal_count];
+  if (!read_name(&p, terminal->name)) {
+    fail("expected a terminal name");
+  }
+  if (find_terminal(terminal->name) >= 0) {
+    fail("terminal %s declared twice", terminal->name);
+  }
+  terminal->arity = -1;
+  while (terminal->opcode_count < MAX_OPCODES &&
+         read_name(&p, terminal->opcodes[terminal->opcode_count])) {
+    terminal->opcode_count++;
+  }
+  terminal_count++;
+}
+
+static void parse_rule(const char *p) {
+  if (rule_count == MAX_RULES) {
+    fail("too many rules");
+  }
+  Rule *rule = &rules[rule_count];
+  char name[MAX_NAME];
+  if (!read_name(&p, rule->name) || !read_name(&p, name)) {
+    fail("expected a rule name and its nonterminal");
+  }
+  for (int i = 0; i < rule_count; i++) {
+    if (strcmp(rules[i].name, rule->name) == 0) {
+      fail("rule %s defined twice", rule->name);
+    }
+  }
+  rule->lhs = nonterminal(name);
+  expect(&p, ':');
+
+  if (!read_name(&p, name)) {
+    fail("expected a pattern");
+  }
+  rule->terminal = find_terminal(name);
+  if (rule->terminal < 0) {
+    rule->arity = 1;
+    rule->kids[0] = nonterminal(name);
+  } else {
+    while (*p == ' ' || *p == '\t') {
+      p++;
+    }
+    if (*p == '(') {
+      for (p++;; p++) {
+        if (rule->arity == MAX_ARITY || !read_name(&p, name)) {
+          fail("expected at most %d operand nonterminals", MAX_ARITY);
+        }
+        if (find_terminal(name) >= 0) {
+          fail("operands must be nonterminals; add a rule for %s", name);
+        }
+        rule->kids[rule->arity++] = nonterminal(name);
+        while (*p == ' ' || *p == '\t') {
+          p++;
+        }
+        if (*p != ',') {
+          break;
+        }
+      }
+      expect(&p, ')');
+    }
+    Terminal *terminal = &terminals[rule->terminal];
+    if (terminal->arity >= 0 && terminal->arity != rule->arity) {
+      fail("%s used with %d and %d operands", terminal->name, terminal->arity,
+           rule->arity);
+    }
+    terminal->arity = rule->arity;
+  }
+
+  char *end;
+  rule->cost = (int)strtol(p, &end, 10);
+  if (end == p || rule->cost < 0) {
+    fail("expected a cost");
+  }
+  p = end;
+  read_name(&p, rule->predicate);
+  while (*p == ' ' || *p == '\t') {
+    p++;
+  }
+  if (*p != '\0') {
+    fail("unexpected '%s'", p);
+  }
+  rule_count++;
+}
+
+static void parse(FILE *in) {
+  char line[512];
+  while (fgets(line, sizeof(line), in) != NULL) {
+    line_number++;
+    char *comment = strchr(line, '#');
+    if (comment != NULL) {
+      *comment = '\0';
+    }
+    line[strcspn(line, "\r\n")] = '\0';
+    const char *p = line;
+    while (*p == ' ' || *p == '\t') {
+      p++;
+    }
+    if (*p == '\0') {
+      continue;
+    }
+    if (strncmp(p, "%term", 5) == 0) {
+      parse_terminal(p + 5);
+    } else {
+      parse_rule(p);
+    }
+  }
+}
+
+static void check(void) {
+  for (int n = 0; n < nonterminal_count; n++) {
+    int defined = 0;
+    for (int r = 0; r < rule_count; r++) {
+      defined |= rules[r].lhs == n;
+    }
+    if (!defined) {
+      line_number = 0;
+      fail("nonterminal %s has no rules", nonterminals[n]);
+    }
+  }
+}
+
+/* Orders the chain rules so that each runs after every chain rule deriving
+ * its right-hand side. */
+static int chain_order[MAX_RULES];
+static int chain_count;
+
+static void visit_nonterminal(int n, int *state) {
+  if (state[n] == 2) {
+    return;
+  }
+  if (state[n] == 1) {
+    line_number = 0;
+    fail("chain rules through %s form a cycle", nonterminals[n]);
+  }
+  state[n] = 1;
+  for (int r = 0; r < rule_count; r++) {
+    if (rules[r].terminal < 0 && rules[r].lhs == n) {
+      visit_nonterminal(rules[r].kids[0], state);
+    }
+  }
+  state[n] = 2;
+  for (int r = 0; r < rule_count; r++) {
+    if (rules[r].terminal < 0 && rules[r].lhs == n) {
+      chain_order[chain_count++] = r;
+    }
+  }
+}
+
+static void order_chain_rules(void) {
+  int state[MAX_NONTERMINALS] = {0};
+  for (int n = 0; n < nonterminal_count; n++) {
+    visit_nonterminal(n, state);
+  }
+}
+
+static void upper(FILE *out, const char *name) {
+  for (; *name; name++) {
+    fputc(toupper((unsigned char)*name), out);
+  }
+}
+
+static void write_header(FILE *out) {
+  fprintf(out, "/* Generated by tools/burg.c from %s. Do not edit. */\n\n",
+          input_path);
+  fprintf(out, "#ifndef ISEL_TABLES_H\n#define ISEL_TABLES_H\n\n");
+  fprintf(out, "#include \"ir.h\"\n\n");
+
+  fprintf(out, "typedef enum {\n  TERM_NONE,\n");
+  for (int t = 0; t < terminal_count; t++) {
+    fprintf(out, "  TERM_");
+    upper(out, terminals[t].name);
+    fprintf(out, ",\n");
+  }
+  fprintf(out, "  NUM_TERMINALS,\n} IselTerminal;\n\n");
+
+  fprintf(out, "typedef enum {\n  NT_NONE,\n");
+  for (int n = 0; n < nonterminal_count; n++) {
+    fprintf(out, "  NT_");
+    upper(out, nonterminals[n]);
+    fprintf(out, ",\n");
+  }
+  fprintf(out, "  NUM_NONTERMINALS,\n} Nonterminal;\n\n");
+
+  fprintf(out, "typedef enum {\n  RULE_NONE,\n");
+  for (int r = 0; r < rule_count; r++) {
+    fprintf(out, "  RULE_");
+    upper(out, rules[r].name);
+    fprintf(out, ",\n");
+  }
+  fprintf(out, "  NUM_RULES,\n} IselRule;\n\n");
+
+  fprintf(out, "#define ISEL_MAX_ARITY %d\n", MAX_ARITY);
+  fprintf(out, "#define ISEL_CHAIN_RULE_COUNT %d\n\n", chain_count);
+
+  for (int r = 0; r < rule_count; r++) {
+    int declared = rules[r].predicate[0] == '\0';
+    for (int s = 0; s < r && !declared; s++) {
+      declared = strcmp(rules[s].predicate, rules[r].predicate) == 0;
+    }
+    if (!declared) {
+      fprintf(out, "int isel_%s(const IRFunction *function, IRValue id);\n",
+              rules[r].predicate);
+    }
+  }
+  fprintf(out, "\n#endif // !ISEL_TABLES_H\n");
+}
+
+static void write_rule_name(FILE *out, int r) {
+  fprintf(out, "RULE_");
+  upper(out, rules[r].name);
+}
+
+static void write_source(FILE *out) {
+  fprintf(out, "/* Generated by tools/burg.c from %s. Do not edit. */\n\n",
+          input_path);
+  fprintf(out, "#include \"isel.h\"\n\n");
+
+  fprintf(out, "const uint8_t isel_opcode_terminals[IR_NUM_OPCODES] = {\n");
+  for (int t = 0; t < terminal_count; t++) {
+    for (int o = 0; o < terminals[t].opcode_count; o++) {
+      fprintf(out, "    [%s] = TERM_", terminals[t].opcodes[o]);
+      upper(out, terminals[t].name);
+      fprintf(out, ",\n");
+    }
+  }
+  fprintf(out, "};\n\n");
+
+  fprintf(out, "const IselRuleInfo isel_rules[NUM_RULES] = {\n");
+  for (int r = 0; r < rule_count; r++) {
+    const Rule *rule = &rules[r];
+    fprintf(out, "    [");
+    write_rule_name(out, r);
+    fprintf(out, "] = {\"%s\", NT_", rule->name);
+    upper(out, nonterminals[rule->lhs]);
+    fprintf(out, ", ");
+    if (rule->terminal < 0) {
+      fprintf(out, "TERM_NONE");
+    } else {
+      fprintf(out, "TERM_");
+      upper(out, terminals[rule->terminal].name);
+    }
+    fprintf(out, ", %d, {", rule->arity);
+    for (int k = 0; k < rule->arity; k++) {
+      fprintf(out, k ? ", NT_" : "NT_");
+      upper(out, nonterminals[rule->kids[k]]);
+    }
+    fprintf(out, "}, %d, ", rule->cost);
+    if (rule->predicate[0] != '\0') {
+      fprintf(out, "isel_%s},\n", rule->predicate);
+    } else {
+      fprintf(out, "NULL},\n");
+    }
+  }
+  fprintf(out, "};\n\n");
+
+  // The base rules of each terminal, in file order
+  fprintf(out, "const uint8_t isel_terminal_rules[] = {\n");
+  int start[MAX_TERMINALS + 1];
+  int count = 0;
+  for (int t = 0; t < terminal_count; t++) {
+    start[t] = count;
+    for (int r = 0; r < rule_count; r++) {
+      if (rules[r].terminal == t) {
+        fprintf(out, "    ");
+        write_rule_name(out, r);
+        fprintf(out, ",\n");
+        count++;
+      }
+    }
+  }
+  start[terminal_count] = count;
+  fprintf(out, "};\n\n");
+
+  fprintf(out,
+          "const uint16_t isel_terminal_rule_start[NUM_TERMINALS + 1] = {\n"
+          "    0, // TERM_NONE\n");
+  for (int t = 0; t <= terminal_count; t++) {
+    fprintf(out, "    %d,\n", start[t]);
+  }
+  fprintf(out, "};\n\n");
+
+  fprintf(out, "const uint8_t isel_chain_rules[ISEL_CHAIN_RULE_COUNT] = {\n");
+  for (int c = 0; c < chain_count; c++) {
+    fprintf(out, "    ");
+    write_rule_name(out, chain_order[c]);
+    fprintf(out, ",\n");
+  }
+  fprintf(out, "};\n");
+}
+
+static FILE *open_output(const char *stem, const char *extension) {
+  char path[4096];
+  snprintf(path, sizeof(path), "%s%s", stem, extension);
+  FILE *out = fopen(path, "w");
+  if (out == NULL) {
+    perror(path);
+    exit(EXIT_FAILURE);
+  }
+  return out;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 3) {
+    fprintf(stderr, "Usage: %s <rules> <output stem>\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  input_path = argv[1];
+  FILE *in = fopen(input_path, "r");
+  if (in == NULL) {
+    perror(input_path);
+    return EXIT_FAILURE;
+  }
+  parse(in);
+  fclose(in);
+  check();
+  order_chain_rules();
+
+  FILE *header = open_output(argv[2], ".h");
+  write_header(header);
+  fclose(header);
+  FILE *source = open_output(argv[2], ".c");
+  write_source(source);
+  fclose(source);
+  return EXIT_SUCCESS;
+}